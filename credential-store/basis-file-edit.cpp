@@ -0,0 +1,271 @@
+#include "stdafx.h"
+
+#include "basis-file-edit.h"
+#include "credential-backend.h"
+#include "credential-bases.h"
+#include "text-span.h"
+
+#include <windows.h>
+#include <algorithm>
+#include <cwctype>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#pragma hdrstop
+
+// How long to wait between attempts to replace a file which a reader has open.
+#define BASIS_FILE_RETRY_MS 50
+#define BASIS_FILE_REPLACE_ATTEMPTS 40
+
+using namespace std;
+
+namespace {
+    enum class LineKind {
+        Ignored, // Blank or a comment.
+        Basis,
+        Entry
+    };
+
+    // One line of the file, as ReadBases sees it.
+    struct Line {
+        TextSpan text;    // Without the line ending.
+        TextSpan ending;  // "\r\n" or "\n"; empty for a last line with no ending.
+        LineKind kind;
+        TextSpan name;    // The basis name, or the trimmed entry.
+        bool removed;
+    };
+
+    TextSpan Trim(const TextSpan& text) {
+        const wchar_t* begin = text.begin();
+        const wchar_t* end = text.end();
+        while (begin < end && iswspace(*begin)) {
+            ++begin;
+        }
+        while (end > begin && iswspace(end[-1])) {
+            --end;
+        }
+        return TextSpan(begin, end - begin);
+    }
+
+    vector<Line> SplitLines(const wchar_t* text, size_t length) {
+        vector<Line> lines;
+        const wchar_t* next = text;
+        const wchar_t* const text_end = text + length;
+        while (next < text_end) {
+            Line line;
+            const wchar_t* line_begin = next;
+            const wchar_t* line_end = wmemchr(next, L'\n', text_end - next);
+            const wchar_t* ending_end = text_end;
+            if (line_end == NULL) {
+                line_end = text_end;
+            } else {
+                ending_end = line_end + 1;
+                if (line_end > line_begin && line_end[-1] == L'\r') {
+                    --line_end;
+                }
+            }
+            next = ending_end;
+            line.text = TextSpan(line_begin, line_end - line_begin);
+            line.ending = TextSpan(line_end, ending_end - line_end);
+            line.removed = false;
+
+            TextSpan trimmed = Trim(line.text);
+            if (trimmed.empty() || *line_begin == L'#') {
+                line.kind = LineKind::Ignored;
+            } else if (iswspace(*line_begin)) {
+                line.kind = LineKind::Entry;
+                line.name = trimmed;
+            } else {
+                line.kind = LineKind::Basis;
+                line.name = line.text;
+            }
+            lines.push_back(line);
+        }
+        return lines;
+    }
+
+    // Removes the line of any basis whose entries have all been removed, so that it isn't left behind empty.
+    void RemoveEmptiedBases(vector<Line>& lines) {
+        size_t basis_line = lines.size();
+        bool any_removed = false;
+        bool any_kept = false;
+        for (size_t i = 0; i <= lines.size(); ++i) {
+            if (i == lines.size() || lines[i].kind == LineKind::Basis) {
+                if (basis_line < lines.size() && any_removed && !any_kept) {
+                    lines[basis_line].removed = true;
+                }
+                basis_line = i;
+                any_removed = false;
+                any_kept = false;
+            } else if (lines[i].kind == LineKind::Entry && basis_line < lines.size()) {
+                if (lines[i].removed) {
+                    any_removed = true;
+                } else {
+                    any_kept = true;
+                }
+            }
+        }
+    }
+
+    // Always writes UTF-8, which is what the Holy Gradle plugins read, with a byte order mark only if the file had one.
+    bool WriteBasisText(const wstring& file_name, const wstring& text, bool byte_order_mark) {
+        string bytes;
+        if (byte_order_mark) {
+            bytes = "\xEF\xBB\xBF";
+        }
+        if (!text.empty()) {
+            int size = ::WideCharToMultiByte(CP_UTF8, 0, text.data(), (int)text.size(), NULL, 0, NULL, NULL);
+            if (size <= 0) {
+                wcerr << L"ERROR: Failed to encode the new content of " << file_name << L" - errno " <<
+                    ::GetLastError() << endl;
+                return false;
+            }
+            const size_t prefix = bytes.size();
+            bytes.resize(prefix + size);
+            ::WideCharToMultiByte(CP_UTF8, 0, text.data(), (int)text.size(), &bytes[prefix], size, NULL, NULL);
+        }
+
+        // Readers which opened the file without FILE_SHARE_DELETE (such as the Holy Gradle plugins) stop it being
+        // replaced until they close it, which they do as soon as they've read it.
+        for (int attempt = 1; ; ++attempt) {
+            if (ReplaceWholeFile(file_name, bytes.data(), (DWORD)bytes.size())) {
+                return true;
+            }
+            DWORD error = ::GetLastError();
+            if ((error != ERROR_ACCESS_DENIED && error != ERROR_SHARING_VIOLATION) ||
+                attempt == BASIS_FILE_REPLACE_ATTEMPTS
+            ) {
+                wcerr << L"ERROR: Failed to write " << file_name << L" - errno " << error << endl;
+                return false;
+            }
+            ::Sleep(BASIS_FILE_RETRY_MS);
+        }
+    }
+}
+
+BasisFileEditResult EditBasisFile(
+    const wstring& file_name,
+    BasisFileEdit edit,
+    const wstring& basis,
+    const wstring& raw_entry
+) {
+    if (basis.empty() || iswspace(basis[0]) || basis[0] == L'#' || basis.find_first_of(L"\r\n") != wstring::npos) {
+        wcerr << L"ERROR: '" << basis << L"' can't be used as a basis name." << endl;
+        return BasisFileEditResult::Failed;
+    }
+    const TextSpan entry = Trim(raw_entry);
+    if (entry.empty() || find(entry.begin(), entry.end(), L'\n') != entry.end()) {
+        wcerr << L"ERROR: '" << raw_entry << L"' can't be used as a basis entry." << endl;
+        return BasisFileEditResult::Failed;
+    }
+
+    // The Holy Gradle plugins create the directory when they first write the file, but this may come first.
+    const size_t separator = file_name.find_last_of(L"\\/");
+    if (separator != wstring::npos) {
+        ::CreateDirectoryW(file_name.substr(0, separator).c_str(), NULL);
+    }
+
+    FileLock lock;
+    if (!lock.Acquire(file_name + L".lock", BASIS_FILE_LOCK_TIMEOUT_MS)) {
+        wcerr << L"ERROR: Failed to lock " << file_name << L" - errno " << ::GetLastError() << endl;
+        return BasisFileEditResult::Failed;
+    }
+
+    unique_ptr<wchar_t[]> text;
+    size_t length = 0;
+    bool byte_order_mark = false;
+    if (!ReadTextFile(file_name, text, length, &byte_order_mark)) {
+        if (::GetLastError() != ERROR_FILE_NOT_FOUND) {
+            wcerr << L"ERROR: Failed to read " << file_name << L" - errno " << ::GetLastError() << endl;
+            return BasisFileEditResult::Failed;
+        }
+        length = 0;
+    }
+    vector<Line> lines = SplitLines(text.get(), length);
+
+    // Find the entry wherever it's listed, and where the basis's lines end.
+    const TextSpan basis_name(basis);
+    const TextSpan* line_ending = NULL;
+    const TextSpan* indent_line = NULL;
+    size_t last_basis_line = lines.size();
+    bool in_basis = false;
+    bool in_any_basis = false;
+    bool listed = false;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        Line& line = lines[i];
+        if (line_ending == NULL && !line.ending.empty()) {
+            line_ending = &line.ending;
+        }
+        if (line.kind == LineKind::Basis) {
+            in_any_basis = true;
+            in_basis = (line.name == basis_name);
+            if (in_basis) {
+                last_basis_line = i;
+            }
+        } else if (line.kind == LineKind::Entry && in_any_basis) {
+            if (indent_line == NULL) {
+                indent_line = &line.text;
+            }
+            if (in_basis) {
+                last_basis_line = i;
+            }
+            if (line.name == entry) {
+                if (in_basis) {
+                    listed = true;
+                    line.removed = (edit == BasisFileEdit::Remove);
+                } else {
+                    // An entry belongs to one basis only, so adding it to one takes it away from any other.
+                    line.removed = (edit == BasisFileEdit::Add);
+                }
+            }
+        }
+    }
+    RemoveEmptiedBases(lines);
+
+    const bool insert = (edit == BasisFileEdit::Add && !listed);
+    bool any_removed = false;
+    for (auto it = lines.begin(); it != lines.end(); ++it) {
+        any_removed = any_removed || it->removed;
+    }
+    if (!insert && !any_removed) {
+        return BasisFileEditResult::Unchanged;
+    }
+
+    // Build the new text, copying every line which stays exactly as it was.
+    const wstring ending = (line_ending == NULL) ? wstring(L"\r\n") : line_ending->str();
+    wstring indent(L"\t");
+    if (indent_line != NULL) {
+        indent = wstring(indent_line->begin(), Trim(*indent_line).begin());
+    }
+    const wstring new_entry_line = indent + entry.str() + ending;
+    wstring new_text;
+    new_text.reserve(length + new_entry_line.size() + basis.size() + ending.size());
+    if (lines.empty() && insert) {
+        new_text += L"# This is a machine-generated Holy Gradle Credential Basis file." + ending;
+    }
+    for (size_t i = 0; i < lines.size(); ++i) {
+        const Line& line = lines[i];
+        if (!line.removed) {
+            new_text.append(line.text.begin(), line.text.size);
+            new_text.append(line.ending.begin(), line.ending.size);
+        }
+        if (insert && i == last_basis_line) {
+            if (line.ending.empty()) {
+                new_text += ending;
+            }
+            new_text += new_entry_line;
+        }
+    }
+    if (insert && last_basis_line == lines.size()) {
+        if (!lines.empty() && lines.back().ending.empty()) {
+            new_text += ending;
+        }
+        new_text += basis + ending + new_entry_line;
+    }
+
+    if (!WriteBasisText(file_name, new_text, byte_order_mark)) {
+        return BasisFileEditResult::Failed;
+    }
+    return BasisFileEditResult::Changed;
+}
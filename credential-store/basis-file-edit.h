@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+
+// How long an edit waits for another process's edit of the same basis file to finish.
+#define BASIS_FILE_LOCK_TIMEOUT_MS 30000
+
+enum class BasisFileEdit {
+    Add,    // List the entry under the basis, and under no other basis (as the Holy Gradle plugins do).
+    Remove  // Stop listing the entry under the basis; a basis left with no entries is removed too.
+};
+
+// What an edit did.
+enum class BasisFileEditResult {
+    Changed,
+    Unchanged, // The file already said what the edit would have made it say, so it wasn't rewritten.
+    Failed     // An error has been printed.
+};
+
+/*
+    Adds an entry to, or removes one from, a basis in the credential basis file, leaving every other line (comments,
+    ordering, indentation and line endings) as it was.  The file is written as UTF-8, as the Holy Gradle plugins write
+    and read it, keeping its byte order mark if it had one; an older file in the ANSI code page is converted.  Edits
+    are serialised between processes by an exclusive lock on "<file_name>.lock", held only while the file is read,
+    edited and written, and the new content is written via a temporary file and a rename, so readers (which don't
+    lock) always see either the old or the new file, never a partly-written one.  The lock is on a separate file
+    because the basis file itself is replaced by each edit.
+*/
+BasisFileEditResult EditBasisFile(
+    const std::wstring& file_name,
+    BasisFileEdit edit,
+    const std::wstring& basis,
+    const std::wstring& entry
+);
@@ -0,0 +1,468 @@
+#include "stdafx.h"
+
+#include "workload-generator.h"
+#include "bulk-write.h"
+#include "credential-backend.h"
+#include "credential-bases.h"
+#include "credential-snapshot.h"
+#include "glob-matcher.h"
+#include "ignore-case.h"
+#include "secret-buffer.h"
+#include "target-name.h"
+
+#include <tchar.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <list>
+#include <new>
+
+#pragma hdrstop
+
+/*
+    Times the library code behind the credential-store commands against a generated workload, in memory, and writes
+    one JSON object per benchmark to standard output (JSON Lines), so that results can be compared across releases.
+    The workload is the same for the same options on any machine; see workload-generator.h.  With --out=<dir>, it
+    writes the workload instead: <dir>\credentials.dat, for --backend=file:, and <dir>\holygradle\credential-bases.txt,
+    found by setting GRADLE_USER_HOME to <dir>.
+
+    ReadBases writes warnings for the malformed lines to standard error on every iteration; redirect it if they're in
+    the way.
+*/
+
+#define DEFAULT_ITERATIONS 20
+#define SECRET_BUFFERS_PER_RUN 8
+#define CREDENTIALS_OPTION L"--credentials="
+#define USERNAMES_OPTION L"--usernames="
+#define PRIMARY_SHARE_OPTION L"--primary-share="
+#define CASE_VARIANTS_OPTION L"--case-variants="
+#define BASES_OPTION L"--bases="
+#define ENTRIES_OPTION L"--entries="
+#define PATTERNS_OPTION L"--patterns="
+#define MALFORMED_OPTION L"--malformed="
+#define SEED_OPTION L"--seed="
+#define ITERATIONS_OPTION L"--iterations="
+#define OUT_OPTION L"--out="
+
+using namespace std;
+
+namespace {
+    // Every heap allocation in the process is counted, so that each benchmark can report how many it makes.
+    atomic<size_t> heap_allocations(0);
+}
+
+void* operator new(size_t size) {
+    ++heap_allocations;
+    void* memory = malloc((size == 0) ? 1 : size);
+    if (memory == NULL) {
+        throw bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+namespace {
+    // Results which are written somewhere the compiler can't see, so that the work producing them isn't optimised
+    // away.
+    volatile size_t sink;
+
+    // Fills a credential file with one write at the end, instead of rewriting the whole file after each credential.
+    class GeneratedCredentialFile : public FileCredentialBackend {
+    public:
+        explicit GeneratedCredentialFile(const wstring& file_name)
+            : FileCredentialBackend(file_name, CreateUserFileCipher())
+            , deferred_(true)
+        {
+        }
+
+        bool Save() {
+            lock_guard<mutex> lock(mutex_);
+            deferred_ = false;
+            return FileCredentialBackend::Changed();
+        }
+
+    protected:
+        // While the credentials are being generated, the file is neither re-read nor written.
+        virtual bool BeginChange() {
+            return deferred_ || FileCredentialBackend::BeginChange();
+        }
+
+        virtual void EndChange() {
+            if (!deferred_) {
+                FileCredentialBackend::EndChange();
+            }
+        }
+
+        virtual bool Changed() {
+            return deferred_ || FileCredentialBackend::Changed();
+        }
+
+    private:
+        bool deferred_;
+    };
+
+    /*
+        The classifiers which GetDefaultCredentials used before target names were parsed once into a snapshot, kept as
+        they were apart from reading through the backend instead of calling CredRead, so that the old and new ways can
+        be timed on the same workload.  Each reads the credential back, for every name it is asked about, to compare
+        its stored username.
+    */
+    wstring ReferenceGetCredentialUsername(CredentialBackend& backend, const wstring& target_name) {
+        CredentialPtr credential = backend.Read(target_name);
+        return (credential && credential->UserName != NULL) ? wstring(credential->UserName) : wstring();
+    }
+
+    bool ReferenceIsMercurialCredential(
+        CredentialBackend& backend,
+        const wstring& target_name,
+        const wstring& username
+    ) {
+        size_t double_at_pos = target_name.find(L"@@");
+        size_t at_mercurial_pos = target_name.find(L"@Mercurial");
+        bool matches_format = (
+            double_at_pos > 0 &&
+            double_at_pos <= (at_mercurial_pos - 3) &&
+            at_mercurial_pos == target_name.size() - 10
+        );
+        return matches_format &&
+            (_wcsnicmp(
+                ReferenceGetCredentialUsername(backend, target_name).c_str(), username.c_str(), double_at_pos
+            ) == 0);
+    }
+
+    bool ReferenceIsGitCredential(CredentialBackend& backend, const wstring& target_name, const wstring& username) {
+        return (target_name.find(L"git:") == 0) &&
+            (_wcsnicmp(
+                ReferenceGetCredentialUsername(backend, target_name).c_str(), username.c_str(), username.size()
+            ) == 0);
+    }
+
+    bool ReferenceIsIntrepidCredential(
+        CredentialBackend& backend,
+        const wstring& target_name,
+        const wstring& username
+    ) {
+        return (target_name.find(HOLY_GRADLE_CREDENTIAL_PREFIX) == 0) &&
+            (_wcsnicmp(
+                ReferenceGetCredentialUsername(backend, target_name).c_str(), username.c_str(), username.size()
+            ) == 0);
+    }
+
+    // Counts a user's Git, Mercurial and Intrepid credentials as GetDefaultCredentials used to find them.
+    size_t ReferenceClassify(CredentialBackend& backend, const wstring& username) {
+        CredentialEnumeration enumeration;
+        backend.Enumerate(enumeration);
+        size_t matched = 0;
+        for (auto it = enumeration.credentials.begin(); it != enumeration.credentials.end(); ++it) {
+            wstring target_name((*it)->TargetName);
+            if (ReferenceIsMercurialCredential(backend, target_name, username) ||
+                ReferenceIsGitCredential(backend, target_name, username) ||
+                ReferenceIsIntrepidCredential(backend, target_name, username)
+            ) {
+                ++matched;
+            }
+        }
+        return matched;
+    }
+
+    // The same with a snapshot, as GetDefaultCredentials does now.
+    size_t Classify(CredentialBackend& backend, const wstring& username) {
+        CredentialSnapshot snapshot(backend);
+        const vector<size_t>& credentials = snapshot.ForUsername(username);
+        size_t matched = 0;
+        for (auto it = credentials.begin(); it != credentials.end(); ++it) {
+            matched += (snapshot.KindOf(*it) != CredentialKind::Other) ? 1 : 0;
+        }
+        return matched;
+    }
+
+    double Microseconds(const LARGE_INTEGER& start, const LARGE_INTEGER& end) {
+        static LARGE_INTEGER frequency = { 0 };
+        if (frequency.QuadPart == 0) {
+            ::QueryPerformanceFrequency(&frequency);
+        }
+        return (double)(end.QuadPart - start.QuadPart) * 1000000.0 / (double)frequency.QuadPart;
+    }
+
+    // The nearest-rank percentile of sorted values.
+    double Percentile(const vector<double>& sorted, double percent) {
+        size_t rank = (size_t)ceil(percent / 100.0 * (double)sorted.size());
+        return sorted[(rank == 0) ? 0 : rank - 1];
+    }
+
+    /*
+        Runs "body" once to warm up, then "iterations" times, timing each run, and writes a line of JSON with the
+        distribution of the times and the number of heap allocations in the last run.  "items" is how many things
+        one run deals with (names classified, credentials written and so on), for working out rates.
+    */
+    template <typename Body>
+    void RunBenchmark(
+        const char* name,
+        size_t items,
+        size_t iterations,
+        const WorkloadOptions& options,
+        Body body
+    ) {
+        body();
+        vector<double> times;
+        size_t allocations = 0;
+        for (size_t i = 0; i < iterations; ++i) {
+            const size_t allocations_before = heap_allocations;
+            LARGE_INTEGER start, end;
+            ::QueryPerformanceCounter(&start);
+            body();
+            ::QueryPerformanceCounter(&end);
+            allocations = heap_allocations - allocations_before;
+            times.push_back(Microseconds(start, end));
+        }
+        sort(times.begin(), times.end());
+        printf(
+            "{\"benchmark\":\"%s\",\"credentials\":%llu,\"usernames\":%llu,\"bases\":%llu,\"entries_per_basis\":%llu,"
+            "\"seed\":%llu,\"items\":%llu,\"iterations\":%llu,\"min_us\":%.1f,\"p50_us\":%.1f,\"p90_us\":%.1f,"
+            "\"max_us\":%.1f,\"allocations\":%llu}\n",
+            name, (unsigned long long)options.credentials, (unsigned long long)options.usernames,
+            (unsigned long long)options.bases, (unsigned long long)options.entries_per_basis,
+            (unsigned long long)options.seed, (unsigned long long)items, (unsigned long long)iterations,
+            times.front(), Percentile(times, 50), Percentile(times, 90), times.back(),
+            (unsigned long long)allocations
+        );
+        fflush(stdout);
+    }
+
+    bool WriteWholeFile(const wstring& file_name, const string& text) {
+        HANDLE file = ::CreateFileW(file_name.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        DWORD written = 0;
+        bool ok = ::WriteFile(file, text.data(), (DWORD)text.size(), &written, NULL) != FALSE && written == text.size();
+        ::CloseHandle(file);
+        return ok;
+    }
+
+    int WriteWorkload(const WorkloadOptions& options, const wstring& directory) {
+        const wstring holy_gradle_dir = directory + L"\\holygradle";
+        ::CreateDirectoryW(directory.c_str(), NULL);
+        ::CreateDirectoryW(holy_gradle_dir.c_str(), NULL);
+
+        GeneratedCredentialFile credentials(directory + L"\\credentials.dat");
+        vector<wstring> target_names = GenerateCredentials(options, credentials);
+        if (!credentials.Save() ||
+            !WriteWholeFile(holy_gradle_dir + L"\\credential-bases.txt", GenerateBasisFile(options, target_names))
+        ) {
+            fwprintf(stderr, L"ERROR: Failed to write the workload to %s - errno %lu\n", directory.c_str(),
+                ::GetLastError());
+            return 1;
+        }
+        fwprintf(stderr, L"Wrote %llu credentials and %llu bases to %s\n", (unsigned long long)target_names.size(),
+            (unsigned long long)options.bases, directory.c_str());
+        return 0;
+    }
+
+    int RunBenchmarks(const WorkloadOptions& options, size_t iterations) {
+        MemoryCredentialBackend backend;
+        const vector<wstring> target_names = GenerateCredentials(options, backend);
+
+        wchar_t temp_path[MAX_PATH];
+        ::GetTempPathW(MAX_PATH, temp_path);
+        const wstring basis_file = wstring(temp_path) + L"credential-store-perf-bench-" +
+            to_wstring(::GetCurrentProcessId()) + L".txt";
+        if (!WriteWholeFile(basis_file, GenerateBasisFile(options, target_names))) {
+            fwprintf(stderr, L"ERROR: Failed to write %s - errno %lu\n", basis_file.c_str(), ::GetLastError());
+            return 1;
+        }
+
+        RunBenchmark("ReadBases", options.bases * options.entries_per_basis, iterations, options, [&]() {
+            sink = ReadBases(basis_file).Names().size();
+        });
+        const CredentialBases bases(ReadBases(basis_file));
+
+        RunBenchmark("ParseTargetName", target_names.size(), iterations, options, [&]() {
+            size_t git = 0;
+            for (auto it = target_names.begin(); it != target_names.end(); ++it) {
+                git += (ParseTargetName(it->c_str(), it->size()).kind == CredentialKind::Git) ? 1 : 0;
+            }
+            sink = git;
+        });
+
+        RunBenchmark("CredentialSnapshot", target_names.size(), iterations, options, [&]() {
+            CredentialSnapshot snapshot(backend);
+            sink = snapshot.size();
+        });
+        const CredentialSnapshot snapshot(backend);
+
+        RunBenchmark("HasBasis", target_names.size(), iterations, options, [&]() {
+            size_t covered = 0;
+            for (auto it = target_names.begin(); it != target_names.end(); ++it) {
+                covered += bases.HasBasis(*it) ? 1 : 0;
+            }
+            sink = covered;
+        });
+
+        const wstring primary_username = WorkloadUsername(0);
+
+        // Finding one user's credentials, both ways, from enumeration to classification.  The old classifiers
+        // compare the stored username by prefix, and the new ones the username in the target name exactly, so the
+        // counts can differ where the workload has usernames which are prefixes of others.
+        const size_t reference_matches = ReferenceClassify(backend, primary_username);
+        const size_t matches = Classify(backend, primary_username);
+        if (reference_matches != matches) {
+            fwprintf(stderr, L"Note: the reference classifiers matched %llu credentials, and the current ones %llu.\n",
+                (unsigned long long)reference_matches, (unsigned long long)matches);
+        }
+        RunBenchmark("ClassifyReference", target_names.size(), iterations, options, [&]() {
+            sink = ReferenceClassify(backend, primary_username);
+        });
+        RunBenchmark("Classify", target_names.size(), iterations, options, [&]() {
+            sink = Classify(backend, primary_username);
+        });
+
+        const list<wstring> defaults = GetDefaultCredentials(snapshot, bases, primary_username);
+        RunBenchmark("GetDefaultCredentials", snapshot.ForUsername(primary_username).size(), iterations, options, [&]() {
+            sink = GetDefaultCredentials(snapshot, bases, primary_username).size();
+        });
+
+        // What list-basis does for every basis in turn, apart from writing the output.
+        RunBenchmark("ListBasis", bases.Names().size(), iterations, options, [&]() {
+            size_t listed = 0;
+            for (auto name = bases.Names().begin(); name != bases.Names().end(); ++name) {
+                BasisEntries entries = bases.EntriesFor(*name);
+                for (auto it = entries.begin(); it != entries.end(); ++it) {
+                    listed += IsGlobPattern(*it) ? ExpandBasisEntry(*it, snapshot).size() : 1;
+                }
+            }
+            sink = listed;
+        });
+
+        // Case-insensitive matching, as used for usernames, commands and credential names.
+        vector<wstring> upper_names(target_names);
+        for (auto it = upper_names.begin(); it != upper_names.end(); ++it) {
+            FoldCase(&(*it)[0], it->size());
+        }
+        RunBenchmark("EqualsIgnoreCase", target_names.size(), iterations, options, [&]() {
+            size_t equal = 0;
+            for (size_t i = 0; i < target_names.size(); ++i) {
+                equal += EqualsIgnoreCase(target_names[i], upper_names[i]) ? 1 : 0;
+            }
+            sink = equal;
+        });
+        RunBenchmark("FindIgnoreCase", target_names.size(), iterations, options, [&]() {
+            size_t found = 0;
+            for (auto it = target_names.begin(); it != target_names.end(); ++it) {
+                found += (FindIgnoreCase(*it, L"EXAMPLE.COM/GROUP-7") != IGNORE_CASE_NOT_FOUND) ? 1 : 0;
+            }
+            sink = found;
+        });
+
+        // Taking and releasing secrets should come from the locked arena, without touching the heap.
+        RunBenchmark("SecretBuffer", SECRET_BUFFERS_PER_RUN, iterations, options, [&]() {
+            SecretBuffer secrets[SECRET_BUFFERS_PER_RUN];
+            for (size_t i = 0; i < SECRET_BUFFERS_PER_RUN; ++i) {
+                secrets[i].Assign(L"correct horse battery staple", 28);
+            }
+            sink = secrets[0].size();
+        });
+
+        // What for-defaults writes, through the same bulk writer, with its "Updated:" lines suppressed.
+        SecretBuffer password;
+        password.Assign(L"new-password", 12);
+        vector<BulkWriteItem> items;
+        for (auto it = defaults.begin(); it != defaults.end(); ++it) {
+            BulkWriteItem item = { *it, primary_username, password.span() };
+            items.push_back(item);
+        }
+        wcout.setstate(ios::badbit);
+        RunBenchmark("BulkWrite", items.size(), iterations, options, [&]() {
+            BulkWriteSummary summary;
+            BulkWriter(backend).Apply(items, NULL, summary);
+            sink = summary.written;
+        });
+        wcout.clear();
+
+        ::DeleteFileW(basis_file.c_str());
+        return 0;
+    }
+
+    bool ParseSizeOption(const wchar_t* argument, const wchar_t* option, size_t& value) {
+        const size_t option_length = wcslen(option);
+        if (wcsncmp(argument, option, option_length) != 0) {
+            return false;
+        }
+        value = (size_t)wcstoul(argument + option_length, NULL, 10);
+        return true;
+    }
+
+    void ShowUsage(const wchar_t* program_name) {
+        WorkloadOptions defaults;
+        SetDefaultWorkloadOptions(defaults);
+        wprintf(L"Usage: %s [<options>]\n\n", program_name);
+        wprintf(L"  " CREDENTIALS_OPTION L"<n>      Credentials to generate (default: %llu).\n",
+            (unsigned long long)defaults.credentials);
+        wprintf(L"  " USERNAMES_OPTION L"<n>        Distinct usernames (default: %llu).\n",
+            (unsigned long long)defaults.usernames);
+        wprintf(L"  " PRIMARY_SHARE_OPTION L"<pct>  Percentage of credentials for the first username (default: %u).\n",
+            defaults.primary_share);
+        wprintf(L"  " CASE_VARIANTS_OPTION L"<pct>  Percentage of usernames with different case (default: %u).\n",
+            defaults.case_variants);
+        wprintf(L"  " BASES_OPTION L"<n>            Bases in the basis file (default: %llu).\n",
+            (unsigned long long)defaults.bases);
+        wprintf(L"  " ENTRIES_OPTION L"<n>          Entries under each basis (default: %llu).\n",
+            (unsigned long long)defaults.entries_per_basis);
+        wprintf(L"  " PATTERNS_OPTION L"<pct>       Percentage of entries which are patterns (default: %u).\n",
+            defaults.pattern_share);
+        wprintf(L"  " MALFORMED_OPTION L"<n>        Malformed lines in the basis file (default: %llu).\n",
+            (unsigned long long)defaults.malformed_lines);
+        wprintf(L"  " SEED_OPTION L"<n>             Seed for the generator (default: %llu).\n",
+            (unsigned long long)defaults.seed);
+        wprintf(L"  " ITERATIONS_OPTION L"<n>       Timed runs of each benchmark (default: %d).\n", DEFAULT_ITERATIONS);
+        wprintf(L"  " OUT_OPTION L"<dir>            Write the workload to <dir> instead of running benchmarks.\n");
+    }
+}
+
+int _tmain(int argc, wchar_t* argv[]) {
+    WorkloadOptions options;
+    SetDefaultWorkloadOptions(options);
+    size_t iterations = DEFAULT_ITERATIONS;
+    size_t primary_share = options.primary_share;
+    size_t case_variants = options.case_variants;
+    size_t pattern_share = options.pattern_share;
+    size_t seed = (size_t)options.seed;
+    wstring out_directory;
+    const size_t out_option_length = _countof(OUT_OPTION) - 1;
+    for (int i = 1; i < argc; ++i) {
+        const wchar_t* argument = argv[i];
+        if (wcsncmp(argument, OUT_OPTION, out_option_length) == 0 && argument[out_option_length] != 0) {
+            out_directory = argument + out_option_length;
+        } else if (
+            !ParseSizeOption(argument, CREDENTIALS_OPTION, options.credentials) &&
+            !ParseSizeOption(argument, USERNAMES_OPTION, options.usernames) &&
+            !ParseSizeOption(argument, PRIMARY_SHARE_OPTION, primary_share) &&
+            !ParseSizeOption(argument, CASE_VARIANTS_OPTION, case_variants) &&
+            !ParseSizeOption(argument, BASES_OPTION, options.bases) &&
+            !ParseSizeOption(argument, ENTRIES_OPTION, options.entries_per_basis) &&
+            !ParseSizeOption(argument, PATTERNS_OPTION, pattern_share) &&
+            !ParseSizeOption(argument, MALFORMED_OPTION, options.malformed_lines) &&
+            !ParseSizeOption(argument, SEED_OPTION, seed) &&
+            !ParseSizeOption(argument, ITERATIONS_OPTION, iterations)
+        ) {
+            ShowUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (iterations == 0 || primary_share > 100 || case_variants > 100 || pattern_share > 100) {
+        ShowUsage(argv[0]);
+        return 1;
+    }
+    options.primary_share = (unsigned)primary_share;
+    options.case_variants = (unsigned)case_variants;
+    options.pattern_share = (unsigned)pattern_share;
+    options.seed = seed;
+
+    return out_directory.empty() ? RunBenchmarks(options, iterations) : WriteWorkload(options, out_directory);
+}
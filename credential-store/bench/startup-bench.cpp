@@ -0,0 +1,213 @@
+#include <windows.h>
+#include <wincred.h>
+#include <tchar.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+    Measures how long credential-store.exe takes from being spawned to exiting, for the commands which builds run
+    over and over: get, set and the list-* commands.  Each command is run many times against a private file
+    backend and basis file (in a temporary directory, found through GRADLE_USER_HOME), with output discarded, and
+    the percentiles of the run times are printed.
+
+    Given a second executable (for example, the previous release), runs of the two are interleaved, so that both see
+    the same machine conditions, and both are reported side by side.  Releases before the file backend don't accept
+    --backend, so then both run against the current user's Windows Credential Manager instead, seeded with the same
+    few credentials, which are deleted again at the end.
+*/
+
+#define DEFAULT_RUNS 200
+#define WARM_UP_RUNS 5
+#define RUNS_OPTION L"--runs="
+#define BENCH_BASIS_NAME L"Startup Bench"
+#define BENCH_TARGET_NAME L"Intrepid - Startup Bench"
+#define BENCH_USERNAME L"bench"
+
+using namespace std;
+
+namespace {
+    struct Scenario {
+        const wchar_t* name;
+        wstring arguments;
+    };
+
+    struct Timings {
+        vector<double> milliseconds;
+        size_t failures;
+    };
+
+    wstring Quote(const wstring& argument) {
+        return L"\"" + argument + L"\"";
+    }
+
+    bool WriteAsciiFile(const wstring& file_name, const string& text) {
+        HANDLE file = ::CreateFileW(file_name.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        DWORD written = 0;
+        bool ok = ::WriteFile(file, text.data(), (DWORD)text.size(), &written, NULL) != FALSE && written == text.size();
+        ::CloseHandle(file);
+        return ok;
+    }
+
+    // Runs one command line to completion with its standard handles on the NUL device.  Returns false if it couldn't
+    // be started or exited with an error; "milliseconds" is the time from just before spawning it to its exit.
+    bool TimeRun(const wstring& command_line, HANDLE null_device, double& milliseconds) {
+        STARTUPINFOW startup_info = { sizeof(startup_info) };
+        startup_info.dwFlags = STARTF_USESTDHANDLES;
+        startup_info.hStdInput = null_device;
+        startup_info.hStdOutput = null_device;
+        startup_info.hStdError = null_device;
+        PROCESS_INFORMATION process_info;
+        vector<wchar_t> mutable_command_line(command_line.begin(), command_line.end());
+        mutable_command_line.push_back(L'\0');
+
+        LARGE_INTEGER frequency, start, end;
+        ::QueryPerformanceFrequency(&frequency);
+        ::QueryPerformanceCounter(&start);
+        if (!::CreateProcessW(NULL, &mutable_command_line[0], NULL, NULL, TRUE, 0, NULL, NULL, &startup_info, &process_info)) {
+            return false;
+        }
+        ::WaitForSingleObject(process_info.hProcess, INFINITE);
+        ::QueryPerformanceCounter(&end);
+
+        DWORD exit_code = 1;
+        ::GetExitCodeProcess(process_info.hProcess, &exit_code);
+        ::CloseHandle(process_info.hThread);
+        ::CloseHandle(process_info.hProcess);
+        milliseconds = (double)(end.QuadPart - start.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+        return exit_code == 0;
+    }
+
+    // The nearest-rank percentile of sorted values.
+    double Percentile(const vector<double>& sorted, double percent) {
+        size_t rank = (size_t)ceil(percent / 100.0 * (double)sorted.size());
+        return sorted[(rank == 0) ? 0 : rank - 1];
+    }
+
+    void PrintTimings(const wchar_t* scenario, const wchar_t* executable, Timings& timings) {
+        vector<double>& sorted = timings.milliseconds;
+        if (sorted.empty()) {
+            wprintf(L"%-14s %-10s %6u %8s %8s %8s %8s %8s %8u\n", scenario, executable, 0U, L"-", L"-", L"-", L"-", L"-",
+                (unsigned)timings.failures);
+            return;
+        }
+        sort(sorted.begin(), sorted.end());
+        wprintf(L"%-14s %-10s %6u %8.2f %8.2f %8.2f %8.2f %8.2f %8u\n", scenario, executable, (unsigned)sorted.size(),
+            sorted.front(), Percentile(sorted, 50), Percentile(sorted, 90), Percentile(sorted, 99), sorted.back(),
+            (unsigned)timings.failures);
+    }
+
+    void ShowUsage(const wchar_t* program_name) {
+        wprintf(L"Usage: %s [" RUNS_OPTION L"<n>] <credential-store.exe> [<baseline credential-store.exe>]\n",
+            program_name);
+        wprintf(L"  Runs get, set, list-defaults, list-bases and list-basis <n> times each (default: %d) and\n",
+            DEFAULT_RUNS);
+        wprintf(L"  prints the min, p50, p90, p99 and max milliseconds from spawn to exit.  With a baseline,\n");
+        wprintf(L"  both run against the Windows Credential Manager, as older releases have no --backend.\n");
+    }
+}
+
+int _tmain(int argc, wchar_t* argv[]) {
+    const wchar_t* program_name = argv[0];
+    const size_t runs_option_length = _countof(RUNS_OPTION) - 1;
+    size_t runs = DEFAULT_RUNS;
+    if (argc > 1 && wcsncmp(argv[1], RUNS_OPTION, runs_option_length) == 0) {
+        runs = wcstoul(argv[1] + runs_option_length, NULL, 10);
+        ++argv;
+        --argc;
+    }
+    if (argc < 2 || argc > 3 || runs == 0) {
+        ShowUsage(program_name);
+        return 1;
+    }
+    vector<wstring> executables(argv + 1, argv + argc);
+    const wchar_t* executable_labels[] = { L"current", L"baseline" };
+
+    // Everything the runs touch lives in a private directory, which the children find through the environment.
+    wchar_t temp_path[MAX_PATH];
+    ::GetTempPathW(MAX_PATH, temp_path);
+    const wstring home = wstring(temp_path) + L"credential-store-startup-bench-" + to_wstring(::GetCurrentProcessId());
+    const wstring holy_gradle_dir = home + L"\\holygradle";
+    const wstring basis_file = holy_gradle_dir + L"\\credential-bases.txt";
+    const wstring credential_file = home + L"\\credentials.dat";
+    if (!::CreateDirectoryW(home.c_str(), NULL) || !::CreateDirectoryW(holy_gradle_dir.c_str(), NULL) ||
+        !WriteAsciiFile(basis_file, "Startup Bench\n    git:https://bench@example.com/repo\n")
+    ) {
+        fwprintf(stderr, L"ERROR: Failed to create %s - errno %lu\n", home.c_str(), ::GetLastError());
+        return 1;
+    }
+    ::SetEnvironmentVariableW(L"GRADLE_USER_HOME", home.c_str());
+
+    SECURITY_ATTRIBUTES inheritable = { sizeof(inheritable), NULL, TRUE };
+    HANDLE null_device = ::CreateFileW(L"NUL", GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+        &inheritable, OPEN_EXISTING, 0, NULL);
+
+    const bool use_windows_store = (executables.size() > 1);
+    const wstring options = use_windows_store ? L" " : L" --backend=file:" + Quote(credential_file) + L" ";
+    vector<Scenario> scenarios;
+    Scenario get = { L"get", L"get " + Quote(BENCH_TARGET_NAME) };
+    Scenario set = { L"set", L"set " + Quote(BENCH_TARGET_NAME) + L" " BENCH_USERNAME L" password" };
+    Scenario list_defaults = { L"list-defaults", L"list-defaults " BENCH_USERNAME };
+    Scenario list_bases = { L"list-bases", L"list-bases" };
+    Scenario list_basis = { L"list-basis", L"list-basis " + Quote(BENCH_BASIS_NAME) };
+    scenarios.push_back(get);
+    scenarios.push_back(set);
+    scenarios.push_back(list_defaults);
+    scenarios.push_back(list_bases);
+    scenarios.push_back(list_basis);
+
+    // Seed the store, so that get finds something and list-defaults has something to classify.
+    double ignored;
+    const wchar_t* const seed_targets[] = {
+        BENCH_TARGET_NAME,
+        L"git:https://" BENCH_USERNAME L"@example.com/repo",
+        L"git:https://" BENCH_USERNAME L"@example.org/other",
+    };
+    for (size_t i = 0; i < _countof(seed_targets); ++i) {
+        const wstring seed = L"set " + Quote(seed_targets[i]) + L" " BENCH_USERNAME L" password";
+        if (!TimeRun(Quote(executables[0]) + options + seed, null_device, ignored)) {
+            fwprintf(stderr, L"ERROR: Failed to run %s\n", executables[0].c_str());
+            return 1;
+        }
+    }
+
+    wprintf(L"%-14s %-10s %6s %8s %8s %8s %8s %8s %8s\n", L"command", L"executable", L"runs", L"min_ms", L"p50_ms",
+        L"p90_ms", L"p99_ms", L"max_ms", L"failures");
+    for (auto scenario = scenarios.begin(); scenario != scenarios.end(); ++scenario) {
+        vector<Timings> timings(executables.size());
+        for (size_t run = 0; run < WARM_UP_RUNS + runs; ++run) {
+            for (size_t i = 0; i < executables.size(); ++i) {
+                double milliseconds;
+                bool ok = TimeRun(Quote(executables[i]) + options + scenario->arguments, null_device, milliseconds);
+                if (run < WARM_UP_RUNS) {
+                    continue;
+                }
+                if (ok) {
+                    timings[i].milliseconds.push_back(milliseconds);
+                } else {
+                    ++timings[i].failures;
+                }
+            }
+        }
+        for (size_t i = 0; i < executables.size(); ++i) {
+            PrintTimings(scenario->name, executable_labels[i], timings[i]);
+        }
+    }
+
+    ::CloseHandle(null_device);
+    if (use_windows_store) {
+        for (size_t i = 0; i < _countof(seed_targets); ++i) {
+            ::CredDeleteW(seed_targets[i], CRED_TYPE_GENERIC, 0);
+        }
+    }
+    ::DeleteFileW(credential_file.c_str());
+    ::DeleteFileW(basis_file.c_str());
+    ::RemoveDirectoryW(holy_gradle_dir.c_str());
+    ::RemoveDirectoryW(home.c_str());
+    return 0;
+}
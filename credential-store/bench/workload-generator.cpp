@@ -0,0 +1,213 @@
+#include "stdafx.h"
+
+#include "workload-generator.h"
+#include "target-name.h"
+
+#include <algorithm>
+#include <cwctype>
+
+#pragma hdrstop
+
+using namespace std;
+
+namespace {
+    // splitmix64, which is small and gives the same sequence everywhere, unlike the distributions in <random>.
+    class WorkloadRandom {
+    public:
+        explicit WorkloadRandom(uint64_t seed) : state_(seed) {}
+
+        uint64_t Next() {
+            uint64_t z = (state_ += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        }
+
+        // A number in [0, limit).
+        size_t Below(size_t limit) { return (limit == 0) ? 0 : (size_t)(Next() % limit); }
+
+        bool Percent(unsigned percent) { return Below(100) < percent; }
+
+    private:
+        uint64_t state_;
+    };
+
+    // Credentials cluster on a limited number of SCM servers, as they do in practice.
+    size_t HostCount(const WorkloadOptions& options) {
+        return min<size_t>(max<size_t>(1, options.credentials / 25), 500);
+    }
+
+    wstring HostName(size_t index) {
+        return L"scm-" + to_wstring(index) + L".example.com";
+    }
+
+    wstring PickUsername(const WorkloadOptions& options, WorkloadRandom& random) {
+        size_t index = 0;
+        if (options.usernames > 1 && !random.Percent(options.primary_share)) {
+            index = 1 + random.Below(options.usernames - 1);
+        }
+        wstring username = WorkloadUsername(index);
+        if (random.Percent(options.case_variants)) {
+            username[0] = towupper(username[0]);
+        }
+        return username;
+    }
+
+    bool WriteGenerated(
+        CredentialBackend& backend,
+        const wstring& target_name,
+        const wstring& user_name,
+        const wstring& password
+    ) {
+        CREDENTIALW credential = {0};
+        credential.Type = CRED_TYPE_GENERIC;
+        credential.TargetName = (LPWSTR)target_name.c_str();
+        credential.UserName = (LPWSTR)user_name.c_str();
+        credential.CredentialBlob = (LPBYTE)password.c_str();
+        credential.CredentialBlobSize = (DWORD)(password.size() * sizeof(wchar_t));
+        credential.Persist = CRED_PERSIST_ENTERPRISE;
+        return backend.Write(credential);
+    }
+
+    // Basis file text is ASCII, so this only has to narrow each character.
+    string Narrow(const wstring& text) {
+        string narrow;
+        narrow.reserve(text.size());
+        for (auto it = text.begin(); it != text.end(); ++it) {
+            narrow.push_back((char)*it);
+        }
+        return narrow;
+    }
+}
+
+void SetDefaultWorkloadOptions(WorkloadOptions& options) {
+    options.credentials = 5000;
+    options.usernames = 20;
+    options.primary_share = 60;
+    options.case_variants = 5;
+    options.bases = 50;
+    options.entries_per_basis = 20;
+    options.pattern_share = 5;
+    options.malformed_lines = 10;
+    options.seed = 1;
+}
+
+wstring WorkloadUsername(size_t index) {
+    return L"user" + to_wstring(index);
+}
+
+wstring WorkloadBasisName(size_t index) {
+    return L"Basis " + to_wstring(index);
+}
+
+vector<wstring> GenerateCredentials(const WorkloadOptions& options, CredentialBackend& backend) {
+    WorkloadRandom random(options.seed);
+    const size_t hosts = HostCount(options);
+    size_t intrepid_count = 0;
+    vector<wstring> target_names;
+    target_names.reserve(options.credentials);
+    for (size_t i = 0; i < options.credentials; ++i) {
+        const size_t kind = random.Below(100);
+        const wstring username = PickUsername(options, random);
+        const wstring host = HostName(random.Below(hosts));
+        // The index makes every name unique, so the store ends up with exactly the number asked for.
+        const wstring path = L"/group-" + to_wstring(random.Below(20)) + L"/repo-" + to_wstring(i);
+        const wstring password = L"password-" + to_wstring(random.Below(4));
+
+        wstring target_name;
+        wstring user_name = username;
+        if (kind < 45) {
+            // Most Git credentials have the username in the URL, but some are stored for the bare host.
+            target_name = random.Percent(70)
+                ? L"git:https://" + username + L"@" + host + path
+                : L"git:https://" + host + path;
+        } else if (kind < 85) {
+            const wstring url = L"https://" + host + L"/hg" + path;
+            target_name = username + L"@@" + url + L"@Mercurial";
+            if (random.Percent(50)) {
+                // Newer versions of Mercurial put the URL in the username too.
+                user_name = username + L"@@" + url;
+            }
+        } else if (kind < 95) {
+            target_name = HOLY_GRADLE_CREDENTIAL_PREFIX + ((intrepid_count < options.bases)
+                ? WorkloadBasisName(intrepid_count)
+                : L"Other " + to_wstring(intrepid_count));
+            ++intrepid_count;
+        } else {
+            target_name = L"LegacyGeneric:target=other-" + to_wstring(i);
+        }
+        if (WriteGenerated(backend, target_name, user_name, password)) {
+            target_names.push_back(target_name);
+        }
+    }
+    return target_names;
+}
+
+string GenerateBasisFile(const WorkloadOptions& options, const vector<wstring>& target_names) {
+    // Seed differently from the credentials, so that the basis file doesn't just follow the order they were made in.
+    WorkloadRandom random(options.seed ^ 0x5DEECE66DULL);
+    const size_t hosts = HostCount(options);
+
+    vector<string> scm_names;
+    for (auto it = target_names.begin(); it != target_names.end(); ++it) {
+        CredentialKind kind = ParseTargetName(it->c_str(), it->size()).kind;
+        if (kind == CredentialKind::Git || kind == CredentialKind::Mercurial) {
+            scm_names.push_back(Narrow(*it));
+        }
+    }
+
+    // Decide where the malformed lines go: entries before the first basis go at the top, everything else after one
+    // of the bases.
+    string top;
+    vector<string> after_basis(max<size_t>(options.bases, 1));
+    for (size_t i = 0; i < options.malformed_lines; ++i) {
+        string& lines = after_basis[random.Below(after_basis.size())];
+        switch (i % 5) {
+        case 0:
+            top += "    git:https://orphan.example.com/repo-" + to_string(i) + "\r\n";
+            break;
+        case 1:
+            lines += "   \t\r\n";
+            break;
+        case 2:
+            lines += "    git:https://" + Narrow(HostName(random.Below(hosts))) + "/trailing-" + to_string(i) + "   \r\n";
+            break;
+        case 3:
+            // A basis which has already appeared, with one more entry, as when two files have been concatenated.
+            lines += Narrow(WorkloadBasisName(random.Below(max<size_t>(options.bases, 1)))) + "\r\n";
+            lines += "    git:https://" + Narrow(HostName(random.Below(hosts))) + "/repeated-" + to_string(i) + "\r\n";
+            break;
+        default:
+            lines += "Empty Basis " + to_string(i) + "\r\n";
+            break;
+        }
+    }
+
+    string text = "# Generated by perf-bench: " + to_string(options.bases) + " bases of " +
+        to_string(options.entries_per_basis) + " entries, seed " + to_string(options.seed) + ".\r\n";
+    text += top;
+    for (size_t b = 0; b < options.bases; ++b) {
+        if (random.Percent(30)) {
+            text += "# Repositories for team " + to_string(b) + "\r\n";
+        }
+        text += Narrow(WorkloadBasisName(b)) + "\r\n";
+        for (size_t e = 0; e < options.entries_per_basis; ++e) {
+            const string host = Narrow(HostName(random.Below(hosts)));
+            if (random.Percent(options.pattern_share)) {
+                text += random.Percent(50)
+                    ? "    git:https://*@" + host + "/*\r\n"
+                    : "    *@@https://" + host + "/hg/group-" + to_string(random.Below(20)) + "/*@Mercurial\r\n";
+            } else if (!scm_names.empty() && random.Percent(80)) {
+                text += "    " + scm_names[random.Below(scm_names.size())] + "\r\n";
+            } else {
+                // A repository which has since been removed from the store.
+                text += "    git:https://" + host + "/retired/repo-" + to_string(b) + "-" + to_string(e) + "\r\n";
+            }
+        }
+        text += after_basis[b];
+    }
+    if (options.bases == 0) {
+        text += after_basis[0];
+    }
+    return text;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "credential-backend.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// The shape of a synthetic credential store and basis file.  The same options (including the seed) always give the
+// same workload, whatever machine it's generated on.
+struct WorkloadOptions {
+    size_t credentials;       // Git, Mercurial, Intrepid and other credentials, in total.
+    size_t usernames;         // How many distinct usernames the credentials are spread over.
+    unsigned primary_share;   // The percentage of credentials which belong to the first username.
+    unsigned case_variants;   // The percentage of credentials whose username differs from the usual one in case only.
+    size_t bases;             // How many bases the basis file lists.
+    size_t entries_per_basis;
+    unsigned pattern_share;   // The percentage of basis entries which are glob patterns.
+    size_t malformed_lines;   // Lines which ReadBases has to skip or warn about, scattered through the basis file.
+    uint64_t seed;
+};
+
+// Sets the defaults: 5000 credentials, 20 usernames of which the first holds 60%, and 50 bases of 20 entries.
+void SetDefaultWorkloadOptions(WorkloadOptions& options);
+
+// The name of the index'th generated username; 0 is the primary one.
+std::wstring WorkloadUsername(size_t index);
+
+// The name of the index'th generated basis.
+std::wstring WorkloadBasisName(size_t index);
+
+/*
+    Writes the generated credentials into "backend" and returns their target names, in the order they were made.
+    About 45% are Git ("git:https://[<username>@]<host>/<path>"), 40% Mercurial ("<username>@@<url>@Mercurial"), 10%
+    Intrepid (one per basis first, then others) and 5% other Windows credentials, spread over a few hundred hosts.
+*/
+std::vector<std::wstring> GenerateCredentials(const WorkloadOptions& options, CredentialBackend& backend);
+
+/*
+    Returns the text of a basis file, in ASCII.  Most entries are names from "target_names", some are names which
+    aren't stored, and "pattern_share" percent are patterns over one host's repositories.  There are comment lines
+    throughout, and "malformed_lines" lines of the kinds people leave in hand-edited files: whitespace-only lines,
+    trailing spaces, a repeated basis heading, a basis with no entries and entries before the first basis.
+*/
+std::string GenerateBasisFile(const WorkloadOptions& options, const std::vector<std::wstring>& target_names);
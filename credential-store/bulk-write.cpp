@@ -0,0 +1,167 @@
+#include "stdafx.h"
+
+#include "bulk-write.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#pragma hdrstop
+
+using namespace std;
+
+namespace {
+    typedef chrono::steady_clock Clock;
+
+    double MillisecondsSince(Clock::time_point start) {
+        return chrono::duration<double, milli>(Clock::now() - start).count();
+    }
+
+    // The value of a credential before the bulk write, so that it can be put back.
+    struct PriorValue {
+        PCREDENTIALW credential; // NULL if the credential didn't exist.
+        CredentialPtr owner;     // Keeps "credential" alive, if it was read rather than taken from a snapshot.
+    };
+
+    // Runs task(0) .. task(count - 1) on up to max_workers threads, taking indexes in order, until they're all done
+    // or "stop" becomes true.
+    void RunWorkers(size_t count, size_t max_workers, const function<void(size_t)>& task, const atomic<bool>& stop) {
+        atomic<size_t> next_index(0);
+        auto worker = [&]() {
+            for (;;) {
+                if (stop) {
+                    return;
+                }
+                size_t index = next_index++;
+                if (index >= count) {
+                    return;
+                }
+                task(index);
+            }
+        };
+
+        size_t worker_count = min(max_workers, count);
+        if (worker_count <= 1) {
+            worker();
+            return;
+        }
+        vector<thread> workers;
+        workers.reserve(worker_count);
+        for (size_t i = 0; i < worker_count; ++i) {
+            workers.push_back(thread(worker));
+        }
+        for (auto it = workers.begin(); it != workers.end(); ++it) {
+            it->join();
+        }
+    }
+}
+
+BulkWriter::BulkWriter(CredentialBackend& backend, size_t max_workers)
+    : backend_(backend)
+    , max_workers_(max_workers == 0 ? 1 : max_workers)
+{
+}
+
+bool BulkWriter::Apply(const vector<BulkWriteItem>& items, const CredentialSnapshot* prior, BulkWriteSummary& summary) {
+    Clock::time_point start = Clock::now();
+    summary.results.clear();
+    summary.results.reserve(items.size());
+    summary.written = 0;
+    summary.failed = 0;
+    summary.rolled_back = 0;
+    summary.rollback_failed = 0;
+
+    vector<PriorValue> prior_values(items.size());
+    vector<char> written(items.size(), 0);
+    atomic<bool> failed(false);
+    mutex report_mutex;
+
+    RunWorkers(items.size(), max_workers_, [&](size_t index) {
+        const BulkWriteItem& item = items[index];
+        PriorValue& prior_value = prior_values[index];
+        Clock::time_point item_start = Clock::now();
+
+        bool ok = true;
+        if (prior != NULL) {
+            prior_value.credential = prior->Find(item.target_name);
+        } else {
+            prior_value.owner = backend_.Read(item.target_name);
+            prior_value.credential = prior_value.owner.get();
+            // If we can't tell what the credential was, we couldn't roll it back, so don't touch it.
+            ok = (prior_value.owner || ::GetLastError() == ERROR_NOT_FOUND);
+        }
+        if (ok) {
+            ok = WriteCredential(backend_, item.target_name, item.username, item.password);
+        }
+        BulkWriteResult result = { item.target_name, ok, ok ? 0 : ::GetLastError(), MillisecondsSince(item_start) };
+        written[index] = ok;
+        if (!ok) {
+            failed = true;
+        }
+
+        lock_guard<mutex> lock(report_mutex);
+        if (ok) {
+            ++summary.written;
+            wcout << L"Updated: " << result.target_name
+                << L" (" << fixed << setprecision(1) << result.milliseconds << L" ms)" << endl;
+        } else {
+            ++summary.failed;
+            wcout << L"ERROR: Failed to update: " << result.target_name << L" - errno " << result.error << endl;
+        }
+        summary.results.push_back(result);
+    }, failed);
+
+    if (failed) {
+        // Put back everything we managed to write.  This always runs to completion, even if some of it fails.
+        atomic<bool> never_stop(false);
+        RunWorkers(items.size(), max_workers_, [&](size_t index) {
+            if (!written[index]) {
+                return;
+            }
+            const PriorValue& prior_value = prior_values[index];
+            bool restored = (prior_value.credential != NULL)
+                ? backend_.Write(*prior_value.credential)
+                : backend_.Delete(items[index].target_name);
+            DWORD error = restored ? 0 : ::GetLastError();
+
+            lock_guard<mutex> lock(report_mutex);
+            if (restored) {
+                ++summary.rolled_back;
+                wcout << L"Rolled back: " << items[index].target_name << endl;
+            } else {
+                ++summary.rollback_failed;
+                wcout << L"ERROR: Failed to roll back: " << items[index].target_name
+                    << L" - errno " << error << endl;
+            }
+        }, never_stop);
+    }
+
+    summary.milliseconds = MillisecondsSince(start);
+    return !failed;
+}
+
+void PrintBulkWriteSummary(const BulkWriteSummary& summary) {
+    double item_milliseconds = 0;
+    for (auto it = summary.results.begin(); it != summary.results.end(); ++it) {
+        item_milliseconds += it->milliseconds;
+    }
+    double mean_milliseconds = summary.results.empty() ? 0 : (item_milliseconds / summary.results.size());
+
+    wcout << endl;
+    if (summary.failed == 0) {
+        wcout << L"Updated " << summary.written << L" credential(s) in "
+            << fixed << setprecision(1) << summary.milliseconds << L" ms (mean " << mean_milliseconds
+            << L" ms per credential)." << endl;
+    } else {
+        wcout << L"ERROR: " << summary.failed << L" credential update(s) failed." << endl;
+        wcout << L"Rolled back " << summary.rolled_back << L" of " << summary.written << L" completed update(s)";
+        if (summary.rollback_failed > 0) {
+            wcout << L"; " << summary.rollback_failed << L" could not be rolled back and may hold the new value";
+        }
+        wcout << L"." << endl;
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "credential-backend.h"
+#include "credential-snapshot.h"
+#include "text-span.h"
+
+#include <string>
+#include <vector>
+
+#define DEFAULT_BULK_WRITE_WORKERS 8
+
+// One credential to write.  The password is a view of a secret which the caller keeps alive until the write is done;
+// usually many items share one SecretBuffer.
+struct BulkWriteItem {
+    std::wstring target_name;
+    std::wstring username;
+    TextSpan password;
+};
+
+struct BulkWriteResult {
+    std::wstring target_name;
+    bool written;
+    DWORD error;
+    double milliseconds;
+};
+
+struct BulkWriteSummary {
+    std::vector<BulkWriteResult> results; // In the order the writes finished.
+    size_t written;
+    size_t failed;
+    size_t rolled_back;
+    size_t rollback_failed;
+    double milliseconds;
+};
+
+/*
+    Writes a set of credentials through a bounded pool of worker threads.  The value of each credential before it is
+    written is remembered, either from a snapshot taken by the caller or by reading it just before the write, so that
+    if any write fails, the ones which succeeded can be put back as they were (or deleted, if they didn't exist
+    before).  Each write is timed, and reported as it finishes.
+*/
+class BulkWriter {
+public:
+    BulkWriter(CredentialBackend& backend, size_t max_workers = DEFAULT_BULK_WRITE_WORKERS);
+
+    // Applies all the writes, returning true if they all succeeded.  If "prior" is not NULL, it must hold the
+    // current state of the store, and is used instead of reading each credential before writing it.
+    bool Apply(const std::vector<BulkWriteItem>& items, const CredentialSnapshot* prior, BulkWriteSummary& summary);
+
+private:
+    CredentialBackend& backend_;
+    size_t max_workers_;
+};
+
+// Prints the outcome of a bulk write, in the same style as the single-credential "Updated:" messages.
+void PrintBulkWriteSummary(const BulkWriteSummary& summary);
@@ -0,0 +1,516 @@
+#include "stdafx.h"
+
+#include "credential-backend.h"
+#include "ignore-case.h"
+#include "trace.h"
+
+#include <iostream>
+
+#pragma hdrstop
+
+#define BACKEND_FILE_MAGIC 0x53434748 // "HGCS"
+#define BACKEND_FILE_VERSION 1
+#define BACKEND_FILE_SPEC_PREFIX L"file:"
+#define FILE_LOCK_RETRY_MS 50
+
+using namespace std;
+
+namespace {
+    // A StoredCredential together with a CREDENTIALW which points into it.  The view must be re-pointed if the
+    // stored credential moves, so these are never copied once the view is filled in.
+    struct CredentialCopy {
+        StoredCredential stored;
+        CREDENTIALW view;
+
+        void FillView() {
+            ZeroMemory(&view, sizeof(view));
+            view.Flags = stored.flags;
+            view.Type = stored.type;
+            view.Persist = stored.persist;
+            view.LastWritten = stored.last_written;
+            view.TargetName = const_cast<LPWSTR>(stored.target_name.c_str());
+            view.Comment = stored.comment.empty() ? NULL : const_cast<LPWSTR>(stored.comment.c_str());
+            view.UserName = const_cast<LPWSTR>(stored.user_name.c_str());
+            view.CredentialBlobSize = (DWORD)stored.blob.size();
+            view.CredentialBlob = stored.blob.empty() ? NULL : const_cast<LPBYTE>(stored.blob.data());
+        }
+    };
+
+    void Store(const CREDENTIALW& credential, StoredCredential& stored) {
+        stored.flags = credential.Flags;
+        stored.type = credential.Type;
+        stored.persist = credential.Persist;
+        ::GetSystemTimeAsFileTime(&stored.last_written);
+        stored.target_name.assign(credential.TargetName);
+        stored.comment.assign(credential.Comment == NULL ? L"" : credential.Comment);
+        stored.user_name.assign(credential.UserName == NULL ? L"" : credential.UserName);
+        stored.blob.assign(credential.CredentialBlob, credential.CredentialBlob + credential.CredentialBlobSize);
+    }
+
+    /*
+        The file's contents are written byte by byte, little-endian, and strings as UTF-16LE code units, so the
+        format doesn't depend on the platform's byte order or size of wchar_t.  (This is the layout the first version
+        got by copying DWORDs and wchar_ts straight from memory on Windows, so old files still read.)
+    */
+    void AppendDword(string& out, DWORD value) {
+        for (int shift = 0; shift < 32; shift += 8) {
+            out += (char)((value >> shift) & 0xFF);
+        }
+    }
+
+    void AppendBytes(string& out, const void* data, size_t size) {
+        AppendDword(out, (DWORD)size);
+        out.append(reinterpret_cast<const char*>(data), size);
+    }
+
+    void AppendString(string& out, const wstring& value) {
+        AppendDword(out, (DWORD)(value.size() * 2));
+        for (auto it = value.begin(); it != value.end(); ++it) {
+            out += (char)(*it & 0xFF);
+            out += (char)((*it >> 8) & 0xFF);
+        }
+    }
+
+    // The number of bytes which the Append functions add for a string, or for a block of "size" bytes.
+    size_t AppendedSize(const wstring& value) {
+        return 4 + value.size() * 2;
+    }
+
+    size_t AppendedSize(size_t size) {
+        return 4 + size;
+    }
+
+    // Reads values back in the order they were appended, failing if it runs off the end of the data.
+    class Reader {
+    public:
+        Reader(const BYTE* data, size_t size) : next_(data), end_(data + size) {}
+
+        bool ReadDword(DWORD& value) {
+            if (end_ - next_ < 4) {
+                return false;
+            }
+            value = next_[0] | (next_[1] << 8) | (next_[2] << 16) | ((DWORD)next_[3] << 24);
+            next_ += 4;
+            return true;
+        }
+
+        bool ReadBytes(const BYTE*& data, DWORD& size) {
+            if (!ReadDword(size) || (size_t)(end_ - next_) < size) {
+                return false;
+            }
+            data = next_;
+            next_ += size;
+            return true;
+        }
+
+        bool ReadString(wstring& value) {
+            const BYTE* data;
+            DWORD size;
+            if (!ReadBytes(data, size)) {
+                return false;
+            }
+            value.resize(size / 2);
+            for (size_t i = 0; i < value.size(); ++i) {
+                value[i] = (wchar_t)(data[2 * i] | (data[2 * i + 1] << 8));
+            }
+            return true;
+        }
+
+    private:
+        const BYTE* next_;
+        const BYTE* end_;
+    };
+
+    bool ReadWholeFile(const wstring& file_name, string& content) {
+        HANDLE file = ::CreateFileW(
+            file_name.c_str(),
+            GENERIC_READ,
+            FILE_SHARE_READ | FILE_SHARE_DELETE, // so that another process can replace it meanwhile
+            NULL,
+            OPEN_EXISTING,
+            FILE_FLAG_SEQUENTIAL_SCAN,
+            NULL
+        );
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER size;
+        bool ok = (::GetFileSizeEx(file, &size) != FALSE);
+        if (ok) {
+            content.resize((size_t)size.QuadPart);
+            DWORD read = 0;
+            ok = content.empty() ||
+                (::ReadFile(file, &content[0], (DWORD)content.size(), &read, NULL) && read == content.size());
+        }
+        ::CloseHandle(file);
+        return ok;
+    }
+}
+
+FileLock::FileLock() : file_(INVALID_HANDLE_VALUE) {
+}
+
+FileLock::~FileLock() {
+    Release();
+}
+
+bool FileLock::Acquire(const wstring& lock_file_name, DWORD timeout_ms) {
+    Release();
+    file_ = ::CreateFileW(
+        lock_file_name.c_str(),
+        GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL,
+        OPEN_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL
+    );
+    if (file_ == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    const ULONGLONG deadline = ::GetTickCount64() + timeout_ms;
+    for (;;) {
+        OVERLAPPED overlapped = {0};
+        if (::LockFileEx(file_, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &overlapped)) {
+            return true;
+        }
+        DWORD error = ::GetLastError();
+        if (error != ERROR_LOCK_VIOLATION || ::GetTickCount64() >= deadline) {
+            ::CloseHandle(file_);
+            file_ = INVALID_HANDLE_VALUE;
+            ::SetLastError(error);
+            return false;
+        }
+        ::Sleep(FILE_LOCK_RETRY_MS);
+    }
+}
+
+void FileLock::Release() {
+    if (file_ != INVALID_HANDLE_VALUE) {
+        OVERLAPPED overlapped = {0};
+        ::UnlockFileEx(file_, 0, 1, 0, &overlapped);
+        ::CloseHandle(file_);
+        file_ = INVALID_HANDLE_VALUE;
+    }
+}
+
+bool ReplaceWholeFile(const wstring& file_name, const void* data, DWORD size) {
+    wstring temp_file_name(file_name + L".tmp");
+    HANDLE file = ::CreateFileW(
+        temp_file_name.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL
+    );
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    DWORD written = 0;
+    bool ok = ::WriteFile(file, data, size, &written, NULL) && written == size && ::FlushFileBuffers(file);
+    ::CloseHandle(file);
+    if (ok) {
+        ok = (::MoveFileExW(
+            temp_file_name.c_str(), file_name.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH
+        ) != FALSE);
+    }
+    if (!ok) {
+        DWORD error = ::GetLastError();
+        ::DeleteFileW(temp_file_name.c_str());
+        ::SetLastError(error);
+    }
+    return ok;
+}
+
+CredentialPtr WindowsCredentialBackend::Read(const wstring& target_name) {
+    TraceSpan span("CredRead", target_name.c_str());
+    PCREDENTIALW pcred;
+    if (!::CredReadW(target_name.c_str(), CRED_TYPE_GENERIC, 0, &pcred)) {
+        return CredentialPtr();
+    }
+    // Must free memory allocated by CredRead()!  Wipe the password first, so it doesn't linger in freed memory.
+    return CredentialPtr(pcred, [](PCREDENTIALW credential) {
+        SecureZeroMemory(credential->CredentialBlob, credential->CredentialBlobSize);
+        ::CredFree(credential);
+    });
+}
+
+bool WindowsCredentialBackend::Write(const CREDENTIALW& credential) {
+    TraceSpan span("CredWrite", credential.TargetName);
+    return (::CredWriteW(const_cast<PCREDENTIALW>(&credential), 0) != FALSE);
+}
+
+bool WindowsCredentialBackend::Delete(const wstring& target_name) {
+    TraceSpan span("CredDelete", target_name.c_str());
+    return (::CredDeleteW(target_name.c_str(), CRED_TYPE_GENERIC, 0) != FALSE);
+}
+
+bool WindowsCredentialBackend::Enumerate(CredentialEnumeration& enumeration) {
+    TraceSpan span("CredEnumerate");
+    PCREDENTIALW* pCredArray = NULL;
+    DWORD dwCount = 0;
+    enumeration.credentials.clear();
+    enumeration.storage.reset();
+    if (!::CredEnumerateW(NULL, 0, &dwCount, &pCredArray)) {
+        // ERROR_NOT_FOUND just means there are no credentials at all.
+        return (::GetLastError() == ERROR_NOT_FOUND);
+    }
+    // Must free memory allocated by CredEnumerate()!
+    enumeration.storage.reset(pCredArray, ::CredFree);
+    enumeration.credentials.assign(pCredArray, pCredArray + dwCount);
+    return true;
+}
+
+CredentialPtr MemoryCredentialBackend::Read(const wstring& target_name) {
+    lock_guard<mutex> lock(mutex_);
+    auto found = credentials_.find(target_name);
+    if (found == credentials_.end()) {
+        ::SetLastError(ERROR_NOT_FOUND);
+        return CredentialPtr();
+    }
+    auto copy = make_shared<CredentialCopy>();
+    copy->stored = found->second;
+    copy->FillView();
+    return CredentialPtr(copy, &copy->view);
+}
+
+bool MemoryCredentialBackend::Write(const CREDENTIALW& credential) {
+    if (credential.Type != CRED_TYPE_GENERIC || credential.TargetName == NULL) {
+        ::SetLastError(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    lock_guard<mutex> lock(mutex_);
+    if (!BeginChange()) {
+        return false;
+    }
+    wstring target_name(credential.TargetName);
+    auto existing = credentials_.find(target_name);
+    bool existed = (existing != credentials_.end());
+    StoredCredential previous;
+    if (existed) {
+        previous = existing->second;
+    }
+
+    Store(credential, credentials_[target_name]);
+    bool ok = Changed();
+    DWORD error = ::GetLastError();
+    if (!ok) {
+        // Keep the in-memory store matching what was last saved.
+        if (existed) {
+            credentials_[target_name] = previous;
+        } else {
+            credentials_.erase(target_name);
+        }
+    }
+    EndChange();
+    ::SetLastError(error);
+    return ok;
+}
+
+bool MemoryCredentialBackend::Delete(const wstring& target_name) {
+    lock_guard<mutex> lock(mutex_);
+    if (!BeginChange()) {
+        return false;
+    }
+    auto existing = credentials_.find(target_name);
+    bool ok = false;
+    DWORD error = ERROR_NOT_FOUND;
+    if (existing != credentials_.end()) {
+        StoredCredential previous(existing->second);
+        credentials_.erase(existing);
+        ok = Changed();
+        error = ::GetLastError();
+        if (!ok) {
+            credentials_[target_name] = previous;
+        }
+    }
+    EndChange();
+    ::SetLastError(error);
+    return ok;
+}
+
+bool MemoryCredentialBackend::Enumerate(CredentialEnumeration& enumeration) {
+    lock_guard<mutex> lock(mutex_);
+    // Copy everything, so that the enumeration isn't affected by later writes.
+    auto copies = make_shared<vector<CredentialCopy>>(credentials_.size());
+    enumeration.credentials.clear();
+    enumeration.credentials.reserve(credentials_.size());
+    auto copy = copies->begin();
+    for (auto it = credentials_.begin(); it != credentials_.end(); ++it, ++copy) {
+        copy->stored = it->second;
+        copy->FillView();
+        enumeration.credentials.push_back(&copy->view);
+    }
+    enumeration.storage = copies;
+    return true;
+}
+
+FileCredentialBackend::FileCredentialBackend(const wstring& file_name, unique_ptr<FileCipher> cipher)
+    : file_name_(file_name)
+    , cipher_(move(cipher))
+{
+}
+
+bool FileCredentialBackend::Open() {
+    lock_guard<mutex> lock(mutex_);
+    return Load();
+}
+
+bool FileCredentialBackend::Load() {
+    TraceSpan span("ReadCredentialFile", file_name_.c_str());
+    string encrypted;
+    if (!ReadWholeFile(file_name_, encrypted)) {
+        // A missing file is just an empty store; it will be created on the first write.
+        if (::GetLastError() != ERROR_FILE_NOT_FOUND) {
+            return false;
+        }
+        credentials_.clear();
+        return true;
+    }
+
+    string plain;
+    if (!cipher_->Open(encrypted, plain)) {
+        return false;
+    }
+
+    // Parse into a new map, so that the credentials already loaded are kept if the file is bad.
+    map<wstring, StoredCredential> loaded;
+    Reader reader(reinterpret_cast<const BYTE*>(plain.data()), plain.size());
+    DWORD magic, version, count;
+    bool ok = reader.ReadDword(magic) && magic == BACKEND_FILE_MAGIC &&
+        reader.ReadDword(version) && version == BACKEND_FILE_VERSION &&
+        reader.ReadDword(count);
+    for (DWORD index = 0; ok && index < count; ++index) {
+        StoredCredential stored;
+        const BYTE* blob;
+        DWORD blob_size;
+        ok = reader.ReadDword(stored.flags) &&
+            reader.ReadDword(stored.type) &&
+            reader.ReadDword(stored.persist) &&
+            reader.ReadDword(stored.last_written.dwLowDateTime) &&
+            reader.ReadDword(stored.last_written.dwHighDateTime) &&
+            reader.ReadString(stored.target_name) &&
+            reader.ReadString(stored.comment) &&
+            reader.ReadString(stored.user_name) &&
+            reader.ReadBytes(blob, blob_size);
+        if (ok) {
+            stored.blob.assign(blob, blob + blob_size);
+            loaded[stored.target_name] = move(stored);
+        }
+    }
+
+    if (!plain.empty()) {
+        SecureZeroMemory(&plain[0], plain.size());
+    }
+    if (!ok) {
+        ::SetLastError(ERROR_INVALID_DATA);
+        return false;
+    }
+    credentials_.swap(loaded);
+    return true;
+}
+
+bool FileCredentialBackend::BeginChange() {
+    // Another process may have changed the file since it was loaded, so apply the change to what it holds now.
+    if (!file_lock_.Acquire(file_name_ + L".lock", CREDENTIAL_FILE_LOCK_TIMEOUT_MS)) {
+        return false;
+    }
+    if (!Load()) {
+        DWORD error = ::GetLastError();
+        file_lock_.Release();
+        ::SetLastError(error);
+        return false;
+    }
+    return true;
+}
+
+void FileCredentialBackend::EndChange() {
+    file_lock_.Release();
+}
+
+bool FileCredentialBackend::Changed() {
+    TraceSpan span("WriteCredentialFile", file_name_.c_str());
+    // Size the buffer once, so that growing it doesn't leave copies of the passwords in freed memory.
+    size_t plain_size = 3 * 4;
+    for (auto it = credentials_.begin(); it != credentials_.end(); ++it) {
+        const StoredCredential& stored = it->second;
+        plain_size += 5 * 4 + AppendedSize(stored.target_name) + AppendedSize(stored.comment) +
+            AppendedSize(stored.user_name) + AppendedSize(stored.blob.size());
+    }
+    string plain;
+    plain.reserve(plain_size);
+    AppendDword(plain, BACKEND_FILE_MAGIC);
+    AppendDword(plain, BACKEND_FILE_VERSION);
+    AppendDword(plain, (DWORD)credentials_.size());
+    for (auto it = credentials_.begin(); it != credentials_.end(); ++it) {
+        const StoredCredential& stored = it->second;
+        AppendDword(plain, stored.flags);
+        AppendDword(plain, stored.type);
+        AppendDword(plain, stored.persist);
+        AppendDword(plain, stored.last_written.dwLowDateTime);
+        AppendDword(plain, stored.last_written.dwHighDateTime);
+        AppendString(plain, stored.target_name);
+        AppendString(plain, stored.comment);
+        AppendString(plain, stored.user_name);
+        AppendBytes(plain, stored.blob.data(), stored.blob.size());
+    }
+
+    string sealed;
+    bool ok = cipher_->Seal(plain, sealed);
+    SecureZeroMemory(&plain[0], plain.size());
+    if (ok) {
+        ok = ReplaceWholeFile(file_name_, sealed.data(), (DWORD)sealed.size());
+    }
+    return ok;
+}
+
+unique_ptr<CredentialBackend> CreateCredentialBackend(const wstring& requested_spec) {
+    wstring spec(requested_spec);
+    if (spec.empty()) {
+        DWORD length = ::GetEnvironmentVariableW(CREDENTIAL_BACKEND_ENV_VAR_NAME, NULL, 0);
+        if (length > 0) {
+            spec.resize(length);
+            spec.resize(::GetEnvironmentVariableW(CREDENTIAL_BACKEND_ENV_VAR_NAME, &spec[0], length));
+        }
+    }
+
+    const size_t file_prefix_length = _countof(BACKEND_FILE_SPEC_PREFIX) - 1;
+    if (spec.empty() || EqualsIgnoreCase(spec, L"windows")) {
+        return unique_ptr<CredentialBackend>(new WindowsCredentialBackend());
+    } else if (EqualsIgnoreCase(spec, L"memory")) {
+        return unique_ptr<CredentialBackend>(new MemoryCredentialBackend());
+    } else if (StartsWithIgnoreCase(spec, BACKEND_FILE_SPEC_PREFIX) &&
+        spec.size() > file_prefix_length
+    ) {
+        wstring file_name(spec.substr(file_prefix_length));
+        unique_ptr<FileCredentialBackend> backend(new FileCredentialBackend(file_name, CreateUserFileCipher()));
+        if (!backend->Open()) {
+            wcerr << L"ERROR: Failed to read credential file " << file_name << L" - errno " << ::GetLastError()
+                << endl;
+            return unique_ptr<CredentialBackend>();
+        }
+        return move(backend);
+    }
+
+    wcerr << L"ERROR: Unknown credential backend '" << spec << L"'; expected 'windows', 'memory' or 'file:<path>'."
+        << endl;
+    return unique_ptr<CredentialBackend>();
+}
+
+bool WriteCredential(CredentialBackend& backend, const wstring& target_name, const wstring& username, const TextSpan& password) {
+    CREDENTIALW cred = {0};
+    cred.Type = CRED_TYPE_GENERIC;
+    cred.TargetName = (LPWSTR)target_name.c_str();
+    cred.CredentialBlobSize = (DWORD) (password.size*2);
+    cred.CredentialBlob = (LPBYTE) password.data;
+    cred.Persist = CRED_PERSIST_ENTERPRISE;
+    cred.UserName = (LPWSTR)username.c_str();
+
+    return backend.Write(cred);
+}
+
+bool CredentialHasValue(const CREDENTIALW& existing, const wstring& username, const TextSpan& password) {
+    size_t blob_size = password.size * sizeof(wchar_t);
+    return existing.Type == CRED_TYPE_GENERIC
+        && existing.Persist == CRED_PERSIST_ENTERPRISE
+        && existing.UserName != NULL
+        && username == existing.UserName
+        && existing.CredentialBlobSize == blob_size
+        && (blob_size == 0 || memcmp(existing.CredentialBlob, password.data, blob_size) == 0);
+}
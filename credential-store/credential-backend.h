@@ -0,0 +1,162 @@
+#pragma once
+
+#include "file-cipher.h"
+#include "secret-buffer.h"
+#include "text-span.h"
+
+#include <windows.h>
+#include <wincred.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define CREDENTIAL_BACKEND_ENV_VAR_NAME L"CREDENTIAL_STORE_BACKEND"
+#define BACKEND_OPTION L"--backend="
+
+// How long a FileCredentialBackend waits for another process to finish changing the same file.
+#define CREDENTIAL_FILE_LOCK_TIMEOUT_MS 30000
+
+// A credential returned by CredentialBackend::Read, whose deleter frees it in the way the backend requires.
+typedef std::shared_ptr<CREDENTIALW> CredentialPtr;
+
+// The credentials returned by one CredentialBackend::Enumerate call.  The credential pointers refer into memory
+// which is kept alive by "storage", so they are valid for as long as the enumeration is.
+struct CredentialEnumeration {
+    std::vector<PCREDENTIALW> credentials;
+    std::shared_ptr<void> storage;
+};
+
+/*
+    The store in which credentials are kept.  Only generic credentials are read, written or deleted.  All methods
+    return NULL or false on failure, with the reason available from GetLastError(); in particular, Read and Delete
+    fail with ERROR_NOT_FOUND if there is no such credential.  Implementations must be safe to call from several
+    threads at once.
+*/
+class CredentialBackend {
+public:
+    virtual ~CredentialBackend() {}
+
+    virtual CredentialPtr Read(const std::wstring& target_name) = 0;
+    virtual bool Write(const CREDENTIALW& credential) = 0;
+    virtual bool Delete(const std::wstring& target_name) = 0;
+    virtual bool Enumerate(CredentialEnumeration& enumeration) = 0;
+};
+
+// The Windows Credential Manager, for the current user.
+class WindowsCredentialBackend : public CredentialBackend {
+public:
+    virtual CredentialPtr Read(const std::wstring& target_name);
+    virtual bool Write(const CREDENTIALW& credential);
+    virtual bool Delete(const std::wstring& target_name);
+    virtual bool Enumerate(CredentialEnumeration& enumeration);
+};
+
+// An owned copy of all the parts of a CREDENTIALW which this tool uses.  The blob is zeroed whenever it is freed, so
+// copies of a password don't linger on the heap.
+struct StoredCredential {
+    DWORD flags;
+    DWORD type;
+    DWORD persist;
+    FILETIME last_written;
+    std::wstring target_name;
+    std::wstring comment;
+    std::wstring user_name;
+    std::vector<BYTE, WipingAllocator<BYTE>> blob;
+};
+
+// A store which only lasts as long as the process; mainly useful for tests and benchmarks, in the "batch" and
+// "serve" sessions.
+class MemoryCredentialBackend : public CredentialBackend {
+public:
+    virtual CredentialPtr Read(const std::wstring& target_name);
+    virtual bool Write(const CREDENTIALW& credential);
+    virtual bool Delete(const std::wstring& target_name);
+    virtual bool Enumerate(CredentialEnumeration& enumeration);
+
+protected:
+    // Called with the lock held before every change; the change is only made if this returns true.  EndChange is
+    // called after each change for which BeginChange succeeded, whether or not the change was made.
+    virtual bool BeginChange() { return true; }
+    virtual void EndChange() {}
+
+    // Called with the lock held after every successful change.
+    virtual bool Changed() { return true; }
+
+    std::mutex mutex_;
+    std::map<std::wstring, StoredCredential> credentials_;
+};
+
+/*
+    An exclusive lock on a file (created if need be), held until it is released or this object is destroyed; used to
+    serialise changes to files which several processes share.  Windows drops the lock if the process dies, so a
+    crashed change can't leave the file locked.
+*/
+class FileLock {
+public:
+    FileLock();
+    ~FileLock();
+
+    // Waits for up to "timeout_ms" for the lock; returns false, with the last error set, if it isn't taken.
+    bool Acquire(const std::wstring& lock_file_name, DWORD timeout_ms);
+    void Release();
+
+private:
+    FileLock(const FileLock&);
+    FileLock& operator=(const FileLock&);
+
+    HANDLE file_;
+};
+
+/*
+    A store kept in a single file, encrypted for the current user by a FileCipher, for machines where the Windows
+    Credential Manager isn't available or shouldn't be used (for example, build agents running as a service).  The
+    whole file is read when the backend is opened, and rewritten (via a temporary file and a rename, so that it is
+    never left half-written) after each change.  Each change holds a lock on "<file>.lock" while it reads the file
+    again, applies the change and writes the result, so several processes can share one file without losing each
+    other's changes; reads are served from what was last loaded.
+*/
+class FileCredentialBackend : public MemoryCredentialBackend {
+public:
+    FileCredentialBackend(const std::wstring& file_name, std::unique_ptr<FileCipher> cipher);
+
+    // Reads the file, if it exists; returns false if it can't be read or decrypted.
+    bool Open();
+
+protected:
+    virtual bool BeginChange();
+    virtual void EndChange();
+    virtual bool Changed();
+
+private:
+    // Replaces "credentials_" with the file's contents; called with the lock held.
+    bool Load();
+
+    std::wstring file_name_;
+    std::unique_ptr<FileCipher> cipher_;
+    FileLock file_lock_;
+};
+
+// Creates the backend described by "spec", which is one of "windows", "memory" or "file:<path>".  An empty spec
+// means the value of the CREDENTIAL_STORE_BACKEND environment variable, or "windows" if that isn't set.  Prints an
+// error and returns NULL if the spec is not recognised or the backend can't be opened.
+std::unique_ptr<CredentialBackend> CreateCredentialBackend(const std::wstring& spec);
+
+// Writes a generic, enterprise-persisted credential, returning false on failure.  The password is written straight
+// from wherever it is held (usually a SecretBuffer), without being copied.
+bool WriteCredential(
+    CredentialBackend& backend,
+    const std::wstring& target_name,
+    const std::wstring& username,
+    const TextSpan& password
+);
+
+// Returns true if "existing" already holds exactly what WriteCredential would write for this username and password,
+// so that writing it again would change nothing.
+bool CredentialHasValue(const CREDENTIALW& existing, const std::wstring& username, const TextSpan& password);
+
+// Writes a whole file via a temporary file ("<file_name>.tmp") and a rename, so that readers only ever see the old or
+// the new content.  Callers which might race each other must take a lock around this, since they share the
+// temporary file.
+bool ReplaceWholeFile(const std::wstring& file_name, const void* data, DWORD size);
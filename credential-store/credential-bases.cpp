@@ -0,0 +1,373 @@
+#include "stdafx.h"
+
+#include "credential-bases.h"
+#include "trace.h"
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cwctype>
+#include <lmcons.h>
+
+#pragma hdrstop
+
+#define GRADLE_USER_HOME_ENV_VAR_NAME L"GRADLE_USER_HOME"
+#define USERPROFILE_ENV_VAR_NAME L"USERPROFILE"
+#define HOLY_GRADLE_DIR_NAME L"holygradle"
+#define CREDENTIAL_BASIS_FILE_NAME L"credential-bases.txt"
+
+using namespace std;
+
+wstring GetIntrepidCredentialName(const wstring& target_name) {
+    return target_name.substr(11);
+}
+
+wstring GetUserName()
+{
+    DWORD usernameLen = UNLEN;
+    wchar_t usernameBuffer[UNLEN];
+    if (GetUserName(usernameBuffer, &usernameLen)) {
+        return usernameBuffer;
+    } else {
+        return L"";
+    }
+}
+
+bool GetPathFromEnv(const wstring& name, wstring& value) {
+    wchar_t raw_value[MAX_PATH];
+    DWORD length = ::GetEnvironmentVariable(name.c_str(), raw_value, MAX_PATH);
+    bool ok = !(length == 0 || length > MAX_PATH);
+    if (ok) {
+        value.assign(raw_value, length);
+    }
+    return ok;
+}
+
+bool GetGradleUserHome(wstring& home) {
+    TraceSpan span("GetGradleUserHome");
+    bool found_home = false;
+    if (GetPathFromEnv(L"GRADLE_USER_HOME", home)) {
+        found_home = (home.size() > 0);
+    } else {
+        if (GetPathFromEnv(L"USERPROFILE", home)) {
+            auto size = home.size();
+            if (size > 0) {
+                if (home[size - 1] != L'\\') {
+                    home += L'\\';
+                }
+                home += L".gradle";
+                found_home = true;
+            }
+        }
+    }
+    return found_home;
+}
+
+namespace {
+    wstring FindCredentialBasisFileName() {
+        wstring home;
+        if (GetGradleUserHome(home)) {
+            wstringstream basis_file_name_stream;
+            basis_file_name_stream << home;
+            wchar_t last_char = home[home.size() - 1];
+            if (!(last_char == L'/' || last_char == L'\\')) {
+                basis_file_name_stream << L'\\';
+            }
+            basis_file_name_stream << HOLY_GRADLE_DIR_NAME << L'\\' << CREDENTIAL_BASIS_FILE_NAME;
+            return basis_file_name_stream.str();
+        } else {
+            wcerr << L"ERROR: Failed to read environment variable " GRADLE_USER_HOME_ENV_VAR_NAME L" or "
+                USERPROFILE_ENV_VAR_NAME L"." << endl;
+            wcerr << L"One of these must be set to locate the credential basis file." << endl;
+            return L"???";
+        }
+    }
+}
+
+bool ReadTextFile(const wstring& file_name, unique_ptr<wchar_t[]>& text, size_t& length, bool* byte_order_mark) {
+    HANDLE file = ::CreateFileW(
+        file_name.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL,
+        OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN,
+        NULL
+    );
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER file_size;
+    DWORD read = 0;
+    unique_ptr<char[]> bytes;
+    bool ok = (::GetFileSizeEx(file, &file_size) != FALSE);
+    if (ok) {
+        bytes.reset(new char[(size_t)file_size.QuadPart + 1]);
+        ok = (::ReadFile(file, bytes.get(), (DWORD)file_size.QuadPart, &read, NULL) != FALSE);
+    }
+    ::CloseHandle(file);
+    if (!ok) {
+        return false;
+    }
+
+    const char* start = bytes.get();
+    const bool has_byte_order_mark = (read >= 3 && memcmp(start, "\xEF\xBB\xBF", 3) == 0);
+    if (has_byte_order_mark) {
+        start += 3;
+        read -= 3;
+    }
+    // Without a byte order mark, anything which isn't valid UTF-8 must be an older file in the ANSI code page.
+    UINT code_page = CP_UTF8;
+    DWORD flags = has_byte_order_mark ? 0 : MB_ERR_INVALID_CHARS;
+    length = (read == 0) ? 0 : ::MultiByteToWideChar(code_page, flags, start, (int)read, NULL, 0);
+    if (read > 0 && length == 0 && !has_byte_order_mark) {
+        code_page = CP_ACP;
+        flags = 0;
+        length = ::MultiByteToWideChar(code_page, flags, start, (int)read, NULL, 0);
+    }
+    text.reset(new wchar_t[length + 1]);
+    if (length > 0) {
+        ::MultiByteToWideChar(code_page, flags, start, (int)read, text.get(), (int)length);
+    }
+    if (byte_order_mark != NULL) {
+        *byte_order_mark = has_byte_order_mark;
+    }
+    return true;
+}
+
+wstring GetCredentialBasisFileName() {
+    // Statically cache the result, because this function may be called multiple times and it won't change.  The
+    // initialisation of a function-local static is thread-safe, which matters for the daemon.
+    static const wstring basis_file_name(FindCredentialBasisFileName());
+    return basis_file_name;
+}
+
+CredentialBases::CredentialBases()
+    : basis_by_pattern_(new GlobSet())
+{
+    first_entry_.push_back(0);
+}
+
+CredentialBases::CredentialBases(
+    unique_ptr<wchar_t[]> text,
+    vector<TextSpan> basis_names,
+    const vector<pair<size_t, TextSpan>>& entries
+)
+    : text_(move(text))
+    , basis_by_pattern_(new GlobSet())
+{
+    const size_t basis_count = basis_names.size();
+
+    // Sort the bases by name, remembering where each one moved to.
+    vector<size_t> order(basis_count);
+    for (size_t i = 0; i < basis_count; ++i) {
+        order[i] = i;
+    }
+    sort(order.begin(), order.end(), [&basis_names](size_t a, size_t b) {
+        return basis_names[a] < basis_names[b];
+    });
+    vector<size_t> sorted_index(basis_count);
+    names_.reserve(basis_count);
+    for (size_t i = 0; i < basis_count; ++i) {
+        sorted_index[order[i]] = i;
+        names_.push_back(basis_names[order[i]]);
+    }
+
+    // Counting sort the entries by basis, so that all the storage is allocated once and each basis's entries end
+    // up contiguous, in the order they appeared in the file.
+    first_entry_.assign(basis_count + 1, 0);
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        ++first_entry_[sorted_index[it->first] + 1];
+    }
+    for (size_t i = 0; i < basis_count; ++i) {
+        first_entry_[i + 1] += first_entry_[i];
+    }
+    vector<size_t> next_entry(first_entry_.begin(), first_entry_.end() - 1);
+    entries_.resize(entries.size());
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        entries_[next_entry[sorted_index[it->first]]++] = it->second;
+    }
+
+    basis_by_name_.reserve(basis_count);
+    basis_by_entry_.reserve(entries_.size());
+    for (size_t basis = 0; basis < basis_count; ++basis) {
+        basis_by_name_.emplace(names_[basis], basis);
+        for (size_t entry = first_entry_[basis]; entry < first_entry_[basis + 1]; ++entry) {
+            // emplace doesn't replace an existing key, so the first basis (in sorted order) wins; GlobSet likewise
+            // reports the smallest index.
+            if (IsGlobPattern(entries_[entry])) {
+                basis_by_pattern_->Add(entries_[entry], basis);
+            } else {
+                basis_by_entry_.emplace(entries_[entry], basis);
+            }
+        }
+    }
+}
+
+bool CredentialBases::IsBasis(const TextSpan& basis) const {
+    return basis_by_name_.find(basis) != basis_by_name_.end();
+}
+
+BasisEntries CredentialBases::EntriesFor(const TextSpan& basis) const {
+    auto found = basis_by_name_.find(basis);
+    if (found == basis_by_name_.end()) {
+        return BasisEntries(NULL, NULL);
+    }
+    const TextSpan* entries = entries_.data();
+    return BasisEntries(entries + first_entry_[found->second], entries + first_entry_[found->second + 1]);
+}
+
+bool CredentialBases::HasBasis(const TextSpan& credential_name) const {
+    return basis_by_entry_.find(credential_name) != basis_by_entry_.end()
+        || basis_by_pattern_->Match(credential_name) != GLOB_NO_MATCH;
+}
+
+const TextSpan* CredentialBases::BasisOf(const TextSpan& credential_name) const {
+    // A name may be listed literally under one basis and matched by a pattern under another, so take the first.
+    size_t basis = basis_by_pattern_->Match(credential_name);
+    auto found = basis_by_entry_.find(credential_name);
+    if (found != basis_by_entry_.end()) {
+        basis = min(basis, found->second);
+    }
+    return (basis == GLOB_NO_MATCH) ? NULL : &names_[basis];
+}
+
+vector<wstring> ExpandBasisEntry(const TextSpan& entry, const CredentialSnapshot& snapshot) {
+    vector<wstring> names;
+    if (!IsGlobPattern(entry)) {
+        names.push_back(entry.str());
+        return names;
+    }
+    const CredentialKind kinds[] = { CredentialKind::Git, CredentialKind::Mercurial };
+    for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); ++k) {
+        const auto& indexes = snapshot.OfKind(kinds[k]);
+        for (auto it = indexes.begin(); it != indexes.end(); ++it) {
+            const wchar_t* target_name = snapshot[*it]->TargetName;
+            if (GlobMatch(entry, target_name)) {
+                names.push_back(target_name);
+            }
+        }
+    }
+    sort(names.begin(), names.end());
+    return names;
+}
+
+CredentialBases ReadBases(const wstring& credentialBasisFileName) {
+    TraceSpan span("ReadBases", credentialBasisFileName.c_str());
+    unique_ptr<wchar_t[]> text;
+    size_t length = 0;
+    if (!ReadTextFile(credentialBasisFileName, text, length)) {
+        return CredentialBases();
+    }
+
+    vector<TextSpan> basis_names;
+    unordered_map<TextSpan, size_t, TextSpanHash> basis_indexes;
+    vector<size_t> entry_counts;
+    vector<pair<size_t, TextSpan>> entries;
+    const size_t NO_BASIS = (size_t)-1;
+    size_t current_basis = NO_BASIS;
+
+    // Scan the lines in place; each name is recorded as a span of the text, so no line is ever copied.
+    const wchar_t* next = text.get();
+    const wchar_t* const text_end = next + length;
+    unsigned long line_index = 0;
+    while (next < text_end) {
+        const wchar_t* line_begin = next;
+        const wchar_t* line_end = wmemchr(next, L'\n', text_end - next);
+        if (line_end == NULL) {
+            line_end = text_end;
+            next = text_end;
+        } else {
+            next = line_end + 1;
+        }
+        if (line_end > line_begin && line_end[-1] == L'\r') {
+            --line_end;
+        }
+        ++line_index;
+
+        // Trim whitespace from both ends of the line.
+        const wchar_t* trimmed_begin = line_begin;
+        while (trimmed_begin < line_end && iswspace(*trimmed_begin)) {
+            ++trimmed_begin;
+        }
+        const wchar_t* trimmed_end = line_end;
+        while (trimmed_end > trimmed_begin && iswspace(trimmed_end[-1])) {
+            --trimmed_end;
+        }
+        TextSpan trimmed_line(trimmed_begin, trimmed_end - trimmed_begin);
+
+        if (trimmed_line.empty() || *line_begin == L'#') {
+            // Ignore blank and comment lines.
+            continue;
+        } else if (iswspace(*line_begin)) {
+            if (current_basis == NO_BASIS) {
+                wcerr << L"WARNING: Ignoring entry '" << trimmed_line
+                    << L"' on line " << to_wstring(line_index) << L" of " << credentialBasisFileName
+                    << L" because no basis line has been encountered yet." << endl;
+            } else {
+                entries.push_back(make_pair(current_basis, trimmed_line));
+                ++entry_counts[current_basis];
+            }
+        } else {
+            // Warn the user if we haven't seen any entries under the current basis, before we set the next.
+            if (current_basis != NO_BASIS && entry_counts[current_basis] == 0) {
+                wcerr << L"WARNING: Basis credential " << basis_names[current_basis] << L" in "
+                    << credentialBasisFileName << L" has no credentials listed under it." << endl;
+            }
+            TextSpan line(line_begin, line_end - line_begin);
+            auto inserted = basis_indexes.emplace(line, basis_names.size());
+            if (inserted.second) {
+                basis_names.push_back(line);
+                entry_counts.push_back(0);
+            }
+            current_basis = inserted.first->second;
+        }
+    }
+
+    // Warn the user if we haven't seen any entries under the last basis.
+    if (current_basis != NO_BASIS && entry_counts[current_basis] == 0) {
+        wcerr << L"WARNING: Basis credential " << basis_names[current_basis] << L" in " << credentialBasisFileName
+            << L" has no credentials listed under it." << endl;
+    }
+
+    return CredentialBases(move(text), move(basis_names), entries);
+}
+
+const CredentialBases& GetBasisConfig() {
+    static const CredentialBases bases(ReadBases(GetCredentialBasisFileName()));
+    return bases;
+}
+
+list<wstring> GetDefaultCredentials(
+    const CredentialSnapshot& snapshot,
+    const CredentialBases& bases,
+    const wstring& username
+) {
+    list<wstring> defaultCredentials;
+
+    // The snapshot has already classified every credential and bucketed it by embedded username, so we
+    // only need to look at this user's credentials, and don't need to go back to the OS for any of them.
+    const auto& userCredentials = snapshot.ForUsername(username);
+    for (auto it = userCredentials.begin(); it != userCredentials.end(); ++it) {
+        PCREDENTIALW pCredential = snapshot[*it];
+        wstring target_name(pCredential->TargetName);
+
+        switch (snapshot.KindOf(*it)) {
+        case CredentialKind::Mercurial:
+        case CredentialKind::Git:
+            if (!bases.HasBasis(target_name)) {
+                defaultCredentials.push_back(target_name);
+            }
+            break;
+        case CredentialKind::Intrepid:
+            if (!bases.IsBasis(snapshot.PartsOf(*it).location)) {
+                defaultCredentials.push_back(target_name);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    return defaultCredentials;
+}
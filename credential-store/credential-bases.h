@@ -0,0 +1,120 @@
+#pragma once
+
+#include "credential-snapshot.h"
+#include "glob-matcher.h"
+#include "text-span.h"
+
+#include <string>
+#include <list>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+
+// The names of the credentials listed under one basis, as a contiguous range.
+class BasisEntries {
+public:
+    BasisEntries(const TextSpan* begin, const TextSpan* end) : begin_(begin), end_(end) {}
+
+    const TextSpan* begin() const { return begin_; }
+    const TextSpan* end() const { return end_; }
+    size_t size() const { return end_ - begin_; }
+    bool empty() const { return begin_ == end_; }
+
+private:
+    const TextSpan* begin_;
+    const TextSpan* end_;
+};
+
+/*
+    The contents of the credential basis file: a mapping from basis names to the names of the credentials listed
+    under them.  All names are spans of the file's text, which this object owns, so the only allocations are for the
+    text itself and the indexes.  The entries for all bases are kept in one vector, with each basis's entries
+    contiguous, and there is a hash-based reverse index from each credential name to its basis, so that checking
+    whether a credential is covered by any basis doesn't depend on the number of bases or entries.
+
+    An entry may also be a glob pattern, such as "git:https://scm.example.com/*", which covers every credential whose
+    name it matches.  Patterns are kept out of the hash index and compiled together into one GlobSet, so they add one
+    pass over the credential name to each check, however many there are.
+*/
+class CredentialBases {
+public:
+    CredentialBases();
+    CredentialBases(CredentialBases&& other) = default;
+
+    // Builds the bases from the text of the basis file, the names of the bases (in any order and without
+    // duplicates) and a list of entries, each given as the index of a basis name and the credential name.  All the
+    // spans must point into "text".
+    CredentialBases(
+        std::unique_ptr<wchar_t[]> text,
+        std::vector<TextSpan> basis_names,
+        const std::vector<std::pair<size_t, TextSpan>>& entries
+    );
+
+    // The basis names, in sorted order.
+    const std::vector<TextSpan>& Names() const { return names_; }
+
+    bool IsBasis(const TextSpan& basis) const;
+
+    // The credentials listed under a basis, including any patterns as written; empty if there is no such basis.
+    BasisEntries EntriesFor(const TextSpan& basis) const;
+
+    // Returns true if the credential is listed under any basis, or matches any pattern.
+    bool HasBasis(const TextSpan& credential_name) const;
+
+    // Returns the basis which the credential is listed under or matched by, or NULL if there is none.  If the
+    // credential is covered by more than one basis, the first in sorted order is returned.
+    const TextSpan* BasisOf(const TextSpan& credential_name) const;
+
+private:
+    CredentialBases(const CredentialBases&);
+    CredentialBases& operator=(const CredentialBases&);
+
+    std::unique_ptr<wchar_t[]> text_;
+    std::vector<TextSpan> names_;
+    std::vector<size_t> first_entry_; // One more element than names_, so basis i has entries [first_entry_[i], first_entry_[i + 1]).
+    std::vector<TextSpan> entries_;
+    std::unordered_map<TextSpan, size_t, TextSpanHash> basis_by_name_;
+    std::unordered_map<TextSpan, size_t, TextSpanHash> basis_by_entry_;
+    std::unique_ptr<GlobSet> basis_by_pattern_; // Held by pointer because it has a mutex, so can't be moved.
+};
+
+// Returns the names of the credentials which a basis entry stands for: the entry itself, if it isn't a pattern, or
+// else the Git and Mercurial credentials in the snapshot which match it, in sorted order.
+std::vector<std::wstring> ExpandBasisEntry(const TextSpan& entry, const CredentialSnapshot& snapshot);
+
+// Returns the current Windows username, or an empty string if it can't be found.
+std::wstring GetUserName();
+
+bool GetGradleUserHome(std::wstring& home);
+
+std::wstring GetCredentialBasisFileName();
+
+// Reads a whole text file with a single read, and converts it to wide characters.  The file is normally UTF-8 without
+// a byte order mark (as the Holy Gradle plugins write the basis file), but may have one; if "byte_order_mark" isn't
+// NULL, it's set to say which.  A file without a byte order mark which isn't valid UTF-8 is read in the ANSI code
+// page, as older versions wrote it.  Returns false if the file can't be read.
+bool ReadTextFile(
+    const std::wstring& file_name,
+    std::unique_ptr<wchar_t[]>& text,
+    size_t& length,
+    bool* byte_order_mark = NULL
+);
+
+// Reads and parses a basis file.  A missing file is treated as an empty one.
+CredentialBases ReadBases(const std::wstring& credentialBasisFileName);
+
+// Returns the parsed credential basis file for this process.  The file is read at most once, on first use, so all
+// commands share the same immutable copy.
+const CredentialBases& GetBasisConfig();
+
+// Returns the name of the basis for an "Intrepid - <name>" credential.
+std::wstring GetIntrepidCredentialName(const std::wstring& target_name);
+
+// Returns the names of all Git, Mercurial and Intrepid credentials for the given username which are not
+// covered by any basis.
+std::list<std::wstring> GetDefaultCredentials(
+    const CredentialSnapshot& snapshot,
+    const CredentialBases& bases,
+    const std::wstring& username
+);
@@ -0,0 +1,509 @@
+#include "stdafx.h"
+
+#include "credential-daemon.h"
+#include "credential-output.h"
+#include "credential-session.h"
+
+#include <aclapi.h>
+#include <sddl.h>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#pragma hdrstop
+
+#pragma comment(lib, "ws2_32.lib")
+
+#define DAEMON_PIPE_NAME_PREFIX L"\\\\.\\pipe\\holygradle-credential-store-"
+#define DAEMON_PIPE_BUFFER_SIZE 4096
+#define DAEMON_CONNECT_TIMEOUT_MILLISECONDS 2000
+#define UNIX_SOCKET_PATH_SIZE 108
+
+// The reparse tag of a Unix domain socket file, from ntifs.h in newer Windows SDKs.
+#ifndef IO_REPARSE_TAG_AF_UNIX
+#define IO_REPARSE_TAG_AF_UNIX 0x80000023L
+#endif
+
+using namespace std;
+
+namespace {
+    // Returns the current user's SID in a buffer which must be freed with LocalFree, or NULL on failure.
+    PSID GetCurrentUserSid() {
+        HANDLE token;
+        if (!::OpenProcessToken(::GetCurrentProcess(), TOKEN_QUERY, &token)) {
+            return NULL;
+        }
+        DWORD size = 0;
+        ::GetTokenInformation(token, TokenUser, NULL, 0, &size);
+        unique_ptr<BYTE[]> buffer(new BYTE[size]);
+        PSID sid = NULL;
+        if (::GetTokenInformation(token, TokenUser, buffer.get(), size, &size)) {
+            PSID user_sid = reinterpret_cast<TOKEN_USER*>(buffer.get())->User.Sid;
+            DWORD sid_size = ::GetLengthSid(user_sid);
+            sid = ::LocalAlloc(LPTR, sid_size);
+            if (sid != NULL) {
+                ::CopySid(sid_size, sid, user_sid);
+            }
+        }
+        ::CloseHandle(token);
+        return sid;
+    }
+
+    // Builds a security descriptor which only gives the current user access, so that other users on the same
+    // machine can't talk to the daemon.  The result must be freed with LocalFree.
+    PSECURITY_DESCRIPTOR CreateCurrentUserOnlyDescriptor() {
+        PSID sid = GetCurrentUserSid();
+        if (sid == NULL) {
+            return NULL;
+        }
+        LPWSTR sid_string = NULL;
+        PSECURITY_DESCRIPTOR descriptor = NULL;
+        if (::ConvertSidToStringSidW(sid, &sid_string)) {
+            wstring sddl(L"D:P(A;;GA;;;");
+            sddl += sid_string;
+            sddl += L")";
+            ::ConvertStringSecurityDescriptorToSecurityDescriptorW(
+                sddl.c_str(), SDDL_REVISION_1, &descriptor, NULL
+            );
+            ::LocalFree(sid_string);
+        }
+        ::LocalFree(sid);
+        return descriptor;
+    }
+
+    // Checks that the object behind "handle" (of type SE_KERNEL_OBJECT or SE_FILE_OBJECT) is owned by the current
+    // user.
+    bool IsOwnedByCurrentUser(HANDLE handle, SE_OBJECT_TYPE type) {
+        PSID owner = NULL;
+        PSECURITY_DESCRIPTOR descriptor = NULL;
+        if (::GetSecurityInfo(
+            handle, type, OWNER_SECURITY_INFORMATION, &owner, NULL, NULL, NULL, &descriptor
+        ) != ERROR_SUCCESS) {
+            return false;
+        }
+        PSID sid = GetCurrentUserSid();
+        bool owned = (sid != NULL && ::EqualSid(owner, sid));
+        if (sid != NULL) {
+            ::LocalFree(sid);
+        }
+        ::LocalFree(descriptor);
+        return owned;
+    }
+
+    // Checks that the server end of a pipe is owned by the current user, so that we never send a request (which
+    // may contain a password) to a pipe which another user created first.
+    bool IsOwnedByCurrentUser(HANDLE pipe) {
+        return IsOwnedByCurrentUser(pipe, SE_KERNEL_OBJECT);
+    }
+
+    // Opens a file or directory itself, rather than whatever a reparse point (such as a socket file) leads to, with
+    // enough access to read its owner and attributes as well as "access".
+    HANDLE OpenFileItself(const wstring& path, DWORD access) {
+        return ::CreateFileW(
+            path.c_str(),
+            access | READ_CONTROL | FILE_READ_ATTRIBUTES,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            NULL,
+            OPEN_EXISTING,
+            FILE_FLAG_OPEN_REPARSE_POINT | FILE_FLAG_BACKUP_SEMANTICS,
+            NULL
+        );
+    }
+
+    // Checks that the file or directory at "path" is owned by the current user.  Fails with ERROR_ACCESS_DENIED if
+    // it is owned by someone else.
+    bool IsPathOwnedByCurrentUser(const wstring& path) {
+        HANDLE file = OpenFileItself(path, 0);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        bool owned = IsOwnedByCurrentUser(file, SE_FILE_OBJECT);
+        ::CloseHandle(file);
+        if (!owned) {
+            ::SetLastError(ERROR_ACCESS_DENIED);
+        }
+        return owned;
+    }
+
+    /*
+        Checks that a socket at "path", and the directory it is in, are owned by the current user, so that no one
+        else can have put the socket there, or can swap it for theirs.  The client checks this before it sends a
+        request (which may contain a password), and the daemon checks the directory before it creates the socket.
+    */
+    bool IsSocketDirectoryOwnedByCurrentUser(const wstring& path) {
+        const size_t separator = path.find_last_of(L"\\/");
+        return IsPathOwnedByCurrentUser((separator == wstring::npos) ? wstring(L".") : path.substr(0, separator + 1));
+    }
+
+    bool IsSocketOwnedByCurrentUser(const wstring& path) {
+        return IsSocketDirectoryOwnedByCurrentUser(path) && IsPathOwnedByCurrentUser(path);
+    }
+
+    /*
+        Deletes the file at "path" if it is a socket which the current user created, so that a daemon can replace one
+        left by a daemon which has exited.  Anything else there is left alone, and the call fails with
+        ERROR_ALREADY_EXISTS (or ERROR_ACCESS_DENIED, if it belongs to someone else).  Succeeds if there is no file.
+    */
+    bool DeleteStaleSocket(const wstring& path) {
+        HANDLE file = OpenFileItself(path, DELETE);
+        if (file == INVALID_HANDLE_VALUE) {
+            return (::GetLastError() == ERROR_FILE_NOT_FOUND);
+        }
+        FILE_ATTRIBUTE_TAG_INFO tag_info;
+        bool ok = (::GetFileInformationByHandleEx(file, FileAttributeTagInfo, &tag_info, sizeof(tag_info)) != FALSE);
+        DWORD error = ::GetLastError();
+        if (ok && ((tag_info.FileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) == 0 ||
+            tag_info.ReparseTag != IO_REPARSE_TAG_AF_UNIX)
+        ) {
+            ok = false;
+            error = ERROR_ALREADY_EXISTS;
+        } else if (ok && !IsOwnedByCurrentUser(file, SE_FILE_OBJECT)) {
+            ok = false;
+            error = ERROR_ACCESS_DENIED;
+        }
+        if (ok) {
+            // Delete through the handle which was checked, so that it can't be a different file by then.
+            FILE_DISPOSITION_INFO disposition = { TRUE };
+            ok = (::SetFileInformationByHandle(file, FileDispositionInfo, &disposition, sizeof(disposition)) != FALSE);
+            error = ::GetLastError();
+        }
+        ::CloseHandle(file);
+        ::SetLastError(error);
+        return ok;
+    }
+
+    // Gives only the current user access to the socket at "path", whatever the directory it is in would give.
+    bool RestrictSocketToCurrentUser(const wstring& path) {
+        PSECURITY_DESCRIPTOR descriptor = CreateCurrentUserOnlyDescriptor();
+        if (descriptor == NULL) {
+            return false;
+        }
+        BOOL present = FALSE;
+        BOOL defaulted = FALSE;
+        PACL dacl = NULL;
+        bool ok = (::GetSecurityDescriptorDacl(descriptor, &present, &dacl, &defaulted) != FALSE);
+        if (ok) {
+            HANDLE file = OpenFileItself(path, WRITE_DAC);
+            ok = (file != INVALID_HANDLE_VALUE);
+            if (ok) {
+                DWORD error = ::SetSecurityInfo(
+                    file,
+                    SE_FILE_OBJECT,
+                    DACL_SECURITY_INFORMATION | PROTECTED_DACL_SECURITY_INFORMATION,
+                    NULL,
+                    NULL,
+                    dacl,
+                    NULL
+                );
+                ::CloseHandle(file);
+                ok = (error == ERROR_SUCCESS);
+                if (!ok) {
+                    ::SetLastError(error);
+                }
+            }
+        }
+        DWORD error = ::GetLastError();
+        ::LocalFree(descriptor);
+        ::SetLastError(error);
+        return ok;
+    }
+
+    void ServeClient(CredentialSession* session, HANDLE pipe) {
+        RunBatchSession(*session, pipe, pipe);
+        ::FlushFileBuffers(pipe);
+        ::DisconnectNamedPipe(pipe);
+        ::CloseHandle(pipe);
+    }
+
+    // The layout of sockaddr_un, from afunix.h, which older Windows SDKs don't have.
+    struct UnixSocketAddress {
+        ADDRESS_FAMILY sun_family;
+        char sun_path[UNIX_SOCKET_PATH_SIZE];
+    };
+
+    bool StartWinsock() {
+        WSADATA wsa_data;
+        return (::WSAStartup(MAKEWORD(2, 2), &wsa_data) == 0);
+    }
+
+    // Returns false if the path, in UTF-8, is too long for a socket address.
+    bool GetUnixSocketAddress(const wstring& path, UnixSocketAddress& address) {
+        const string utf8_path(ToUtf8(path));
+        if (utf8_path.empty() || utf8_path.size() >= UNIX_SOCKET_PATH_SIZE) {
+            ::WSASetLastError(WSAENAMETOOLONG);
+            return false;
+        }
+        ZeroMemory(&address, sizeof(address));
+        address.sun_family = AF_UNIX;
+        memcpy(address.sun_path, utf8_path.c_str(), utf8_path.size() + 1);
+        return true;
+    }
+
+    // Without WSA_FLAG_OVERLAPPED, so that the socket can be read and written with ReadFile and WriteFile.
+    SOCKET CreateUnixSocket() {
+        return ::WSASocketW(AF_UNIX, SOCK_STREAM, 0, NULL, 0, 0);
+    }
+
+    // Returns INVALID_SOCKET, with the Winsock error set, if nothing is listening at the address.
+    SOCKET ConnectUnixSocket(const UnixSocketAddress& address) {
+        SOCKET connection = CreateUnixSocket();
+        if (connection != INVALID_SOCKET &&
+            ::connect(connection, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+        ) {
+            const int error = ::WSAGetLastError();
+            ::closesocket(connection);
+            ::WSASetLastError(error);
+            connection = INVALID_SOCKET;
+        }
+        return connection;
+    }
+
+    void WriteServingMessage(const wstring& endpoint, DWORD ttl_seconds) {
+        wcout << L"Serving credentials on " << endpoint << L" (cache TTL ";
+        if (ttl_seconds == 0) {
+            wcout << L"unlimited";
+        } else {
+            wcout << ttl_seconds << L"s";
+        }
+        wcout << L")." << endl;
+    }
+
+    int ServeOnSocket(CredentialSession& session, DWORD ttl_seconds, const wstring& socket_path) {
+        SocketDaemon daemon(session);
+        if (!daemon.Listen(socket_path)) {
+            const int error = ::WSAGetLastError();
+            wcerr << L"ERROR: Failed to listen on " << socket_path << L" - errno " << error << endl;
+            if (error == WSAEADDRINUSE) {
+                wcerr << L"Is another credential-store daemon already running?" << endl;
+            } else if (error == ERROR_ALREADY_EXISTS) {
+                wcerr << L"There is a file there which isn't a socket left by this user's daemon." << endl;
+            } else if (error == ERROR_ACCESS_DENIED) {
+                wcerr << L"The socket must be in a directory owned by the current user." << endl;
+            }
+            return 1;
+        }
+        WriteServingMessage(socket_path, ttl_seconds);
+        daemon.Serve();
+        return 1;
+    }
+}
+
+wstring GetDaemonPipeName() {
+    return DAEMON_PIPE_NAME_PREFIX + GetUserName();
+}
+
+SocketDaemon::SocketDaemon(CredentialSession& session)
+    : session_(session)
+    , stopping_(false)
+    , listener_(INVALID_SOCKET)
+{
+}
+
+SocketDaemon::~SocketDaemon() {
+    Stop();
+}
+
+bool SocketDaemon::Listen(const wstring& path) {
+    UnixSocketAddress address;
+    if (!StartWinsock() || !GetUnixSocketAddress(path, address) || !IsSocketDirectoryOwnedByCurrentUser(path)) {
+        return false;
+    }
+    // Never take over from a daemon which is still answering, as FILE_FLAG_FIRST_PIPE_INSTANCE does for the pipe.
+    SOCKET running = ConnectUnixSocket(address);
+    if (running != INVALID_SOCKET) {
+        ::closesocket(running);
+        ::WSASetLastError(WSAEADDRINUSE);
+        return false;
+    }
+    // Binding fails if the file exists, even if nothing is listening on it any more.
+    if (!DeleteStaleSocket(path)) {
+        return false;
+    }
+
+    lock_guard<mutex> lock(mutex_);
+    listener_ = CreateUnixSocket();
+    const bool bound = (listener_ != INVALID_SOCKET) &&
+        ::bind(listener_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+    // No one can connect until listen() is called, so restricting the socket file first leaves no gap.
+    if (!bound || !RestrictSocketToCurrentUser(path) || ::listen(listener_, SOMAXCONN) != 0) {
+        const int error = ::WSAGetLastError();
+        if (listener_ != INVALID_SOCKET) {
+            ::closesocket(listener_);
+            listener_ = INVALID_SOCKET;
+        }
+        if (bound) {
+            ::DeleteFileW(path.c_str());
+        }
+        ::WSASetLastError(error);
+        return false;
+    }
+    path_ = path;
+    return true;
+}
+
+void SocketDaemon::Serve() {
+    SOCKET listener;
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (stopping_) {
+            return;
+        }
+        listener = listener_;
+    }
+    for (;;) {
+        SOCKET client = ::accept(listener, NULL, NULL);
+        lock_guard<mutex> lock(mutex_);
+        if (stopping_) {
+            if (client != INVALID_SOCKET) {
+                ::closesocket(client);
+            }
+            return;
+        }
+        if (client != INVALID_SOCKET) {
+            clients_.insert(client);
+            thread(&SocketDaemon::ServeClient, this, client).detach();
+        }
+    }
+}
+
+void SocketDaemon::ServeClient(SOCKET client) {
+    RunBatchSession(session_, (HANDLE)client, (HANDLE)client);
+    unique_lock<mutex> lock(mutex_);
+    clients_.erase(client);
+    ::closesocket(client);
+    // Stop may destroy this object as soon as it sees no clients, so wake it only once this thread is done with it.
+    notify_all_at_thread_exit(clients_changed_, move(lock));
+}
+
+void SocketDaemon::Stop() {
+    unique_lock<mutex> lock(mutex_);
+    stopping_ = true;
+    if (listener_ != INVALID_SOCKET) {
+        // Closing the socket wakes a thread blocked in accept() on Windows; elsewhere, shutting it down does.
+        ::shutdown(listener_, SD_BOTH);
+        ::closesocket(listener_);
+        listener_ = INVALID_SOCKET;
+        ::DeleteFileW(path_.c_str());
+    }
+    // Each client's thread finishes once its connection is shut down, whatever it was waiting for.
+    for (auto it = clients_.begin(); it != clients_.end(); ++it) {
+        ::shutdown(*it, SD_BOTH);
+    }
+    clients_changed_.wait(lock, [this]() { return clients_.empty(); });
+}
+
+bool SendSocketRequest(const wstring& path, const vector<wstring>& request, SessionResponse& response) {
+    UnixSocketAddress address;
+    if (!StartWinsock() || !GetUnixSocketAddress(path, address) || !IsSocketOwnedByCurrentUser(path)) {
+        return false;
+    }
+    SOCKET connection = ConnectUnixSocket(address);
+    if (connection == INVALID_SOCKET) {
+        return false;
+    }
+    const bool ok = WriteRequest((HANDLE)connection, request) && ReadResponse((HANDLE)connection, response);
+    ::closesocket(connection);
+    return ok;
+}
+
+int ServeCredentials(CredentialBackend& backend, DWORD ttl_seconds, const wstring& socket_path) {
+    // The session is shared by all client threads, and lives as long as the process.
+    if (ttl_seconds > MAX_DAEMON_TTL_SECONDS) {
+        ttl_seconds = MAX_DAEMON_TTL_SECONDS;
+    }
+    CredentialSession* session = new CredentialSession(
+        backend,
+        (ttl_seconds == 0) ? INFINITE : ttl_seconds * 1000
+    );
+    if (!socket_path.empty()) {
+        return ServeOnSocket(*session, ttl_seconds, socket_path);
+    }
+
+    wstring pipe_name = GetDaemonPipeName();
+    PSECURITY_DESCRIPTOR descriptor = CreateCurrentUserOnlyDescriptor();
+    if (descriptor == NULL) {
+        wcerr << L"ERROR: Failed to create security descriptor for " << pipe_name
+            << L" - errno " << ::GetLastError() << endl;
+        return 1;
+    }
+    SECURITY_ATTRIBUTES security_attributes = { sizeof(SECURITY_ATTRIBUTES), descriptor, FALSE };
+    WriteServingMessage(pipe_name, ttl_seconds);
+
+    DWORD open_mode = PIPE_ACCESS_DUPLEX | FILE_FLAG_FIRST_PIPE_INSTANCE;
+    for (;;) {
+        HANDLE pipe = ::CreateNamedPipeW(
+            pipe_name.c_str(),
+            open_mode,
+            PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+            PIPE_UNLIMITED_INSTANCES,
+            DAEMON_PIPE_BUFFER_SIZE,
+            DAEMON_PIPE_BUFFER_SIZE,
+            0,
+            &security_attributes
+        );
+        if (pipe == INVALID_HANDLE_VALUE) {
+            wcerr << L"ERROR: Failed to create " << pipe_name << L" - errno " << ::GetLastError() << endl;
+            wcerr << L"Is another credential-store daemon already running?" << endl;
+            ::LocalFree(descriptor);
+            return 1;
+        }
+        // Only the first instance may be created with FILE_FLAG_FIRST_PIPE_INSTANCE.
+        open_mode = PIPE_ACCESS_DUPLEX;
+
+        bool connected = ::ConnectNamedPipe(pipe, NULL) ? true : (::GetLastError() == ERROR_PIPE_CONNECTED);
+        if (connected) {
+            thread(ServeClient, session, pipe).detach();
+        } else {
+            ::CloseHandle(pipe);
+        }
+    }
+}
+
+int SendDaemonRequest(const wstring& socket_path, const vector<wstring>& request) {
+    SessionResponse response;
+    if (!socket_path.empty()) {
+        if (!SendSocketRequest(socket_path, request, response)) {
+            const int error = ::WSAGetLastError();
+            if (error == ERROR_ACCESS_DENIED) {
+                wcerr << L"ERROR: " << socket_path << L" or its directory is not owned by the current user." << endl;
+            } else {
+                wcerr << L"ERROR: Failed to get a response from " << socket_path << L" - errno " << error << endl;
+            }
+            return 1;
+        }
+    } else {
+        wstring pipe_name = GetDaemonPipeName();
+        HANDLE pipe;
+        for (;;) {
+            pipe = ::CreateFileW(pipe_name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+            if (pipe != INVALID_HANDLE_VALUE) {
+                break;
+            }
+            if (::GetLastError() != ERROR_PIPE_BUSY ||
+                !::WaitNamedPipeW(pipe_name.c_str(), DAEMON_CONNECT_TIMEOUT_MILLISECONDS)
+            ) {
+                wcerr << L"ERROR: Failed to connect to " << pipe_name << L" - errno " << ::GetLastError() << endl;
+                return 1;
+            }
+        }
+
+        if (!IsOwnedByCurrentUser(pipe)) {
+            wcerr << L"ERROR: " << pipe_name << L" is not owned by the current user." << endl;
+            ::CloseHandle(pipe);
+            return 1;
+        }
+
+        bool ok = WriteRequest(pipe, request) && ReadResponse(pipe, response);
+        ::CloseHandle(pipe);
+        if (!ok) {
+            wcerr << L"ERROR: Failed to get a response from " << pipe_name << endl;
+            return 1;
+        }
+    }
+
+    OutputBuffer output;
+    output.Reserve(response.payload.size() * 3);
+    output.AppendUtf8(response.payload.data(), response.payload.size());
+    output.WriteTo(::GetStdHandle(response.ok ? STD_OUTPUT_HANDLE : STD_ERROR_HANDLE));
+    return response.ok ? 0 : 1;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "credential-backend.h"
+#include "credential-session.h"
+
+#include <winsock2.h>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#define DEFAULT_DAEMON_TTL_SECONDS 300
+// The longest TTL whose milliseconds fit in a DWORD without reaching INFINITE (about 49 days).
+#define MAX_DAEMON_TTL_SECONDS ((INFINITE - 1) / 1000)
+#define DAEMON_SOCKET_OPTION L"--socket="
+
+// The name of the pipe on which the current user's daemon listens.
+std::wstring GetDaemonPipeName();
+
+/*
+    Serves requests on a Unix domain socket, in the same format as on the daemon pipe, for platforms without named
+    pipes and for tests.  (Windows has these sockets from Windows 10 version 1803.)  The socket must be in a directory
+    owned by the current user, and only the current user is given access to it; clients also check that both are
+    owned by the current user before sending anything.
+
+    Each client connection is handled on its own thread, out of the one shared session.  The accepted sockets are
+    used directly as handles for RunBatchSession, which reads and writes them with ReadFile and WriteFile; that works
+    because they are created without overlapped I/O.
+*/
+class SocketDaemon {
+public:
+    explicit SocketDaemon(CredentialSession& session);
+    // Stops serving, if it still is.
+    ~SocketDaemon();
+
+    // Creates the socket file at "path" and listens on it.  Fails if another daemon is already answering there; a
+    // socket left there by one of the current user's daemons which has exited is replaced, but any other file is
+    // not.  Returns false, with the Winsock error set, on failure.
+    bool Listen(const std::wstring& path);
+    // Accepts clients until Stop is called.
+    void Serve();
+    // Stops accepting clients, closes every client connection, waits for their threads to finish, and removes the
+    // socket file.  Serve then returns.
+    void Stop();
+
+private:
+    SocketDaemon(const SocketDaemon&);
+    SocketDaemon& operator=(const SocketDaemon&);
+
+    void ServeClient(SOCKET client);
+
+    CredentialSession& session_;
+    std::wstring path_;
+    std::mutex mutex_;
+    std::condition_variable clients_changed_;
+    bool stopping_;
+    SOCKET listener_;
+    std::set<SOCKET> clients_;
+};
+
+// Sends one request to the daemon listening on the Unix domain socket at "path", and reads its response.  Returns
+// false if it can't connect, or doesn't get a whole response; the error is ERROR_ACCESS_DENIED if the socket or its
+// directory isn't owned by the current user.
+bool SendSocketRequest(
+    const std::wstring& path,
+    const std::vector<std::wstring>& request,
+    SessionResponse& response
+);
+
+/*
+    Listens on the current user's daemon pipe, or on the Unix domain socket at "socket_path" if that isn't empty, and
+    answers requests from all clients out of one shared, cached CredentialSession.  Each client connection is handled
+    on its own thread, and may send any number of requests, in the same format as for the "batch" command.  The cache
+    TTL is "ttl_seconds", up to MAX_DAEMON_TTL_SECONDS, or unlimited if that is 0.  Only returns if the pipe or
+    socket can't be created.
+*/
+int ServeCredentials(CredentialBackend& backend, DWORD ttl_seconds, const std::wstring& socket_path);
+
+// Sends one request to the current user's daemon, on its pipe or on the socket at "socket_path" if that isn't empty,
+// and writes the response content to standard output.  Returns the process exit code.
+int SendDaemonRequest(const std::wstring& socket_path, const std::vector<std::wstring>& request);
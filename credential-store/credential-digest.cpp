@@ -0,0 +1,65 @@
+#include "stdafx.h"
+
+#include "credential-digest.h"
+
+#pragma hdrstop
+
+#pragma comment(lib, "bcrypt.lib")
+
+using namespace std;
+
+namespace {
+    bool Succeeded(NTSTATUS status) {
+        if (!BCRYPT_SUCCESS(status)) {
+            // BCrypt reports NTSTATUS codes rather than setting the last error; this is close enough for messages.
+            ::SetLastError((DWORD)status);
+            return false;
+        }
+        return true;
+    }
+}
+
+CredentialDigester::CredentialDigester()
+    : algorithm_(NULL)
+{
+    BCRYPT_ALG_HANDLE algorithm = NULL;
+    if (!Succeeded(::BCryptOpenAlgorithmProvider(
+        &algorithm, BCRYPT_SHA256_ALGORITHM, NULL, BCRYPT_ALG_HANDLE_HMAC_FLAG
+    ))) {
+        return;
+    }
+    if (!Succeeded(::BCryptGenRandom(NULL, key_, sizeof(key_), BCRYPT_USE_SYSTEM_PREFERRED_RNG))) {
+        ::BCryptCloseAlgorithmProvider(algorithm, 0);
+        return;
+    }
+    algorithm_ = algorithm;
+}
+
+CredentialDigester::~CredentialDigester() {
+    SecureZeroMemory(key_, sizeof(key_));
+    if (algorithm_ != NULL) {
+        ::BCryptCloseAlgorithmProvider(algorithm_, 0);
+    }
+}
+
+bool CredentialDigester::Digest(const BYTE* data, size_t size, BYTE (&digest)[CREDENTIAL_DIGEST_SIZE]) const {
+    if (algorithm_ == NULL) {
+        ::SetLastError(ERROR_INVALID_HANDLE);
+        return false;
+    }
+    // Letting BCrypt allocate the hash object keeps this safe to call from several threads with one handle.
+    BCRYPT_HASH_HANDLE hash = NULL;
+    bool ok = Succeeded(::BCryptCreateHash(
+        algorithm_, &hash, NULL, 0, const_cast<BYTE*>(key_), sizeof(key_), 0
+    ));
+    if (ok && size > 0) {
+        ok = Succeeded(::BCryptHashData(hash, const_cast<BYTE*>(data), (ULONG)size, 0));
+    }
+    if (ok) {
+        ok = Succeeded(::BCryptFinishHash(hash, digest, sizeof(digest), 0));
+    }
+    if (hash != NULL) {
+        ::BCryptDestroyHash(hash);
+    }
+    return ok;
+}
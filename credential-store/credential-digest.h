@@ -0,0 +1,31 @@
+#pragma once
+
+#include <windows.h>
+#include <bcrypt.h>
+
+#define CREDENTIAL_DIGEST_SIZE 32
+
+/*
+    Keyed, one-way digests (HMAC-SHA256) of credential blobs, for telling whether two credentials hold the same secret
+    without showing either.  The key is chosen at random when the digester is created, so equal blobs have equal
+    digests within one run, but a digest can't be compared with one from another run, or used to check guesses at the
+    password offline.  A digester may be used from several threads at once.
+*/
+class CredentialDigester {
+public:
+    CredentialDigester();
+    ~CredentialDigester();
+
+    // False if the algorithm or the key couldn't be set up; Digest then always fails.
+    bool ok() const { return algorithm_ != NULL; }
+
+    // Returns false, with the reason from GetLastError(), if the digest couldn't be computed.
+    bool Digest(const BYTE* data, size_t size, BYTE (&digest)[CREDENTIAL_DIGEST_SIZE]) const;
+
+private:
+    CredentialDigester(const CredentialDigester&);
+    CredentialDigester& operator=(const CredentialDigester&);
+
+    BCRYPT_ALG_HANDLE algorithm_;
+    BYTE key_[CREDENTIAL_DIGEST_SIZE];
+};
@@ -0,0 +1,252 @@
+#include "stdafx.h"
+
+#include "credential-output.h"
+#include "credential-session.h"
+#include "ignore-case.h"
+
+#include <cstdio>
+
+#pragma hdrstop
+
+using namespace std;
+
+bool ParseOutputFormat(const wstring& name, OutputFormat& format) {
+    if (EqualsIgnoreCase(name, L"text")) {
+        format = OutputFormat::Text;
+    } else if (EqualsIgnoreCase(name, L"binary")) {
+        format = OutputFormat::Binary;
+    } else if (EqualsIgnoreCase(name, L"json")) {
+        format = OutputFormat::Json;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+OutputBuffer::~OutputBuffer() {
+    Wipe();
+}
+
+void OutputBuffer::Wipe() {
+    // This covers the whole of the storage in use, including a short string held within the object itself.
+    SecureZeroMemory(&buffer_[0], buffer_.capacity());
+}
+
+void OutputBuffer::AppendByte(uint8_t value) {
+    buffer_.push_back((char)value);
+}
+
+void OutputBuffer::AppendUInt32(uint32_t value) {
+    for (int shift = 0; shift < 32; shift += 8) {
+        buffer_.push_back((char)((value >> shift) & 0xFF));
+    }
+}
+
+void OutputBuffer::AppendAscii(const char* text) {
+    buffer_.append(text);
+}
+
+void OutputBuffer::AppendUtf8(const wchar_t* text, size_t length) {
+    AppendText(text, length, CP_UTF8);
+}
+
+void OutputBuffer::AppendText(const wchar_t* text, size_t length, UINT code_page) {
+    if (length == 0) {
+        return;
+    }
+    int size = ::WideCharToMultiByte(code_page, 0, text, (int)length, NULL, 0, NULL, NULL);
+    if (size <= 0) {
+        return;
+    }
+    size_t start = buffer_.size();
+    buffer_.resize(start + size);
+    ::WideCharToMultiByte(code_page, 0, text, (int)length, &buffer_[start], size, NULL, NULL);
+}
+
+void OutputBuffer::AppendLengthPrefixedUtf8(const wchar_t* text, size_t length) {
+    // Leave room for the length, convert, then fill the length in.
+    size_t length_pos = buffer_.size();
+    AppendUInt32(0);
+    AppendUtf8(text, length);
+    uint32_t size = (uint32_t)(buffer_.size() - length_pos - 4);
+    for (int i = 0; i < 4; ++i) {
+        buffer_[length_pos + i] = (char)((size >> (8 * i)) & 0xFF);
+    }
+}
+
+void OutputBuffer::AppendJsonString(const wchar_t* text, size_t length) {
+    buffer_.push_back('"');
+    size_t run_start = 0;
+    for (size_t i = 0; i < length; ++i) {
+        wchar_t c = text[i];
+        if (c >= 0x20 && c != L'"' && c != L'\\') {
+            continue;
+        }
+        AppendUtf8(text + run_start, i - run_start);
+        run_start = i + 1;
+        if (c == L'"' || c == L'\\') {
+            buffer_.push_back('\\');
+            buffer_.push_back((char)c);
+        } else {
+            char escape[7];
+            sprintf_s(escape, sizeof(escape), "\\u%04x", (unsigned)c);
+            buffer_.append(escape);
+        }
+    }
+    AppendUtf8(text + run_start, length - run_start);
+    buffer_.push_back('"');
+}
+
+void OutputBuffer::AppendCsvField(const wchar_t* text, size_t length) {
+    bool needs_quotes = false;
+    for (size_t i = 0; i < length && !needs_quotes; ++i) {
+        wchar_t c = text[i];
+        needs_quotes = (c == L',' || c == L'"' || c == L'\r' || c == L'\n');
+    }
+    if (!needs_quotes) {
+        AppendUtf8(text, length);
+        return;
+    }
+    buffer_.push_back('"');
+    size_t run_start = 0;
+    for (size_t i = 0; i < length; ++i) {
+        if (text[i] == L'"') {
+            // Write up to and including the quote, then start the next run with it, so that it appears twice.
+            AppendUtf8(text + run_start, i + 1 - run_start);
+            run_start = i;
+        }
+    }
+    AppendUtf8(text + run_start, length - run_start);
+    buffer_.push_back('"');
+}
+
+void OutputBuffer::AppendDecimal(uint64_t value) {
+    char digits[20];
+    size_t count = 0;
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    while (count > 0) {
+        buffer_.push_back(digits[--count]);
+    }
+}
+
+void OutputBuffer::AppendHex(const uint8_t* data, size_t size) {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    for (size_t i = 0; i < size; ++i) {
+        buffer_.push_back(HEX_DIGITS[data[i] >> 4]);
+        buffer_.push_back(HEX_DIGITS[data[i] & 0xF]);
+    }
+}
+
+bool OutputBuffer::WriteTo(HANDLE out) const {
+    return WriteAll(out, buffer_.data(), buffer_.size());
+}
+
+bool OutputBuffer::FlushTo(HANDLE out) {
+    bool ok = buffer_.empty() || WriteAll(out, buffer_.data(), buffer_.size());
+    Wipe();
+    buffer_.clear();
+    return ok;
+}
+
+namespace {
+    const wchar_t* UserNameOf(const CREDENTIALW& credential, size_t& length) {
+        const wchar_t* user_name = (credential.UserName == NULL) ? L"" : credential.UserName;
+        length = wcslen(user_name);
+        return user_name;
+    }
+
+    const wchar_t* PasswordOf(const CREDENTIALW& credential, size_t& length) {
+        length = credential.CredentialBlobSize / sizeof(wchar_t);
+        return (const wchar_t*)credential.CredentialBlob;
+    }
+}
+
+size_t MaxCredentialRecordsSize(const vector<wstring>& target_names, const vector<CredentialPtr>& credentials) {
+    // A UTF-16 unit takes at most three bytes of UTF-8, or six as a JSON escape; the rest is punctuation, lengths
+    // and error codes, which need well under a hundred bytes a record.
+    size_t units = 0;
+    for (size_t i = 0; i < credentials.size(); ++i) {
+        units += target_names[i].size();
+        if (credentials[i]) {
+            size_t length;
+            UserNameOf(*credentials[i], length);
+            units += length;
+            PasswordOf(*credentials[i], length);
+            units += length;
+        }
+    }
+    return units * 6 + credentials.size() * 100 + 8;
+}
+
+void AppendCredentialRecords(
+    const vector<wstring>& target_names,
+    const vector<CredentialPtr>& credentials,
+    const vector<DWORD>& errors,
+    OutputFormat format,
+    OutputBuffer& output
+) {
+    size_t length;
+    if (format == OutputFormat::Binary) {
+        output.AppendUInt32((uint32_t)credentials.size());
+        for (auto it = credentials.begin(); it != credentials.end(); ++it) {
+            if (!*it) {
+                output.AppendByte(0);
+                continue;
+            }
+            output.AppendByte(1);
+            const wchar_t* user_name = UserNameOf(**it, length);
+            output.AppendLengthPrefixedUtf8(user_name, length);
+            const wchar_t* password = PasswordOf(**it, length);
+            output.AppendLengthPrefixedUtf8(password, length);
+        }
+    } else if (format == OutputFormat::Json) {
+        const bool as_array = (credentials.size() != 1);
+        if (as_array) {
+            output.AppendAscii("[");
+        }
+        for (size_t i = 0; i < credentials.size(); ++i) {
+            if (i > 0) {
+                output.AppendAscii(",");
+            }
+            output.AppendAscii("{\"target\":");
+            output.AppendJsonString(target_names[i].data(), target_names[i].size());
+            if (credentials[i]) {
+                output.AppendAscii(",\"username\":");
+                const wchar_t* user_name = UserNameOf(*credentials[i], length);
+                output.AppendJsonString(user_name, length);
+                output.AppendAscii(",\"password\":");
+                const wchar_t* password = PasswordOf(*credentials[i], length);
+                output.AppendJsonString(password, length);
+            } else {
+                char error[32];
+                sprintf_s(error, sizeof(error), ",\"error\":%lu", (unsigned long)errors[i]);
+                output.AppendAscii(error);
+            }
+            output.AppendAscii("}");
+        }
+        if (as_array) {
+            output.AppendAscii("]");
+        }
+        output.AppendAscii("\n");
+    }
+}
+
+size_t MaxCredentialTextSize(const CREDENTIALW& credential) {
+    // No code page takes more than four bytes for a UTF-16 unit.
+    size_t user_name_length, password_length;
+    UserNameOf(credential, user_name_length);
+    PasswordOf(credential, password_length);
+    return (user_name_length + 3 + password_length) * 4;
+}
+
+void AppendCredentialText(const CREDENTIALW& credential, UINT code_page, OutputBuffer& output) {
+    size_t length;
+    const wchar_t* user_name = UserNameOf(credential, length);
+    output.AppendText(user_name, length, code_page);
+    output.AppendAscii("&&&");
+    const wchar_t* password = PasswordOf(credential, length);
+    output.AppendText(password, length, code_page);
+}
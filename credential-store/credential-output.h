@@ -0,0 +1,97 @@
+#pragma once
+
+#include "credential-backend.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define FORMAT_OPTION L"--format="
+
+// How the "get" command writes the credentials it reads.
+enum class OutputFormat {
+    Text,   // "<username>&&&<password>", as UTF-16 text through the console.
+    Binary, // Length-prefixed UTF-8; see AppendCredentialRecords.
+    Json    // UTF-8 JSON.
+};
+
+// Parses "text", "binary" or "json", ignoring case; returns false for anything else.
+bool ParseOutputFormat(const std::wstring& name, OutputFormat& format);
+
+/*
+    Bytes to be written to an output handle all at once.  Text is converted to UTF-8 straight into the buffer.  The
+    output often includes passwords, so the buffer is zeroed when it is flushed or destroyed, and any storage it
+    outgrows is zeroed before it is freed.  Reserve enough up front, and it never moves at all.
+*/
+class OutputBuffer {
+public:
+    OutputBuffer() {}
+    ~OutputBuffer();
+
+    void Reserve(size_t size) { buffer_.reserve(size); }
+
+    void AppendByte(uint8_t value);
+    // Little-endian.
+    void AppendUInt32(uint32_t value);
+    void AppendAscii(const char* text);
+    void AppendUtf8(const wchar_t* text, size_t length);
+    // In any code page which WideCharToMultiByte knows, such as CP_ACP.
+    void AppendText(const wchar_t* text, size_t length, UINT code_page);
+    // A little-endian 32-bit byte count, followed by the text as UTF-8.
+    void AppendLengthPrefixedUtf8(const wchar_t* text, size_t length);
+    // A JSON string literal, with quotes and escapes.
+    void AppendJsonString(const wchar_t* text, size_t length);
+    // A CSV field, quoted (with quotes doubled) only if it contains a comma, a quote or a line break.
+    void AppendCsvField(const wchar_t* text, size_t length);
+    void AppendDecimal(uint64_t value);
+    // Lower-case hex digits, two per byte.
+    void AppendHex(const uint8_t* data, size_t size);
+
+    const char* data() const { return buffer_.data(); }
+    size_t size() const { return buffer_.size(); }
+
+    // Writes the whole buffer with as few calls as the handle allows.
+    bool WriteTo(HANDLE out) const;
+
+    // Writes the whole buffer, then empties it, keeping its storage for the next lot of output.
+    bool FlushTo(HANDLE out);
+
+private:
+    OutputBuffer(const OutputBuffer&);
+    OutputBuffer& operator=(const OutputBuffer&);
+
+    void Wipe();
+
+    std::basic_string<char, std::char_traits<char>, WipingAllocator<char>> buffer_;
+};
+
+/*
+    Appends the credentials read for a list of target names, where a NULL credential means that it couldn't be
+    read, in the given binary or JSON format:
+
+    Binary: a uint32 record count, then for each record a status byte, which is 1 if the credential was found and
+    0 if not; found records are followed by the length-prefixed username and password.  All integers are
+    little-endian, and all text is UTF-8.
+
+    JSON: for each record, {"target": ..., "username": ..., "password": ...} if it was found, or {"target": ...,
+    "error": <Win32 error code>} if not.  A single target name gives a single object; several give an array.
+*/
+// The most bytes AppendCredentialRecords can append for these credentials, so that the buffer can be reserved once.
+size_t MaxCredentialRecordsSize(
+    const std::vector<std::wstring>& target_names,
+    const std::vector<CredentialPtr>& credentials
+);
+
+void AppendCredentialRecords(
+    const std::vector<std::wstring>& target_names,
+    const std::vector<CredentialPtr>& credentials,
+    const std::vector<DWORD>& errors,
+    OutputFormat format,
+    OutputBuffer& output
+);
+
+// The most bytes AppendCredentialText can append for this credential, in any code page.
+size_t MaxCredentialTextSize(const CREDENTIALW& credential);
+
+// Appends a credential in the text format, "<username>&&&<password>", in the given code page.
+void AppendCredentialText(const CREDENTIALW& credential, UINT code_page, OutputBuffer& output);
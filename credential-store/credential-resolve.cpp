@@ -0,0 +1,101 @@
+#include "stdafx.h"
+
+#include "credential-resolve.h"
+#include "glob-matcher.h"
+#include "ignore-case.h"
+
+#pragma hdrstop
+
+using namespace std;
+
+CredentialResolver::CredentialResolver(const CredentialSnapshot& snapshot, const CredentialBases& bases) {
+    const vector<size_t>* kinds[] = {
+        &snapshot.OfKind(CredentialKind::Git),
+        &snapshot.OfKind(CredentialKind::Mercurial)
+    };
+    for (size_t k = 0; k < 2; ++k) {
+        for (auto it = kinds[k]->begin(); it != kinds[k]->end(); ++it) {
+            AddCandidate(snapshot[*it]->TargetName, snapshot[*it]->TargetName, true);
+        }
+    }
+
+    // A basis entry which isn't stored yet will be written with its basis's password, so until then the basis
+    // credential is the one to use, if that is stored.
+    const vector<TextSpan>& names = bases.Names();
+    for (auto name = names.begin(); name != names.end(); ++name) {
+        const wstring basis_target_name = HOLY_GRADLE_CREDENTIAL_PREFIX + name->str();
+        if (snapshot.Find(basis_target_name) == NULL) {
+            continue;
+        }
+        const BasisEntries entries = bases.EntriesFor(*name);
+        for (auto entry = entries.begin(); entry != entries.end(); ++entry) {
+            if (!IsGlobPattern(*entry) && snapshot.Find(entry->str()) == NULL) {
+                AddCandidate(*entry, basis_target_name, false);
+            }
+        }
+    }
+}
+
+void CredentialResolver::AddCandidate(const TextSpan& target_name, const wstring& resolved_name, bool stored) {
+    const TargetNameParts parts = ParseTargetName(target_name.data, target_name.size);
+    if (parts.kind != CredentialKind::Git && parts.kind != CredentialKind::Mercurial) {
+        return;
+    }
+    wstring url;
+    wstring url_username;
+    if (!NormaliseUrl(parts.location, url, url_username)) {
+        return;
+    }
+    Candidate candidate;
+    candidate.target_name = resolved_name;
+    candidate.username = parts.username.empty() ? url_username : parts.username.str();
+    candidate.stored = stored;
+    index_.Add(url, candidates_.size());
+    candidates_.push_back(candidate);
+}
+
+bool CredentialResolver::Resolve(const TextSpan& url, const wstring& username, wstring& target_name) const {
+    wstring key;
+    wstring url_username;
+    if (!NormaliseUrl(url, key, url_username)) {
+        return false;
+    }
+    wstring wanted = username.empty() ? url_username : username;
+    const bool username_given = !wanted.empty();
+    if (!username_given) {
+        wanted = GetUserName();
+    }
+
+    vector<const vector<size_t>*> matches;
+    index_.FindPrefixes(key, matches);
+    for (auto depth = matches.rbegin(); depth != matches.rend(); ++depth) {
+        const Candidate* best = NULL;
+        int best_rank = 0;
+        for (auto it = (*depth)->begin(); it != (*depth)->end(); ++it) {
+            const Candidate& candidate = candidates_[*it];
+            int rank;
+            if (candidate.username.empty()) {
+                rank = 2;
+            } else if (EqualsIgnoreCase(candidate.username, wanted)) {
+                rank = 3;
+            } else if (!username_given) {
+                rank = 1;
+            } else {
+                continue;
+            }
+            if (best == NULL ||
+                rank > best_rank ||
+                (rank == best_rank && candidate.stored && !best->stored) ||
+                (rank == best_rank && candidate.stored == best->stored && candidate.target_name < best->target_name)
+            ) {
+                best = &candidate;
+                best_rank = rank;
+            }
+        }
+        if (best != NULL) {
+            target_name = best->target_name;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "credential-bases.h"
+#include "credential-snapshot.h"
+#include "url-index.h"
+
+#include <string>
+#include <vector>
+
+/*
+    Finds the credential to use for a repository URL, so callers needn't guess target names and retry.  The URLs in
+    all stored Git and Mercurial target names are put in a UrlIndex, along with the URLs of the Git and Mercurial
+    names listed in the basis file which aren't stored themselves, which stand for their basis's Intrepid credential.
+    Basis entries which are patterns aren't indexed, since they don't name one URL.
+*/
+class CredentialResolver {
+public:
+    CredentialResolver(const CredentialSnapshot& snapshot, const CredentialBases& bases);
+
+    /*
+        Looks up the candidates whose URL is the longest prefix of "url" (at a path boundary) and picks one: first
+        those for the wanted username, then those with no username, then (only if no username was asked for) any
+        other; then stored credentials before basis entries, and then the first target name in order.  If none at
+        the longest prefix will do, shorter prefixes are tried.  The wanted username is "username" or, if that is
+        empty, the user info in "url", or failing both the current Windows user.  Returns false if nothing matches.
+    */
+    bool Resolve(const TextSpan& url, const std::wstring& username, std::wstring& target_name) const;
+
+private:
+    CredentialResolver(const CredentialResolver&);
+    CredentialResolver& operator=(const CredentialResolver&);
+
+    struct Candidate {
+        std::wstring target_name;
+        std::wstring username;  // As written in the name; empty for a Git URL with no user info.
+        bool stored;            // False for a basis entry, whose target is the basis credential.
+    };
+
+    void AddCandidate(const TextSpan& target_name, const std::wstring& resolved_name, bool stored);
+
+    std::vector<Candidate> candidates_;
+    UrlIndex index_;
+};
@@ -0,0 +1,326 @@
+#include "stdafx.h"
+
+#include "credential-session.h"
+#include "credential-output.h"
+#include "ignore-case.h"
+
+#include <sstream>
+#include <cstdlib>
+
+#pragma hdrstop
+
+#define READ_CHUNK_SIZE 4096
+
+using namespace std;
+
+namespace {
+    SessionResponse Ok(const wstring& payload) {
+        SessionResponse response = { true, WipingString(payload.data(), payload.size()) };
+        return response;
+    }
+
+    SessionResponse Error(const wstring& payload) {
+        SessionResponse response = { false, WipingString(payload.data(), payload.size()) };
+        return response;
+    }
+
+    size_t Utf8Length(const wchar_t* text, size_t length) {
+        return (length == 0) ? 0 : (size_t)::WideCharToMultiByte(CP_UTF8, 0, text, (int)length, NULL, 0, NULL, NULL);
+    }
+
+    template<typename Lines>
+    wstring JoinLines(const Lines& lines) {
+        wstringstream joined;
+        for (auto it = lines.begin(); it != lines.end(); ++it) {
+            if (it != lines.begin()) {
+                joined << L'\n';
+            }
+            joined << *it;
+        }
+        return joined.str();
+    }
+
+    // Gets the last write time of a file, or zero if the file doesn't exist.
+    void GetLastWriteTime(const wstring& file_name, FILETIME& write_time) {
+        WIN32_FILE_ATTRIBUTE_DATA attributes;
+        if (::GetFileAttributesExW(file_name.c_str(), GetFileExInfoStandard, &attributes)) {
+            write_time = attributes.ftLastWriteTime;
+        } else {
+            write_time.dwLowDateTime = 0;
+            write_time.dwHighDateTime = 0;
+        }
+    }
+}
+
+CredentialSession::CredentialSession(
+    CredentialBackend& backend,
+    DWORD ttl_milliseconds,
+    const wstring& basis_file_name
+)
+    : backend_(backend)
+    , ttl_milliseconds_(ttl_milliseconds)
+    , basis_file_name_(basis_file_name)
+    , snapshot_time_(0)
+{
+    bases_write_time_.dwLowDateTime = 0;
+    bases_write_time_.dwHighDateTime = 0;
+}
+
+const CredentialSnapshot& CredentialSession::Snapshot() {
+    if (!snapshot_) {
+        snapshot_.reset(new CredentialSnapshot(backend_));
+        snapshot_time_ = ::GetTickCount64();
+    }
+    return *snapshot_;
+}
+
+const CredentialBases& CredentialSession::Bases() {
+    if (!bases_) {
+        GetLastWriteTime(basis_file_name_, bases_write_time_);
+        bases_.reset(new CredentialBases(ReadBases(basis_file_name_)));
+    }
+    return *bases_;
+}
+
+void CredentialSession::InvalidateSnapshot() {
+    snapshot_.reset();
+}
+
+void CredentialSession::Invalidate() {
+    snapshot_.reset();
+    bases_.reset();
+}
+
+void CredentialSession::ExpireStaleState() {
+    if (snapshot_ && ttl_milliseconds_ != INFINITE && ::GetTickCount64() - snapshot_time_ >= ttl_milliseconds_) {
+        Invalidate();
+    }
+    if (bases_) {
+        // Re-check the basis file on every request; this is a single stat, and much cheaper than re-reading it.
+        FILETIME write_time;
+        GetLastWriteTime(basis_file_name_, write_time);
+        if (::CompareFileTime(&write_time, &bases_write_time_) != 0) {
+            Invalidate();
+        }
+    }
+}
+
+SessionResponse CredentialSession::Handle(const vector<wstring>& request) {
+    lock_guard<mutex> lock(mutex_);
+    ExpireStaleState();
+
+    if (request.empty()) {
+        return Error(L"Empty request");
+    }
+
+    const wstring& command = request[0];
+    if (EqualsIgnoreCase(command, L"get") && request.size() == 2) {
+        PCREDENTIALW pcred = Snapshot().Find(request[1]);
+        if (pcred == NULL) {
+            return Error(L"Credential not found: " + request[1]);
+        }
+        const wchar_t* username = (pcred->UserName == NULL) ? L"" : pcred->UserName;
+        const size_t username_length = wcslen(username);
+        const size_t password_length = pcred->CredentialBlobSize / sizeof(wchar_t);
+        SessionResponse response = { true, WipingString() };
+        response.payload.reserve(username_length + 3 + password_length);
+        response.payload.append(username, username_length);
+        response.payload.append(L"&&&");
+        response.payload.append((const wchar_t*)pcred->CredentialBlob, password_length);
+        return response;
+    } else if (EqualsIgnoreCase(command, L"set") && request.size() == 4) {
+        bool written = WriteCredential(backend_, request[1], request[2], request[3]);
+        InvalidateSnapshot();
+        return written
+            ? Ok(L"Updated: " + request[1])
+            : Error(L"Failed to update: " + request[1]);
+    } else if (EqualsIgnoreCase(command, L"list-defaults") && request.size() <= 2) {
+        wstring username = (request.size() == 2) ? request[1] : GetUserName();
+        return Ok(JoinLines(GetDefaultCredentials(Snapshot(), Bases(), username)));
+    } else if (EqualsIgnoreCase(command, L"list-bases") && request.size() == 1) {
+        return Ok(JoinLines(Bases().Names()));
+    } else if (EqualsIgnoreCase(command, L"list-basis") && request.size() == 2) {
+        return Ok(JoinLines(Bases().EntriesFor(request[1])));
+    }
+
+    return Error(L"Unknown request: " + command);
+}
+
+Utf8LineReader::Utf8LineReader(HANDLE in)
+    : in_(in)
+    , start_(0)
+    , at_end_(false)
+{
+}
+
+bool Utf8LineReader::ReadLine(wstring& line) {
+    for (;;) {
+        size_t newline_pos = buffer_.find('\n', start_);
+        if (newline_pos != string::npos || (at_end_ && start_ < buffer_.size())) {
+            size_t end = (newline_pos == string::npos) ? buffer_.size() : newline_pos;
+            size_t next = (newline_pos == string::npos) ? end : newline_pos + 1;
+            if (end > start_ && buffer_[end - 1] == '\r') {
+                --end;
+            }
+            line = FromUtf8(buffer_.data() + start_, end - start_);
+            start_ = next;
+            return true;
+        }
+        if (at_end_) {
+            return false;
+        }
+
+        // Drop consumed lines before reading more, so the buffer only ever holds one partial line.
+        buffer_.erase(0, start_);
+        start_ = 0;
+
+        char chunk[READ_CHUNK_SIZE];
+        DWORD read = 0;
+        if (!::ReadFile(in_, chunk, READ_CHUNK_SIZE, &read, NULL) || read == 0) {
+            at_end_ = true;
+        } else {
+            buffer_.append(chunk, read);
+        }
+    }
+}
+
+string ToUtf8(const wchar_t* s, size_t length) {
+    if (length == 0) {
+        return string();
+    }
+    int size = ::WideCharToMultiByte(CP_UTF8, 0, s, (int)length, NULL, 0, NULL, NULL);
+    string result(size, '\0');
+    ::WideCharToMultiByte(CP_UTF8, 0, s, (int)length, &result[0], size, NULL, NULL);
+    return result;
+}
+
+string ToUtf8(const wstring& s) {
+    return ToUtf8(s.data(), s.size());
+}
+
+wstring FromUtf8(const char* s, size_t length) {
+    if (length == 0) {
+        return wstring();
+    }
+    int size = ::MultiByteToWideChar(CP_UTF8, 0, s, (int)length, NULL, 0);
+    wstring result(size, L'\0');
+    ::MultiByteToWideChar(CP_UTF8, 0, s, (int)length, &result[0], size);
+    return result;
+}
+
+vector<wstring> SplitRequest(const wstring& line) {
+    vector<wstring> fields;
+    size_t start = 0;
+    for (;;) {
+        size_t tab_pos = line.find(L'\t', start);
+        fields.push_back(line.substr(start, tab_pos - start));
+        if (tab_pos == wstring::npos) {
+            break;
+        }
+        start = tab_pos + 1;
+    }
+    return fields;
+}
+
+bool WriteAll(HANDLE out, const char* data, size_t length) {
+    while (length > 0) {
+        DWORD written = 0;
+        if (!::WriteFile(out, data, (DWORD)length, &written, NULL)) {
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+bool WriteAll(HANDLE out, const string& data) {
+    return WriteAll(out, data.data(), data.size());
+}
+
+bool WriteRequest(HANDLE out, const vector<wstring>& request) {
+    // A "set" request includes the password, so it goes through a buffer which is zeroed afterwards.
+    size_t size = request.size();
+    for (auto it = request.begin(); it != request.end(); ++it) {
+        size += Utf8Length(it->data(), it->size());
+    }
+    OutputBuffer line;
+    line.Reserve(size);
+    for (auto it = request.begin(); it != request.end(); ++it) {
+        if (it != request.begin()) {
+            line.AppendAscii("\t");
+        }
+        line.AppendUtf8(it->data(), it->size());
+    }
+    line.AppendAscii("\n");
+    return line.WriteTo(out);
+}
+
+bool WriteResponse(HANDLE out, const SessionResponse& response) {
+    const size_t payload_size = Utf8Length(response.payload.data(), response.payload.size());
+    OutputBuffer message;
+    message.Reserve(payload_size + 32);
+    message.AppendAscii(response.ok ? "OK " : "ERROR ");
+    message.AppendDecimal(payload_size);
+    message.AppendAscii("\n");
+    message.AppendUtf8(response.payload.data(), response.payload.size());
+    return message.WriteTo(out);
+}
+
+bool ReadResponse(HANDLE in, SessionResponse& response) {
+    // Read the header a byte at a time, so that we never consume any of the payload.
+    string header;
+    for (;;) {
+        char c;
+        DWORD read = 0;
+        if (!::ReadFile(in, &c, 1, &read, NULL) || read == 0) {
+            return false;
+        }
+        if (c == '\n') {
+            break;
+        }
+        header += c;
+    }
+
+    size_t space_pos = header.find(' ');
+    if (space_pos == string::npos) {
+        return false;
+    }
+    response.ok = (header.compare(0, space_pos, "OK") == 0);
+    size_t length = strtoul(header.c_str() + space_pos + 1, NULL, 10);
+
+    // The payload may hold a password, so it's read and converted only into storage which is zeroed when freed.
+    basic_string<char, char_traits<char>, WipingAllocator<char>> payload(length, '\0');
+    size_t received = 0;
+    while (received < length) {
+        DWORD read = 0;
+        if (!::ReadFile(in, &payload[received], (DWORD)(length - received), &read, NULL) || read == 0) {
+            return false;
+        }
+        received += read;
+    }
+    response.payload.clear();
+    if (length > 0) {
+        int size = ::MultiByteToWideChar(CP_UTF8, 0, payload.data(), (int)length, NULL, 0);
+        response.payload.resize(size);
+        ::MultiByteToWideChar(CP_UTF8, 0, payload.data(), (int)length, &response.payload[0], size);
+    }
+    return true;
+}
+
+void RunBatchSession(CredentialSession& session, HANDLE in, HANDLE out) {
+    Utf8LineReader reader(in);
+    wstring line;
+    while (reader.ReadLine(line)) {
+        if (line.empty()) {
+            continue;
+        }
+        auto request = SplitRequest(line);
+        if (EqualsIgnoreCase(request[0], L"quit")) {
+            break;
+        }
+        if (!WriteResponse(out, session.Handle(request))) {
+            break;
+        }
+    }
+}
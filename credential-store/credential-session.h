@@ -0,0 +1,94 @@
+#pragma once
+
+#include "credential-snapshot.h"
+#include "credential-bases.h"
+#include "secret-buffer.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// The payload of a response to "get" includes the password, so it is zeroed whenever its storage is freed.
+struct SessionResponse {
+    bool ok;
+    WipingString payload;
+};
+
+/*
+    The state shared by all requests in one session of the "batch" or "serve" commands.  The credential snapshot
+    and the parsed basis file are each built on first use and then cached.  The cache is dropped when the session
+    itself writes a credential, when the basis file changes, and (if a time-to-live is given) when it is older than
+    that.
+*/
+class CredentialSession {
+public:
+    // A ttl_milliseconds of INFINITE means the cache never expires by age.  The bases are read from the user's
+    // credential basis file unless another is given.
+    explicit CredentialSession(
+        CredentialBackend& backend,
+        DWORD ttl_milliseconds = INFINITE,
+        const std::wstring& basis_file_name = GetCredentialBasisFileName()
+    );
+
+    const CredentialSnapshot& Snapshot();
+    const CredentialBases& Bases();
+    void InvalidateSnapshot();
+    void Invalidate();
+
+    // Handles a single request, already split into its tab-separated fields.  This is safe to call from several
+    // threads at once; requests are handled one at a time.
+    SessionResponse Handle(const std::vector<std::wstring>& request);
+
+private:
+    CredentialSession(const CredentialSession&);
+    CredentialSession& operator=(const CredentialSession&);
+
+    void ExpireStaleState();
+
+    std::mutex mutex_;
+    CredentialBackend& backend_;
+    DWORD ttl_milliseconds_;
+    const std::wstring basis_file_name_;
+    ULONGLONG snapshot_time_;
+    FILETIME bases_write_time_;
+    std::unique_ptr<CredentialSnapshot> snapshot_;
+    std::unique_ptr<CredentialBases> bases_;
+};
+
+// Reads UTF-8 text from a file or pipe handle, one line at a time.
+class Utf8LineReader {
+public:
+    explicit Utf8LineReader(HANDLE in);
+
+    // Returns false at end of input.  The line terminator ("\n" or "\r\n") is not included in the line.
+    bool ReadLine(std::wstring& line);
+
+private:
+    HANDLE in_;
+    std::string buffer_;
+    size_t start_;
+    bool at_end_;
+};
+
+std::string ToUtf8(const wchar_t* s, size_t length);
+std::string ToUtf8(const std::wstring& s);
+std::wstring FromUtf8(const char* s, size_t length);
+
+std::vector<std::wstring> SplitRequest(const std::wstring& line);
+
+bool WriteAll(HANDLE out, const char* data, size_t length);
+bool WriteAll(HANDLE out, const std::string& data);
+
+// Writes a request as a line of tab-separated fields.
+bool WriteRequest(HANDLE out, const std::vector<std::wstring>& request);
+
+// Writes a response as a "<status> <length>\n" header followed by <length> bytes of UTF-8 payload.
+bool WriteResponse(HANDLE out, const SessionResponse& response);
+
+// Reads a response written by WriteResponse, returning false if the input ends early or is malformed.
+bool ReadResponse(HANDLE in, SessionResponse& response);
+
+// Handles requests read from "in" until the end of input, or a "quit" request, writing each response to "out"
+// as soon as it is ready.
+void RunBatchSession(CredentialSession& session, HANDLE in, HANDLE out);
@@ -0,0 +1,90 @@
+#include "stdafx.h"
+
+#include "credential-snapshot.h"
+
+#include "ignore-case.h"
+#include "trace.h"
+
+#pragma hdrstop
+
+using namespace std;
+
+namespace {
+    const vector<size_t> NO_CREDENTIALS;
+}
+
+CredentialKind ClassifyCredential(PCREDENTIALW credential) {
+    // Only generic credentials are written by this tool (and by Git and Mercurial), so don't classify
+    // any others, even if their names happen to match.
+    if (credential->Type != CRED_TYPE_GENERIC || credential->TargetName == NULL) {
+        return CredentialKind::Other;
+    }
+
+    return ParseTargetName(credential->TargetName, wcslen(credential->TargetName)).kind;
+}
+
+wstring GetEmbeddedUsername(PCREDENTIALW credential, CredentialKind kind) {
+    if (credential->UserName == NULL) {
+        return wstring();
+    }
+    wstring username(credential->UserName);
+    if (kind == CredentialKind::Mercurial) {
+        // Mercurial accepts, and older versions store, the username data in the credential as just the
+        // username, whereas newer versions store it as "<username>@@<repo_url>" (without a trailing
+        // "@Mercurial").
+        size_t double_at_pos = username.find(L"@@");
+        if (double_at_pos != wstring::npos) {
+            username.erase(double_at_pos);
+        }
+    }
+    return username;
+}
+
+wstring FoldUsername(const wstring& username) {
+    wstring folded(username);
+    if (!folded.empty()) {
+        FoldCase(&folded[0], folded.size());
+    }
+    return folded;
+}
+
+CredentialSnapshot::CredentialSnapshot(CredentialBackend& backend) {
+    // A failed enumeration just leaves the snapshot empty, as if there were no credentials.
+    backend.Enumerate(enumeration_);
+
+    TraceSpan span("Classify");
+    const size_t count = enumeration_.credentials.size();
+    parts_.reserve(count);
+    by_target_name_.reserve(count);
+    for (size_t index = 0; index < count; ++index) {
+        PCREDENTIALW credential = enumeration_.credentials[index];
+        // As for ClassifyCredential, only generic credentials have a kind; but here we parse the name just once,
+        // and keep the parts.
+        TargetNameParts parts = { CredentialKind::Other, TextSpan(), TextSpan() };
+        if (credential->Type == CRED_TYPE_GENERIC && credential->TargetName != NULL) {
+            size_t length = wcslen(credential->TargetName);
+            parts = ParseTargetName(credential->TargetName, length);
+            by_target_name_.emplace(wstring(credential->TargetName, length), index);
+        }
+        CredentialKind kind = parts.kind;
+        parts_.push_back(parts);
+        by_kind_[static_cast<size_t>(kind)].push_back(index);
+        if (kind != CredentialKind::Other) {
+            by_username_[FoldUsername(GetEmbeddedUsername(credential, kind))].push_back(index);
+        }
+    }
+}
+
+const vector<size_t>& CredentialSnapshot::OfKind(CredentialKind kind) const {
+    return by_kind_[static_cast<size_t>(kind)];
+}
+
+const vector<size_t>& CredentialSnapshot::ForUsername(const wstring& username) const {
+    auto found = by_username_.find(FoldUsername(username));
+    return (found == by_username_.end()) ? NO_CREDENTIALS : found->second;
+}
+
+PCREDENTIALW CredentialSnapshot::Find(const wstring& target_name) const {
+    auto found = by_target_name_.find(target_name);
+    return (found == by_target_name_.end()) ? NULL : enumeration_.credentials[found->second];
+}
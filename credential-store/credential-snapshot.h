@@ -0,0 +1,53 @@
+#pragma once
+
+#include "credential-backend.h"
+#include "target-name.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Returns the username embedded in a credential.  For Mercurial credentials this is the part of the UserName
+// before any "@@<repo_url>" suffix; for other kinds it is the whole UserName.
+std::wstring GetEmbeddedUsername(PCREDENTIALW credential, CredentialKind kind);
+
+CredentialKind ClassifyCredential(PCREDENTIALW credential);
+
+// Case-fold a username so that it can be used as a key for case-insensitive lookups.
+std::wstring FoldUsername(const std::wstring& username);
+
+/*
+    A single enumeration of the user's credentials, with each entry classified once and indexed by kind,
+    by (case-folded) embedded username and by target name.  The snapshot owns the enumerated credentials,
+    so the indexes refer straight into them rather than copying, and no further reads from the backend are
+    needed to answer questions about enumerated credentials.
+*/
+class CredentialSnapshot {
+public:
+    explicit CredentialSnapshot(CredentialBackend& backend);
+
+    size_t size() const { return enumeration_.credentials.size(); }
+    PCREDENTIALW operator[](size_t index) const { return enumeration_.credentials[index]; }
+    CredentialKind KindOf(size_t index) const { return parts_[index].kind; }
+    // The parsed target name of a credential; the parts point into the snapshot's own copy of the name.
+    const TargetNameParts& PartsOf(size_t index) const { return parts_[index]; }
+
+    // Indexes of all credentials of the given kind, in enumeration order.
+    const std::vector<size_t>& OfKind(CredentialKind kind) const;
+
+    // Indexes of all Git, Mercurial and Intrepid credentials whose embedded username matches, ignoring case.
+    const std::vector<size_t>& ForUsername(const std::wstring& username) const;
+
+    // Returns the credential with the given target name, or NULL if there is none.
+    PCREDENTIALW Find(const std::wstring& target_name) const;
+
+private:
+    CredentialSnapshot(const CredentialSnapshot&);
+    CredentialSnapshot& operator=(const CredentialSnapshot&);
+
+    CredentialEnumeration enumeration_;
+    std::vector<TargetNameParts> parts_;
+    std::vector<size_t> by_kind_[CREDENTIAL_KIND_COUNT];
+    std::unordered_map<std::wstring, std::vector<size_t>> by_username_;
+    std::unordered_map<std::wstring, size_t> by_target_name_;
+};
@@ -1,541 +1,1160 @@
-#include "stdafx.h"
-
-#include <windows.h>
-#include <wincred.h>
-#include <lmcons.h>
-#include <tchar.h>
-#include <locale>
-#include <iostream>
-#include <sstream>
-#include <fstream>
-#include <string>
-#include <map>
-#include <list>
-#include <algorithm>
-#include <functional>
-#include <cctype>
-
-#pragma hdrstop
-
-#define INPUT_LENGTH_LIMIT 256
-#define GRADLE_USER_HOME_ENV_VAR_NAME L"GRADLE_USER_HOME"
-#define USERPROFILE_ENV_VAR_NAME L"USERPROFILE"
-#define HOLY_GRADLE_DIR_NAME L"holygradle"
-#define CREDENTIAL_BASIS_FILE_NAME L"credential-bases.txt"
-#define HOLY_GRADLE_CREDENTIAL_PREFIX L"Intrepid - "
-
-using namespace std;
-
-void echo(bool on) {
-    DWORD  mode;
-    HANDLE hConIn = ::GetStdHandle(STD_INPUT_HANDLE);
-    ::GetConsoleMode(hConIn, &mode);
-    mode = on
-        ? (mode | ENABLE_ECHO_INPUT)
-        : (mode & ~(ENABLE_ECHO_INPUT));
-    ::SetConsoleMode(hConIn, mode);
-}
-
-// Trim whitespace from both ends of the string.  This function intentionally copies its input because it
-// internally erases characters in place.  Based on http://stackoverflow.com/a/217605.
-wstring trim(wstring s) {
-    s.erase(s.begin(), find_if(s.begin(), s.end(),
-        not1(ptr_fun<int, int>(isspace))));
-    s.erase(find_if(s.rbegin(), s.rend(),
-        not1(ptr_fun<int, int>(isspace))).base(), s.end());
-    return s;
-}
-
-void StoreCredential(wstring& target_address, wstring& target_user, wstring& target_password) {
-    CREDENTIALW cred = {0};
-    cred.Type = CRED_TYPE_GENERIC;
-    cred.TargetName = (LPWSTR)target_address.c_str();
-    cred.CredentialBlobSize = (DWORD) (target_password.size()*2);
-    cred.CredentialBlob = (LPBYTE) target_password.c_str();
-    cred.Persist = CRED_PERSIST_ENTERPRISE;
-    cred.UserName = (LPWSTR)target_user.c_str();
-
-    bool result = (::CredWriteW(&cred, 0) != FALSE);
-    if (result) {
-        wcout << "Updated: " << target_address << endl;
-    } else {
-        wcout << "ERROR: Failed to update: " << target_address << endl;
-    }
-}
-
-void PrintCredential(PCREDENTIAL pCredential) {
-    //Write the Credential information into the standard output.
-    wcout << "*********************************************" << endl;
-    printf(	"Flags:   %d\r\n"\
-        "Type:    %d\r\n"\
-        "Name:    %ls\r\n"\
-        "Comment: %ls\r\n"\
-        "Persist: %d\r\n"\
-        "User:    %ls\r\n",
-        pCredential->Flags,
-        pCredential->Type,
-        pCredential->TargetName, 
-        pCredential->Comment,
-        pCredential->Persist,
-        pCredential->UserName);
-
-    wcout << "Data: " << endl;
-
-    char szHexBuffer[256] = "";
-    char szAsciiBuffer[256] = "";
-    char szHex[16];
-    char szAscii[2];
-    DWORD dwByte;
-
-    //Write the credential's data as Hex Dump.
-    for (dwByte = 0; dwByte < pCredential->CredentialBlobSize; dwByte++) {
-        BYTE byte1 = pCredential->CredentialBlob[dwByte];
-        sprintf_s(szHex, 16, "%2.2X ", byte1);
-        szAscii[1] = '\0';
-
-        if (byte1 >= 32 && byte1 < 128)
-            szAscii[0] = (UCHAR)byte1;
-        else
-            szAscii[0] = ' ';
-
-        strcat_s(szHexBuffer, 256, szHex);
-        strcat_s(szAsciiBuffer, 256, szAscii);
-
-        if (dwByte == pCredential->CredentialBlobSize - 1 
-            || dwByte % 16 == 15)
-        {
-            printf("%-50s %s\r\n", szHexBuffer, szAsciiBuffer);
-            szHexBuffer[0] = '\0';
-            szAsciiBuffer[0] = '\0';
-        }
-    }
-
-    wcout << "*********************************************" << endl << endl << endl;
-}
-
-void ReadAndPrintCredential(const wstring& target_key) {
-    PCREDENTIALW pcred;
-    BOOL ok = ::CredReadW(target_key.c_str(), CRED_TYPE_GENERIC, 0, &pcred);
-    if (!ok) {
-        wcout << "CredRead() - errno " << (ok ? 0 : ::GetLastError()) << endl;
-        exit(1);
-    }
-    wcout << pcred->UserName << "&&&" << wstring((LPWSTR)pcred->CredentialBlob, pcred->CredentialBlobSize / 2);
-
-    // must free memory allocated by CredRead()!
-    ::CredFree(pcred);
-}
-
-wstring GetCredentialUsername(const wstring& target_key) {
-    PCREDENTIALW pcred;
-    BOOL ok = ::CredReadW(target_key.c_str(), CRED_TYPE_GENERIC, 0, &pcred);
-    if (!ok) {
-        wcout << "CredRead() - errno " << (ok ? 0 : ::GetLastError()) << endl;
-        exit(1);
-    }
-    wstring result(pcred->UserName);
-
-    // Must free memory allocated by CredRead()!
-    ::CredFree(pcred);
-
-    return result;
-}
-
-// templated version of my_equal so it could work with both char and wchar_t
-template<typename charT>
-struct my_equal {
-    my_equal( const locale& loc ) : loc_(loc) {}
-    bool operator()(charT ch1, charT ch2) {
-        return toupper(ch1, loc_) == toupper(ch2, loc_);
-    }
-private:
-    const locale& loc_;
-};
-
-// find substring (case insensitive)
-template<typename T>
-int ci_find_substr( const T& str1, const T& str2, const locale& loc = locale() )
-{
-    T::const_iterator it = search( str1.begin(), str1.end(), 
-        str2.begin(), str2.end(), my_equal<T::value_type>(loc) );
-    if ( it != str1.end() ) return it - str1.begin();
-    else return -1; // not found
-}
-
-bool IsMercurialCredential(const wstring& target_name, const wstring& username) {
-    // A Mercurial credential name should have the following components in order:
-    //  a non-zero-length username
-    //  "@@"
-    //  a non-zero-length repo URL
-    //  "@Mercurial"
-    //
-    // Mercurial accepts, and older versions store, the username data in the credential as just the username,
-    // whereas newer versions store it as "<username>@@<repo_url>" (without a trailing "@Mercurial").
-
-    size_t double_at_pos = target_name.find(L"@@");
-    size_t at_mercurial_pos = target_name.find(L"@Mercurial");
-    bool matches_format = (
-        double_at_pos > 0 &&
-        double_at_pos <= (at_mercurial_pos - 3) &&
-        at_mercurial_pos == target_name.size() - 10
-    );
-    // Need to check matches_format is true before calling GetCredentialUsername or we may get
-    // ERROR_NOT_FOUND from CredRead, if the target_name is not for a CRED_TYPE_GENERIC credential.
-
-
-    return matches_format &&
-        (_wcsnicmp(GetCredentialUsername(target_name).c_str(), username.c_str(), double_at_pos) == 0);
-}
-
-bool IsGitCredential(const wstring& target_name, const wstring& username) {
-    // git://<scheme>://<username>@<hostname> or git:<scheme>://<hostname> 
-    return (target_name.find(L"git:") == 0) && (_wcsnicmp(GetCredentialUsername(target_name).c_str() ,username.c_str(), username.size()) == 0);
-
-}
-
-bool IsIntrepidCredential(const wstring& target_name, const wstring& username) {
-    return (target_name.find(HOLY_GRADLE_CREDENTIAL_PREFIX) == 0) && (_wcsnicmp(GetCredentialUsername(target_name).c_str(), username.c_str(), username.size()) == 0);
-}
-
-wstring GetIntrepidCredentialName(const wstring& target_name) {
-    return target_name.substr(11);
-}
-
-bool HasBasis(const map<wstring, list<wstring>>& bases, wstring credential_name) {
-    for (auto b = bases.begin(); b != bases.end(); ++b) {
-        auto basis_credentials = b->second;
-        auto found_credential_it = find(basis_credentials.begin(), basis_credentials.end(), credential_name);
-        if (found_credential_it != basis_credentials.end()) {
-            return true;
-        }
-    }
-    return false;
-}
-
-wstring GetUserName()
-{
-    DWORD usernameLen = UNLEN;
-    wchar_t usernameBuffer[UNLEN];
-    if (GetUserName(usernameBuffer, &usernameLen)) {
-        return usernameBuffer;
-    } else {
-        return L"";
-    }
-}
-
-void RequestUsernameAndPassword(wstring& username, wstring& password)
-{
-    wstring usernameDefault(GetUserName());
-    wcout << L"Username [ENTER to accept default '" << usernameDefault << L"']: ";
-    getline(wcin, username);
-    if (username.empty()) {
-        username = usernameDefault;
-    }
-    if (username.empty()) {
-        wcerr << L"ERROR: Empty username" << endl;
-        exit(1);
-    }
-
-    cout << "Password: ";
-    echo(false);
-    getline(wcin, password);
-    echo(true);
-    wcout << endl;
-    if (password.empty()) {
-        wcerr << L"ERROR: Empty password" << endl;
-        exit(1);
-    }
-}
-
-bool GetPathFromEnv(const wstring& name, wstring& value) {
-    wchar_t raw_value[MAX_PATH];
-    DWORD length = ::GetEnvironmentVariable(name.c_str(), raw_value, MAX_PATH);
-    bool ok = !(length == 0 || length > MAX_PATH);
-    if (ok) {
-        value.assign(raw_value, length);
-    }
-    return ok;
-}
-
-bool GetGradleUserHome(wstring& home) {
-    bool found_home = false;
-    if (GetPathFromEnv(L"GRADLE_USER_HOME", home)) {
-        found_home = (home.size() > 0);
-    } else {
-        if (GetPathFromEnv(L"USERPROFILE", home)) {
-            auto size = home.size();
-            if (size > 0) {
-                if (home[size - 1] != L'\\') {
-                    home += L'\\';
-                }
-                home += L".gradle";
-                found_home = true;
-            }
-        }
-    }
-    return found_home;
-}
-
-wstring GetCredentialBasisFileName() {
-    // Statically cache the result, because this function may be called multiple times and it won't change.
-    static wstring basis_file_name;
-    if (basis_file_name.size() > 0) {
-        return basis_file_name;
-    }
-
-    wstring home;
-    if (GetGradleUserHome(home)) {
-        wstringstream basis_file_name_stream;
-        basis_file_name_stream << home;
-        wchar_t last_char = home[home.size() - 1];
-        if (!(last_char == L'/' || last_char == L'\\')) {
-            basis_file_name_stream << L'\\';
-        }
-        basis_file_name_stream << HOLY_GRADLE_DIR_NAME << L'\\' << CREDENTIAL_BASIS_FILE_NAME;
-        basis_file_name = basis_file_name_stream.str();
-    } else {
-        wcerr << L"ERROR: Failed to read environment variable " GRADLE_USER_HOME_ENV_VAR_NAME L" or "
-            USERPROFILE_ENV_VAR_NAME L"." << endl;
-        wcerr << L"One of these must be set to locate the credential basis file." << endl;
-        basis_file_name = L"???";
-    }
-
-    return basis_file_name;
-}
-
-map<wstring, list<wstring>> ReadBases(const wstring& credentialBasisFileName) {
-    map<wstring, list<wstring>> bases;
-    wifstream in(credentialBasisFileName);
-    wstring current_basis;
-    wstring line;
-    unsigned long line_index = 0;
-    while (getline(in, line)) {
-        ++line_index;
-        wstring trimmed_line(trim(line));
-        if (trimmed_line.empty() || line[0] == L'#') {
-            // Ignore blank and comment lines.
-            continue;
-        } else if (isspace(line[0])) {
-            if (current_basis.empty()) {
-                wcerr << L"WARNING: Ignoring entry '" << trimmed_line
-                    << L"' on line " << to_wstring(line_index) << L" of " << credentialBasisFileName
-                    << L" because no basis line has been encountered yet." << endl;
-            } else {
-                bases[current_basis].push_back(trimmed_line);
-            }
-        } else {
-            // Warn the user if we haven't seen any entries under the current basis, before we set the next.
-            if (!current_basis.empty() && bases[current_basis].empty()) {
-                wcerr << L"WARNING: Basis credential " << current_basis << L" in " << credentialBasisFileName
-                    << L" has no credentials listed under it." << endl;
-            }
-            current_basis = line;
-            bases[current_basis]; // Access the key to create the value.
-        }
-    }
-
-    // Warn the user if we haven't seen any entries under the last basis.
-    if (!current_basis.empty() && bases[current_basis].empty()) {
-        wcerr << L"WARNING: Basis credential " << current_basis << L" in " << credentialBasisFileName
-            << L" has no credentials listed under it." << endl;
-    }
-
-    return bases;
-}
-
-list<wstring> GetDefaultCredentials(const wstring& username) {
-    wstring credentialBasisFileName = GetCredentialBasisFileName();
-    auto bases = ReadBases(credentialBasisFileName);
-    list<wstring> defaultCredentials;
-
-    PCREDENTIAL *pCredArray = NULL;
-    DWORD dwCount = 0;
-
-    if (::CredEnumerate(NULL, 0, &dwCount, &pCredArray)) {
-        for (DWORD dwIndex = 0; dwIndex < dwCount; dwIndex++) {
-            PCREDENTIAL pCredential = pCredArray[dwIndex];
-
-            wstring target_name(pCredential->TargetName);
-
-            if (IsMercurialCredential(target_name, username) ||
-                IsGitCredential(target_name, username)
-            ) {
-                if (!HasBasis(bases, target_name)) {
-                    defaultCredentials.push_back(target_name);
-                }
-            } else if (IsIntrepidCredential(target_name, username)) {
-                wstring credential_name = GetIntrepidCredentialName(target_name);
-                if (bases.find(credential_name) == bases.end()) {
-                    defaultCredentials.push_back(target_name);
-                }
-            }
-        }
-
-        //Free the credentials array.
-        ::CredFree(pCredArray);
-    }
-
-    return defaultCredentials;
-}
-
-/*
-    Update the username & password for all non-basis credentials for the given username.
-*/
-void UpdateCredentialsFromDefault()
-{
-    wstring username;
-    wstring password;
-    RequestUsernameAndPassword(username, password);
-
-    wstring credentialBasisFileName = GetCredentialBasisFileName();
-    auto defaultCredentials = GetDefaultCredentials(username);
-    if (defaultCredentials.empty()) {
-        wcout << L"ERROR: There are no default credentials listed in " << endl
-            << credentialBasisFileName << L"." << endl;
-        exit(1);
-    }
-
-    for (auto it = defaultCredentials.begin(); it != defaultCredentials.end(); ++it) {
-        StoreCredential(*it, username, password);
-    }
-}
-
-/*
-    Update the username & password for the basis credential and for all credentials listed under it
-    in the credential-bases.txt file.
-*/
-void UpdateCredentialsFromBasis(const wstring& basis)
-{
-    wstring credentialBasisFileName = GetCredentialBasisFileName();
-    auto bases = ReadBases(credentialBasisFileName);
-    auto basisCredentials = bases[basis];
-    if (basisCredentials.empty()) {
-        wcout << L"ERROR: There are no credentials for basis '" << basis << L"' listed in " << endl
-            << credentialBasisFileName << L"." << endl;
-        exit(1);
-    }
-
-    wstring username;
-    wstring password;
-    RequestUsernameAndPassword(username, password);
-
-    auto credentialName = HOLY_GRADLE_CREDENTIAL_PREFIX + basis;
-    StoreCredential(credentialName, username, password);
-    for (auto it = basisCredentials.begin(); it != basisCredentials.end(); ++it) {
-        StoreCredential(*it, username, password);
-    }
-}
-
-void ListBases() {
-    wstring credentialBasisFileName = GetCredentialBasisFileName();
-    auto bases = ReadBases(credentialBasisFileName);
-    wcout << L"The following basis credentials exist in " << credentialBasisFileName << L":" << endl << endl;
-    for (auto it = bases.begin(); it != bases.end(); ++it) {
-        wcout << it->first << endl;
-    }
-}
-
-void ListBasis(const wstring& basis) {
-    wstring credentialBasisFileName = GetCredentialBasisFileName();
-    auto bases = ReadBases(credentialBasisFileName);
-    auto basisCredentials = bases[basis];
-    if (basisCredentials.empty()) {
-        wcout << L"There are no Git, or Mercurial credentials listed for " << basis << L" in " << endl
-            << credentialBasisFileName << L"." << endl;
-    } else {
-        wcout << L"The following Git or Mercurial credentials are listed for " << basis << L" in " << endl
-            << credentialBasisFileName << L":" << endl << endl;
-        for (auto it = basisCredentials.begin(); it != basisCredentials.end(); ++it) {
-            wcout << *it << endl;
-        }
-    }
-}
-
-void ListDefaults(const wstring& username) {
-    wstring credentialBasisFileName = GetCredentialBasisFileName();
-    auto defaultCredentials = GetDefaultCredentials(username);
-    if (defaultCredentials.empty()) {
-        wcout << L"There are no Git, Mercurial, and Holy Gradle credentials listed in " << endl
-            << credentialBasisFileName << L"." << endl;
-    } else {
-        wcout << L"The following Git, Mercurial, and Holy Gradle credentials are not listed in " << endl
-            << credentialBasisFileName << L":" << endl << endl;
-        for (auto it = defaultCredentials.begin(); it != defaultCredentials.end(); ++it) {
-            wcout << *it << endl;
-        }
-    }
-}
-
-void ShowUsage(wchar_t* program_name) {
-    wcout << L"Usage: " << program_name << L" <command> <arguments>" << endl;
-    wcout << endl;
-    wcout << L"Main commands:" << endl;
-    wcout << endl;
-    wcout << L"  " << program_name << L" for-defaults" << endl;
-    wcout << L"    Prompts for a username and password, then sets them as the content of" << endl;
-    wcout << L"    credential \"" << HOLY_GRADLE_CREDENTIAL_PREFIX L"Domain Credentials\"," << endl;
-    wcout << L"    all Git and Mercurial credentials not listed under any name in" << endl;
-    wcout << L"    " << GetCredentialBasisFileName() << L", and" << endl;
-    wcout << L"    all \"" << HOLY_GRADLE_CREDENTIAL_PREFIX << L"*\" credentials not listed as bases there." << endl;
-    wcout << endl;
-    wcout << L"  " << program_name << L" for-basis <basis_name>" << endl;
-    wcout << L"    Prompts for a username and password, then sets them as the content of" << endl;
-    wcout << L"    credential \"" << HOLY_GRADLE_CREDENTIAL_PREFIX << L"<basis_name>\", and" << endl;
-    wcout << L"    all credentials listed under <basis_name> in" << endl;
-    wcout << L"    " << GetCredentialBasisFileName() << endl;
-    wcout << endl;
-    wcout << L"Other commands:" << endl;
-    wcout << endl;
-    wcout << L"  " << program_name << L" list-defaults [<username>]" << endl;
-    wcout << L"    Lists all the credentials which would be updated by the 'for-default' command" << endl;
-    wcout << L"    for the given <username> (default: '" << GetUserName() << "')." << endl;
-    wcout << endl;
-    wcout << L"  " << program_name << L" list-bases" << endl;
-    wcout << L"    Lists all the <basis_name> values in" << endl;
-    wcout << L"    " << GetCredentialBasisFileName() << endl;
-    wcout << endl;
-    wcout << L"  " << program_name << L" list-basis <basis_name>" << endl;
-    wcout << L"    Lists all the credentials which would be updated by the 'for-basis <basis_name>' command" << endl;
-    wcout << endl;
-    wcout << L"  " << program_name << L" get <credential_name>" << endl;
-    wcout << L"    Outputs the content of the named credential; normally \"<username>&&&<password>\"." << endl;
-    wcout << endl;
-    wcout << L"  " << program_name << L" set <credential_name> <username> <password>" << endl;
-    wcout << L"    Sets the content of the named credential to \"<username>&&&<password>\"." << endl;
-    wcout << endl;
-}
-
-int _tmain(int argc, wchar_t* argv[]) {
-
-    if (argc == 1) {
-        ShowUsage(argv[0]);
-        exit(1);
-    }
-
-    const size_t command_length = wcsnlen_s(argv[1], INPUT_LENGTH_LIMIT);
-
-    if (_wcsnicmp(argv[1], L"get", command_length) == 0 && argc == 3) {
-        wstring readKey(argv[2]);
-        ReadAndPrintCredential(readKey);
-    } else if (_wcsnicmp(argv[1], L"set", command_length) == 0 && argc == 5) {
-        wstring writeKey(argv[2]);
-        wstring username(argv[3]);
-        wstring password(argv[4]);
-        StoreCredential(writeKey, username, password);
-    } else if (_wcsnicmp(argv[1], L"for-basis", command_length) == 0 && argc == 3) {
-        UpdateCredentialsFromBasis(argv[2]);
-    } else if (_wcsnicmp(argv[1], L"for-defaults", command_length) == 0 && argc == 2) {
-        UpdateCredentialsFromDefault();
-    } else if (_wcsnicmp(argv[1], L"list-bases", command_length) == 0 && argc == 2) {
-        ListBases();
-    } else if (_wcsnicmp(argv[1], L"list-basis", command_length) == 0 && argc == 3) {
-        ListBasis(argv[2]);
-    } else if (_wcsnicmp(argv[1], L"list-defaults", command_length) == 0 && argc == 2) {
-        ListDefaults(GetUserName());
-    } else if (_wcsnicmp(argv[1], L"list-defaults", command_length) == 0 && argc == 3) {
-        ListDefaults(argv[2]);
-    } else {
-        ShowUsage(argv[0]);
-        exit(1);
-    }
-}
+#include "stdafx.h"
+
+#include <windows.h>
+#include <wincred.h>
+#include "credential-backend.h"
+#include "credential-snapshot.h"
+#include "credential-bases.h"
+#include "credential-session.h"
+#include "credential-daemon.h"
+#include "basis-file-edit.h"
+#include "bulk-write.h"
+#include "credential-output.h"
+#include "credential-resolve.h"
+#include "credential-verify.h"
+#include "drift-check.h"
+#include "fast-path.h"
+#include "git-helper.h"
+#include "inventory.h"
+#include "rotation-manifest.h"
+#include "secret-buffer.h"
+#include "trace.h"
+#include "ignore-case.h"
+#include <tchar.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <unordered_set>
+#include <list>
+#include <algorithm>
+#include <functional>
+#include <iomanip>
+#include <future>
+#include <cctype>
+
+#pragma hdrstop
+
+#define INCREMENTAL_OPTION L"--incremental"
+#define PLAN_OPTION L"--plan"
+#define MANIFEST_OPTION L"--manifest"
+
+using namespace std;
+
+void echo(bool on) {
+    DWORD  mode;
+    HANDLE hConIn = ::GetStdHandle(STD_INPUT_HANDLE);
+    ::GetConsoleMode(hConIn, &mode);
+    mode = on
+        ? (mode | ENABLE_ECHO_INPUT)
+        : (mode & ~(ENABLE_ECHO_INPUT));
+    ::SetConsoleMode(hConIn, mode);
+}
+
+void StoreCredential(CredentialBackend& backend, const wstring& target_address, const wstring& target_user, const TextSpan& target_password) {
+    if (WriteCredential(backend, target_address, target_user, target_password)) {
+        wcout << "Updated: " << target_address << endl;
+    } else {
+        wcout << "ERROR: Failed to update: " << target_address << endl;
+    }
+}
+
+void ReadAndPrintCredential(CredentialBackend& backend, const wstring& target_key) {
+    CredentialPtr pcred = backend.Read(target_key);
+    if (!pcred) {
+        wcout << "CredRead() - errno " << ::GetLastError() << endl;
+        exit(1);
+    }
+    TraceSpan span("Output");
+    // Write the password straight from the credential, rather than copying it into a string first.
+    wcout << pcred->UserName << "&&&";
+    wcout.write((const wchar_t*)pcred->CredentialBlob, pcred->CredentialBlobSize / 2);
+}
+
+/*
+    Read several credentials and write them all to standard output in one go, in binary or JSON format.  Exits with 1
+    if any of them couldn't be read, after writing the records for all of them.
+*/
+void ReadAndWriteCredentials(CredentialBackend& backend, const vector<wstring>& target_keys, OutputFormat format) {
+    vector<CredentialPtr> credentials;
+    vector<DWORD> errors;
+    bool all_found = true;
+    for (auto it = target_keys.begin(); it != target_keys.end(); ++it) {
+        credentials.push_back(backend.Read(*it));
+        errors.push_back(credentials.back() ? ERROR_SUCCESS : ::GetLastError());
+        all_found = all_found && credentials.back();
+    }
+
+    bool written;
+    {
+        TraceSpan span("Output");
+        OutputBuffer output;
+        output.Reserve(MaxCredentialRecordsSize(target_keys, credentials));
+        AppendCredentialRecords(target_keys, credentials, errors, format, output);
+        written = output.WriteTo(::GetStdHandle(STD_OUTPUT_HANDLE));
+    }
+    if (!written || !all_found) {
+        exit(1);
+    }
+}
+
+/*
+    Prompt for a password, and for a username first in RequestUsernameAndPassword.  These print an error and return
+    false, rather than exiting, if nothing usable was typed: callers are usually enumerating the store on another
+    thread meanwhile, and must wait for it before they exit.
+*/
+bool RequestPassword(const wstring& prompt, SecretBuffer& password)
+{
+    wcout << prompt;
+    echo(false);
+    const SecretLine line = ReadSecretLine(wcin, password);
+    echo(true);
+    wcout << endl;
+    if (line == SecretLine::TooLong) {
+        wcerr << L"ERROR: Password is longer than " << SECRET_BUFFER_CAPACITY << L" characters" << endl;
+        return false;
+    }
+    if (password.empty()) {
+        wcerr << L"ERROR: Empty password" << endl;
+        return false;
+    }
+    return true;
+}
+
+bool RequestUsernameAndPassword(wstring& username, SecretBuffer& password)
+{
+    wstring usernameDefault(GetUserName());
+    wcout << L"Username [ENTER to accept default '" << usernameDefault << L"']: ";
+    getline(wcin, username);
+    if (username.empty()) {
+        username = usernameDefault;
+    }
+    if (username.empty()) {
+        wcerr << L"ERROR: Empty username" << endl;
+        return false;
+    }
+
+    return RequestPassword(L"Password: ", password);
+}
+
+// How the for-defaults and for-basis commands apply their changes.
+struct UpdateOptions {
+    bool incremental; // Only write credentials whose username or password would actually change.
+    bool plan;        // Only print what would be written, without prompting or writing anything.
+};
+
+/*
+    Print what for-defaults or for-basis would do to each of the given credentials.  The password isn't known at this
+    point, so credentials which already have the given username can only be reported as possibly changing.
+*/
+void PrintUpdatePlan(
+    const vector<wstring>& target_names,
+    const CredentialSnapshot& snapshot,
+    const wstring& username,
+    const UpdateOptions& options
+) {
+    wcout << L"Plan for username '" << username << L"'"
+        << (options.incremental ? L" (incremental)" : L"") << L":" << endl << endl;
+    size_t created = 0;
+    size_t updated = 0;
+    size_t unknown = 0;
+    for (auto it = target_names.begin(); it != target_names.end(); ++it) {
+        PCREDENTIALW existing = snapshot.Find(*it);
+        if (existing == NULL) {
+            ++created;
+            wcout << L"  create:  " << *it << endl;
+        } else if (existing->UserName == NULL || username != existing->UserName) {
+            ++updated;
+            wcout << L"  update:  " << *it << L" (username '"
+                << (existing->UserName == NULL ? L"" : existing->UserName) << L"')" << endl;
+        } else if (existing->Persist != CRED_PERSIST_ENTERPRISE) {
+            ++updated;
+            wcout << L"  update:  " << *it << L" (not enterprise-persisted)" << endl;
+        } else {
+            ++unknown;
+            wcout << (options.incremental ? L"  maybe:   " : L"  rewrite: ") << *it << endl;
+        }
+    }
+    wcout << endl << created << L" to create, " << updated << L" to update, " << unknown
+        << (options.incremental ? L" to update only if the password differs." : L" to rewrite.") << endl;
+}
+
+/*
+    Add a write of the same username & password to each of the given credentials, returning how many were left out.
+    In incremental mode, "prior" must be a snapshot of the store, and credentials which it shows already hold the
+    same value are left out.
+*/
+size_t AddWriteItems(
+    vector<BulkWriteItem>& items,
+    const vector<wstring>& target_names,
+    const wstring& username,
+    const TextSpan& password,
+    const CredentialSnapshot* prior,
+    const UpdateOptions& options
+) {
+    size_t unchanged = 0;
+    for (auto it = target_names.begin(); it != target_names.end(); ++it) {
+        if (options.incremental) {
+            PCREDENTIALW existing = prior->Find(*it);
+            if (existing != NULL && CredentialHasValue(*existing, username, password)) {
+                wcout << L"Unchanged: " << *it << endl;
+                ++unchanged;
+                continue;
+            }
+        }
+        BulkWriteItem item = { *it, username, password };
+        items.push_back(item);
+    }
+    return unchanged;
+}
+
+/*
+    Apply all the writes at once, putting them all back as they were if any of them fails, and exit with 1 if so.  If
+    "prior" is not NULL, it is a snapshot of the store taken before any of the writes.
+*/
+void ApplyWriteItems(
+    CredentialBackend& backend,
+    const vector<BulkWriteItem>& items,
+    size_t unchanged,
+    const CredentialSnapshot* prior
+) {
+    if (unchanged > 0) {
+        wcout << L"Skipped " << unchanged << L" credential(s) which were already up to date." << endl;
+    }
+
+    BulkWriter writer(backend);
+    BulkWriteSummary summary;
+    bool ok = writer.Apply(items, prior, summary);
+    PrintBulkWriteSummary(summary);
+    if (!ok) {
+        exit(1);
+    }
+}
+
+/*
+    Write the same username & password to all the given credentials at once, putting them all back as they were if any
+    of the writes fails.  If "prior" is not NULL, it is a snapshot of the store taken before any of the writes; in
+    incremental mode, it must not be NULL, and credentials which it shows already hold the same value are skipped.
+*/
+void StoreCredentials(
+    CredentialBackend& backend,
+    const vector<wstring>& target_names,
+    const wstring& username,
+    const TextSpan& password,
+    const CredentialSnapshot* prior,
+    const UpdateOptions& options
+) {
+    vector<BulkWriteItem> items;
+    items.reserve(target_names.size());
+    size_t unchanged = AddWriteItems(items, target_names, username, password, prior, options);
+    ApplyWriteItems(backend, items, unchanged, prior);
+}
+
+/*
+    Start enumerating the store on another thread, so that it overlaps with reading the basis file and with waiting
+    for the user to type a username and password.
+*/
+future<unique_ptr<CredentialSnapshot>> PrefetchSnapshot(CredentialBackend& backend) {
+    return async(launch::async, [&backend]() {
+        return unique_ptr<CredentialSnapshot>(new CredentialSnapshot(backend));
+    });
+}
+
+/*
+    Update the username & password for all non-basis credentials for the given username.
+*/
+void UpdateCredentialsFromDefault(CredentialBackend& backend, const UpdateOptions& options)
+{
+    // Neither of these depends on the username, so both can be done while the user is typing.
+    auto prefetchedSnapshot = PrefetchSnapshot(backend);
+    auto prefetchedBases = async(launch::async, []() { GetBasisConfig(); });
+
+    wstring username;
+    SecretBuffer password;
+    if (options.plan) {
+        username = GetUserName();
+    } else if (!RequestUsernameAndPassword(username, password)) {
+        prefetchedSnapshot.wait();
+        prefetchedBases.wait();
+        exit(1);
+    }
+
+    wstring credentialBasisFileName = GetCredentialBasisFileName();
+    prefetchedBases.get();
+    const CredentialBases& bases = GetBasisConfig();
+    unique_ptr<CredentialSnapshot> prefetched(prefetchedSnapshot.get());
+    const CredentialSnapshot& snapshot = *prefetched;
+    auto defaultCredentials = GetDefaultCredentials(snapshot, bases, username);
+    if (defaultCredentials.empty()) {
+        wcout << L"ERROR: There are no default credentials listed in " << endl
+            << credentialBasisFileName << L"." << endl;
+        exit(1);
+    }
+
+    vector<wstring> targetNames(defaultCredentials.begin(), defaultCredentials.end());
+    if (options.plan) {
+        PrintUpdatePlan(targetNames, snapshot, username, options);
+        return;
+    }
+    StoreCredentials(backend, targetNames, username, password.span(), &snapshot, options);
+}
+
+// Returns the usernames without any repeats, ignoring case as the snapshot's username index does.
+vector<wstring> DistinctUsernames(const vector<wstring>& usernames) {
+    vector<wstring> distinct;
+    unordered_set<wstring> seen;
+    for (auto it = usernames.begin(); it != usernames.end(); ++it) {
+        if (seen.insert(FoldUsername(*it)).second) {
+            distinct.push_back(*it);
+        }
+    }
+    return distinct;
+}
+
+/*
+    Update the password for all non-basis credentials of each of several usernames, keeping each username as it is.
+    The store is enumerated once for all of them, and all the writes are applied together.
+*/
+void UpdateCredentialsFromDefaultForUsers(
+    CredentialBackend& backend,
+    const vector<wstring>& requested_usernames,
+    const UpdateOptions& options
+) {
+    auto prefetchedSnapshot = PrefetchSnapshot(backend);
+    auto prefetchedBases = async(launch::async, []() { GetBasisConfig(); });
+
+    const vector<wstring> usernames(DistinctUsernames(requested_usernames));
+    vector<SecretBuffer> passwords(usernames.size());
+    if (!options.plan) {
+        for (size_t i = 0; i < usernames.size(); ++i) {
+            if (!RequestPassword(L"Password for '" + usernames[i] + L"': ", passwords[i])) {
+                prefetchedSnapshot.wait();
+                prefetchedBases.wait();
+                exit(1);
+            }
+        }
+    }
+
+    wstring credentialBasisFileName = GetCredentialBasisFileName();
+    prefetchedBases.get();
+    const CredentialBases& bases = GetBasisConfig();
+    unique_ptr<CredentialSnapshot> snapshot(prefetchedSnapshot.get());
+
+    vector<BulkWriteItem> items;
+    size_t unchanged = 0;
+    size_t total = 0;
+    for (size_t i = 0; i < usernames.size(); ++i) {
+        auto defaultCredentials = GetDefaultCredentials(*snapshot, bases, usernames[i]);
+        vector<wstring> targetNames(defaultCredentials.begin(), defaultCredentials.end());
+        total += targetNames.size();
+        if (targetNames.empty()) {
+            wcout << L"There are no default credentials for '" << usernames[i] << L"'." << endl;
+        } else if (options.plan) {
+            PrintUpdatePlan(targetNames, *snapshot, usernames[i], options);
+            wcout << endl;
+        } else {
+            wcout << usernames[i] << L": " << targetNames.size() << L" default credential(s)." << endl;
+            unchanged += AddWriteItems(
+                items, targetNames, usernames[i], passwords[i].span(), snapshot.get(), options
+            );
+        }
+    }
+    if (total == 0) {
+        wcout << L"ERROR: There are no default credentials listed in " << endl
+            << credentialBasisFileName << L" for any of the given usernames." << endl;
+        exit(1);
+    }
+    if (!options.plan) {
+        ApplyWriteItems(backend, items, unchanged, snapshot.get());
+    }
+}
+
+// The basis credential followed by the credentials its entries stand for, with patterns expanded, without duplicates.
+vector<wstring> GetBasisTargetNames(
+    const wstring& basis,
+    const BasisEntries& entries,
+    const CredentialSnapshot& snapshot
+) {
+    vector<wstring> targetNames;
+    targetNames.push_back(HOLY_GRADLE_CREDENTIAL_PREFIX + basis);
+    unordered_set<wstring> seen(targetNames.begin(), targetNames.end());
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        vector<wstring> names = ExpandBasisEntry(*it, snapshot);
+        for (auto name = names.begin(); name != names.end(); ++name) {
+            if (seen.insert(*name).second) {
+                targetNames.push_back(*name);
+            }
+        }
+    }
+    return targetNames;
+}
+
+/*
+    Update the username & password for the basis credential and for all credentials listed under it
+    in the credential-bases.txt file.
+*/
+void UpdateCredentialsFromBasis(CredentialBackend& backend, const wstring& basis, const UpdateOptions& options)
+{
+    // The basis is checked before prompting, but the store can be enumerated meanwhile, and while the user types.
+    auto prefetchedSnapshot = PrefetchSnapshot(backend);
+
+    wstring credentialBasisFileName = GetCredentialBasisFileName();
+    const CredentialBases& bases = GetBasisConfig();
+    auto basisCredentials = bases.EntriesFor(basis);
+    if (basisCredentials.empty()) {
+        wcout << L"ERROR: There are no credentials for basis '" << basis << L"' listed in " << endl
+            << credentialBasisFileName << L"." << endl;
+        prefetchedSnapshot.wait();
+        exit(1);
+    }
+
+    if (options.plan) {
+        unique_ptr<CredentialSnapshot> snapshot(prefetchedSnapshot.get());
+        vector<wstring> targetNames = GetBasisTargetNames(basis, basisCredentials, *snapshot);
+        PrintUpdatePlan(targetNames, *snapshot, GetUserName(), options);
+        return;
+    }
+
+    wstring username;
+    SecretBuffer password;
+    if (!RequestUsernameAndPassword(username, password)) {
+        prefetchedSnapshot.wait();
+        exit(1);
+    }
+
+    // One enumeration tells us which credentials the basis's patterns cover, which need writing (in incremental
+    // mode), and what to put back if a write fails.
+    unique_ptr<CredentialSnapshot> snapshot(prefetchedSnapshot.get());
+    vector<wstring> targetNames = GetBasisTargetNames(basis, basisCredentials, *snapshot);
+    StoreCredentials(backend, targetNames, username, password.span(), snapshot.get(), options);
+}
+
+wstring DescribeRotationEntry(const RotationEntry& entry) {
+    return ((entry.scope == RotationScope::Basis) ? L"basis " : L"defaults ") + entry.name;
+}
+
+/*
+    Get the username & password for one manifest identity, either by prompting (saying which entries it's for), or by
+    reading a line for each from standard input.  Returns false, having said why, if they couldn't be read.
+*/
+bool RequestIdentitySecret(
+    const RotationManifest& manifest,
+    size_t identity_index,
+    wstring& username,
+    SecretBuffer& password
+) {
+    const RotationIdentity& identity = manifest.identities[identity_index];
+    if (identity.source == SecretSource::Prompt) {
+        wcout << L"Identity '" << identity.name << L"', for";
+        const wchar_t* separator = L" ";
+        for (auto it = manifest.entries.begin(); it != manifest.entries.end(); ++it) {
+            if (it->identity == identity_index) {
+                wcout << separator << DescribeRotationEntry(*it);
+                separator = L", ";
+            }
+        }
+        wcout << L":" << endl;
+        return RequestUsernameAndPassword(username, password);
+    }
+
+    getline(wcin, username);
+    if (!username.empty() && username.back() == L'\r') {
+        username.pop_back();
+    }
+    const SecretLine line = ReadSecretLine(wcin, password);
+    if (line == SecretLine::TooLong) {
+        wcerr << L"ERROR: The password for identity '" << identity.name << L"' is longer than "
+            << SECRET_BUFFER_CAPACITY << L" characters" << endl;
+        return false;
+    }
+    if (line == SecretLine::End || username.empty() || password.empty()) {
+        wcerr << L"ERROR: Expected a username and password for identity '" << identity.name
+            << L"' on standard input" << endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+    Print how the writes for each manifest entry went, and the overall rate.  Writes run concurrently, so the time
+    per entry is the mean time of its writes, not the time it took from start to finish.
+*/
+void PrintRotationReport(
+    const RotationManifest& manifest,
+    const unordered_map<wstring, size_t>& entry_of_target,
+    const vector<size_t>& unchanged,
+    const BulkWriteSummary& summary
+) {
+    const size_t entry_count = manifest.entries.size();
+    vector<size_t> written(entry_count, 0);
+    vector<size_t> failed(entry_count, 0);
+    vector<double> milliseconds(entry_count, 0);
+    for (auto it = summary.results.begin(); it != summary.results.end(); ++it) {
+        size_t entry = entry_of_target.at(it->target_name);
+        if (it->written) {
+            ++written[entry];
+        } else {
+            ++failed[entry];
+        }
+        milliseconds[entry] += it->milliseconds;
+    }
+
+    wcout << endl << L"Per manifest entry:" << endl;
+    for (size_t i = 0; i < entry_count; ++i) {
+        size_t attempted = written[i] + failed[i];
+        wcout << L"  " << DescribeRotationEntry(manifest.entries[i]) << L": " << written[i] << L" written, "
+            << failed[i] << L" failed, " << unchanged[i] << L" unchanged";
+        if (attempted > 0) {
+            wcout << L"; mean " << fixed << setprecision(1) << (milliseconds[i] / attempted) << L" ms per credential";
+        }
+        wcout << endl;
+    }
+    if (summary.milliseconds > 0) {
+        wcout << L"Throughput: " << fixed << setprecision(1)
+            << (summary.results.size() * 1000.0 / summary.milliseconds) << L" credential(s) per second." << endl;
+    }
+}
+
+/*
+    Rotate the credentials for every entry in a manifest in one go: read the basis file and enumerate the store once,
+    ask for each identity's username & password once, then apply all the writes as a single bulk write, which is
+    rolled back as a whole if any part of it fails.
+*/
+void RotateFromManifest(CredentialBackend& backend, const wstring& manifest_file, const UpdateOptions& options) {
+    auto prefetchedSnapshot = PrefetchSnapshot(backend);
+
+    RotationManifest manifest;
+    bool ok = ReadRotationManifest(manifest_file, manifest);
+    const CredentialBases& bases = GetBasisConfig();
+    for (auto it = manifest.entries.begin(); ok && it != manifest.entries.end(); ++it) {
+        if (it->scope == RotationScope::Basis && !bases.IsBasis(it->name)) {
+            wcerr << L"ERROR: Line " << it->line << L" of " << manifest_file << L": There is no basis '" << it->name
+                << L"' in " << GetCredentialBasisFileName() << L"." << endl;
+            ok = false;
+        }
+    }
+    if (!ok) {
+        prefetchedSnapshot.wait();
+        exit(1);
+    }
+
+    // Ask for all the secrets up front, while the store is enumerated.
+    vector<wstring> usernames(manifest.identities.size());
+    vector<SecretBuffer> passwords(manifest.identities.size());
+    if (!options.plan) {
+        for (size_t i = 0; i < manifest.identities.size(); ++i) {
+            if (!RequestIdentitySecret(manifest, i, usernames[i], passwords[i])) {
+                prefetchedSnapshot.wait();
+                exit(1);
+            }
+        }
+    }
+
+    // Work out every entry's credentials from the one snapshot.  A credential covered by several entries is written
+    // once, and counted against the first; but entries with different identities mustn't overlap.
+    unique_ptr<CredentialSnapshot> snapshot(prefetchedSnapshot.get());
+    const size_t entry_count = manifest.entries.size();
+    vector<vector<wstring>> entry_targets(entry_count);
+    unordered_map<wstring, size_t> entry_of_target;
+    for (size_t i = 0; i < entry_count; ++i) {
+        const RotationEntry& entry = manifest.entries[i];
+        vector<wstring> targets;
+        if (entry.scope == RotationScope::Basis) {
+            targets = GetBasisTargetNames(entry.name, bases.EntriesFor(entry.name), *snapshot);
+        } else {
+            auto defaults = GetDefaultCredentials(*snapshot, bases, entry.name);
+            targets.assign(defaults.begin(), defaults.end());
+        }
+        for (auto it = targets.begin(); it != targets.end(); ++it) {
+            auto inserted = entry_of_target.emplace(*it, i);
+            if (inserted.second) {
+                entry_targets[i].push_back(*it);
+            } else if (manifest.entries[inserted.first->second].identity != entry.identity) {
+                wcerr << L"ERROR: " << *it << L" is covered by both '"
+                    << DescribeRotationEntry(manifest.entries[inserted.first->second]) << L"' and '"
+                    << DescribeRotationEntry(entry) << L"', which have different identities." << endl;
+                ok = false;
+            }
+        }
+    }
+    if (!ok) {
+        exit(1);
+    }
+
+    if (options.plan) {
+        for (size_t i = 0; i < entry_count; ++i) {
+            const RotationEntry& entry = manifest.entries[i];
+            wcout << DescribeRotationEntry(entry) << L" (identity '" << manifest.identities[entry.identity].name
+                << L"')" << endl;
+            const wstring& username = (entry.scope == RotationScope::Defaults) ? entry.name : GetUserName();
+            PrintUpdatePlan(entry_targets[i], *snapshot, username, options);
+            wcout << endl;
+        }
+        return;
+    }
+
+    vector<BulkWriteItem> items;
+    items.reserve(entry_of_target.size());
+    vector<size_t> unchanged(entry_count, 0);
+    for (size_t i = 0; i < entry_count; ++i) {
+        size_t identity = manifest.entries[i].identity;
+        unchanged[i] = AddWriteItems(
+            items, entry_targets[i], usernames[identity], passwords[identity].span(), snapshot.get(), options
+        );
+    }
+
+    BulkWriter writer(backend);
+    BulkWriteSummary summary;
+    bool written = writer.Apply(items, snapshot.get(), summary);
+    PrintBulkWriteSummary(summary);
+    PrintRotationReport(manifest, entry_of_target, unchanged, summary);
+    if (!written) {
+        exit(1);
+    }
+}
+
+void ListBases() {
+    wstring credentialBasisFileName = GetCredentialBasisFileName();
+    const CredentialBases& bases = GetBasisConfig();
+    TraceSpan span("Output");
+    wcout << L"The following basis credentials exist in " << credentialBasisFileName << L":" << endl << endl;
+    const auto& names = bases.Names();
+    for (auto it = names.begin(); it != names.end(); ++it) {
+        wcout << *it << endl;
+    }
+}
+
+// Add an entry to, or remove one from, a basis in the basis file, for the add-to-basis and remove-from-basis commands.
+void EditBasis(BasisFileEdit edit, const wstring& basis, const wstring& entry) {
+    wstring credentialBasisFileName = GetCredentialBasisFileName();
+    BasisFileEditResult result = EditBasisFile(credentialBasisFileName, edit, basis, entry);
+    if (result == BasisFileEditResult::Failed) {
+        exit(1);
+    }
+    if (edit == BasisFileEdit::Add) {
+        wcout << (result == BasisFileEditResult::Changed ? L"Added: " : L"Already listed: ") << entry
+            << L" under " << basis << endl;
+    } else {
+        wcout << (result == BasisFileEditResult::Changed ? L"Removed: " : L"Not listed: ") << entry
+            << L" under " << basis << endl;
+    }
+}
+
+const wchar_t* VerifyStatusName(VerifyStatus status) {
+    switch (status) {
+    case VerifyStatus::Passed: return L"PASSED";
+    case VerifyStatus::Rejected: return L"REJECTED";
+    case VerifyStatus::Failed: return L"FAILED";
+    case VerifyStatus::Inconclusive: return L"INCONCLUSIVE";
+    default: return L"SKIPPED";
+    }
+}
+
+/*
+    Check the credentials which 'for-basis <basis>' (or, with no basis, 'for-defaults') would update against the
+    servers they are for, and report which are accepted, and how long each took.  Exits with 1 if any are rejected
+    or couldn't be checked, or otherwise with 2 if the server couldn't say whether any were accepted.
+*/
+void VerifyCredentialSet(CredentialBackend& backend, const wstring& basis, const VerifyOptions& options) {
+    auto prefetchedBases = async(launch::async, []() { GetBasisConfig(); });
+    CredentialSnapshot snapshot(backend);
+    prefetchedBases.get();
+    const CredentialBases& bases = GetBasisConfig();
+    wstring credentialBasisFileName = GetCredentialBasisFileName();
+    vector<wstring> targetNames;
+    if (basis.empty()) {
+        auto defaultCredentials = GetDefaultCredentials(snapshot, bases, GetUserName());
+        if (defaultCredentials.empty()) {
+            wcout << L"ERROR: There are no default credentials listed in " << endl
+                << credentialBasisFileName << L"." << endl;
+            exit(1);
+        }
+        targetNames.assign(defaultCredentials.begin(), defaultCredentials.end());
+    } else {
+        auto basisCredentials = bases.EntriesFor(basis);
+        if (basisCredentials.empty()) {
+            wcout << L"ERROR: There are no credentials for basis '" << basis << L"' listed in " << endl
+                << credentialBasisFileName << L"." << endl;
+            exit(1);
+        }
+        targetNames = GetBasisTargetNames(basis, basisCredentials, snapshot);
+    }
+
+    vector<VerifyResult> results = VerifyCredentials(snapshot, targetNames, options);
+
+    TraceSpan span("Output");
+    size_t counts[5] = { 0 };
+    for (auto it = results.begin(); it != results.end(); ++it) {
+        ++counts[(size_t)it->status];
+        wcout << left << setw(14) << VerifyStatusName(it->status) << right;
+        if (it->status == VerifyStatus::Skipped) {
+            wcout << setw(11) << L"";
+        } else {
+            wcout << setw(8) << (unsigned long)(it->milliseconds + 0.5) << L" ms";
+        }
+        wcout << L"  " << it->target_name;
+        if (it->http_status != 0 && it->status != VerifyStatus::Passed) {
+            wcout << L" (HTTP " << it->http_status << L")";
+        } else if (it->error != 0 && it->note.empty()) {
+            wcout << L" (errno " << it->error << L")";
+        }
+        if (!it->note.empty()) {
+            wcout << L" (" << it->note << L")";
+        }
+        wcout << endl;
+    }
+    const size_t failures = counts[(size_t)VerifyStatus::Rejected] + counts[(size_t)VerifyStatus::Failed];
+    wcout << endl << L"Verified " << results.size() << L" credential(s): "
+        << counts[(size_t)VerifyStatus::Passed] << L" passed, "
+        << counts[(size_t)VerifyStatus::Rejected] << L" rejected, "
+        << counts[(size_t)VerifyStatus::Failed] << L" failed, "
+        << counts[(size_t)VerifyStatus::Inconclusive] << L" inconclusive, "
+        << counts[(size_t)VerifyStatus::Skipped] << L" skipped." << endl;
+    if (failures > 0) {
+        exit(1);
+    }
+    if (counts[(size_t)VerifyStatus::Inconclusive] > 0) {
+        exit(2);
+    }
+}
+
+// Prints the target name of the stored credential to use for a repository URL.
+void ResolveUrl(CredentialBackend& backend, const wstring& url, const wstring& username) {
+    auto prefetchedBases = async(launch::async, []() { GetBasisConfig(); });
+    CredentialSnapshot snapshot(backend);
+    prefetchedBases.get();
+    CredentialResolver resolver(snapshot, GetBasisConfig());
+    wstring target_name;
+    if (!resolver.Resolve(url, username, target_name)) {
+        wcerr << L"ERROR: No stored credential matches " << url << L"." << endl;
+        exit(1);
+    }
+
+    TraceSpan span("Output");
+    wcout << target_name << endl;
+}
+
+void ListBasis(CredentialBackend& backend, const wstring& basis) {
+    wstring credentialBasisFileName = GetCredentialBasisFileName();
+    const CredentialBases& bases = GetBasisConfig();
+    auto basisCredentials = bases.EntriesFor(basis);
+
+    // Only enumerate the store if there are patterns to expand.
+    unique_ptr<CredentialSnapshot> snapshot;
+    for (auto it = basisCredentials.begin(); it != basisCredentials.end() && !snapshot; ++it) {
+        if (IsGlobPattern(*it)) {
+            snapshot.reset(new CredentialSnapshot(backend));
+        }
+    }
+
+    TraceSpan span("Output");
+    if (basisCredentials.empty()) {
+        wcout << L"There are no Git, or Mercurial credentials listed for " << basis << L" in " << endl
+            << credentialBasisFileName << L"." << endl;
+    } else {
+        wcout << L"The following Git or Mercurial credentials are listed for " << basis << L" in " << endl
+            << credentialBasisFileName << L":" << endl << endl;
+        for (auto it = basisCredentials.begin(); it != basisCredentials.end(); ++it) {
+            wcout << *it << endl;
+            if (!IsGlobPattern(*it)) {
+                continue;
+            }
+            vector<wstring> matches = ExpandBasisEntry(*it, *snapshot);
+            if (matches.empty()) {
+                wcout << L"    (matches no stored credentials)" << endl;
+            }
+            for (auto match = matches.begin(); match != matches.end(); ++match) {
+                wcout << L"    " << *match << endl;
+            }
+        }
+    }
+}
+
+/*
+    List the default credentials of each of the given usernames.  The snapshot indexes every credential by its
+    embedded username, so this is one enumeration however many usernames there are.
+*/
+void ListDefaults(CredentialBackend& backend, const vector<wstring>& usernames) {
+    wstring credentialBasisFileName = GetCredentialBasisFileName();
+    const CredentialBases& bases = GetBasisConfig();
+    CredentialSnapshot snapshot(backend);
+    const vector<wstring> distinct(DistinctUsernames(usernames));
+    for (auto user = distinct.begin(); user != distinct.end(); ++user) {
+        auto defaultCredentials = GetDefaultCredentials(snapshot, bases, *user);
+        TraceSpan span("Output", user->c_str());
+        if (distinct.size() > 1) {
+            wcout << (user == distinct.begin() ? L"" : L"\n") << L"Username '" << *user << L"':" << endl;
+        }
+        if (defaultCredentials.empty()) {
+            wcout << L"There are no Git, Mercurial, and Holy Gradle credentials listed in " << endl
+                << credentialBasisFileName << L"." << endl;
+        } else {
+            wcout << L"The following Git, Mercurial, and Holy Gradle credentials are not listed in " << endl
+                << credentialBasisFileName << L":" << endl << endl;
+            for (auto it = defaultCredentials.begin(); it != defaultCredentials.end(); ++it) {
+                wcout << *it << endl;
+            }
+        }
+    }
+}
+
+void WriteCredentialInventory(CredentialBackend& backend, const InventoryOptions& options) {
+    auto prefetchedBases = async(launch::async, []() { GetBasisConfig(); });
+    CredentialSnapshot snapshot(backend);
+    prefetchedBases.get();
+    if (!WriteInventory(snapshot, GetBasisConfig(), options, ::GetStdHandle(STD_OUTPUT_HANDLE))) {
+        exit(1);
+    }
+}
+
+/*
+    Report the credentials which hold a different password from the rest of their basis, or from the rest of their
+    user's default credentials.  Only digests are compared, so no password is ever shown.  Exits with 1 if there are
+    any.
+*/
+void CheckCredentials(CredentialBackend& backend) {
+    auto prefetchedBases = async(launch::async, []() { GetBasisConfig(); });
+    CredentialSnapshot snapshot(backend);
+    prefetchedBases.get();
+    vector<DriftGroup> groups;
+    if (!FindCredentialDrift(snapshot, GetBasisConfig(), groups)) {
+        exit(1);
+    }
+
+    TraceSpan span("Output");
+    size_t checked = 0;
+    size_t outliers = 0;
+    for (auto group = groups.begin(); group != groups.end(); ++group) {
+        checked += group->members.size();
+        outliers += group->outliers.size();
+        wcout << (group->is_basis ? L"Basis '" : L"Username '") << group->name << L"': "
+            << group->members.size() << L" credential(s), ";
+        if (group->outliers.empty()) {
+            wcout << L"consistent." << endl;
+            continue;
+        }
+        if (group->no_majority) {
+            wcout << L"no password is held by a majority:" << endl;
+        } else {
+            wcout << group->outliers.size() << L" differ from the rest:" << endl;
+        }
+        for (auto it = group->outliers.begin(); it != group->outliers.end(); ++it) {
+            wcout << L"    " << snapshot[*it]->TargetName << endl;
+        }
+    }
+    wcout << endl << L"Checked " << checked << L" credential(s) in " << groups.size() << L" group(s); " << outliers
+        << L" differ from the rest of their group." << endl;
+    if (outliers > 0) {
+        exit(1);
+    }
+}
+
+void ShowUsage(wchar_t* program_name) {
+    wcout << L"Usage: " << program_name << L" [<options>] <command> <arguments>" << endl;
+    wcout << endl;
+    wcout << L"Main commands:" << endl;
+    wcout << endl;
+    wcout << L"  " << program_name << L" for-defaults" << endl;
+    wcout << L"    Prompts for a username and password, then sets them as the content of" << endl;
+    wcout << L"    credential \"" << HOLY_GRADLE_CREDENTIAL_PREFIX L"Domain Credentials\"," << endl;
+    wcout << L"    all Git and Mercurial credentials not listed under any name in" << endl;
+    wcout << L"    " << GetCredentialBasisFileName() << L", and" << endl;
+    wcout << L"    all \"" << HOLY_GRADLE_CREDENTIAL_PREFIX << L"*\" credentials not listed as bases there." << endl;
+    wcout << endl;
+    wcout << L"  " << program_name << L" for-defaults <username> [<username>...]" << endl;
+    wcout << L"    As above, for the credentials of each <username>, keeping the username and prompting" << endl;
+    wcout << L"    for a new password for each.  The store is read once, and all the writes made together." << endl;
+    wcout << endl;
+    wcout << L"  " << program_name << L" for-basis <basis_name>" << endl;
+    wcout << L"    Prompts for a username and password, then sets them as the content of" << endl;
+    wcout << L"    credential \"" << HOLY_GRADLE_CREDENTIAL_PREFIX << L"<basis_name>\", and" << endl;
+    wcout << L"    all credentials listed under <basis_name> in" << endl;
+    wcout << L"    " << GetCredentialBasisFileName() << endl;
+    wcout << L"    Entries there may be patterns, where '*' matches any run of characters and '?'" << endl;
+    wcout << L"    any one character; these cover every stored Git or Mercurial credential they match." << endl;
+    wcout << endl;
+    wcout << L"  " << program_name << L" rotate " MANIFEST_OPTION L" <file>" << endl;
+    wcout << L"    Does the work of several for-basis and for-defaults commands at once, as listed in" << endl;
+    wcout << L"    <file>: one line per entry, either 'basis <basis_name>' or 'defaults <username>', each" << endl;
+    wcout << L"    optionally followed by indented 'identity <name>' and 'secret prompt|stdin' lines." << endl;
+    wcout << L"    Entries with the same identity (all of them, if none is named) get the same username" << endl;
+    wcout << L"    and password, which are asked for once, or read from standard input as two lines." << endl;
+    wcout << L"    All the writes are made together, and rolled back together if any fails." << endl;
+    wcout << endl;
+    wcout << L"Other commands:" << endl;
+    wcout << endl;
+    wcout << L"  " << program_name << L" list-defaults [<username>...]" << endl;
+    wcout << L"    Lists all the credentials which would be updated by the 'for-default' command" << endl;
+    wcout << L"    for each given <username> (default: '" << GetUserName() << "')." << endl;
+    wcout << endl;
+    wcout << L"  " << program_name << L" list-bases" << endl;
+    wcout << L"    Lists all the <basis_name> values in" << endl;
+    wcout << L"    " << GetCredentialBasisFileName() << endl;
+    wcout << endl;
+    wcout << L"  " << program_name << L" list-basis <basis_name>" << endl;
+    wcout << L"    Lists all the credentials which would be updated by the 'for-basis <basis_name>' command" << endl;
+    wcout << L"    (apart from the basis credential itself), with the stored credentials each pattern matches." << endl;
+    wcout << endl;
+    wcout << L"  " << program_name << L" add-to-basis <basis_name> <credential_name>" << endl;
+    wcout << L"    Lists <credential_name> (which may be a pattern) under <basis_name> in" << endl;
+    wcout << L"    " << GetCredentialBasisFileName() << L"," << endl;
+    wcout << L"    and removes it from any other basis, leaving the rest of the file as it was." << endl;
+    wcout << endl;
+    wcout << L"  " << program_name << L" remove-from-basis <basis_name> <credential_name>" << endl;
+    wcout << L"    Stops listing <credential_name> under <basis_name>, removing the basis if nothing is" << endl;
+    wcout << L"    left under it.  Edits by several processes at once are applied one at a time, and" << endl;
+    wcout << L"    readers always see a complete file." << endl;
+    wcout << endl;
+    wcout << L"  " << program_name << L" check" << endl;
+    wcout << L"    Lists any credentials which hold a different password from most of the others listed" << endl;
+    wcout << L"    under the same basis, or from most of the others with the same username and no basis." << endl;
+    wcout << L"    Passwords are compared by keyed digest, and never shown.  Exits with 1 if any differ." << endl;
+    wcout << endl;
+    wcout << L"  " << program_name << L" verify [" VERIFY_JOBS_OPTION L"<n>] [" VERIFY_TIMEOUT_OPTION L"<seconds>] [<basis_name>]" << endl;
+    wcout << L"    Checks that the credentials which 'for-basis <basis_name>' (or, with no <basis_name>," << endl;
+    wcout << L"    'for-defaults') would update are accepted by their Git or Mercurial servers, sending one" << endl;
+    wcout << L"    request for each, with up to <n> (default: " << DEFAULT_VERIFY_JOBS << L") at once, each allowed" << endl;
+    wcout << L"    <seconds> (default: " << DEFAULT_VERIFY_TIMEOUT_SECONDS << L") per step.  Reports each result and time taken," << endl;
+    wcout << L"    and exits with 1 if any credential is rejected or can't be checked, or with 2 if any" << endl;
+    wcout << L"    server's answer (a 404 for a credential for a whole host) doesn't show either way." << endl;
+    wcout << endl;
+    wcout << L"  " << program_name << L" resolve <url> [<username>]" << endl;
+    wcout << L"    Outputs the name of the stored credential to use for the repository at <url>: the Git or" << endl;
+    wcout << L"    Mercurial credential for the longest prefix of <url>, or the basis credential for a URL" << endl;
+    wcout << L"    listed in the basis file but not stored yet.  Credentials for <username> (default: the" << endl;
+    wcout << L"    user in <url>, else any, preferring '" << GetUserName() << L"') come first." << endl;
+    wcout << endl;
+    wcout << L"  " << program_name << L" inventory [" INVENTORY_JSONL_OPTION L"] [" INVENTORY_DIGEST_OPTION L"]" << endl;
+    wcout << L"    Writes a line for every stored credential, as CSV (or JSON Lines with " INVENTORY_JSONL_OPTION L")," << endl;
+    wcout << L"    with its target, type, persist, username, kind, basis, blob_length and last_written (UTC)." << endl;
+    wcout << L"    Passwords are never written; " INVENTORY_DIGEST_OPTION L" adds a digest of each one, keyed afresh" << endl;
+    wcout << L"    for each run, so that equal passwords can be spotted within one inventory." << endl;
+    wcout << endl;
+    wcout << L"  " << program_name << L" get <credential_name>" << endl;
+    wcout << L"    Outputs the content of the named credential; normally \"<username>&&&<password>\"." << endl;
+    wcout << L"    With " FORMAT_OPTION L"binary or " FORMAT_OPTION L"json, any number of credential names may be given." << endl;
+    wcout << endl;
+    wcout << L"  " << program_name << L" set <credential_name> <username> <password>" << endl;
+    wcout << L"    Sets the content of the named credential to \"<username>&&&<password>\"." << endl;
+    wcout << endl;
+    wcout << L"  " << program_name << L" batch" << endl;
+    wcout << L"    Reads requests from standard input, one per line, until end of input or \"quit\"." << endl;
+    wcout << L"    Each request is a command and its arguments, separated by tabs; the commands are" << endl;
+    wcout << L"    get, set, list-defaults, list-bases and list-basis, taking the same arguments as above." << endl;
+    wcout << L"    Each response is a line \"OK <length>\" or \"ERROR <length>\", followed by <length>" << endl;
+    wcout << L"    bytes of UTF-8 content.  The credentials and basis file are only read once per session." << endl;
+    wcout << endl;
+    wcout << L"  " << program_name << L" serve [<ttl_seconds>] [" DAEMON_SOCKET_OPTION L"<path>]" << endl;
+    wcout << L"    Runs until killed, answering requests as for 'batch' from any number of clients, on" << endl;
+    wcout << L"    " << GetDaemonPipeName() << endl;
+    wcout << L"    or, with " DAEMON_SOCKET_OPTION L", on a Unix domain socket created at <path>, in a directory" << endl;
+    wcout << L"    you own; only you can use it.  Credentials and bases are cached for <ttl_seconds>" << endl;
+    wcout << L"    (default: " << DEFAULT_DAEMON_TTL_SECONDS << L"; 0 means no limit), and re-read after a 'set'"
+        << endl;
+    wcout << L"    request or when the basis file changes." << endl;
+    wcout << endl;
+    wcout << L"  " << program_name << L" client [" DAEMON_SOCKET_OPTION L"<path>] <command> [<arguments>]" << endl;
+    wcout << L"    Sends one request to the 'serve' process, on its pipe or socket, and outputs the response" << endl;
+    wcout << L"    content." << endl;
+    wcout << endl;
+    wcout << L"  " << program_name << L" git-helper get|store|erase" << endl;
+    wcout << L"    Acts as a git credential helper, reading the request from standard input and, for" << endl;
+    wcout << L"    'get', writing the username and password to standard output.  To use it, run:" << endl;
+    wcout << L"      git config --global credential.helper \"!'<path_to>/credential-store.exe' git-helper\"" << endl;
+    wcout << L"    Credentials are stored as \"git:<protocol>://<host>[/<path>]\", and found under that" << endl;
+    wcout << L"    name or with \"<username>@\" before the host." << endl;
+    wcout << endl;
+    wcout << L"Options:" << endl;
+    wcout << endl;
+    wcout << L"  " FORMAT_OPTION L"text|binary|json" << endl;
+    wcout << L"    How 'get' writes credentials.  'text' (the default) is \"<username>&&&<password>\"." << endl;
+    wcout << L"    'binary' is a 32-bit record count, then for each credential a byte which is 1 if it was" << endl;
+    wcout << L"    found (0 if not), followed by a 32-bit byte count and the UTF-8 bytes of the username," << endl;
+    wcout << L"    then the same for the password; all integers are little-endian.  'json' is an object" << endl;
+    wcout << L"    {\"target\", \"username\", \"password\"} (or {\"target\", \"error\"} if it wasn't found)" << endl;
+    wcout << L"    for one credential, or an array of them for several." << endl;
+    wcout << endl;
+    wcout << L"  " INCREMENTAL_OPTION << endl;
+    wcout << L"    For for-defaults, for-basis and rotate, only write credentials whose username or password" << endl;
+    wcout << L"    would change." << endl;
+    wcout << endl;
+    wcout << L"  " PLAN_OPTION << endl;
+    wcout << L"    For for-defaults, for-basis and rotate, list the credentials which would be created or" << endl;
+    wcout << L"    updated for the current user name, without prompting or writing anything." << endl;
+    wcout << endl;
+    wcout << L"  " TRACE_OPTION L"<file>" << endl;
+    wcout << L"    Records how long each stage takes (reading the environment and the basis file, reading," << endl;
+    wcout << L"    classifying and writing credentials, and output), and writes it to <file> on exit in" << endl;
+    wcout << L"    Chrome trace-event JSON, with timestamps in microseconds since 1970." << endl;
+    wcout << endl;
+    wcout << L"  " BACKEND_OPTION L"<backend>" << endl;
+    wcout << L"    Where credentials are stored: 'windows' (the Windows Credential Manager), 'memory'" << endl;
+    wcout << L"    (discarded on exit), or 'file:<path>' (a file encrypted for the current user)." << endl;
+    wcout << L"    The default is the value of " CREDENTIAL_BACKEND_ENV_VAR_NAME L" if set, otherwise 'windows'." << endl;
+    wcout << endl;
+}
+
+int _tmain(int argc, wchar_t* argv[]) {
+    int exit_code;
+    if (RunFastCommand(argc, argv, exit_code)) {
+        return exit_code;
+    }
+
+    wchar_t* program_name = argv[0];
+    wstring backend_spec;
+    UpdateOptions update_options = { false, false };
+    OutputFormat output_format = OutputFormat::Text;
+    const size_t format_option_length = _countof(FORMAT_OPTION) - 1;
+    const size_t trace_option_length = _countof(TRACE_OPTION) - 1;
+    const size_t backend_option_length = _countof(BACKEND_OPTION) - 1;
+    while (argc > 1 && wcsncmp(argv[1], L"--", 2) == 0) {
+        if (wcsncmp(argv[1], BACKEND_OPTION, backend_option_length) == 0) {
+            backend_spec = argv[1] + backend_option_length;
+        } else if (wcsncmp(argv[1], FORMAT_OPTION, format_option_length) == 0) {
+            if (!ParseOutputFormat(argv[1] + format_option_length, output_format)) {
+                ShowUsage(program_name);
+                exit(1);
+            }
+        } else if (wcsncmp(argv[1], TRACE_OPTION, trace_option_length) == 0 && argv[1][trace_option_length] != 0) {
+            StartTracing(argv[1] + trace_option_length);
+        } else if (wcscmp(argv[1], INCREMENTAL_OPTION) == 0) {
+            update_options.incremental = true;
+        } else if (wcscmp(argv[1], PLAN_OPTION) == 0) {
+            update_options.plan = true;
+        } else {
+            ShowUsage(program_name);
+            exit(1);
+        }
+        // Drop the option, so that the command is always argv[1].
+        ++argv;
+        --argc;
+        argv[0] = program_name;
+    }
+
+    if (argc == 1) {
+        ShowUsage(argv[0]);
+        exit(1);
+    }
+
+    unique_ptr<CredentialBackend> backend(CreateCredentialBackend(backend_spec));
+    if (!backend) {
+        exit(1);
+    }
+
+    // Commands are matched ignoring case.  The original commands may be abbreviated, as they always could; the later
+    // ones must be given in full, so that an abbreviation which once failed (such as "s" with the wrong number of
+    // arguments for "set") can't start something else instead.
+    const TextSpan command(argv[1], wcsnlen_s(argv[1], INPUT_LENGTH_LIMIT));
+
+    if (StartsWithIgnoreCase(L"get", command) && argc == 3 && output_format == OutputFormat::Text) {
+        wstring readKey(argv[2]);
+        ReadAndPrintCredential(*backend, readKey);
+    } else if (StartsWithIgnoreCase(L"get", command) && argc >= 3 && output_format != OutputFormat::Text) {
+        ReadAndWriteCredentials(*backend, vector<wstring>(argv + 2, argv + argc), output_format);
+    } else if (StartsWithIgnoreCase(L"set", command) && argc == 5) {
+        wstring writeKey(argv[2]);
+        wstring username(argv[3]);
+        StoreCredential(*backend, writeKey, username, argv[4]);
+    } else if (StartsWithIgnoreCase(L"for-basis", command) && argc == 3) {
+        UpdateCredentialsFromBasis(*backend, argv[2], update_options);
+    } else if (EqualsIgnoreCase(command, L"rotate") && argc == 4 && wcscmp(argv[2], MANIFEST_OPTION) == 0) {
+        RotateFromManifest(*backend, argv[3], update_options);
+    } else if (StartsWithIgnoreCase(L"for-defaults", command) && argc == 2) {
+        UpdateCredentialsFromDefault(*backend, update_options);
+    } else if (StartsWithIgnoreCase(L"for-defaults", command) && argc >= 3) {
+        UpdateCredentialsFromDefaultForUsers(*backend, vector<wstring>(argv + 2, argv + argc), update_options);
+    } else if (StartsWithIgnoreCase(L"list-bases", command) && argc == 2) {
+        ListBases();
+    } else if (StartsWithIgnoreCase(L"list-basis", command) && argc == 3) {
+        ListBasis(*backend, argv[2]);
+    } else if (StartsWithIgnoreCase(L"list-defaults", command) && argc == 2) {
+        ListDefaults(*backend, vector<wstring>(1, GetUserName()));
+    } else if (StartsWithIgnoreCase(L"list-defaults", command) && argc >= 3) {
+        ListDefaults(*backend, vector<wstring>(argv + 2, argv + argc));
+    } else if (EqualsIgnoreCase(command, L"add-to-basis") && argc == 4) {
+        EditBasis(BasisFileEdit::Add, argv[2], argv[3]);
+    } else if (EqualsIgnoreCase(command, L"remove-from-basis") && argc == 4) {
+        EditBasis(BasisFileEdit::Remove, argv[2], argv[3]);
+    } else if (EqualsIgnoreCase(command, L"check") && argc == 2) {
+        CheckCredentials(*backend);
+    } else if (EqualsIgnoreCase(command, L"verify") && argc >= 2) {
+        VerifyOptions verify_options = { DEFAULT_VERIFY_JOBS, DEFAULT_VERIFY_TIMEOUT_SECONDS * 1000 };
+        const size_t jobs_option_length = _countof(VERIFY_JOBS_OPTION) - 1;
+        const size_t timeout_option_length = _countof(VERIFY_TIMEOUT_OPTION) - 1;
+        wstring basis;
+        for (int i = 2; i < argc; ++i) {
+            if (wcsncmp(argv[i], VERIFY_JOBS_OPTION, jobs_option_length) == 0) {
+                verify_options.jobs = wcstoul(argv[i] + jobs_option_length, NULL, 10);
+            } else if (wcsncmp(argv[i], VERIFY_TIMEOUT_OPTION, timeout_option_length) == 0) {
+                verify_options.timeout_ms = wcstoul(argv[i] + timeout_option_length, NULL, 10) * 1000;
+            } else if (basis.empty()) {
+                basis = argv[i];
+            } else {
+                ShowUsage(argv[0]);
+                exit(1);
+            }
+        }
+        if (verify_options.jobs == 0 || verify_options.jobs > MAX_VERIFY_JOBS || verify_options.timeout_ms == 0) {
+            ShowUsage(argv[0]);
+            exit(1);
+        }
+        VerifyCredentialSet(*backend, basis, verify_options);
+    } else if (EqualsIgnoreCase(command, L"resolve") && (argc == 3 || argc == 4)) {
+        ResolveUrl(*backend, argv[2], (argc == 4) ? wstring(argv[3]) : wstring());
+    } else if (EqualsIgnoreCase(command, L"inventory") && argc <= 4) {
+        InventoryOptions inventory_options = { InventoryFormat::Csv, false };
+        for (int i = 2; i < argc; ++i) {
+            if (wcscmp(argv[i], INVENTORY_JSONL_OPTION) == 0) {
+                inventory_options.format = InventoryFormat::JsonLines;
+            } else if (wcscmp(argv[i], INVENTORY_DIGEST_OPTION) == 0) {
+                inventory_options.digests = true;
+            } else {
+                ShowUsage(argv[0]);
+                exit(1);
+            }
+        }
+        WriteCredentialInventory(*backend, inventory_options);
+    } else if (EqualsIgnoreCase(command, L"batch") && argc == 2) {
+        CredentialSession session(*backend);
+        RunBatchSession(session, ::GetStdHandle(STD_INPUT_HANDLE), ::GetStdHandle(STD_OUTPUT_HANDLE));
+    } else if (EqualsIgnoreCase(command, L"serve") && argc <= 4) {
+        const size_t socket_option_length = _countof(DAEMON_SOCKET_OPTION) - 1;
+        DWORD ttl_seconds = DEFAULT_DAEMON_TTL_SECONDS;
+        wstring socket_path;
+        for (int i = 2; i < argc; ++i) {
+            if (wcsncmp(argv[i], DAEMON_SOCKET_OPTION, socket_option_length) == 0) {
+                socket_path = argv[i] + socket_option_length;
+            } else if (i == 2) {
+                wchar_t* end;
+                ttl_seconds = wcstoul(argv[i], &end, 10);
+                if (*end != L'\0' || ttl_seconds > MAX_DAEMON_TTL_SECONDS) {
+                    wcerr << L"ERROR: The cache TTL must be a number of seconds from 0 to " << MAX_DAEMON_TTL_SECONDS
+                        << L"." << endl;
+                    exit(1);
+                }
+            } else {
+                ShowUsage(argv[0]);
+                exit(1);
+            }
+        }
+        return ServeCredentials(*backend, ttl_seconds, socket_path);
+    } else if (EqualsIgnoreCase(command, L"client") && argc >= 3) {
+        const size_t socket_option_length = _countof(DAEMON_SOCKET_OPTION) - 1;
+        wstring socket_path;
+        int first_field = 2;
+        if (wcsncmp(argv[2], DAEMON_SOCKET_OPTION, socket_option_length) == 0) {
+            socket_path = argv[2] + socket_option_length;
+            ++first_field;
+        }
+        if (first_field == argc) {
+            ShowUsage(argv[0]);
+            exit(1);
+        }
+        return SendDaemonRequest(socket_path, vector<wstring>(argv + first_field, argv + argc));
+    } else if (EqualsIgnoreCase(command, L"git-helper") && argc == 3) {
+        return RunGitHelper(*backend, argv[2]);
+    } else {
+        ShowUsage(argv[0]);
+        exit(1);
+    }
+}
@@ -0,0 +1,316 @@
+#include "stdafx.h"
+
+#include "credential-verify.h"
+#include "secret-buffer.h"
+#include "trace.h"
+
+#include <windows.h>
+#include <winhttp.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#pragma hdrstop
+
+#pragma comment(lib, "winhttp.lib")
+
+#define VERIFY_USER_AGENT L"credential-store"
+// How much of a response body is read so that its connection can be reused; a connection sending more is dropped.
+#define VERIFY_DRAIN_LIMIT (64 * 1024)
+
+using namespace std;
+
+namespace {
+    // Closes a WinHTTP handle when it goes out of scope.
+    class InternetHandle {
+    public:
+        explicit InternetHandle(HINTERNET handle) : handle_(handle) {}
+        ~InternetHandle() {
+            if (handle_ != NULL) {
+                ::WinHttpCloseHandle(handle_);
+            }
+        }
+
+        HINTERNET get() const { return handle_; }
+
+    private:
+        InternetHandle(const InternetHandle&);
+        InternetHandle& operator=(const InternetHandle&);
+
+        HINTERNET handle_;
+    };
+
+    // Where to send the request which checks one credential.
+    struct Probe {
+        size_t result;
+        PCREDENTIALW credential;
+        CredentialKind kind;
+        wstring host;
+        INTERNET_PORT port;
+        bool secure;
+        wstring path;  // Including the query.
+        bool host_level;  // A Git credential for a whole host, rather than for one repository.
+    };
+
+    wstring UrlPart(const wchar_t* part, DWORD length) {
+        return (part == NULL) ? wstring() : wstring(part, length);
+    }
+
+    // Works out the probe for a credential, or returns false with the reason there isn't one.
+    bool GetProbe(PCREDENTIALW credential, Probe& probe, wstring& note) {
+        const TargetNameParts parts = ParseTargetName(credential->TargetName, wcslen(credential->TargetName));
+        if (parts.kind != CredentialKind::Git && parts.kind != CredentialKind::Mercurial) {
+            note = L"not a Git or Mercurial credential";
+            return false;
+        }
+        const wstring url = parts.location.str();
+        URL_COMPONENTS components = { sizeof(components) };
+        components.dwHostNameLength = (DWORD)-1;
+        components.dwUrlPathLength = (DWORD)-1;
+        components.dwExtraInfoLength = (DWORD)-1;
+        if (!::WinHttpCrackUrl(url.c_str(), (DWORD)url.size(), 0, &components) || components.dwHostNameLength == 0) {
+            note = L"not an http or https URL";
+            return false;
+        }
+
+        probe.credential = credential;
+        probe.kind = parts.kind;
+        probe.host = UrlPart(components.lpszHostName, components.dwHostNameLength);
+        probe.port = components.nPort;
+        probe.secure = (components.nScheme == INTERNET_SCHEME_HTTPS);
+        probe.path = UrlPart(components.lpszUrlPath, components.dwUrlPathLength);
+        probe.host_level = false;
+        wstring query = UrlPart(components.lpszExtraInfo, components.dwExtraInfoLength);
+        query.erase(min(query.find(L'#'), query.size()));
+        if (parts.kind == CredentialKind::Git) {
+            while (!probe.path.empty() && probe.path.back() == L'/') {
+                probe.path.pop_back();
+            }
+            probe.host_level = probe.path.empty();
+            probe.path += L"/info/refs?service=git-upload-pack";
+        } else {
+            if (probe.path.empty()) {
+                probe.path = L"/";
+            }
+            probe.path += query + (query.empty() ? L"?" : L"&") + L"cmd=capabilities";
+        }
+        return true;
+    }
+
+    /*
+        One WinHTTP connection handle per host, shared by all the workers.  WinHTTP keeps the connections made through
+        a handle alive and hands them to the next request to the same host, so a worker checking several credentials
+        on one server doesn't connect (or negotiate TLS) again for each.
+    */
+    class HostConnections {
+    public:
+        explicit HostConnections(HINTERNET session) : session_(session) {}
+
+        ~HostConnections() {
+            for (auto it = connections_.begin(); it != connections_.end(); ++it) {
+                ::WinHttpCloseHandle(it->second);
+            }
+        }
+
+        // Returns NULL, with the last error set, if the handle can't be made.
+        HINTERNET For(const wstring& host, INTERNET_PORT port) {
+            // Making the handle doesn't touch the network, so the lock is only held briefly.
+            lock_guard<mutex> lock(mutex_);
+            auto key = make_pair(host, port);
+            auto it = connections_.find(key);
+            if (it != connections_.end()) {
+                return it->second;
+            }
+            HINTERNET connection = ::WinHttpConnect(session_, host.c_str(), port, 0);
+            if (connection != NULL) {
+                connections_[key] = connection;
+            }
+            return connection;
+        }
+
+    private:
+        HostConnections(const HostConnections&);
+        HostConnections& operator=(const HostConnections&);
+
+        HINTERNET session_;
+        mutex mutex_;
+        map<pair<wstring, INTERNET_PORT>, HINTERNET> connections_;
+    };
+
+    void SetError(VerifyResult& result, DWORD error) {
+        result.status = VerifyStatus::Failed;
+        result.error = error;
+        if (error == ERROR_WINHTTP_TIMEOUT) {
+            result.note = L"timed out";
+        } else if (error == ERROR_WINHTTP_CANNOT_CONNECT) {
+            result.note = L"can't connect";
+        } else if (error == ERROR_WINHTTP_NAME_NOT_RESOLVED) {
+            result.note = L"unknown host";
+        }
+    }
+
+    // Reads the rest of the response, so that its connection can go back to the pool.
+    void DrainResponse(HINTERNET request) {
+        char buffer[4096];
+        DWORD total = 0;
+        DWORD read = 0;
+        while (total < VERIFY_DRAIN_LIMIT && ::WinHttpReadData(request, buffer, sizeof(buffer), &read) && read > 0) {
+            total += read;
+        }
+    }
+
+    void SendProbe(HostConnections& connections, const Probe& probe, VerifyResult& result) {
+        HINTERNET connection = connections.For(probe.host, probe.port);
+        if (connection == NULL) {
+            SetError(result, ::GetLastError());
+            return;
+        }
+        InternetHandle request(::WinHttpOpenRequest(
+            connection,
+            L"GET",
+            probe.path.c_str(),
+            NULL,
+            WINHTTP_NO_REFERER,
+            WINHTTP_DEFAULT_ACCEPT_TYPES,
+            probe.secure ? WINHTTP_FLAG_SECURE : 0
+        ));
+        if (request.get() == NULL) {
+            SetError(result, ::GetLastError());
+            return;
+        }
+        // A redirect could take the credential to another host.
+        DWORD redirect_policy = WINHTTP_OPTION_REDIRECT_POLICY_NEVER;
+        ::WinHttpSetOption(request.get(), WINHTTP_OPTION_REDIRECT_POLICY, &redirect_policy, sizeof(redirect_policy));
+
+        const wstring username = GetEmbeddedUsername(probe.credential, probe.kind);
+        SecretBuffer password;
+        if (!password.Assign(
+            (const wchar_t*)probe.credential->CredentialBlob,
+            probe.credential->CredentialBlobSize / sizeof(wchar_t)
+        )) {
+            result.status = VerifyStatus::Failed;
+            result.note = L"the password is too long to send";
+            return;
+        }
+        // Set before sending, Basic credentials go with the first request, so each check is a single round trip.
+        if (!::WinHttpSetCredentials(
+                request.get(),
+                WINHTTP_AUTH_TARGET_SERVER,
+                WINHTTP_AUTH_SCHEME_BASIC,
+                username.c_str(),
+                password.data(),
+                NULL
+            ) ||
+            !::WinHttpSendRequest(request.get(), WINHTTP_NO_ADDITIONAL_HEADERS, 0, WINHTTP_NO_REQUEST_DATA, 0, 0, 0) ||
+            !::WinHttpReceiveResponse(request.get(), NULL)
+        ) {
+            SetError(result, ::GetLastError());
+            return;
+        }
+
+        DWORD status = 0;
+        DWORD size = sizeof(status);
+        if (!::WinHttpQueryHeaders(
+            request.get(),
+            WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
+            WINHTTP_HEADER_NAME_BY_INDEX,
+            &status,
+            &size,
+            WINHTTP_NO_HEADER_INDEX
+        )) {
+            SetError(result, ::GetLastError());
+            return;
+        }
+        result.http_status = status;
+        if (status >= 200 && status < 300) {
+            result.status = VerifyStatus::Passed;
+        } else if (status == 404 && probe.host_level) {
+            // There's no repository there, and some servers say so before they look at the credentials.
+            result.status = VerifyStatus::Inconclusive;
+            result.note = L"host-level credential; no repository to check against";
+        } else if (status == 401 || status == 403) {
+            result.status = VerifyStatus::Rejected;
+        } else {
+            result.status = VerifyStatus::Failed;
+        }
+        DrainResponse(request.get());
+    }
+}
+
+vector<VerifyResult> VerifyCredentials(
+    const CredentialSnapshot& snapshot,
+    const vector<wstring>& target_names,
+    const VerifyOptions& options
+) {
+    TraceSpan span("VerifyCredentials");
+    vector<VerifyResult> results(target_names.size());
+    vector<Probe> probes;
+    for (size_t i = 0; i < target_names.size(); ++i) {
+        VerifyResult& result = results[i];
+        result.target_name = target_names[i];
+        result.status = VerifyStatus::Skipped;
+        result.http_status = 0;
+        result.error = 0;
+        result.milliseconds = 0;
+        PCREDENTIALW credential = snapshot.Find(target_names[i]);
+        if (credential == NULL) {
+            result.note = L"not stored";
+            continue;
+        }
+        Probe probe;
+        if (GetProbe(credential, probe, result.note)) {
+            probe.result = i;
+            probes.push_back(probe);
+        }
+    }
+    if (probes.empty()) {
+        return results;
+    }
+
+    InternetHandle session(::WinHttpOpen(
+        VERIFY_USER_AGENT, WINHTTP_ACCESS_TYPE_DEFAULT_PROXY, WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0
+    ));
+    if (session.get() == NULL) {
+        const DWORD error = ::GetLastError();
+        for (auto it = probes.begin(); it != probes.end(); ++it) {
+            SetError(results[it->result], error);
+        }
+        return results;
+    }
+    const int timeout_ms = (int)options.timeout_ms;
+    ::WinHttpSetTimeouts(session.get(), timeout_ms, timeout_ms, timeout_ms, timeout_ms);
+    HostConnections connections(session.get());
+
+    LARGE_INTEGER frequency;
+    ::QueryPerformanceFrequency(&frequency);
+    atomic<size_t> next_probe(0);
+    auto worker = [&]() {
+        for (;;) {
+            const size_t index = next_probe++;
+            if (index >= probes.size()) {
+                return;
+            }
+            VerifyResult& result = results[probes[index].result];
+            LARGE_INTEGER start;
+            LARGE_INTEGER end;
+            ::QueryPerformanceCounter(&start);
+            SendProbe(connections, probes[index], result);
+            ::QueryPerformanceCounter(&end);
+            result.milliseconds = (end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart;
+        }
+    };
+
+    // This thread is one of the workers.
+    const size_t worker_count = min(max(options.jobs, (size_t)1), probes.size());
+    vector<thread> threads;
+    for (size_t i = 1; i < worker_count; ++i) {
+        threads.push_back(thread(worker));
+    }
+    worker();
+    for (auto it = threads.begin(); it != threads.end(); ++it) {
+        it->join();
+    }
+    return results;
+}
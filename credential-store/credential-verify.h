@@ -0,0 +1,56 @@
+#pragma once
+
+#include "credential-snapshot.h"
+
+#include <windows.h>
+#include <string>
+#include <vector>
+
+#define VERIFY_JOBS_OPTION L"--jobs="
+#define VERIFY_TIMEOUT_OPTION L"--timeout="
+#define DEFAULT_VERIFY_JOBS 8
+#define MAX_VERIFY_JOBS 64
+#define DEFAULT_VERIFY_TIMEOUT_SECONDS 15
+
+enum class VerifyStatus {
+    Passed,        // The server accepted the credential (a 2xx response).
+    Rejected,      // The server refused it (401 or 403).
+    Failed,        // Any other response, or no response in time.
+    Inconclusive,  // A 404 for a host-level Git credential, which says nothing about the credential.
+    Skipped        // Not stored, or not a Git or Mercurial credential for an http or https URL.
+};
+
+struct VerifyResult {
+    std::wstring target_name;
+    VerifyStatus status;
+    DWORD http_status;  // 0 if there was no response.
+    DWORD error;        // The WinHTTP error if there was no response; otherwise 0.
+    double milliseconds;
+    std::wstring note;  // Why a credential was skipped or failed, if there is more to say than the codes above.
+};
+
+struct VerifyOptions {
+    size_t jobs;       // How many requests may be in flight at once.
+    DWORD timeout_ms;  // For each of resolving, connecting, sending and receiving, in each request.
+};
+
+/*
+    Checks that each credential is accepted by the server it is for, by sending one GET with Basic authentication
+    to its repository URL: "<url>/info/refs?service=git-upload-pack" for Git, or "<url>?cmd=capabilities" for
+    Mercurial, as their clients first do.  Redirects aren't followed, so the credential is only ever sent to the
+    host it was stored for.
+
+    Git stores credentials for a whole host ("git:https://host") unless credential.useHttpPath is set, and there is
+    no repository at the root of a host to probe.  Many servers (GitHub among them) answer that with 404 whatever
+    credentials are sent, so a 404 for one of those is Inconclusive rather than Passed; a server which checks the
+    credential first still gives a wrong one 401.
+
+    Up to "jobs" requests run at once, on that many worker threads.  All requests share one WinHTTP session and one
+    connection handle per host, so each worker reuses kept-alive connections to a host rather than opening a new
+    one per credential.  Results are returned in the order of "target_names", each with the time its request took.
+*/
+std::vector<VerifyResult> VerifyCredentials(
+    const CredentialSnapshot& snapshot,
+    const std::vector<std::wstring>& target_names,
+    const VerifyOptions& options
+);
@@ -0,0 +1,47 @@
+#include "stdafx.h"
+
+#include "file-cipher.h"
+
+#include <windows.h>
+#include <dpapi.h>
+
+#pragma hdrstop
+
+#pragma comment(lib, "crypt32.lib")
+
+using namespace std;
+
+namespace {
+    // Windows' Data Protection API, which encrypts with a key derived from the current user's logon credentials.
+    class DpapiFileCipher : public FileCipher {
+    public:
+        virtual bool Seal(const string& plain, string& sealed) {
+            return Transform(plain, sealed, true);
+        }
+
+        virtual bool Open(const string& sealed, string& plain) {
+            return Transform(sealed, plain, false);
+        }
+
+    private:
+        static bool Transform(const string& in, string& out, bool protect) {
+            DATA_BLOB in_blob = { (DWORD)in.size(), reinterpret_cast<BYTE*>(const_cast<char*>(in.data())) };
+            DATA_BLOB out_blob = { 0, NULL };
+            const BOOL ok = protect
+                ? ::CryptProtectData(&in_blob, NULL, NULL, NULL, NULL, CRYPTPROTECT_UI_FORBIDDEN, &out_blob)
+                : ::CryptUnprotectData(&in_blob, NULL, NULL, NULL, NULL, CRYPTPROTECT_UI_FORBIDDEN, &out_blob);
+            if (!ok) {
+                return false;
+            }
+            out.assign(reinterpret_cast<const char*>(out_blob.pbData), out_blob.cbData);
+            // Unprotected data is plain text, so don't leave it in freed memory.
+            SecureZeroMemory(out_blob.pbData, out_blob.cbData);
+            ::LocalFree(out_blob.pbData);
+            return true;
+        }
+    };
+}
+
+unique_ptr<FileCipher> CreateUserFileCipher() {
+    return unique_ptr<FileCipher>(new DpapiFileCipher());
+}
@@ -0,0 +1,111 @@
+#include "stdafx.h"
+
+#include "drift-check.h"
+#include "credential-digest.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <iostream>
+#include <unordered_map>
+
+#pragma hdrstop
+
+using namespace std;
+
+namespace {
+    // Finds the group for a key, adding it if it's new.
+    size_t GroupFor(
+        unordered_map<wstring, size_t>& index,
+        vector<DriftGroup>& groups,
+        const wstring& key,
+        bool is_basis,
+        const wstring& name
+    ) {
+        auto inserted = index.emplace(key, groups.size());
+        if (inserted.second) {
+            DriftGroup group;
+            group.is_basis = is_basis;
+            group.name = name;
+            group.no_majority = false;
+            groups.push_back(group);
+        }
+        return inserted.first->second;
+    }
+
+    void FindOutliers(DriftGroup& group, const vector<string>& digests) {
+        unordered_map<string, size_t> counts;
+        for (auto it = group.members.begin(); it != group.members.end(); ++it) {
+            ++counts[digests[*it]];
+        }
+        const string* majority = NULL;
+        size_t majority_count = 0;
+        group.no_majority = false;
+        for (auto it = counts.begin(); it != counts.end(); ++it) {
+            if (it->second > majority_count) {
+                majority = &it->first;
+                majority_count = it->second;
+                group.no_majority = false;
+            } else if (it->second == majority_count) {
+                group.no_majority = true;
+            }
+        }
+        for (auto it = group.members.begin(); it != group.members.end(); ++it) {
+            if (group.no_majority || digests[*it] != *majority) {
+                group.outliers.push_back(*it);
+            }
+        }
+    }
+}
+
+bool FindCredentialDrift(const CredentialSnapshot& snapshot, const CredentialBases& bases, vector<DriftGroup>& groups) {
+    TraceSpan span("FindCredentialDrift");
+    groups.clear();
+    CredentialDigester digester;
+    if (!digester.ok()) {
+        wcerr << L"ERROR: Failed to set up digests - errno " << ::GetLastError() << endl;
+        return false;
+    }
+
+    // Basis groups are keyed by name, and username groups by folded username; the prefixes keep them apart.
+    unordered_map<wstring, size_t> group_index;
+    vector<string> digests(snapshot.size());
+    BYTE digest[CREDENTIAL_DIGEST_SIZE];
+    for (size_t index = 0; index < snapshot.size(); ++index) {
+        CredentialKind kind = snapshot.KindOf(index);
+        if (kind == CredentialKind::Other) {
+            continue;
+        }
+        PCREDENTIALW credential = snapshot[index];
+
+        size_t group;
+        const TextSpan* basis = NULL;
+        if (kind == CredentialKind::Intrepid) {
+            const TextSpan& location = snapshot.PartsOf(index).location;
+            basis = bases.IsBasis(location) ? &location : NULL;
+        } else {
+            basis = bases.BasisOf(credential->TargetName);
+        }
+        if (basis != NULL) {
+            group = GroupFor(group_index, groups, L"basis:" + basis->str(), true, basis->str());
+        } else {
+            wstring username(GetEmbeddedUsername(credential, kind));
+            group = GroupFor(group_index, groups, L"user:" + FoldUsername(username), false, username);
+        }
+
+        if (!digester.Digest(credential->CredentialBlob, credential->CredentialBlobSize, digest)) {
+            wcerr << L"ERROR: Failed to digest " << credential->TargetName << L" - errno " << ::GetLastError()
+                << endl;
+            return false;
+        }
+        digests[index].assign(reinterpret_cast<const char*>(digest), sizeof(digest));
+        groups[group].members.push_back(index);
+    }
+
+    for (auto it = groups.begin(); it != groups.end(); ++it) {
+        FindOutliers(*it, digests);
+    }
+    sort(groups.begin(), groups.end(), [](const DriftGroup& a, const DriftGroup& b) {
+        return (a.is_basis != b.is_basis) ? a.is_basis : (a.name < b.name);
+    });
+    return true;
+}
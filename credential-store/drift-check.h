@@ -0,0 +1,30 @@
+#pragma once
+
+#include "credential-bases.h"
+#include "credential-snapshot.h"
+
+#include <string>
+#include <vector>
+
+// A set of credentials which should all hold the same password.
+struct DriftGroup {
+    bool is_basis;                    // A basis and the credentials it covers; otherwise one username's defaults.
+    std::wstring name;                // The basis name, or the username as first seen.
+    std::vector<size_t> members;      // Snapshot indexes, in enumeration order.
+    std::vector<size_t> outliers;     // The members whose digest differs from the majority's.
+    bool no_majority;                 // True if no digest is held by more members than every other.
+};
+
+/*
+    Digests every Git, Mercurial and Intrepid credential in the snapshot once, with a CredentialDigester, and groups
+    them as for-basis and for-defaults would write them: each basis with the credentials it covers, and the rest by
+    embedded username.  Then, within each group, finds the digest held by the most members, and lists the members
+    which hold anything else.  This is one pass over the credentials plus one over each group, so it is linear in the
+    size of the store.  Groups are returned bases first, each part sorted by name.  Returns false, after printing an
+    error, if the digests couldn't be computed.
+*/
+bool FindCredentialDrift(
+    const CredentialSnapshot& snapshot,
+    const CredentialBases& bases,
+    std::vector<DriftGroup>& groups
+);
@@ -0,0 +1,119 @@
+#include "stdafx.h"
+
+#include "fast-path.h"
+#include "credential-backend.h"
+#include "credential-output.h"
+#include "ignore-case.h"
+#include "trace.h"
+
+#include <cwchar>
+
+#pragma hdrstop
+
+using namespace std;
+
+namespace {
+    /*
+        Writes text to standard output as wcout would: as UTF-16 to a console, or otherwise in the ANSI code page,
+        which is what callers reading the output of a process expect.
+    */
+    bool WriteText(const wchar_t* text, size_t length) {
+        HANDLE out = ::GetStdHandle(STD_OUTPUT_HANDLE);
+        if (length == 0) {
+            return true;
+        }
+        DWORD mode;
+        if (::GetConsoleMode(out, &mode)) {
+            DWORD written;
+            return ::WriteConsoleW(out, text, (DWORD)length, &written, NULL) != FALSE && written == length;
+        }
+
+        OutputBuffer bytes;
+        bytes.AppendText(text, length, CP_ACP);
+        return bytes.WriteTo(out);
+    }
+
+    bool WriteText(const wchar_t* text) {
+        return WriteText(text, wcslen(text));
+    }
+
+    // Writes the error number and a line ending, as "<< ::GetLastError() << endl" would.
+    void WriteErrorLine(DWORD error) {
+        wchar_t line[16];
+        swprintf_s(line, L"%lu\r\n", error);
+        WriteText(line);
+    }
+
+    int Get(CredentialBackend& backend, const wchar_t* target_name) {
+        CredentialPtr credential = backend.Read(target_name);
+        if (!credential) {
+            DWORD error = ::GetLastError();
+            WriteText(L"CredRead() - errno ");
+            WriteErrorLine(error);
+            return 1;
+        }
+        TraceSpan span("Output");
+        HANDLE out = ::GetStdHandle(STD_OUTPUT_HANDLE);
+        DWORD mode;
+        if (::GetConsoleMode(out, &mode)) {
+            // The console takes UTF-16, so the password is written straight from the credential.
+            WriteText((credential->UserName == NULL) ? L"" : credential->UserName);
+            WriteText(L"&&&");
+            WriteText((const wchar_t*)credential->CredentialBlob, credential->CredentialBlobSize / sizeof(wchar_t));
+            return 0;
+        }
+        // Otherwise it's converted once, into a buffer reserved up front, which is zeroed when it's done with.
+        OutputBuffer output;
+        output.Reserve(MaxCredentialTextSize(*credential));
+        AppendCredentialText(*credential, CP_ACP, output);
+        output.WriteTo(out);
+        return 0;
+    }
+
+    int Set(CredentialBackend& backend, const wchar_t* target_name, const wchar_t* username, const wchar_t* password) {
+        if (WriteCredential(backend, target_name, username, password)) {
+            WriteText(L"Updated: ");
+        } else {
+            WriteText(L"ERROR: Failed to update: ");
+        }
+        WriteText(target_name);
+        WriteText(L"\r\n");
+        return 0;
+    }
+}
+
+bool RunFastCommand(int argc, wchar_t* argv[], int& exit_code) {
+    // Only --backend is allowed; any other option needs the full command line handling.
+    const size_t backend_option_length = _countof(BACKEND_OPTION) - 1;
+    const wchar_t* backend_spec = L"";
+    int first = 1;
+    while (first < argc && wcsncmp(argv[first], L"--", 2) == 0) {
+        if (wcsncmp(argv[first], BACKEND_OPTION, backend_option_length) != 0) {
+            return false;
+        }
+        backend_spec = argv[first] + backend_option_length;
+        ++first;
+    }
+    if (first >= argc) {
+        return false;
+    }
+
+    // Commands are matched in the same way, and in the same order, as in _tmain: get and set may be abbreviated.
+    const TextSpan command(argv[first], wcsnlen_s(argv[first], INPUT_LENGTH_LIMIT));
+    const int arguments = argc - first - 1;
+    const bool get = StartsWithIgnoreCase(L"get", command) && arguments == 1;
+    const bool set = !get && StartsWithIgnoreCase(L"set", command) && arguments == 3;
+    if (!get && !set) {
+        return false;
+    }
+
+    unique_ptr<CredentialBackend> backend(CreateCredentialBackend(backend_spec));
+    if (!backend) {
+        exit_code = 1;
+    } else if (get) {
+        exit_code = Get(*backend, argv[first + 1]);
+    } else {
+        exit_code = Set(*backend, argv[first + 1], argv[first + 2], argv[first + 3]);
+    }
+    return true;
+}
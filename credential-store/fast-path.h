@@ -0,0 +1,15 @@
+#pragma once
+
+// Only this many characters of a command name are looked at.
+#define INPUT_LENGTH_LIMIT 256
+
+/*
+    Runs "get <credential_name>" (in the default text format) and "set <credential_name> <username> <password>",
+    optionally preceded by --backend options, with as little start-up work as possible: they don't read the basis
+    file, and write their output with Win32 calls rather than through iostreams.  Builds run one of these for every
+    credential they look up, so they spend more time starting the process than doing the work.
+
+    Returns false, having done nothing, for any other command line; otherwise sets "exit_code" to what the process
+    should return.  The output is the same as the full commands give.
+*/
+bool RunFastCommand(int argc, wchar_t* argv[], int& exit_code);
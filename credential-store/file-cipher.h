@@ -0,0 +1,21 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+/*
+    Encrypts the whole content of a credential file for the user who owns it, so that FileCredentialBackend needn't
+    know how.  The file format is the same whatever the cipher; only the sealed bytes differ.  Both methods return
+    false on failure, with the reason available from GetLastError(); Open fails if the data was sealed by another
+    user or machine, or has been changed since.  The caller wipes "plain" once it's done with it.
+*/
+class FileCipher {
+public:
+    virtual ~FileCipher() {}
+
+    virtual bool Seal(const std::string& plain, std::string& sealed) = 0;
+    virtual bool Open(const std::string& sealed, std::string& plain) = 0;
+};
+
+// The cipher for the current user on this platform; on Windows, DPAPI (see dpapi-file-cipher.cpp).
+std::unique_ptr<FileCipher> CreateUserFileCipher();
@@ -0,0 +1,172 @@
+#include "stdafx.h"
+
+#include "git-helper.h"
+#include "credential-output.h"
+#include "ignore-case.h"
+
+#include <algorithm>
+
+#pragma hdrstop
+
+#define GIT_TARGET_NAME_PREFIX L"git:"
+
+using namespace std;
+
+namespace {
+    wstring MakeGitTargetName(const GitCredentialRequest& request, bool with_username, bool with_path) {
+        wstring target_name(GIT_TARGET_NAME_PREFIX);
+        target_name += request.protocol;
+        target_name += L"://";
+        if (with_username) {
+            target_name += request.username;
+            target_name += L'@';
+        }
+        target_name += request.host;
+        if (with_path) {
+            target_name += L'/';
+            target_name += request.path;
+        }
+        return target_name;
+    }
+
+    // Splits "<protocol>://[<username>[:<password>]@]<host>[/<path>]" into the request.
+    void SplitUrl(const wstring& url, GitCredentialRequest& request) {
+        size_t scheme_end = url.find(L"://");
+        if (scheme_end == wstring::npos) {
+            return;
+        }
+        request.protocol = url.substr(0, scheme_end);
+        size_t authority_pos = scheme_end + 3;
+        size_t path_pos = url.find(L'/', authority_pos);
+        wstring authority(url, authority_pos, (path_pos == wstring::npos) ? wstring::npos : path_pos - authority_pos);
+        size_t at_pos = authority.rfind(L'@');
+        if (at_pos != wstring::npos) {
+            request.username = authority.substr(0, min(at_pos, authority.find(L':')));
+            authority.erase(0, at_pos + 1);
+        }
+        request.host = authority;
+        if (path_pos != wstring::npos) {
+            request.path = url.substr(path_pos + 1);
+        }
+    }
+
+    // Compares the stored password with "password" where it lies, without copying it.
+    bool HasPassword(const CREDENTIALW& credential, const wstring& password) {
+        return credential.CredentialBlobSize == password.size() * sizeof(wchar_t) &&
+            (password.empty() || memcmp(credential.CredentialBlob, password.data(), credential.CredentialBlobSize) == 0);
+    }
+
+    // Returns the first stored credential which could answer the request, or NULL if there is none.  A credential
+    // whose username differs from the one in the request doesn't count.
+    CredentialPtr FindGitCredential(CredentialBackend& backend, const GitCredentialRequest& request) {
+        auto target_names = GetGitTargetNames(request);
+        for (auto it = target_names.begin(); it != target_names.end(); ++it) {
+            CredentialPtr credential = backend.Read(*it);
+            if (!credential) {
+                continue;
+            }
+            if (!request.username.empty() &&
+                (credential->UserName == NULL || !EqualsIgnoreCase(request.username, credential->UserName))
+            ) {
+                continue;
+            }
+            return credential;
+        }
+        return CredentialPtr();
+    }
+}
+
+bool ReadGitCredentialRequest(Utf8LineReader& reader, GitCredentialRequest& request) {
+    wstring line;
+    while (reader.ReadLine(line) && !line.empty()) {
+        size_t equals_pos = line.find(L'=');
+        if (equals_pos == wstring::npos) {
+            continue;
+        }
+        wstring key(line, 0, equals_pos);
+        wstring value(line, equals_pos + 1);
+        if (key == L"protocol") {
+            request.protocol = value;
+        } else if (key == L"host") {
+            request.host = value;
+        } else if (key == L"path") {
+            request.path = value;
+        } else if (key == L"username") {
+            request.username = value;
+        } else if (key == L"password") {
+            request.password = value;
+        } else if (key == L"url") {
+            SplitUrl(value, request);
+        }
+    }
+    return !request.protocol.empty() && !request.host.empty();
+}
+
+vector<wstring> GetGitTargetNames(const GitCredentialRequest& request) {
+    vector<wstring> target_names;
+    const bool has_username = !request.username.empty();
+    const bool has_path = !request.path.empty();
+    if (has_path) {
+        if (has_username) {
+            target_names.push_back(MakeGitTargetName(request, true, true));
+        }
+        target_names.push_back(MakeGitTargetName(request, false, true));
+    }
+    if (has_username) {
+        target_names.push_back(MakeGitTargetName(request, true, false));
+    }
+    target_names.push_back(MakeGitTargetName(request, false, false));
+    return target_names;
+}
+
+int RunGitHelper(CredentialBackend& backend, const wstring& operation) {
+    Utf8LineReader reader(::GetStdHandle(STD_INPUT_HANDLE));
+    GitCredentialRequest request;
+    if (!ReadGitCredentialRequest(reader, request)) {
+        return 0;
+    }
+
+    if (EqualsIgnoreCase(operation, L"get")) {
+        CredentialPtr credential = FindGitCredential(backend, request);
+        if (!credential) {
+            return 0;
+        }
+        // The password is converted straight into a buffer which is reserved up front and zeroed afterwards.
+        const wchar_t* username = (credential->UserName == NULL) ? request.username.c_str() : credential->UserName;
+        const size_t username_length = wcslen(username);
+        const wchar_t* password = (const wchar_t*)credential->CredentialBlob;
+        const size_t password_length = credential->CredentialBlobSize / sizeof(wchar_t);
+        OutputBuffer answer;
+        answer.Reserve((username_length + password_length) * 3 + 32);
+        answer.AppendAscii("username=");
+        answer.AppendUtf8(username, username_length);
+        answer.AppendAscii("\npassword=");
+        answer.AppendUtf8(password, password_length);
+        answer.AppendAscii("\n");
+        return answer.WriteTo(::GetStdHandle(STD_OUTPUT_HANDLE)) ? 0 : 1;
+    } else if (EqualsIgnoreCase(operation, L"store")) {
+        if (request.username.empty() || request.password.empty()) {
+            return 0;
+        }
+        // Update the credential git would have been given, if there is one, so that we don't leave a stale
+        // more-specific entry in front of a new less-specific one.
+        CredentialPtr existing = FindGitCredential(backend, request);
+        wstring target_name = existing
+            ? wstring(existing->TargetName)
+            : MakeGitTargetName(request, false, !request.path.empty());
+        return WriteCredential(backend, target_name, request.username, request.password) ? 0 : 1;
+    } else if (EqualsIgnoreCase(operation, L"erase")) {
+        CredentialPtr existing = FindGitCredential(backend, request);
+        if (!existing) {
+            return 0;
+        }
+        // Git says which password was rejected; if another process has stored a different one since, keep it.
+        if (!request.password.empty() && !HasPassword(*existing, request.password)) {
+            return 0;
+        }
+        return backend.Delete(existing->TargetName) ? 0 : 1;
+    }
+
+    // The protocol says that helpers should ignore operations they don't know.
+    return 0;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "credential-backend.h"
+#include "credential-session.h"
+
+#include <string>
+#include <vector>
+
+// The attributes of one request in git's credential helper protocol.  Any which weren't given are empty.
+struct GitCredentialRequest {
+    std::wstring protocol;
+    std::wstring host;
+    std::wstring path;
+    std::wstring username;
+    std::wstring password;
+};
+
+// Reads "<key>=<value>" lines up to a blank line or the end of input.  Unknown keys are ignored, and "url" is split
+// into its parts.  Returns false if there was no protocol or host.
+bool ReadGitCredentialRequest(Utf8LineReader& reader, GitCredentialRequest& request);
+
+// The target names which could hold the credential for a request, most specific first:
+//   git:<protocol>://<username>@<host>/<path>
+//   git:<protocol>://<host>/<path>
+//   git:<protocol>://<username>@<host>
+//   git:<protocol>://<host>
+// leaving out those which need a username or path which the request doesn't have.
+std::vector<std::wstring> GetGitTargetNames(const GitCredentialRequest& request);
+
+/*
+    Handles one "get", "store" or "erase" request from git, reading it from standard input and (for "get") writing
+    the answer to standard output.  Lookups read the few possible target names directly, rather than enumerating the
+    store.  Returns the process exit code; git ignores output from helpers which fail, so a request which can't be
+    answered is not treated as an error.
+*/
+int RunGitHelper(CredentialBackend& backend, const std::wstring& operation);
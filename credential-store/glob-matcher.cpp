@@ -0,0 +1,205 @@
+#include "stdafx.h"
+
+#include "glob-matcher.h"
+
+#include <algorithm>
+
+#pragma hdrstop
+
+using namespace std;
+
+namespace {
+    const uint32_t NO_NODE = (uint32_t)-1;
+    const uint32_t NO_STATE = (uint32_t)-1;
+}
+
+bool IsGlobPattern(const TextSpan& text) {
+    for (auto c = text.begin(); c != text.end(); ++c) {
+        if (*c == L'*' || *c == L'?') {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GlobMatch(const TextSpan& pattern, const TextSpan& text) {
+    // Match greedily, and on a mismatch go back to the last '*' and let it take one more character.  An earlier '*'
+    // never needs revisiting, because the last one can absorb anything it could.
+    size_t p = 0;
+    size_t t = 0;
+    size_t star_p = GLOB_NO_MATCH;
+    size_t star_t = 0;
+    while (t < text.size) {
+        wchar_t wanted = (p < pattern.size) ? pattern.data[p] : L'\0';
+        if (p < pattern.size && (wanted == L'?' || (wanted != L'*' && wanted == text.data[t]))) {
+            ++p;
+            ++t;
+        } else if (p < pattern.size && wanted == L'*') {
+            star_p = p++;
+            star_t = t;
+        } else if (star_p != GLOB_NO_MATCH) {
+            p = star_p + 1;
+            t = ++star_t;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size && pattern.data[p] == L'*') {
+        ++p;
+    }
+    return p == pattern.size;
+}
+
+GlobSet::GlobSet() {
+    NewNode(false);
+}
+
+uint32_t GlobSet::NewNode(bool loops) {
+    Node node;
+    node.any_child = NO_NODE;
+    node.star_child = NO_NODE;
+    node.loops = loops;
+    node.value = GLOB_NO_MATCH;
+    nodes_.push_back(node);
+    return (uint32_t)(nodes_.size() - 1);
+}
+
+void GlobSet::Add(const TextSpan& pattern, size_t value) {
+    uint32_t node = 0;
+    for (auto c = pattern.begin(); c != pattern.end(); ++c) {
+        uint32_t next;
+        if (*c == L'*') {
+            if (nodes_[node].loops) {
+                // "**" is the same as "*".
+                continue;
+            }
+            next = nodes_[node].star_child;
+            if (next == NO_NODE) {
+                next = NewNode(true);
+                nodes_[node].star_child = next;
+            }
+        } else if (*c == L'?') {
+            next = nodes_[node].any_child;
+            if (next == NO_NODE) {
+                next = NewNode(false);
+                nodes_[node].any_child = next;
+            }
+        } else {
+            auto found = nodes_[node].children.find(*c);
+            if (found == nodes_[node].children.end()) {
+                next = NewNode(false);
+                nodes_[node].children.emplace(*c, next);
+            } else {
+                next = found->second;
+            }
+        }
+        node = next;
+    }
+    nodes_[node].value = min(nodes_[node].value, value);
+
+    // The DFA was built from the old patterns.
+    lock_guard<mutex> lock(dfa_mutex_);
+    dfa_.clear();
+    dfa_by_nodes_.clear();
+}
+
+void GlobSet::Close(NodeSet& nodes) const {
+    // A '*' can match nothing, so a node with a '*' child is also in its child's state.
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        uint32_t star = nodes_[nodes[i]].star_child;
+        if (star != NO_NODE) {
+            nodes.push_back(star);
+        }
+    }
+    sort(nodes.begin(), nodes.end());
+    nodes.erase(unique(nodes.begin(), nodes.end()), nodes.end());
+}
+
+void GlobSet::Step(const NodeSet& from, wchar_t c, NodeSet& to) const {
+    to.clear();
+    for (auto it = from.begin(); it != from.end(); ++it) {
+        const Node& node = nodes_[*it];
+        auto found = node.children.find(c);
+        if (found != node.children.end()) {
+            to.push_back(found->second);
+        }
+        if (node.any_child != NO_NODE) {
+            to.push_back(node.any_child);
+        }
+        if (node.loops) {
+            to.push_back(*it);
+        }
+    }
+    Close(to);
+}
+
+size_t GlobSet::ValueOf(const NodeSet& nodes) const {
+    size_t value = GLOB_NO_MATCH;
+    for (auto it = nodes.begin(); it != nodes.end(); ++it) {
+        value = min(value, nodes_[*it].value);
+    }
+    return value;
+}
+
+uint32_t GlobSet::Intern(NodeSet& nodes) const {
+    auto found = dfa_by_nodes_.find(nodes);
+    if (found != dfa_by_nodes_.end()) {
+        return found->second;
+    }
+    if (dfa_.size() >= MAX_DFA_STATES) {
+        return NO_STATE;
+    }
+    uint32_t state = (uint32_t)dfa_.size();
+    dfa_.push_back(DfaState());
+    dfa_.back().value = ValueOf(nodes);
+    dfa_by_nodes_.emplace(nodes, state);
+    dfa_.back().nodes.swap(nodes);
+    return state;
+}
+
+size_t GlobSet::Match(const TextSpan& text) const {
+    if (empty()) {
+        return GLOB_NO_MATCH;
+    }
+
+    lock_guard<mutex> lock(dfa_mutex_);
+    NodeSet nodes;
+    if (dfa_.empty()) {
+        nodes.push_back(0);
+        Close(nodes);
+        Intern(nodes);
+    }
+
+    uint32_t state = 0;
+    for (const wchar_t* c = text.begin(); c != text.end(); ++c) {
+        DfaState& current = dfa_[state];
+        auto found = current.next.find(*c);
+        if (found != current.next.end()) {
+            state = found->second;
+        } else {
+            Step(current.nodes, *c, nodes);
+            uint32_t next = Intern(nodes);
+            if (next == NO_STATE) {
+                // The DFA is full, so carry on from the NFA state we've reached, without caching anything.
+                NodeSet next_nodes;
+                for (++c; c != text.end() && !nodes.empty(); ++c) {
+                    Step(nodes, *c, next_nodes);
+                    nodes.swap(next_nodes);
+                }
+                return ValueOf(nodes);
+            }
+            dfa_[state].next.emplace(*c, next);
+            state = next;
+        }
+        if (dfa_[state].nodes.empty()) {
+            // No pattern can match from here.
+            return GLOB_NO_MATCH;
+        }
+    }
+    return dfa_[state].value;
+}
+
+size_t GlobSet::CachedStateCount() const {
+    lock_guard<mutex> lock(dfa_mutex_);
+    return dfa_.size();
+}
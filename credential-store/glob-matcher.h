@@ -0,0 +1,78 @@
+#pragma once
+
+#include "text-span.h"
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Returned by GlobSet::Match when no pattern matches.
+#define GLOB_NO_MATCH ((size_t)-1)
+
+// Beyond this many DFA states, GlobSet::Match simulates the NFA rather than caching any more.
+#define MAX_DFA_STATES 4096
+
+// Returns true if the text contains a '*' (any run of characters, including none) or a '?' (any one character).
+bool IsGlobPattern(const TextSpan& text);
+
+// Matches one pattern against one text, case-sensitively.  This is for checking a few known patterns; to find
+// which of many patterns match, use a GlobSet.
+bool GlobMatch(const TextSpan& pattern, const TextSpan& text);
+
+/*
+    A set of glob patterns compiled into a single matcher, each with a value to report when it matches.  The
+    patterns are merged into a trie, which is an NFA where a '*' node loops back to itself on any character.  That
+    NFA is turned into a DFA lazily, one state and transition at a time as texts are matched, so matching a text
+    takes one lookup per character however many patterns there are.  The DFA is shared by all callers and guarded
+    by a mutex, since matching extends it; if it grows beyond a fixed size, matching carries on by simulating the
+    NFA directly instead.
+*/
+class GlobSet {
+public:
+    GlobSet();
+
+    // Adds a pattern.  When a text matches several patterns, the smallest of their values is reported.
+    void Add(const TextSpan& pattern, size_t value);
+
+    bool empty() const { return nodes_.size() == 1 && nodes_[0].value == GLOB_NO_MATCH; }
+
+    // Returns the value of the matching pattern, or GLOB_NO_MATCH if none match.
+    size_t Match(const TextSpan& text) const;
+
+    // How many DFA states have been built since the last Add; at most MAX_DFA_STATES.
+    size_t CachedStateCount() const;
+
+private:
+    GlobSet(const GlobSet&);
+    GlobSet& operator=(const GlobSet&);
+
+    typedef std::vector<uint32_t> NodeSet;
+
+    struct Node {
+        std::unordered_map<wchar_t, uint32_t> children;
+        uint32_t any_child;   // The node after a '?', or NO_NODE.
+        uint32_t star_child;  // The node after a '*', or NO_NODE.
+        bool loops;           // Whether this node was reached by a '*', so stays active on any character.
+        size_t value;         // The smallest value of the patterns which end here, or GLOB_NO_MATCH.
+    };
+
+    struct DfaState {
+        NodeSet nodes;
+        size_t value;
+        std::unordered_map<wchar_t, uint32_t> next;
+    };
+
+    uint32_t NewNode(bool loops);
+    void Close(NodeSet& nodes) const;
+    void Step(const NodeSet& from, wchar_t c, NodeSet& to) const;
+    size_t ValueOf(const NodeSet& nodes) const;
+    uint32_t Intern(NodeSet& nodes) const;
+
+    std::vector<Node> nodes_;
+
+    mutable std::mutex dfa_mutex_;
+    mutable std::vector<DfaState> dfa_;
+    mutable std::map<NodeSet, uint32_t> dfa_by_nodes_;
+};
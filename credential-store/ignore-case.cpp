@@ -0,0 +1,341 @@
+#include "stdafx.h"
+
+#include "ignore-case.h"
+
+#include <windows.h>
+#include <string>
+#include <vector>
+
+#if defined(_M_IX86) || defined(_M_X64)
+#define IGNORE_CASE_SIMD
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#pragma hdrstop
+
+using namespace std;
+
+static_assert(sizeof(wchar_t) == 2, "wide strings are expected to be UTF-16");
+
+namespace {
+    // The invariant upper-case mapping of every UTF-16 code unit.  Surrogates are mapped to themselves, so
+    // characters outside the Basic Multilingual Plane only match exactly.
+    class UpperCaseTable {
+    public:
+        UpperCaseTable() : table_(0x10000) {
+            vector<wchar_t> identity(table_.size());
+            for (size_t c = 0; c < identity.size(); ++c) {
+                identity[c] = table_[c] = (wchar_t)c;
+            }
+            MapToUpperCase(identity, 0x80, 0xD800);
+            MapToUpperCase(identity, 0xE000, 0x10000);
+        }
+
+        wchar_t operator[](wchar_t c) const { return table_[(unsigned short)c]; }
+
+    private:
+        void MapToUpperCase(const vector<wchar_t>& identity, size_t begin, size_t end) {
+            // If this fails, the units are left mapped to themselves, so they still match exactly.
+            int length = (int)(end - begin);
+            ::LCMapStringEx(
+                LOCALE_NAME_INVARIANT, LCMAP_UPPERCASE,
+                &identity[begin], length, &table_[begin], length,
+                NULL, NULL, 0
+            );
+        }
+
+        vector<wchar_t> table_;
+    };
+
+    const UpperCaseTable& UpperCase() {
+        static const UpperCaseTable table;
+        return table;
+    }
+
+    inline wchar_t FoldChar(wchar_t c) {
+        if (c < 0x80) {
+            return (c >= L'a' && c <= L'z') ? (wchar_t)(c - 0x20) : c;
+        }
+        return UpperCase()[c];
+    }
+
+    inline char FoldAsciiByte(char c) {
+        return (c >= 'a' && c <= 'z') ? (char)(c - 0x20) : c;
+    }
+
+    bool EqualsScalar(const wchar_t* a, const wchar_t* b, size_t length) {
+        for (size_t i = 0; i < length; ++i) {
+            if (a[i] != b[i] && FoldChar(a[i]) != FoldChar(b[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+#ifdef IGNORE_CASE_SIMD
+    // Upper-cases the ASCII letters among eight UTF-16 units, leaving all other units unchanged.  (Units from 0x8000
+    // up are negative as signed 16-bit values, so they never fall in the range.)
+    inline __m128i FoldAscii(__m128i x) {
+        __m128i is_lower = _mm_and_si128(
+            _mm_cmpgt_epi16(x, _mm_set1_epi16(L'a' - 1)), _mm_cmplt_epi16(x, _mm_set1_epi16(L'z' + 1))
+        );
+        return _mm_sub_epi16(x, _mm_and_si128(is_lower, _mm_set1_epi16(0x20)));
+    }
+
+    inline __m256i FoldAscii(__m256i x) {
+        __m256i is_lower = _mm256_and_si256(
+            _mm256_cmpgt_epi16(x, _mm256_set1_epi16(L'a' - 1)), _mm256_cmpgt_epi16(_mm256_set1_epi16(L'z' + 1), x)
+        );
+        return _mm256_sub_epi16(x, _mm256_and_si256(is_lower, _mm256_set1_epi16(0x20)));
+    }
+
+    // The same for sixteen bytes, which must all be ASCII.
+    inline __m128i FoldAsciiBytes(__m128i x) {
+        __m128i is_lower = _mm_and_si128(
+            _mm_cmpgt_epi8(x, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(x, _mm_set1_epi8('z' + 1))
+        );
+        return _mm_sub_epi8(x, _mm_and_si128(is_lower, _mm_set1_epi8(0x20)));
+    }
+
+    // A block which is equal once ASCII letters are folded is equal, since only ASCII letters were changed.  Blocks
+    // which aren't are checked unit by unit, as they may still match through the table: non-ASCII letters which
+    // differ only in case, and also a few non-ASCII units which upper-case to ASCII letters (U+0131 to 'I' and U+017F
+    // to 'S'), so an ASCII unit in one string can match a non-ASCII unit in the other.
+    bool EqualsSse2(const wchar_t* a, const wchar_t* b, size_t length) {
+        size_t i = 0;
+        for (; i + 8 <= length; i += 8) {
+            __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+            __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(FoldAscii(x), FoldAscii(y))) != 0xFFFF &&
+                !EqualsScalar(a + i, b + i, 8)
+            ) {
+                return false;
+            }
+        }
+        return EqualsScalar(a + i, b + i, length - i);
+    }
+
+    bool EqualsAvx2(const wchar_t* a, const wchar_t* b, size_t length) {
+        size_t i = 0;
+        for (; i + 16 <= length; i += 16) {
+            __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+            __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi16(FoldAscii(x), FoldAscii(y))) != -1 &&
+                !EqualsScalar(a + i, b + i, 16)
+            ) {
+                return false;
+            }
+        }
+        return EqualsSse2(a + i, b + i, length - i);
+    }
+
+    bool HasAvx2() {
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) {
+            return false;
+        }
+        // The OS must also save the AVX registers across context switches.
+        __cpuid(info, 1);
+        const int osxsave_and_avx = (1 << 27) | (1 << 28);
+        if ((info[2] & osxsave_and_avx) != osxsave_and_avx || (_xgetbv(0) & 6) != 6) {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    }
+
+    typedef bool (*EqualsFunction)(const wchar_t* a, const wchar_t* b, size_t length);
+
+    bool EqualsUnits(const wchar_t* a, const wchar_t* b, size_t length) {
+        static const EqualsFunction equals = HasAvx2() ? EqualsAvx2 : EqualsSse2;
+        return equals(a, b, length);
+    }
+
+    inline unsigned LowestBit(unsigned bits) {
+        unsigned long index;
+        _BitScanForward(&index, bits);
+        return (unsigned)index;
+    }
+#else
+    bool EqualsUnits(const wchar_t* a, const wchar_t* b, size_t length) {
+        return EqualsScalar(a, b, length);
+    }
+#endif
+
+    // Compares two runs of bytes as ASCII ignoring case.  Returns 1 if they are equal, 0 if they differ, or -1 if a
+    // non-ASCII byte was found before any difference, in which case they must be compared as UTF-16 instead.
+    int CompareAsciiBytes(const char* a, const char* b, size_t size) {
+        size_t i = 0;
+#ifdef IGNORE_CASE_SIMD
+        for (; i + 16 <= size; i += 16) {
+            __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+            __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+            if (_mm_movemask_epi8(_mm_or_si128(x, y)) != 0) {
+                return -1;
+            }
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(FoldAsciiBytes(x), FoldAsciiBytes(y))) != 0xFFFF) {
+                return 0;
+            }
+        }
+#endif
+        for (; i < size; ++i) {
+            if (((a[i] | b[i]) & 0x80) != 0) {
+                return -1;
+            }
+            if (FoldAsciiByte(a[i]) != FoldAsciiByte(b[i])) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+
+    bool IsAscii(const char* text, size_t size) {
+        size_t i = 0;
+#ifdef IGNORE_CASE_SIMD
+        for (; i + 16 <= size; i += 16) {
+            if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(text + i))) != 0) {
+                return false;
+            }
+        }
+#endif
+        for (; i < size; ++i) {
+            if ((text[i] & 0x80) != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    wstring Utf8ToUtf16(const char* text, size_t size) {
+        wstring result;
+        if (size == 0) {
+            return result;
+        }
+        int length = ::MultiByteToWideChar(CP_UTF8, 0, text, (int)size, NULL, 0);
+        if (length > 0) {
+            result.resize(length);
+            ::MultiByteToWideChar(CP_UTF8, 0, text, (int)size, &result[0], length);
+        }
+        return result;
+    }
+}
+
+bool EqualsIgnoreCase(const TextSpan& a, const TextSpan& b) {
+    return a.size == b.size && EqualsUnits(a.data, b.data, a.size);
+}
+
+bool StartsWithIgnoreCase(const TextSpan& text, const TextSpan& prefix) {
+    return prefix.size <= text.size && EqualsUnits(text.data, prefix.data, prefix.size);
+}
+
+size_t FindIgnoreCase(const TextSpan& text, const TextSpan& pattern) {
+    if (pattern.size > text.size) {
+        return IGNORE_CASE_NOT_FOUND;
+    }
+    if (pattern.empty()) {
+        return 0;
+    }
+
+    const wchar_t first = FoldChar(pattern.data[0]);
+    const size_t last_start = text.size - pattern.size;
+    size_t i = 0;
+#ifdef IGNORE_CASE_SIMD
+    // Look for candidate starts eight units at a time: units which fold to the first unit of the pattern as ASCII,
+    // plus any non-ASCII units, since those might fold to it through the table.
+    const __m128i wanted = _mm_set1_epi16((short)first);
+    const __m128i non_ascii_bits = _mm_set1_epi16((short)0xFF80);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= last_start + 1; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(text.data + i));
+        unsigned ascii = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(x, non_ascii_bits), zero));
+        unsigned matches = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi16(FoldAscii(x), wanted));
+        unsigned candidates = (matches | ~ascii) & 0xFFFF;
+        while (candidates != 0) {
+            unsigned bit = LowestBit(candidates);
+            size_t start = i + bit / 2;
+            if (FoldChar(text.data[start]) == first &&
+                EqualsUnits(text.data + start + 1, pattern.data + 1, pattern.size - 1)
+            ) {
+                return start;
+            }
+            // Each unit sets two bits of the mask.
+            candidates &= ~(3u << (bit & ~1u));
+        }
+    }
+#endif
+    for (; i <= last_start; ++i) {
+        if (FoldChar(text.data[i]) == first && EqualsUnits(text.data + i + 1, pattern.data + 1, pattern.size - 1)) {
+            return i;
+        }
+    }
+    return IGNORE_CASE_NOT_FOUND;
+}
+
+void FoldCase(wchar_t* text, size_t length) {
+    size_t i = 0;
+#ifdef IGNORE_CASE_SIMD
+    const __m128i non_ascii_bits = _mm_set1_epi16((short)0xFF80);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= length; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(text + i));
+        // Compare whole units with zero: a unit such as U+0131 has no byte with its top bit set.
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(x, non_ascii_bits), zero)) == 0xFFFF) {
+            _mm_storeu_si128((__m128i*)(text + i), FoldAscii(x));
+        } else {
+            for (size_t j = i; j < i + 8; ++j) {
+                text[j] = FoldChar(text[j]);
+            }
+        }
+    }
+#endif
+    for (; i < length; ++i) {
+        text[i] = FoldChar(text[i]);
+    }
+}
+
+bool EqualsIgnoreCaseUtf8(const char* a, size_t a_size, const char* b, size_t b_size) {
+    // Strings which are equal ignoring case can have different numbers of bytes, but only if some are non-ASCII.
+    switch (CompareAsciiBytes(a, b, (a_size < b_size) ? a_size : b_size)) {
+    case 1:
+        return a_size == b_size;
+    case 0:
+        return false;
+    default:
+        return EqualsIgnoreCase(Utf8ToUtf16(a, a_size), Utf8ToUtf16(b, b_size));
+    }
+}
+
+bool StartsWithIgnoreCaseUtf8(const char* text, size_t text_size, const char* prefix, size_t prefix_size) {
+    switch (CompareAsciiBytes(text, prefix, (text_size < prefix_size) ? text_size : prefix_size)) {
+    case 1:
+        return prefix_size <= text_size;
+    case 0:
+        return false;
+    default:
+        return StartsWithIgnoreCase(Utf8ToUtf16(text, text_size), Utf8ToUtf16(prefix, prefix_size));
+    }
+}
+
+size_t FindIgnoreCaseUtf8(const char* text, size_t text_size, const char* pattern, size_t pattern_size) {
+    if (IsAscii(text, text_size) && IsAscii(pattern, pattern_size)) {
+        if (pattern_size > text_size) {
+            return IGNORE_CASE_NOT_FOUND;
+        }
+        for (size_t i = 0; i + pattern_size <= text_size; ++i) {
+            if (CompareAsciiBytes(text + i, pattern, pattern_size) == 1) {
+                return i;
+            }
+        }
+        return IGNORE_CASE_NOT_FOUND;
+    }
+
+    wstring wide_text(Utf8ToUtf16(text, text_size));
+    size_t found = FindIgnoreCase(wide_text, Utf8ToUtf16(pattern, pattern_size));
+    if (found == IGNORE_CASE_NOT_FOUND || found == 0) {
+        return found;
+    }
+    // Convert the index back into a byte offset.
+    return (size_t)::WideCharToMultiByte(CP_UTF8, 0, wide_text.data(), (int)found, NULL, 0, NULL, NULL);
+}
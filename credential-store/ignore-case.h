@@ -0,0 +1,26 @@
+#pragma once
+
+#include "text-span.h"
+
+#define IGNORE_CASE_NOT_FOUND ((size_t)-1)
+
+/*
+    Case-insensitive matching of UTF-16 and UTF-8 text, for usernames, commands and credential names.  Two code units
+    match if they upper-case to the same unit under the invariant locale, so the results don't depend on the user's
+    locale settings.  Runs of ASCII are compared with SSE2 or AVX2 (whichever the processor supports) eight or sixteen
+    units at a time; anything else goes through a table of the invariant upper-case mapping, built the first time it is
+    needed.
+*/
+
+bool EqualsIgnoreCase(const TextSpan& a, const TextSpan& b);
+bool StartsWithIgnoreCase(const TextSpan& text, const TextSpan& prefix);
+// Returns the index of the first match of "pattern" in "text", or IGNORE_CASE_NOT_FOUND.
+size_t FindIgnoreCase(const TextSpan& text, const TextSpan& pattern);
+
+// Upper-cases "text" in place, in the same way as the comparisons above, so that the result can be used as a key.
+void FoldCase(wchar_t* text, size_t length);
+
+// The same for UTF-8; FindIgnoreCaseUtf8 returns a byte offset.
+bool EqualsIgnoreCaseUtf8(const char* a, size_t a_size, const char* b, size_t b_size);
+bool StartsWithIgnoreCaseUtf8(const char* text, size_t text_size, const char* prefix, size_t prefix_size);
+size_t FindIgnoreCaseUtf8(const char* text, size_t text_size, const char* pattern, size_t pattern_size);
@@ -0,0 +1,189 @@
+#include "stdafx.h"
+
+#include "inventory.h"
+#include "credential-digest.h"
+#include "credential-output.h"
+#include "trace.h"
+
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+#pragma hdrstop
+
+// How much output is gathered before it is written.
+#define INVENTORY_FLUSH_BYTES (64 * 1024)
+
+using namespace std;
+
+namespace {
+    const char* TypeName(DWORD type) {
+        switch (type) {
+        case CRED_TYPE_GENERIC: return "generic";
+        case CRED_TYPE_DOMAIN_PASSWORD: return "domain_password";
+        case CRED_TYPE_DOMAIN_CERTIFICATE: return "domain_certificate";
+        case CRED_TYPE_DOMAIN_VISIBLE_PASSWORD: return "domain_visible_password";
+        default: return "unknown";
+        }
+    }
+
+    const char* PersistName(DWORD persist) {
+        switch (persist) {
+        case CRED_PERSIST_SESSION: return "session";
+        case CRED_PERSIST_LOCAL_MACHINE: return "local_machine";
+        case CRED_PERSIST_ENTERPRISE: return "enterprise";
+        default: return "unknown";
+        }
+    }
+
+    const char* KindName(CredentialKind kind) {
+        switch (kind) {
+        case CredentialKind::Git: return "git";
+        case CredentialKind::Mercurial: return "mercurial";
+        case CredentialKind::Intrepid: return "intrepid";
+        default: return "other";
+        }
+    }
+
+    // Formats a FILETIME as "YYYY-MM-DDTHH:MM:SSZ", by hand, since this runs once per credential.
+    void AppendTimestamp(OutputBuffer& output, const FILETIME& time) {
+        SYSTEMTIME utc;
+        if (!::FileTimeToSystemTime(&time, &utc)) {
+            return;
+        }
+        char text[21];
+        const WORD parts[] = { utc.wYear, utc.wMonth, utc.wDay, utc.wHour, utc.wMinute, utc.wSecond };
+        const char separators[] = { '-', '-', 'T', ':', ':', 'Z' };
+        size_t pos = 0;
+        for (size_t i = 0; i < 6; ++i) {
+            WORD value = parts[i];
+            if (i == 0) {
+                text[pos++] = (char)('0' + value / 1000 % 10);
+                text[pos++] = (char)('0' + value / 100 % 10);
+            }
+            text[pos++] = (char)('0' + value / 10 % 10);
+            text[pos++] = (char)('0' + value % 10);
+            text[pos++] = separators[i];
+        }
+        text[pos] = '\0';
+        output.AppendAscii(text);
+    }
+
+    // The basis which covers a credential, or an empty span.
+    TextSpan BasisOf(const CredentialSnapshot& snapshot, const CredentialBases& bases, size_t index) {
+        switch (snapshot.KindOf(index)) {
+        case CredentialKind::Git:
+        case CredentialKind::Mercurial: {
+            const TextSpan* basis = bases.BasisOf(snapshot[index]->TargetName);
+            return (basis == NULL) ? TextSpan() : *basis;
+        }
+        case CredentialKind::Intrepid: {
+            const TextSpan& location = snapshot.PartsOf(index).location;
+            return bases.IsBasis(location) ? location : TextSpan();
+        }
+        default:
+            return TextSpan();
+        }
+    }
+
+    size_t Length(const wchar_t* text) {
+        return (text == NULL) ? 0 : wcslen(text);
+    }
+}
+
+bool WriteInventory(
+    const CredentialSnapshot& snapshot,
+    const CredentialBases& bases,
+    const InventoryOptions& options,
+    HANDLE out
+) {
+    TraceSpan span("Output");
+    unique_ptr<CredentialDigester> digester;
+    if (options.digests) {
+        digester.reset(new CredentialDigester());
+        if (!digester->ok()) {
+            wcerr << L"ERROR: Failed to set up digests - errno " << ::GetLastError() << endl;
+            return false;
+        }
+    }
+    const bool csv = (options.format == InventoryFormat::Csv);
+
+    OutputBuffer output;
+    if (csv) {
+        output.AppendAscii("target,type,persist,username,kind,basis,blob_length,last_written");
+        output.AppendAscii(options.digests ? ",digest\n" : "\n");
+    }
+
+    bool ok = true;
+    BYTE digest[CREDENTIAL_DIGEST_SIZE];
+    for (size_t index = 0; index < snapshot.size() && ok; ++index) {
+        PCREDENTIALW credential = snapshot[index];
+        const wchar_t* user_name = (credential->UserName == NULL) ? L"" : credential->UserName;
+        TextSpan basis = BasisOf(snapshot, bases, index);
+        bool digested = options.digests
+            && digester->Digest(credential->CredentialBlob, credential->CredentialBlobSize, digest);
+
+        if (csv) {
+            output.AppendCsvField(credential->TargetName, Length(credential->TargetName));
+            output.AppendAscii(",");
+            output.AppendAscii(TypeName(credential->Type));
+            output.AppendAscii(",");
+            output.AppendAscii(PersistName(credential->Persist));
+            output.AppendAscii(",");
+            output.AppendCsvField(user_name, wcslen(user_name));
+            output.AppendAscii(",");
+            output.AppendAscii(KindName(snapshot.KindOf(index)));
+            output.AppendAscii(",");
+            output.AppendCsvField(basis.data, basis.size);
+            output.AppendAscii(",");
+            output.AppendDecimal(credential->CredentialBlobSize);
+            output.AppendAscii(",");
+            AppendTimestamp(output, credential->LastWritten);
+            if (options.digests) {
+                output.AppendAscii(",");
+                if (digested) {
+                    output.AppendHex(digest, sizeof(digest));
+                }
+            }
+        } else {
+            output.AppendAscii("{\"target\":");
+            output.AppendJsonString(credential->TargetName, Length(credential->TargetName));
+            output.AppendAscii(",\"type\":\"");
+            output.AppendAscii(TypeName(credential->Type));
+            output.AppendAscii("\",\"persist\":\"");
+            output.AppendAscii(PersistName(credential->Persist));
+            output.AppendAscii("\",\"username\":");
+            output.AppendJsonString(user_name, wcslen(user_name));
+            output.AppendAscii(",\"kind\":\"");
+            output.AppendAscii(KindName(snapshot.KindOf(index)));
+            output.AppendAscii("\",\"basis\":");
+            if (basis.empty()) {
+                output.AppendAscii("null");
+            } else {
+                output.AppendJsonString(basis.data, basis.size);
+            }
+            output.AppendAscii(",\"blob_length\":");
+            output.AppendDecimal(credential->CredentialBlobSize);
+            output.AppendAscii(",\"last_written\":\"");
+            AppendTimestamp(output, credential->LastWritten);
+            output.AppendAscii("\"");
+            if (options.digests) {
+                output.AppendAscii(",\"digest\":");
+                if (digested) {
+                    output.AppendAscii("\"");
+                    output.AppendHex(digest, sizeof(digest));
+                    output.AppendAscii("\"");
+                } else {
+                    output.AppendAscii("null");
+                }
+            }
+            output.AppendAscii("}");
+        }
+        output.AppendAscii("\n");
+
+        if (output.size() >= INVENTORY_FLUSH_BYTES) {
+            ok = output.FlushTo(out);
+        }
+    }
+    return ok && output.FlushTo(out);
+}
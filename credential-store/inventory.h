@@ -0,0 +1,36 @@
+#pragma once
+
+#include "credential-bases.h"
+#include "credential-snapshot.h"
+
+#include <windows.h>
+
+#define INVENTORY_JSONL_OPTION L"--jsonl"
+#define INVENTORY_DIGEST_OPTION L"--digest"
+
+enum class InventoryFormat {
+    Csv,       // A header line, then one line per credential.
+    JsonLines  // One JSON object per line.
+};
+
+struct InventoryOptions {
+    InventoryFormat format;
+    bool digests; // Include a CredentialDigester digest of each blob; otherwise only its length is shown.
+};
+
+/*
+    Writes one record per credential in the snapshot, with fields:
+        target, type, persist, username, kind, basis, blob_length, last_written[, digest]
+    "kind" is git, mercurial, intrepid or other.  "basis" is the basis which lists or matches a Git or Mercurial
+    credential, or the basis which an Intrepid credential holds; it is empty (null in JSON) if there is none.
+    "last_written" is UTC, in ISO 8601 form.  Secrets are never written.
+
+    The records are formatted into one buffer, which is written out whenever it fills, so the output is streamed
+    without a write per line.  Returns false if writing failed.
+*/
+bool WriteInventory(
+    const CredentialSnapshot& snapshot,
+    const CredentialBases& bases,
+    const InventoryOptions& options,
+    HANDLE out
+);
@@ -0,0 +1,205 @@
+#include "stdafx.h"
+
+#include "rotation-manifest.h"
+#include "credential-bases.h"
+#include "ignore-case.h"
+#include "text-span.h"
+
+#include <cwctype>
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+
+#pragma hdrstop
+
+using namespace std;
+
+namespace {
+    TextSpan Trim(const wchar_t* begin, const wchar_t* end) {
+        while (begin < end && iswspace(*begin)) {
+            ++begin;
+        }
+        while (end > begin && iswspace(end[-1])) {
+            --end;
+        }
+        return TextSpan(begin, end - begin);
+    }
+
+    // Splits a trimmed line into its first word and the (trimmed) rest.
+    void SplitKeyword(const TextSpan& line, TextSpan& keyword, TextSpan& rest) {
+        const wchar_t* end = line.begin();
+        while (end < line.end() && !iswspace(*end)) {
+            ++end;
+        }
+        keyword = TextSpan(line.begin(), end - line.begin());
+        rest = Trim(end, line.end());
+    }
+
+    // Parses a manifest a line at a time.  An entry's options are collected as its lines are seen, and only applied
+    // when the next entry starts (or the file ends), so they can be given in any order.
+    class ManifestParser {
+    public:
+        ManifestParser(const wstring& file_name, RotationManifest& manifest)
+            : file_name_(file_name)
+            , manifest_(manifest)
+            , line_index_(0)
+            , in_entry_(false)
+            , has_source_(false)
+            , source_(SecretSource::Prompt)
+        {
+        }
+
+        bool ParseLine(const TextSpan& line, bool indented, unsigned long line_index) {
+            line_index_ = line_index;
+            TextSpan keyword;
+            TextSpan value;
+            SplitKeyword(line, keyword, value);
+            if (!indented) {
+                return FinishEntry() && StartEntry(keyword, value);
+            }
+            if (!in_entry_) {
+                return Fail(L"an option must follow an entry");
+            }
+            if (value.empty()) {
+                return Fail(L"'" + keyword.str() + L"' needs a value");
+            }
+            if (EqualsIgnoreCase(keyword, L"identity")) {
+                if (!identity_.empty()) {
+                    return Fail(L"the entry already has an identity");
+                }
+                identity_ = value.str();
+            } else if (EqualsIgnoreCase(keyword, L"secret")) {
+                if (has_source_) {
+                    return Fail(L"the entry already has a secret");
+                }
+                if (EqualsIgnoreCase(value, L"prompt")) {
+                    source_ = SecretSource::Prompt;
+                } else if (EqualsIgnoreCase(value, L"stdin")) {
+                    source_ = SecretSource::Stdin;
+                } else {
+                    return Fail(L"the secret must be 'prompt' or 'stdin'");
+                }
+                has_source_ = true;
+            } else {
+                return Fail(L"unknown option '" + keyword.str() + L"'");
+            }
+            return true;
+        }
+
+        bool Finish() {
+            if (!FinishEntry()) {
+                return false;
+            }
+            if (manifest_.entries.empty()) {
+                wcerr << L"ERROR: There are no entries in " << file_name_ << L"." << endl;
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        ManifestParser(const ManifestParser&);
+        ManifestParser& operator=(const ManifestParser&);
+
+        bool StartEntry(const TextSpan& keyword, const TextSpan& name) {
+            if (EqualsIgnoreCase(keyword, L"basis")) {
+                entry_.scope = RotationScope::Basis;
+            } else if (EqualsIgnoreCase(keyword, L"defaults")) {
+                entry_.scope = RotationScope::Defaults;
+            } else {
+                return Fail(L"an entry must start with 'basis' or 'defaults'");
+            }
+            if (name.empty()) {
+                return Fail(L"'" + keyword.str() + L"' needs a name");
+            }
+            entry_.name = name.str();
+            entry_.line = line_index_;
+            in_entry_ = true;
+            identity_.clear();
+            has_source_ = false;
+            return true;
+        }
+
+        bool FinishEntry() {
+            if (!in_entry_) {
+                return true;
+            }
+            in_entry_ = false;
+
+            const wstring& name = identity_.empty() ? wstring(DEFAULT_ROTATION_IDENTITY) : identity_;
+            auto inserted = identity_indexes_.emplace(name, manifest_.identities.size());
+            if (inserted.second) {
+                RotationIdentity identity = { name, SecretSource::Prompt };
+                manifest_.identities.push_back(identity);
+                explicit_sources_.push_back(false);
+            }
+            entry_.identity = inserted.first->second;
+            manifest_.entries.push_back(entry_);
+
+            if (has_source_) {
+                RotationIdentity& identity = manifest_.identities[entry_.identity];
+                if (explicit_sources_[entry_.identity] && identity.source != source_) {
+                    line_index_ = entry_.line;
+                    return Fail(L"identity '" + identity.name + L"' was given a different secret earlier");
+                }
+                identity.source = source_;
+                explicit_sources_[entry_.identity] = true;
+            }
+            return true;
+        }
+
+        bool Fail(const wstring& message) {
+            wcerr << L"ERROR: Line " << line_index_ << L" of " << file_name_ << L": " << message << L"." << endl;
+            return false;
+        }
+
+        const wstring& file_name_;
+        RotationManifest& manifest_;
+        unordered_map<wstring, size_t> identity_indexes_;
+        vector<bool> explicit_sources_; // Whether each identity's source was given, rather than defaulted.
+        unsigned long line_index_;
+
+        // The entry being parsed, and its options so far.
+        bool in_entry_;
+        RotationEntry entry_;
+        wstring identity_;
+        bool has_source_;
+        SecretSource source_;
+    };
+}
+
+bool ReadRotationManifest(const wstring& file_name, RotationManifest& manifest) {
+    unique_ptr<wchar_t[]> text;
+    size_t length = 0;
+    if (!ReadTextFile(file_name, text, length)) {
+        wcerr << L"ERROR: Failed to read " << file_name << L" - errno " << ::GetLastError() << endl;
+        return false;
+    }
+
+    manifest.entries.clear();
+    manifest.identities.clear();
+    ManifestParser parser(file_name, manifest);
+    const wchar_t* next = text.get();
+    const wchar_t* const text_end = next + length;
+    unsigned long line_index = 0;
+    while (next < text_end) {
+        const wchar_t* line_begin = next;
+        const wchar_t* line_end = wmemchr(next, L'\n', text_end - next);
+        if (line_end == NULL) {
+            line_end = text_end;
+            next = text_end;
+        } else {
+            next = line_end + 1;
+        }
+        ++line_index;
+
+        TextSpan line = Trim(line_begin, line_end);
+        if (line.empty() || *line.begin() == L'#') {
+            continue;
+        }
+        if (!parser.ParseLine(line, iswspace(*line_begin) != 0, line_index)) {
+            return false;
+        }
+    }
+    return parser.Finish();
+}
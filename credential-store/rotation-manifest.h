@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// The identity used by manifest entries which don't name one, so that a manifest with no identities prompts once.
+#define DEFAULT_ROTATION_IDENTITY L"default"
+
+// Which credentials a manifest entry covers.
+enum class RotationScope {
+    Basis,    // A basis credential and everything listed under it, as for "for-basis <name>".
+    Defaults  // The credentials of one username which aren't covered by any basis, as for "for-defaults".
+};
+
+// Where the new username and password for an identity come from.
+enum class SecretSource {
+    Prompt, // Asked for on the console, with the password hidden.
+    Stdin   // Read from standard input without prompting, as a line holding the username then one holding the password.
+};
+
+// One username and password, which may be shared by several manifest entries.
+struct RotationIdentity {
+    std::wstring name;
+    SecretSource source;
+};
+
+struct RotationEntry {
+    RotationScope scope;
+    std::wstring name;    // The basis name, or the username whose default credentials are rotated.
+    size_t identity;      // An index into RotationManifest::identities.
+    unsigned long line;   // Where the entry starts in the manifest, for messages.
+};
+
+struct RotationManifest {
+    std::vector<RotationEntry> entries;        // In the order they appear in the file.
+    std::vector<RotationIdentity> identities;  // In the order they are first used.
+};
+
+/*
+    Reads a rotation manifest.  It has the same shape as the credential basis file: each unindented line starts an
+    entry, and the indented lines after it set options for that entry.  For example:
+
+        # Comments start with '#'.
+        basis Corporate LDAP
+            identity corp
+        defaults jbloggs
+            identity corp
+        basis Build Servers
+            identity build
+            secret stdin
+
+    An entry is "basis <basis_name>" or "defaults <username>".  The options are "identity <name>", naming the
+    username and password to write (entries without one share DEFAULT_ROTATION_IDENTITY), and "secret prompt" or
+    "secret stdin", saying where that identity's username and password come from (by default, a prompt).  Prints an
+    error and returns false if the file can't be read or is malformed.
+*/
+bool ReadRotationManifest(const std::wstring& file_name, RotationManifest& manifest);
@@ -0,0 +1,174 @@
+#include "stdafx.h"
+
+#include "secret-buffer.h"
+
+#include <mutex>
+
+#pragma hdrstop
+
+// How many slots are added to the arena at a time.  Only a few secrets are ever alive at once, and the default
+// working set only allows a process to lock a few dozen pages.
+#define SECRET_ARENA_BLOCK_SLOTS 8
+
+using namespace std;
+
+namespace {
+    /*
+        Hands out slots of SECRET_BUFFER_CAPACITY characters from blocks of locked pages.  Free slots are chained
+        through their own first bytes, so neither taking nor returning a slot allocates anything.  Blocks are never
+        given back; every slot in them is zeroed whenever it's free, apart from the chain pointer.
+    */
+    class SecretArena {
+    public:
+        SecretArena() : free_(NULL) {}
+
+        wchar_t* Acquire() {
+            lock_guard<mutex> lock(mutex_);
+            if (free_ == NULL) {
+                AddBlock();
+                if (free_ == NULL) {
+                    return NULL;
+                }
+            }
+            FreeSlot* slot = free_;
+            free_ = slot->next;
+            slot->next = NULL;
+            return reinterpret_cast<wchar_t*>(slot);
+        }
+
+        void Release(wchar_t* slot) {
+            SecureZeroMemory(slot, SLOT_BYTES);
+            lock_guard<mutex> lock(mutex_);
+            FreeSlot* free_slot = reinterpret_cast<FreeSlot*>(slot);
+            free_slot->next = free_;
+            free_ = free_slot;
+        }
+
+    private:
+        SecretArena(const SecretArena&);
+        SecretArena& operator=(const SecretArena&);
+
+        struct FreeSlot {
+            FreeSlot* next;
+        };
+
+        // One extra character, so the contents can always be null-terminated.
+        static const size_t SLOT_BYTES = (SECRET_BUFFER_CAPACITY + 1) * sizeof(wchar_t);
+
+        void AddBlock() {
+            const size_t slot_size = (SLOT_BYTES + sizeof(void*) - 1) / sizeof(void*) * sizeof(void*);
+            const size_t block_size = slot_size * SECRET_ARENA_BLOCK_SLOTS;
+            BYTE* block = static_cast<BYTE*>(
+                ::VirtualAlloc(NULL, block_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE)
+            );
+            if (block == NULL) {
+                return;
+            }
+            // If the pages can't be locked (for example, because the working set is too small), the slots are still
+            // zeroed after use, which is the best we can do.
+            ::VirtualLock(block, block_size);
+            for (size_t i = SECRET_ARENA_BLOCK_SLOTS; i > 0; --i) {
+                FreeSlot* slot = reinterpret_cast<FreeSlot*>(block + (i - 1) * slot_size);
+                slot->next = free_;
+                free_ = slot;
+            }
+        }
+
+        mutex mutex_;
+        FreeSlot* free_;
+    };
+
+    SecretArena& GetSecretArena() {
+        static SecretArena arena;
+        return arena;
+    }
+}
+
+SecretBuffer::SecretBuffer()
+    : slot_(GetSecretArena().Acquire())
+    , size_(0)
+{
+}
+
+SecretBuffer::SecretBuffer(SecretBuffer&& other)
+    : slot_(other.slot_)
+    , size_(other.size_)
+{
+    other.slot_ = NULL;
+    other.size_ = 0;
+}
+
+SecretBuffer& SecretBuffer::operator=(SecretBuffer&& other) {
+    if (this != &other) {
+        Release();
+        slot_ = other.slot_;
+        size_ = other.size_;
+        other.slot_ = NULL;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+SecretBuffer::~SecretBuffer() {
+    Release();
+}
+
+bool SecretBuffer::Append(wchar_t c) {
+    if (slot_ == NULL || size_ >= SECRET_BUFFER_CAPACITY) {
+        return false;
+    }
+    slot_[size_++] = c;
+    slot_[size_] = L'\0';
+    return true;
+}
+
+bool SecretBuffer::Assign(const wchar_t* text, size_t length) {
+    if (slot_ == NULL || length > SECRET_BUFFER_CAPACITY) {
+        return false;
+    }
+    Clear();
+    wmemcpy(slot_, text, length);
+    size_ = length;
+    return true;
+}
+
+void SecretBuffer::Truncate(size_t length) {
+    if (length < size_) {
+        SecureZeroMemory(slot_ + length, (size_ - length) * sizeof(wchar_t));
+        size_ = length;
+    }
+}
+
+void SecretBuffer::Clear() {
+    Truncate(0);
+}
+
+void SecretBuffer::Release() {
+    if (slot_ != NULL) {
+        GetSecretArena().Release(slot_);
+        slot_ = NULL;
+    }
+    size_ = 0;
+}
+
+SecretLine ReadSecretLine(wistream& in, SecretBuffer& secret) {
+    secret.Clear();
+    bool fits = true;
+    bool any = false;
+    wchar_t c;
+    while (in.get(c)) {
+        any = true;
+        if (c == L'\n') {
+            break;
+        }
+        fits = fits && secret.Append(c);
+    }
+    if (!fits) {
+        secret.Clear();
+        return SecretLine::TooLong;
+    }
+    if (!secret.empty() && secret.data()[secret.size() - 1] == L'\r') {
+        secret.Truncate(secret.size() - 1);
+    }
+    return any ? SecretLine::Read : SecretLine::End;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "text-span.h"
+
+#include <windows.h>
+#include <wincred.h>
+#include <istream>
+#include <string>
+
+// The most characters a SecretBuffer holds: as many as fit in the largest credential blob Windows allows.
+#define SECRET_BUFFER_CAPACITY (CRED_MAX_CREDENTIAL_BLOB_SIZE / sizeof(wchar_t))
+
+/*
+    An allocator which zeroes each block before freeing it, so that a container holding secrets doesn't leave copies
+    of them on the heap when it grows or is destroyed.
+*/
+template <typename T>
+struct WipingAllocator {
+    typedef T value_type;
+
+    WipingAllocator() {}
+    template <typename U> WipingAllocator(const WipingAllocator<U>&) {}
+
+    T* allocate(size_t count) {
+        return static_cast<T*>(::operator new(count * sizeof(T)));
+    }
+
+    void deallocate(T* block, size_t count) {
+        SecureZeroMemory(block, count * sizeof(T));
+        ::operator delete(block);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const WipingAllocator<T>&, const WipingAllocator<U>&) { return true; }
+template <typename T, typename U>
+bool operator!=(const WipingAllocator<T>&, const WipingAllocator<U>&) { return false; }
+
+// Text which may include a secret, zeroed whenever its storage is freed.
+typedef std::basic_string<wchar_t, std::char_traits<wchar_t>, WipingAllocator<wchar_t>> WipingString;
+
+/*
+    A password (or other secret), held in a fixed-size slot of a small arena of pages which are locked in memory, so
+    they are never written to the page file.  The slot is zeroed when the buffer is cleared or destroyed, and the
+    buffer can be moved but not copied, so there is only ever one copy of the secret.  Taking a slot doesn't touch the
+    heap; the arena only grows (by another block of locked pages) if more buffers are alive at once than fit in it.
+
+    Pass the contents on as a TextSpan (from span()), which views the slot without copying it.
+*/
+class SecretBuffer {
+public:
+    SecretBuffer();
+    SecretBuffer(SecretBuffer&& other);
+    SecretBuffer& operator=(SecretBuffer&& other);
+    ~SecretBuffer();
+
+    const wchar_t* data() const { return (slot_ == NULL) ? L"" : slot_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    TextSpan span() const { return TextSpan(data(), size_); }
+
+    // These return false, leaving the buffer unchanged, if the result wouldn't fit.
+    bool Append(wchar_t c);
+    bool Assign(const wchar_t* text, size_t length);
+
+    // Zeroes everything after the first "length" characters.
+    void Truncate(size_t length);
+
+    // Zeroes the contents.
+    void Clear();
+
+private:
+    SecretBuffer(const SecretBuffer&);
+    SecretBuffer& operator=(const SecretBuffer&);
+
+    void Release();
+
+    wchar_t* slot_;
+    size_t size_;
+};
+
+// What ReadSecretLine found.
+enum class SecretLine {
+    Read,     // A line, which may be empty.
+    End,      // Nothing: the input had already ended.
+    TooLong   // A line too long to fit.  The rest of it has been consumed, and the buffer is left empty.
+};
+
+// Reads a line into "secret", without the line ending and without any other copy of it.
+SecretLine ReadSecretLine(std::wistream& in, SecretBuffer& secret);
@@ -0,0 +1,106 @@
+#include "stdafx.h"
+
+#include "target-name.h"
+
+#pragma hdrstop
+
+using namespace std;
+
+namespace {
+    const wchar_t GIT_CREDENTIAL_PREFIX[] = L"git:";
+    const size_t GIT_CREDENTIAL_PREFIX_LENGTH = _countof(GIT_CREDENTIAL_PREFIX) - 1;
+    const wchar_t INTREPID_CREDENTIAL_PREFIX[] = HOLY_GRADLE_CREDENTIAL_PREFIX;
+    const size_t INTREPID_CREDENTIAL_PREFIX_LENGTH = _countof(INTREPID_CREDENTIAL_PREFIX) - 1;
+    const wchar_t MERCURIAL_CREDENTIAL_SUFFIX[] = L"@Mercurial";
+    const size_t MERCURIAL_CREDENTIAL_SUFFIX_LENGTH = _countof(MERCURIAL_CREDENTIAL_SUFFIX) - 1;
+
+    const size_t NOT_FOUND = (size_t)-1;
+
+    // Bits for the prefixes which the characters seen so far could still be the start of.
+    const unsigned MAY_BE_GIT = 1;
+    const unsigned MAY_BE_INTREPID = 2;
+}
+
+TargetNameParts ParseTargetName(const wchar_t* target_name, size_t length) {
+    unsigned prefixes = MAY_BE_GIT | MAY_BE_INTREPID;
+
+    // Mercurial: where the first "@@" starts, and where the first "@Mercurial" starts.  Since '@' only occurs at the
+    // start of "@Mercurial", a partial match which fails can only restart at the failing character.
+    size_t double_at_pos = NOT_FOUND;
+    size_t suffix_pos = NOT_FOUND;
+    size_t suffix_matched = 0;
+
+    // Git: where the URL's authority starts (just after "://"), and the last '@' within it.
+    size_t authority_pos = NOT_FOUND;
+    size_t user_end_pos = NOT_FOUND;
+    bool in_authority = false;
+
+    for (size_t i = 0; i < length; ++i) {
+        const wchar_t c = target_name[i];
+
+        if (i < GIT_CREDENTIAL_PREFIX_LENGTH && c != GIT_CREDENTIAL_PREFIX[i]) {
+            prefixes &= ~MAY_BE_GIT;
+        }
+        if (i < INTREPID_CREDENTIAL_PREFIX_LENGTH && c != INTREPID_CREDENTIAL_PREFIX[i]) {
+            prefixes &= ~MAY_BE_INTREPID;
+        }
+
+        if (c == L'@' && double_at_pos == NOT_FOUND && i > 0 && target_name[i - 1] == L'@') {
+            double_at_pos = i - 1;
+        }
+        if (suffix_pos == NOT_FOUND) {
+            if (c == MERCURIAL_CREDENTIAL_SUFFIX[suffix_matched]) {
+                if (++suffix_matched == MERCURIAL_CREDENTIAL_SUFFIX_LENGTH) {
+                    suffix_pos = i + 1 - MERCURIAL_CREDENTIAL_SUFFIX_LENGTH;
+                    if (i + 1 < length && prefixes == 0) {
+                        // The suffix isn't at the end, so this isn't Mercurial, and it can't be anything else.
+                        break;
+                    }
+                }
+            } else {
+                suffix_matched = (c == L'@') ? 1 : 0;
+            }
+        }
+
+        if ((prefixes & MAY_BE_GIT) != 0) {
+            if (in_authority) {
+                if (c == L'@') {
+                    user_end_pos = i;
+                } else if (c == L'/') {
+                    in_authority = false;
+                }
+            } else if (
+                authority_pos == NOT_FOUND && c == L'/' && i >= GIT_CREDENTIAL_PREFIX_LENGTH + 2 &&
+                target_name[i - 1] == L'/' && target_name[i - 2] == L':'
+            ) {
+                authority_pos = i + 1;
+                in_authority = true;
+            }
+        }
+    }
+
+    TargetNameParts parts = { CredentialKind::Other, TextSpan(), TextSpan() };
+    if (
+        double_at_pos != NOT_FOUND && double_at_pos > 0 &&
+        suffix_pos != NOT_FOUND && suffix_pos == length - MERCURIAL_CREDENTIAL_SUFFIX_LENGTH &&
+        double_at_pos + 3 <= suffix_pos
+    ) {
+        parts.kind = CredentialKind::Mercurial;
+        parts.username = TextSpan(target_name, double_at_pos);
+        parts.location = TextSpan(target_name + double_at_pos + 2, suffix_pos - (double_at_pos + 2));
+    } else if ((prefixes & MAY_BE_GIT) != 0 && length >= GIT_CREDENTIAL_PREFIX_LENGTH) {
+        parts.kind = CredentialKind::Git;
+        parts.location = TextSpan(
+            target_name + GIT_CREDENTIAL_PREFIX_LENGTH, length - GIT_CREDENTIAL_PREFIX_LENGTH
+        );
+        if (user_end_pos != NOT_FOUND) {
+            parts.username = TextSpan(target_name + authority_pos, user_end_pos - authority_pos);
+        }
+    } else if ((prefixes & MAY_BE_INTREPID) != 0 && length >= INTREPID_CREDENTIAL_PREFIX_LENGTH) {
+        parts.kind = CredentialKind::Intrepid;
+        parts.location = TextSpan(
+            target_name + INTREPID_CREDENTIAL_PREFIX_LENGTH, length - INTREPID_CREDENTIAL_PREFIX_LENGTH
+        );
+    }
+    return parts;
+}
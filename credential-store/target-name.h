@@ -0,0 +1,34 @@
+#pragma once
+
+#include "text-span.h"
+
+#define HOLY_GRADLE_CREDENTIAL_PREFIX L"Intrepid - "
+
+// The kinds of credential which this tool knows how to update.
+enum class CredentialKind {
+    Other,
+    Git,
+    Mercurial,
+    Intrepid
+};
+const size_t CREDENTIAL_KIND_COUNT = 4;
+
+// The parts of a credential's target name, as views into the name itself.
+struct TargetNameParts {
+    CredentialKind kind;
+    // The username written into the target name: the part before "@@" for Mercurial, or the user part of the URL
+    // for Git (empty if the URL has none).  Always empty for Intrepid and other credentials.
+    TextSpan username;
+    // The repository URL for Mercurial and Git (without the "git:" prefix), or the basis name after the
+    // HOLY_GRADLE_CREDENTIAL_PREFIX for Intrepid.  Empty for other credentials.
+    TextSpan location;
+};
+
+/*
+    Classifies a target name in a single pass over its characters, without allocating:
+        Mercurial:  <username>@@<repo_url>@Mercurial  (both parts non-empty)
+        Git:        git:<scheme>://[<username>@]<hostname>[/...]
+        Intrepid:   Intrepid - <name>
+    A name which fits the Mercurial pattern is Mercurial even if it also starts with one of the prefixes.
+*/
+TargetNameParts ParseTargetName(const wchar_t* target_name, size_t length);
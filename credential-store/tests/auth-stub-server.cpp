@@ -0,0 +1,245 @@
+#include "stdafx.h"
+
+#include "auth-stub-server.h"
+
+#include <ws2tcpip.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#pragma hdrstop
+
+#pragma comment(lib, "ws2_32.lib")
+
+#define MAX_REQUEST_HEAD_BYTES (16 * 1024)
+
+using namespace std;
+
+namespace {
+    string Base64(const string& data) {
+        static const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        string encoded;
+        for (size_t i = 0; i < data.size(); i += 3) {
+            unsigned bits = (unsigned char)data[i] << 16;
+            if (i + 1 < data.size()) {
+                bits |= (unsigned char)data[i + 1] << 8;
+            }
+            if (i + 2 < data.size()) {
+                bits |= (unsigned char)data[i + 2];
+            }
+            encoded += ALPHABET[(bits >> 18) & 63];
+            encoded += ALPHABET[(bits >> 12) & 63];
+            encoded += (i + 1 < data.size()) ? ALPHABET[(bits >> 6) & 63] : '=';
+            encoded += (i + 2 < data.size()) ? ALPHABET[bits & 63] : '=';
+        }
+        return encoded;
+    }
+
+    // Finds a header in a request head, matching its name ignoring case, and returns its value without surrounding
+    // spaces.
+    bool FindHeader(const string& head, const char* name, string& value) {
+        const size_t name_length = strlen(name);
+        size_t line = head.find("\r\n");
+        while (line != string::npos && line + 2 < head.size()) {
+            const size_t start = line + 2;
+            const size_t end = head.find("\r\n", start);
+            if (end == string::npos) {
+                return false;
+            }
+            if (end - start > name_length && head[start + name_length] == ':' &&
+                _strnicmp(head.c_str() + start, name, name_length) == 0
+            ) {
+                size_t value_start = start + name_length + 1;
+                size_t value_end = end;
+                while (value_start < value_end && head[value_start] == ' ') {
+                    ++value_start;
+                }
+                while (value_end > value_start && head[value_end - 1] == ' ') {
+                    --value_end;
+                }
+                value = head.substr(value_start, value_end - value_start);
+                return true;
+            }
+            line = end;
+        }
+        return false;
+    }
+
+    bool SendAll(SOCKET client, const string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            int result = ::send(client, data.data() + sent, (int)(data.size() - sent), 0);
+            if (result <= 0) {
+                return false;
+            }
+            sent += result;
+        }
+        return true;
+    }
+
+    // Reads up to the blank line which ends a request's headers, leaving anything after it in "buffer".  Returns
+    // false if the connection closes first, or the head is unreasonably long.
+    bool ReadRequestHead(SOCKET client, string& buffer, string& head) {
+        size_t head_end;
+        while ((head_end = buffer.find("\r\n\r\n")) == string::npos) {
+            if (buffer.size() > MAX_REQUEST_HEAD_BYTES) {
+                return false;
+            }
+            char chunk[4096];
+            int received = ::recv(client, chunk, sizeof(chunk), 0);
+            if (received <= 0) {
+                return false;
+            }
+            buffer.append(chunk, received);
+        }
+        head = buffer.substr(0, head_end + 2);
+        buffer.erase(0, head_end + 4);
+        return true;
+    }
+
+    // Reads and drops a request body, so the next request on the connection can be read.
+    bool SkipBody(SOCKET client, string& buffer, size_t length) {
+        while (buffer.size() < length) {
+            char chunk[4096];
+            int received = ::recv(client, chunk, sizeof(chunk), 0);
+            if (received <= 0) {
+                return false;
+            }
+            buffer.append(chunk, received);
+        }
+        buffer.erase(0, length);
+        return true;
+    }
+}
+
+AuthStubServer::AuthStubServer(const string& username, const string& password, DWORD slow_delay_ms)
+    : expected_authorization_("Basic " + Base64(username + ":" + password))
+    , slow_delay_ms_(slow_delay_ms)
+    , listener_(INVALID_SOCKET)
+    , port_(0)
+    , stopping_(false)
+    , connection_count_(0)
+    , request_count_(0)
+    , active_requests_(0)
+    , max_active_requests_(0)
+{
+}
+
+AuthStubServer::~AuthStubServer() {
+    Stop();
+}
+
+bool AuthStubServer::Start() {
+    WSADATA wsa_data;
+    if (::WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+        return false;
+    }
+    listener_ = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = 0;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t address_size = sizeof(address);
+    if (listener_ == INVALID_SOCKET ||
+        ::bind(listener_, (const sockaddr*)&address, sizeof(address)) != 0 ||
+        ::listen(listener_, SOMAXCONN) != 0 ||
+        ::getsockname(listener_, (sockaddr*)&address, &address_size) != 0
+    ) {
+        Stop();
+        return false;
+    }
+    port_ = ntohs(address.sin_port);
+    acceptor_ = thread(&AuthStubServer::AcceptConnections, this);
+    return true;
+}
+
+void AuthStubServer::Stop() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        stopping_ = true;
+        for (auto it = clients_.begin(); it != clients_.end(); ++it) {
+            ::shutdown(*it, SD_BOTH);
+        }
+    }
+    stopped_.notify_all();
+    if (listener_ != INVALID_SOCKET) {
+        // Closing the listener doesn't always wake a thread blocked in accept(), but shutting it down does.
+        ::shutdown(listener_, SD_BOTH);
+        ::closesocket(listener_);
+        listener_ = INVALID_SOCKET;
+    }
+    if (acceptor_.joinable()) {
+        acceptor_.join();
+    }
+    // No more connections can be added now that the acceptor has finished.
+    for (auto it = connections_.begin(); it != connections_.end(); ++it) {
+        it->join();
+    }
+    connections_.clear();
+}
+
+void AuthStubServer::AcceptConnections() {
+    for (;;) {
+        SOCKET client = ::accept(listener_, NULL, NULL);
+        lock_guard<mutex> lock(mutex_);
+        if (stopping_) {
+            if (client != INVALID_SOCKET) {
+                ::closesocket(client);
+            }
+            return;
+        }
+        if (client == INVALID_SOCKET) {
+            continue;
+        }
+        ++connection_count_;
+        clients_.insert(client);
+        connections_.push_back(thread(&AuthStubServer::ServeConnection, this, client));
+    }
+}
+
+bool AuthStubServer::Delay(DWORD milliseconds) {
+    unique_lock<mutex> lock(mutex_);
+    return !stopped_.wait_for(lock, chrono::milliseconds(milliseconds), [this]() { return stopping_; });
+}
+
+void AuthStubServer::ServeConnection(SOCKET client) {
+    string buffer;
+    string head;
+    while (ReadRequestHead(client, buffer, head)) {
+        const long active = ++active_requests_;
+        long highest = max_active_requests_;
+        while (active > highest && !max_active_requests_.compare_exchange_weak(highest, active)) {
+        }
+        ++request_count_;
+
+        const size_t method_end = head.find(' ');
+        const size_t target_end = (method_end == string::npos) ? string::npos : head.find(' ', method_end + 1);
+        const string target = (target_end == string::npos) ? string() :
+            head.substr(method_end + 1, target_end - method_end - 1);
+        const bool http_1_0 = (target_end != string::npos && head.compare(target_end + 1, 8, "HTTP/1.0") == 0);
+        string value;
+        const bool close = http_1_0 ||
+            (FindHeader(head, "Connection", value) && _stricmp(value.c_str(), "close") == 0);
+        const size_t body_length = FindHeader(head, "Content-Length", value) ? strtoul(value.c_str(), NULL, 10) : 0;
+        const bool authorised = FindHeader(head, "Authorization", value) && value == expected_authorization_;
+
+        bool sent = false;
+        if (target.compare(0, strlen(SLOW_PATH_PREFIX), SLOW_PATH_PREFIX) != 0 || Delay(slow_delay_ms_)) {
+            const string response =
+                (target.compare(0, strlen(NO_REPOSITORY_PATH_PREFIX), NO_REPOSITORY_PATH_PREFIX) == 0)
+                ? "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n"
+                : authorised
+                ? "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 3\r\n\r\nok\n"
+                : "HTTP/1.1 401 Unauthorized\r\nWWW-Authenticate: Basic realm=\"auth-stub-server\"\r\n"
+                  "Content-Length: 0\r\n\r\n";
+            sent = SkipBody(client, buffer, body_length) && SendAll(client, response);
+        }
+        --active_requests_;
+        if (!sent || close) {
+            break;
+        }
+    }
+    lock_guard<mutex> lock(mutex_);
+    clients_.erase(client);
+    ::closesocket(client);
+}
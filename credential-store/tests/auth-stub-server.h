@@ -0,0 +1,68 @@
+#pragma once
+
+#include <winsock2.h>
+#include <windows.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define SLOW_PATH_PREFIX "/slow/"
+#define NO_REPOSITORY_PATH_PREFIX "/info/refs"
+
+/*
+    A stand-in for a Git or Mercurial HTTP server, for testing "verify" without a network.  It listens on an
+    ephemeral port of 127.0.0.1 and answers every GET with 200 if it carries Basic authentication for the one
+    username and password it was given, or 401 otherwise.  Requests for paths under SLOW_PATH_PREFIX are answered only
+    after "slow_delay_ms", so one server can stand in both for a prompt host and for one which makes verify time out.
+    Requests for NO_REPOSITORY_PATH_PREFIX, at the root of the host where there is no repository, get 404 whatever
+    their credentials, as they do from GitHub.
+
+    Connections are kept alive as HTTP/1.1 allows, and the server counts connections, requests, and the most requests
+    in progress at once, so that a test can check that the client reused connections and bounded its concurrency.
+*/
+class AuthStubServer {
+public:
+    AuthStubServer(const std::string& username, const std::string& password, DWORD slow_delay_ms);
+    // Stops the server, if it's running.
+    ~AuthStubServer();
+
+    // Starts listening, and accepting connections on another thread; returns false if it can't listen.
+    bool Start();
+    // Closes every connection, cutting short any slow responses, and waits for all the server's threads to finish.
+    void Stop();
+
+    unsigned short port() const { return port_; }
+    long connection_count() const { return connection_count_; }
+    long request_count() const { return request_count_; }
+    long max_active_requests() const { return max_active_requests_; }
+
+private:
+    AuthStubServer(const AuthStubServer&);
+    AuthStubServer& operator=(const AuthStubServer&);
+
+    void AcceptConnections();
+    void ServeConnection(SOCKET client);
+    // Waits for "milliseconds", or until the server stops; returns false if it stopped.
+    bool Delay(DWORD milliseconds);
+
+    const std::string expected_authorization_;  // "Basic <base64 of username:password>"
+    const DWORD slow_delay_ms_;
+    SOCKET listener_;
+    unsigned short port_;
+    std::thread acceptor_;
+
+    std::mutex mutex_;
+    std::condition_variable stopped_;
+    bool stopping_;
+    std::set<SOCKET> clients_;
+    std::vector<std::thread> connections_;
+
+    std::atomic<long> connection_count_;
+    std::atomic<long> request_count_;
+    std::atomic<long> active_requests_;
+    std::atomic<long> max_active_requests_;
+};
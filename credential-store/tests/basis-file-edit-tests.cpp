@@ -0,0 +1,197 @@
+#include "stdafx.h"
+
+#include "test-harness.h"
+#include "basis-file-edit.h"
+
+#include <windows.h>
+#include <memory>
+#include <string>
+
+#pragma hdrstop
+
+using namespace std;
+
+namespace {
+    // A basis file name in the temporary directory, deleted (with its lock file) when the test is done with it.
+    class TemporaryBasisFile {
+    public:
+        explicit TemporaryBasisFile(const wchar_t* name) {
+            wchar_t directory[MAX_PATH + 1];
+            const DWORD length = ::GetTempPathW(_countof(directory), directory);
+            name_ = wstring(directory, length) + name;
+            ::DeleteFileW(name_.c_str());
+        }
+
+        ~TemporaryBasisFile() {
+            ::DeleteFileW(name_.c_str());
+            ::DeleteFileW((name_ + L".lock").c_str());
+        }
+
+        const wstring& name() const { return name_; }
+
+        void Write(const string& bytes) const {
+            HANDLE file = ::CreateFileW(
+                name_.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL
+            );
+            DWORD written = 0;
+            ::WriteFile(file, bytes.data(), (DWORD)bytes.size(), &written, NULL);
+            ::CloseHandle(file);
+        }
+
+        string Read() const {
+            HANDLE file = ::CreateFileW(
+                name_.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL
+            );
+            if (file == INVALID_HANDLE_VALUE) {
+                return "<missing>";
+            }
+            string bytes;
+            char buffer[4096];
+            DWORD read = 0;
+            while (::ReadFile(file, buffer, sizeof(buffer), &read, NULL) && read > 0) {
+                bytes.append(buffer, read);
+            }
+            ::CloseHandle(file);
+            return bytes;
+        }
+
+    private:
+        TemporaryBasisFile(const TemporaryBasisFile&);
+        TemporaryBasisFile& operator=(const TemporaryBasisFile&);
+
+        wstring name_;
+    };
+
+    // Writes "before" to a basis file, makes one edit, and returns what the file then holds.
+    string EditedText(
+        const string& before,
+        BasisFileEdit edit,
+        const wstring& basis,
+        const wstring& entry,
+        BasisFileEditResult expected_result = BasisFileEditResult::Changed
+    ) {
+        TemporaryBasisFile file(L"credential-store-tests-bases.txt");
+        file.Write(before);
+        CHECK(EditBasisFile(file.name(), edit, basis, entry) == expected_result);
+        return file.Read();
+    }
+}
+
+TEST_CASE(BasisEditCreatesAMissingFile) {
+    TemporaryBasisFile file(L"credential-store-tests-new-bases.txt");
+    CHECK(EditBasisFile(file.name(), BasisFileEdit::Add, L"Intrepid", L"git:https://host/repo") ==
+        BasisFileEditResult::Changed);
+    CHECK(file.Read() ==
+        "# This is a machine-generated Holy Gradle Credential Basis file.\r\n"
+        "Intrepid\r\n"
+        "\tgit:https://host/repo\r\n");
+
+    CHECK(EditBasisFile(file.name(), BasisFileEdit::Remove, L"Intrepid", L"git:https://host/repo") ==
+        BasisFileEditResult::Changed);
+    CHECK(file.Read() == "# This is a machine-generated Holy Gradle Credential Basis file.\r\n");
+}
+
+TEST_CASE(BasisEditInsertsAfterTheLastLineOfItsBasis) {
+    // Blank and comment lines after a basis's last entry stay after it, and so does the next basis.
+    CHECK(EditedText(
+        "# Comment\r\n"
+        "A\r\n"
+        "\tx\r\n"
+        "\r\n"
+        "# Before B\r\n"
+        "B\r\n"
+        "\ty\r\n",
+        BasisFileEdit::Add, L"A", L"z"
+    ) ==
+        "# Comment\r\n"
+        "A\r\n"
+        "\tx\r\n"
+        "\tz\r\n"
+        "\r\n"
+        "# Before B\r\n"
+        "B\r\n"
+        "\ty\r\n");
+
+    // A new basis goes at the end.
+    CHECK(EditedText("A\r\n\tx\r\n", BasisFileEdit::Add, L"B", L"y") == "A\r\n\tx\r\nB\r\n\ty\r\n");
+
+    // A basis which is listed but has no entries yet gets the entry straight after it.
+    CHECK(EditedText("A\r\nB\r\n\tx\r\n", BasisFileEdit::Add, L"A", L"y") == "A\r\n\ty\r\nB\r\n\tx\r\n");
+}
+
+TEST_CASE(BasisEditCopesWithAMissingFinalNewline) {
+    CHECK(EditedText("A\n\tx", BasisFileEdit::Add, L"A", L"y") == "A\n\tx\n\ty\n");
+    CHECK(EditedText("A\n\tx", BasisFileEdit::Add, L"B", L"y") == "A\n\tx\nB\n\ty\n");
+    CHECK(EditedText("A\n\tx\n# Last", BasisFileEdit::Add, L"B", L"y") == "A\n\tx\n# Last\nB\n\ty\n");
+    CHECK(EditedText("A\n\tx\nB\n\ty", BasisFileEdit::Remove, L"A", L"x") == "B\n\ty");
+}
+
+TEST_CASE(BasisEditKeepsEachLinesEnding) {
+    // New lines use the first line ending in the file; existing lines keep their own.
+    CHECK(EditedText("A\n\tx\r\n\ty\n", BasisFileEdit::Add, L"A", L"z") == "A\n\tx\r\n\ty\n\tz\n");
+    CHECK(EditedText("A\r\n\tx\n\ty\r\n", BasisFileEdit::Remove, L"A", L"x") == "A\r\n\ty\r\n");
+}
+
+TEST_CASE(BasisEditReusesTheFilesIndent) {
+    CHECK(EditedText("A\n    x\n", BasisFileEdit::Add, L"B", L"y") == "A\n    x\nB\n    y\n");
+    CHECK(EditedText("A\n  \tx\n", BasisFileEdit::Add, L"A", L"y") == "A\n  \tx\n  \ty\n");
+
+    // Surrounding whitespace isn't part of an entry, either in the file or in the edit.
+    CHECK(EditedText("A\n    x  \n\ty\n", BasisFileEdit::Remove, L"A", L" x") == "A\n\ty\n");
+}
+
+TEST_CASE(BasisEditMovesAnEntryBetweenBases) {
+    CHECK(EditedText(
+        "A\r\n\tx\r\n\ty\r\nB\r\n\tz\r\n",
+        BasisFileEdit::Add, L"B", L"y"
+    ) == "A\r\n\tx\r\nB\r\n\tz\r\n\ty\r\n");
+
+    // Moving a basis's only entry removes the basis, but not its comments.
+    CHECK(EditedText(
+        "# About A\nA\n\tx\n# About B\nB\n\tz\n",
+        BasisFileEdit::Add, L"B", L"x"
+    ) == "# About A\n# About B\nB\n\tz\n\tx\n");
+
+    // An entry listed under several bases (which the plugins never write) ends up under just the one.
+    CHECK(EditedText("A\n\tx\nB\n\tx\n\ty\nC\n\tx\n", BasisFileEdit::Add, L"B", L"x") == "B\n\tx\n\ty\n");
+}
+
+TEST_CASE(BasisEditRemovesOnlyBasesItEmptied) {
+    // A basis which was already empty is left alone when another is edited.
+    CHECK(EditedText("A\nB\n\tx\n\ty\n", BasisFileEdit::Remove, L"B", L"x") == "A\nB\n\ty\n");
+    CHECK(EditedText("A\nB\n\tx\n", BasisFileEdit::Remove, L"B", L"x") == "A\n");
+    CHECK(EditedText("A\n\tx\n\n# End\n", BasisFileEdit::Remove, L"A", L"x") == "\n# End\n");
+}
+
+TEST_CASE(BasisEditLeavesTheFileAloneIfNothingChanges) {
+    const string text = "# Comment\r\nA\r\n\tx\r\n";
+    CHECK(EditedText(text, BasisFileEdit::Add, L"A", L"x", BasisFileEditResult::Unchanged) == text);
+    CHECK(EditedText(text, BasisFileEdit::Remove, L"A", L"y", BasisFileEditResult::Unchanged) == text);
+    CHECK(EditedText(text, BasisFileEdit::Remove, L"B", L"x", BasisFileEditResult::Unchanged) == text);
+
+    // A comment or an entry before any basis isn't an entry of any basis.
+    CHECK(EditedText(
+        "#A\n\tx\nA\n\ty\n", BasisFileEdit::Remove, L"A", L"x", BasisFileEditResult::Unchanged
+    ) == "#A\n\tx\nA\n\ty\n");
+}
+
+TEST_CASE(BasisEditRejectsBadNames) {
+    TemporaryBasisFile file(L"credential-store-tests-bad-bases.txt");
+    CHECK(EditBasisFile(file.name(), BasisFileEdit::Add, L"", L"x") == BasisFileEditResult::Failed);
+    CHECK(EditBasisFile(file.name(), BasisFileEdit::Add, L" A", L"x") == BasisFileEditResult::Failed);
+    CHECK(EditBasisFile(file.name(), BasisFileEdit::Add, L"#A", L"x") == BasisFileEditResult::Failed);
+    CHECK(EditBasisFile(file.name(), BasisFileEdit::Add, L"A\nB", L"x") == BasisFileEditResult::Failed);
+    CHECK(EditBasisFile(file.name(), BasisFileEdit::Add, L"A", L"  ") == BasisFileEditResult::Failed);
+    CHECK(EditBasisFile(file.name(), BasisFileEdit::Add, L"A", L"x\ny") == BasisFileEditResult::Failed);
+    CHECK(file.Read() == "<missing>");
+}
+
+TEST_CASE(BasisEditWritesUtf8) {
+    // As the plugins write it: UTF-8 without a byte order mark.
+    CHECK(EditedText("A\n\t\xC3\xA9\n", BasisFileEdit::Add, L"A", L"\u00FC") == "A\n\t\xC3\xA9\n\t\xC3\xBC\n");
+    CHECK(EditedText("A\n\tx\n", BasisFileEdit::Add, L"\u00C9", L"y") == "A\n\tx\n\xC3\x89\n\ty\n");
+
+    // A byte order mark is kept.
+    CHECK(EditedText("\xEF\xBB\xBF" "A\n\tx\n", BasisFileEdit::Add, L"A", L"\u00FC") ==
+        "\xEF\xBB\xBF" "A\n\tx\n\t\xC3\xBC\n");
+}
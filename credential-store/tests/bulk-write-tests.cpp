@@ -0,0 +1,187 @@
+#include "stdafx.h"
+
+#include "test-harness.h"
+#include "bulk-write.h"
+#include "credential-backend.h"
+#include "credential-snapshot.h"
+
+#include <windows.h>
+#include <atomic>
+#include <set>
+#include <string>
+#include <vector>
+
+#pragma hdrstop
+
+#define OLD_USERNAME L"old-user"
+#define NEW_USERNAME L"new-user"
+
+using namespace std;
+
+namespace {
+    // A store in memory whose writes fail with ERROR_ACCESS_DENIED when they're among the given numbers (counting
+    // from 1, and including the writes which roll others back), or are to the given target name.
+    class FailingBackend : public MemoryCredentialBackend {
+    public:
+        FailingBackend() : writes_(0) {}
+
+        void FailWrite(size_t number) { failing_writes_.insert(number); }
+        void FailWritesTo(const wstring& target_name) { failing_targets_.insert(target_name); }
+        void FailReadsOf(const wstring& target_name) { failing_reads_.insert(target_name); }
+        size_t writes() const { return writes_; }
+
+        virtual CredentialPtr Read(const wstring& target_name) {
+            if (failing_reads_.count(target_name) != 0) {
+                ::SetLastError(ERROR_ACCESS_DENIED);
+                return CredentialPtr();
+            }
+            return MemoryCredentialBackend::Read(target_name);
+        }
+
+        virtual bool Write(const CREDENTIALW& credential) {
+            const size_t number = ++writes_;
+            if (failing_writes_.count(number) != 0 || failing_targets_.count(credential.TargetName) != 0) {
+                ::SetLastError(ERROR_ACCESS_DENIED);
+                return false;
+            }
+            return MemoryCredentialBackend::Write(credential);
+        }
+
+    private:
+        atomic<size_t> writes_;
+        set<size_t> failing_writes_;
+        set<wstring> failing_targets_;
+        set<wstring> failing_reads_;
+    };
+
+    // Returns the username of a stored credential, or "<missing>" if it isn't stored.
+    wstring StoredUsername(CredentialBackend& backend, const wstring& target_name) {
+        CredentialPtr credential = backend.Read(target_name);
+        return credential ? wstring(credential->UserName) : wstring(L"<missing>");
+    }
+
+    vector<BulkWriteItem> NewValues(const vector<wstring>& target_names) {
+        vector<BulkWriteItem> items;
+        for (auto it = target_names.begin(); it != target_names.end(); ++it) {
+            BulkWriteItem item = { *it, NEW_USERNAME, TextSpan(L"new password") };
+            items.push_back(item);
+        }
+        return items;
+    }
+}
+
+TEST_CASE(BulkWriteWritesEverything) {
+    MemoryCredentialBackend backend;
+    CHECK(WriteCredential(backend, L"existing", OLD_USERNAME, TextSpan(L"old password")));
+    vector<wstring> target_names;
+    target_names.push_back(L"existing");
+    target_names.push_back(L"created");
+
+    BulkWriter writer(backend, 4);
+    BulkWriteSummary summary;
+    CHECK(writer.Apply(NewValues(target_names), NULL, summary));
+    CHECK(summary.written == 2 && summary.failed == 0 && summary.rolled_back == 0);
+    CHECK(summary.results.size() == 2);
+    CHECK(StoredUsername(backend, L"existing") == NEW_USERNAME);
+    CHECK(StoredUsername(backend, L"created") == NEW_USERNAME);
+}
+
+TEST_CASE(BulkWriteRollsBackAfterTheNthWriteFails) {
+    // With one worker the writes go in order, so the third of them (the fourth write of all) fails after two have
+    // been made and before two more.
+    for (int use_snapshot = 0; use_snapshot < 2; ++use_snapshot) {
+        FailingBackend backend;
+        CHECK_AT(WriteCredential(backend, L"a-existing", OLD_USERNAME, TextSpan(L"old password")), use_snapshot);
+        backend.FailWrite(4);
+        vector<wstring> target_names;
+        target_names.push_back(L"a-existing");
+        target_names.push_back(L"b-created");
+        target_names.push_back(L"c-failing");
+        target_names.push_back(L"d-queued");
+        target_names.push_back(L"e-queued");
+
+        const CredentialSnapshot snapshot(backend);
+        BulkWriter writer(backend, 1);
+        BulkWriteSummary summary;
+        CHECK_AT(!writer.Apply(NewValues(target_names), use_snapshot ? &snapshot : NULL, summary), use_snapshot);
+
+        // The earlier writes are undone: the prior value is put back, and a new credential is deleted.
+        CHECK_AT(StoredUsername(backend, L"a-existing") == OLD_USERNAME, use_snapshot);
+        CHECK_AT(StoredUsername(backend, L"b-created") == L"<missing>", use_snapshot);
+        CHECK_AT(StoredUsername(backend, L"c-failing") == L"<missing>", use_snapshot);
+
+        // Nothing queued after the failure is started.
+        CHECK_AT(StoredUsername(backend, L"d-queued") == L"<missing>", use_snapshot);
+        CHECK_AT(StoredUsername(backend, L"e-queued") == L"<missing>", use_snapshot);
+        CHECK_AT(summary.results.size() == 3, use_snapshot);
+        CHECK_AT(summary.written == 2 && summary.failed == 1, use_snapshot);
+        CHECK_AT(summary.rolled_back == 2 && summary.rollback_failed == 0, use_snapshot);
+        CHECK_AT(summary.results.size() == 3 && !summary.results[2].written, use_snapshot);
+        CHECK_AT(summary.results.size() == 3 && summary.results[2].error == ERROR_ACCESS_DENIED, use_snapshot);
+
+        // The initial write, three bulk writes and one restore; the deletion isn't a write.
+        CHECK_AT(backend.writes() == 5, use_snapshot);
+    }
+}
+
+TEST_CASE(BulkWriteReportsWhatCouldntBeRolledBack) {
+    FailingBackend backend;
+    CHECK(WriteCredential(backend, L"a-existing", OLD_USERNAME, TextSpan(L"old password")));
+    CHECK(WriteCredential(backend, L"b-existing", OLD_USERNAME, TextSpan(L"old password")));
+    vector<wstring> target_names;
+    target_names.push_back(L"a-existing");
+    target_names.push_back(L"b-existing");
+    target_names.push_back(L"c-failing");
+
+    // Writes 3 and 4 succeed, 5 fails, and then 6 (restoring "a-existing") fails too.
+    backend.FailWrite(5);
+    backend.FailWrite(6);
+    BulkWriter writer(backend, 1);
+    BulkWriteSummary summary;
+    CHECK(!writer.Apply(NewValues(target_names), NULL, summary));
+    CHECK(summary.written == 2 && summary.failed == 1);
+    CHECK(summary.rolled_back == 1 && summary.rollback_failed == 1);
+    CHECK(StoredUsername(backend, L"a-existing") == NEW_USERNAME);
+    CHECK(StoredUsername(backend, L"b-existing") == OLD_USERNAME);
+}
+
+TEST_CASE(BulkWriteLeavesAloneWhatItCantRead) {
+    // Without a snapshot, a credential which can't be read couldn't be put back, so it isn't written at all.
+    FailingBackend backend;
+    CHECK(WriteCredential(backend, L"a-unreadable", OLD_USERNAME, TextSpan(L"old password")));
+    backend.FailReadsOf(L"a-unreadable");
+    vector<wstring> target_names;
+    target_names.push_back(L"a-unreadable");
+    target_names.push_back(L"b-created");
+
+    BulkWriter writer(backend, 1);
+    BulkWriteSummary summary;
+    CHECK(!writer.Apply(NewValues(target_names), NULL, summary));
+    CHECK(summary.written == 0 && summary.failed == 1 && summary.rolled_back == 0);
+    CHECK(summary.results.size() == 1 && summary.results[0].error == ERROR_ACCESS_DENIED);
+    CHECK(backend.writes() == 1);
+}
+
+TEST_CASE(BulkWriteRollsBackEverythingAcrossWorkers) {
+    FailingBackend backend;
+    vector<wstring> target_names;
+    for (int i = 0; i < 200; ++i) {
+        target_names.push_back(L"credential-" + to_wstring(i));
+        if (i % 2 == 0) {
+            CHECK(WriteCredential(backend, target_names.back(), OLD_USERNAME, TextSpan(L"old password")));
+        }
+    }
+    backend.FailWritesTo(L"credential-150");
+
+    const CredentialSnapshot snapshot(backend);
+    BulkWriter writer(backend, 8);
+    BulkWriteSummary summary;
+    CHECK(!writer.Apply(NewValues(target_names), &snapshot, summary));
+    CHECK(summary.failed == 1);
+    CHECK(summary.written > 0);
+    CHECK(summary.rolled_back == summary.written && summary.rollback_failed == 0);
+    CHECK(summary.results.size() == summary.written + summary.failed);
+    for (size_t i = 0; i < target_names.size(); ++i) {
+        CHECK_AT(StoredUsername(backend, target_names[i]) == ((i % 2 == 0) ? OLD_USERNAME : L"<missing>"), i);
+    }
+}
@@ -0,0 +1,137 @@
+#include "stdafx.h"
+
+#include "test-harness.h"
+#include "credential-bases.h"
+
+#include <windows.h>
+#include <string>
+
+#pragma hdrstop
+
+using namespace std;
+
+namespace {
+    // Reads "text" as a basis file, via a file in the temporary directory which is deleted straight afterwards.
+    CredentialBases BasesFrom(const string& text) {
+        wchar_t directory[MAX_PATH + 1];
+        const DWORD length = ::GetTempPathW(_countof(directory), directory);
+        const wstring file_name = wstring(directory, length) + L"credential-store-tests-read-bases.txt";
+        HANDLE file = ::CreateFileW(
+            file_name.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL
+        );
+        DWORD written = 0;
+        ::WriteFile(file, text.data(), (DWORD)text.size(), &written, NULL);
+        ::CloseHandle(file);
+        CredentialBases bases(ReadBases(file_name));
+        ::DeleteFileW(file_name.c_str());
+        return bases;
+    }
+
+    wstring BasisOf(const CredentialBases& bases, const wchar_t* credential_name) {
+        const TextSpan* basis = bases.BasisOf(credential_name);
+        return (basis == NULL) ? wstring(L"<none>") : basis->str();
+    }
+}
+
+TEST_CASE(BasesListNamesAndEntriesAsWritten) {
+    const CredentialBases bases = BasesFrom(
+        "# Comment\r\n"
+        "\tgit:https://before/any-basis\r\n"
+        "Zeta\r\n"
+        "\tgit:https://host/z\r\n"
+        "\r\n"
+        "Alpha\r\n"
+        "    git:https://host/a  \r\n"
+        "\tgit:https://host/*\r\n"
+        "Zeta\r\n"
+        "\thg:https://host/z"
+    );
+    CHECK(bases.Names().size() == 2 && bases.Names()[0] == L"Alpha" && bases.Names()[1] == L"Zeta");
+    CHECK(bases.IsBasis(L"Alpha"));
+    CHECK(!bases.IsBasis(L"alpha"));
+
+    // Entries are trimmed, patterns are kept as written, and a basis listed twice gets both sets of entries.
+    BasisEntries alpha = bases.EntriesFor(L"Alpha");
+    CHECK(alpha.size() == 2 &&
+        alpha.begin()[0] == L"git:https://host/a" && alpha.begin()[1] == L"git:https://host/*");
+    BasisEntries zeta = bases.EntriesFor(L"Zeta");
+    CHECK(zeta.size() == 2 && zeta.begin()[0] == L"git:https://host/z" && zeta.begin()[1] == L"hg:https://host/z");
+    CHECK(bases.EntriesFor(L"Missing").empty());
+
+    // An entry before any basis belongs to none.
+    CHECK(!bases.HasBasis(L"git:https://before/any-basis"));
+}
+
+TEST_CASE(BasesMatchLiteralsAndPatterns) {
+    const CredentialBases bases = BasesFrom(
+        "Literal\n"
+        "\tgit:https://host/repo\n"
+        "Star\n"
+        "\tgit:https://scm.example.com/*\n"
+        "Question\n"
+        "\thg:https://h?st/x\n"
+    );
+    CHECK(bases.HasBasis(L"git:https://host/repo"));
+    CHECK(!bases.HasBasis(L"git:https://host/repo2"));
+    CHECK(!bases.HasBasis(L"git:https://HOST/repo"));
+    CHECK(BasisOf(bases, L"git:https://host/repo") == L"Literal");
+
+    CHECK(bases.HasBasis(L"git:https://scm.example.com/"));
+    CHECK(BasisOf(bases, L"git:https://scm.example.com/a/b") == L"Star");
+    CHECK(!bases.HasBasis(L"git:https://scm.example.com"));
+    CHECK(!bases.HasBasis(L"hg:https://scm.example.com/a"));
+
+    CHECK(BasisOf(bases, L"hg:https://host/x") == L"Question");
+    CHECK(BasisOf(bases, L"hg:https://hast/x") == L"Question");
+    CHECK(!bases.HasBasis(L"hg:https://hst/x"));
+    CHECK(!bases.HasBasis(L"hg:https://hoost/x"));
+    CHECK(BasisOf(bases, L"svn:https://host/repo") == L"<none>");
+
+    // A glob character in a credential name is matched like any other.
+    CHECK(!bases.HasBasis(L"git:https://host/rep?"));
+}
+
+TEST_CASE(BasesPreferTheFirstBasisInSortedOrder) {
+    // Which basis covers a credential depends only on the order of the bases' names, not on whether it's listed
+    // literally or matched by a pattern, nor on the order of the file.
+    const CredentialBases bases = BasesFrom(
+        "D-late-literal\n"
+        "\tgit:https://other/repo\n"
+        "B-pattern\n"
+        "\tgit:https://host/*\n"
+        "\tgit:https://*/repo\n"
+        "A-pattern\n"
+        "\tgit:https://host/a*\n"
+        "C-literal\n"
+        "\tgit:https://host/repo\n"
+        "\tgit:https://other/repo\n"
+        "\tgit:https://only/literal\n"
+        "E-pattern\n"
+        "\tgit:https://only/*\n"
+    );
+
+    // A pattern in an earlier basis beats a literal entry in a later one...
+    CHECK(BasisOf(bases, L"git:https://host/repo") == L"B-pattern");
+    CHECK(BasisOf(bases, L"git:https://other/repo") == L"B-pattern");
+
+    // ...and a literal entry in an earlier basis beats a pattern in a later one.
+    CHECK(BasisOf(bases, L"git:https://only/literal") == L"C-literal");
+    CHECK(BasisOf(bases, L"git:https://only/other") == L"E-pattern");
+
+    // Overlapping patterns: the earliest basis with any matching pattern.
+    CHECK(BasisOf(bases, L"git:https://host/abc") == L"A-pattern");
+    CHECK(BasisOf(bases, L"git:https://host/b") == L"B-pattern");
+    CHECK(BasisOf(bases, L"git:https://elsewhere/repo") == L"B-pattern");
+    CHECK(BasisOf(bases, L"git:https://elsewhere/other") == L"<none>");
+}
+
+TEST_CASE(BasesCanBeEmpty) {
+    const CredentialBases missing;
+    CHECK(missing.Names().empty());
+    CHECK(!missing.HasBasis(L"git:https://host/repo"));
+    CHECK(missing.BasisOf(L"git:https://host/repo") == NULL);
+
+    const CredentialBases comments = BasesFrom("# Only a comment\r\n\r\n");
+    CHECK(comments.Names().empty());
+    CHECK(!comments.HasBasis(L""));
+}
@@ -0,0 +1,142 @@
+#include "stdafx.h"
+
+#include "test-harness.h"
+#include "credential-backend.h"
+#include "credential-bases.h"
+#include "credential-resolve.h"
+#include "credential-snapshot.h"
+
+#include <windows.h>
+#include <string>
+
+#pragma hdrstop
+
+using namespace std;
+
+namespace {
+    // Reads "text" as a basis file, via a file in the temporary directory which is deleted straight afterwards.
+    CredentialBases BasesFrom(const string& text) {
+        wchar_t directory[MAX_PATH + 1];
+        const DWORD length = ::GetTempPathW(_countof(directory), directory);
+        const wstring file_name = wstring(directory, length) + L"credential-store-tests-resolve-bases.txt";
+        HANDLE file = ::CreateFileW(
+            file_name.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL
+        );
+        DWORD written = 0;
+        ::WriteFile(file, text.data(), (DWORD)text.size(), &written, NULL);
+        ::CloseHandle(file);
+        CredentialBases bases(ReadBases(file_name));
+        ::DeleteFileW(file_name.c_str());
+        return bases;
+    }
+
+    void Store(CredentialBackend& backend, const wstring& target_name, const wstring& username = L"someone") {
+        CHECK(WriteCredential(backend, target_name, username, TextSpan(L"password")));
+    }
+
+    wstring Resolved(const CredentialResolver& resolver, const wchar_t* url, const wstring& username = L"") {
+        wstring target_name;
+        if (!resolver.Resolve(url, username, target_name)) {
+            return L"<none>";
+        }
+        return target_name;
+    }
+}
+
+TEST_CASE(ResolvePrefersTheLongestPrefix) {
+    MemoryCredentialBackend backend;
+    Store(backend, L"git:https://host.example.com");
+    Store(backend, L"git:https://host.example.com/team");
+    Store(backend, L"git:https://host.example.com/team/repo");
+    Store(backend, L"git:https://host.example.com:8443/team");
+    const CredentialSnapshot snapshot(backend);
+    const CredentialBases bases;
+    const CredentialResolver resolver(snapshot, bases);
+
+    CHECK(Resolved(resolver, L"https://host.example.com/team/repo") == L"git:https://host.example.com/team/repo");
+    CHECK(Resolved(resolver, L"https://HOST.example.com/team/repo/") == L"git:https://host.example.com/team/repo");
+    CHECK(Resolved(resolver, L"https://host.example.com/team/repo.git") == L"git:https://host.example.com/team");
+    CHECK(Resolved(resolver, L"https://host.example.com/team/other?x=1") == L"git:https://host.example.com/team");
+    CHECK(Resolved(resolver, L"https://host.example.com/Team/repo") == L"git:https://host.example.com");
+    CHECK(Resolved(resolver, L"https://host.example.com:8443/team/repo") == L"git:https://host.example.com:8443/team");
+    CHECK(Resolved(resolver, L"https://host.example.com:8443/") == L"<none>");
+    CHECK(Resolved(resolver, L"http://host.example.com/team") == L"<none>");
+    CHECK(Resolved(resolver, L"https://other.example.com/team") == L"<none>");
+    CHECK(Resolved(resolver, L"not a url") == L"<none>");
+}
+
+TEST_CASE(ResolveRanksByUsername) {
+    const wstring me = GetUserName();
+    MemoryCredentialBackend backend;
+    Store(backend, L"git:https://alice@host/repo");
+    Store(backend, L"git:https://bob@host/repo");
+    Store(backend, L"git:https://host/repo");
+    Store(backend, L"carol@@https://host/repo@Mercurial", L"carol");
+    Store(backend, L"git:https://alice@host/others-only");
+    Store(backend, L"git:https://bob@host/others-only");
+    Store(backend, L"git:https://" + me + L"@host/mine");
+    Store(backend, L"git:https://host/mine");
+    const CredentialSnapshot snapshot(backend);
+    const CredentialBases bases;
+    const CredentialResolver resolver(snapshot, bases);
+
+    // A wanted username, given or in the URL (ignoring case), comes first, in Git or Mercurial names alike...
+    CHECK(Resolved(resolver, L"https://host/repo", L"bob") == L"git:https://bob@host/repo");
+    CHECK(Resolved(resolver, L"https://BOB@host/repo") == L"git:https://bob@host/repo");
+    CHECK(Resolved(resolver, L"https://bob@host/repo", L"alice") == L"git:https://alice@host/repo");
+    CHECK(Resolved(resolver, L"https://host/repo", L"Carol") == L"carol@@https://host/repo@Mercurial");
+
+    // ...then a name without a username, but never another user's.
+    CHECK(Resolved(resolver, L"https://host/repo", L"dave") == L"git:https://host/repo");
+    CHECK(Resolved(resolver, L"https://host/others-only", L"dave") == L"<none>");
+
+    // With no username asked for, the current user's name comes first, then one without a username, then anyone's
+    // (the first in order).
+    CHECK(Resolved(resolver, L"https://host/mine") == L"git:https://" + me + L"@host/mine");
+    CHECK(Resolved(resolver, L"https://host/repo") == L"git:https://host/repo");
+    CHECK(Resolved(resolver, L"https://host/others-only") == L"git:https://alice@host/others-only");
+}
+
+TEST_CASE(ResolveFallsBackToShorterPrefixes) {
+    MemoryCredentialBackend backend;
+    Store(backend, L"git:https://alice@host/team/repo");
+    Store(backend, L"git:https://host/team");
+    Store(backend, L"git:https://bob@host");
+    const CredentialSnapshot snapshot(backend);
+    const CredentialBases bases;
+    const CredentialResolver resolver(snapshot, bases);
+
+    CHECK(Resolved(resolver, L"https://host/team/repo", L"alice") == L"git:https://alice@host/team/repo");
+    CHECK(Resolved(resolver, L"https://host/team/repo", L"bob") == L"git:https://host/team");
+    CHECK(Resolved(resolver, L"https://host/elsewhere", L"alice") == L"<none>");
+    CHECK(Resolved(resolver, L"https://host/elsewhere", L"bob") == L"git:https://bob@host");
+}
+
+TEST_CASE(ResolveUsesBasisEntriesWhichArentStored) {
+    MemoryCredentialBackend backend;
+    Store(backend, HOLY_GRADLE_CREDENTIAL_PREFIX L"Team");
+    Store(backend, L"git:https://host/stored/");
+    Store(backend, L"git:https://host/listed-and-stored");
+    const CredentialSnapshot snapshot(backend);
+    const CredentialBases bases = BasesFrom(
+        "Team\n"
+        "\tgit:https://host/team\n"
+        "\tgit:https://host/stored\n"
+        "\tgit:https://host/listed-and-stored\n"
+        "\tgit:https://host/pattern/*\n"
+        "NotStored\n"
+        "\tgit:https://host/orphan\n"
+    );
+    const CredentialResolver resolver(snapshot, bases);
+
+    // An entry stands for its basis's credential until it's stored itself.
+    CHECK(Resolved(resolver, L"https://host/team/repo") == HOLY_GRADLE_CREDENTIAL_PREFIX L"Team");
+    CHECK(Resolved(resolver, L"https://host/listed-and-stored") == L"git:https://host/listed-and-stored");
+
+    // A stored credential beats a basis entry for the same URL.
+    CHECK(Resolved(resolver, L"https://host/stored") == L"git:https://host/stored/");
+
+    // Patterns don't name a URL, and a basis whose own credential isn't stored can't stand in for anything.
+    CHECK(Resolved(resolver, L"https://host/pattern/repo") == L"<none>");
+    CHECK(Resolved(resolver, L"https://host/orphan") == L"<none>");
+}
@@ -0,0 +1,165 @@
+#include "stdafx.h"
+
+#include "test-harness.h"
+#include "credential-backend.h"
+#include "credential-daemon.h"
+#include "credential-session.h"
+
+#include <windows.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#pragma hdrstop
+
+#define TEST_TARGET_NAME L"holygradle:daemon-test"
+#define TEST_USERNAME L"someone"
+#define TEST_TTL_MILLISECONDS 300
+
+using namespace std;
+
+namespace {
+    wstring GetTemporaryFileName(const wchar_t* name) {
+        wchar_t directory[MAX_PATH + 1];
+        const DWORD length = ::GetTempPathW(_countof(directory), directory);
+        return wstring(directory, length) + name;
+    }
+
+    // Writes the whole of a basis file, then sets its last write time, so that a test controls exactly when the
+    // daemon should see that it has changed.
+    bool WriteBasisFile(const wstring& file_name, const char* text, DWORD write_time) {
+        HANDLE file = ::CreateFileW(
+            file_name.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL
+        );
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        FILETIME file_time = { write_time, 0x01D00000 };
+        const bool ok = WriteAll(file, text, strlen(text)) && ::SetFileTime(file, NULL, NULL, &file_time);
+        ::CloseHandle(file);
+        return ok;
+    }
+
+    // A daemon serving a memory backend on a temporary socket, from another thread, for as long as it lives.
+    class TestDaemon {
+    public:
+        explicit TestDaemon(DWORD ttl_milliseconds)
+            : socket_path_(GetTemporaryFileName(L"credential-store-tests.sock"))
+            , basis_file_name_(GetTemporaryFileName(L"credential-store-tests-bases.txt"))
+            , session_(backend_, ttl_milliseconds, basis_file_name_)
+            , daemon_(session_)
+        {
+            ::DeleteFileW(basis_file_name_.c_str());
+            listening_ = daemon_.Listen(socket_path_);
+            if (listening_) {
+                server_ = thread(&SocketDaemon::Serve, &daemon_);
+            }
+        }
+
+        ~TestDaemon() {
+            daemon_.Stop();
+            if (server_.joinable()) {
+                server_.join();
+            }
+            ::DeleteFileW(basis_file_name_.c_str());
+        }
+
+        bool listening() const { return listening_; }
+        // The store behind the daemon, which a test can change without the daemon knowing.
+        CredentialBackend& backend() { return backend_; }
+        const wstring& basis_file_name() const { return basis_file_name_; }
+
+        // Sends a request as a client would, returning its payload, or "(failed)" if the request failed.
+        wstring Request(
+            const wchar_t* command,
+            const wchar_t* argument1 = NULL,
+            const wchar_t* argument2 = NULL,
+            const wchar_t* argument3 = NULL
+        ) {
+            vector<wstring> request(1, command);
+            const wchar_t* arguments[] = { argument1, argument2, argument3 };
+            for (size_t i = 0; i < _countof(arguments) && arguments[i] != NULL; ++i) {
+                request.push_back(arguments[i]);
+            }
+            SessionResponse response;
+            if (!SendSocketRequest(socket_path_, request, response) || !response.ok) {
+                return L"(failed)";
+            }
+            return wstring(response.payload.data(), response.payload.size());
+        }
+
+    private:
+        TestDaemon(const TestDaemon&);
+        TestDaemon& operator=(const TestDaemon&);
+
+        const wstring socket_path_;
+        const wstring basis_file_name_;
+        MemoryCredentialBackend backend_;
+        CredentialSession session_;
+        SocketDaemon daemon_;
+        bool listening_;
+        thread server_;
+    };
+}
+
+TEST_CASE(DaemonCacheExpiresAfterTtl) {
+    TestDaemon daemon(TEST_TTL_MILLISECONDS);
+    CHECK(daemon.listening());
+    CHECK(WriteCredential(daemon.backend(), TEST_TARGET_NAME, TEST_USERNAME, TextSpan(L"first")));
+    CHECK(daemon.Request(L"get", TEST_TARGET_NAME) == TEST_USERNAME L"&&&first");
+
+    // A change the daemon didn't make isn't seen until the cache expires.
+    CHECK(WriteCredential(daemon.backend(), TEST_TARGET_NAME, TEST_USERNAME, TextSpan(L"second")));
+    CHECK(daemon.Request(L"get", TEST_TARGET_NAME) == TEST_USERNAME L"&&&first");
+    ::Sleep(TEST_TTL_MILLISECONDS * 2);
+    CHECK(daemon.Request(L"get", TEST_TARGET_NAME) == TEST_USERNAME L"&&&second");
+}
+
+TEST_CASE(DaemonCacheIsDroppedAfterSet) {
+    TestDaemon daemon(INFINITE);
+    CHECK(daemon.listening());
+    CHECK(WriteCredential(daemon.backend(), TEST_TARGET_NAME, TEST_USERNAME, TextSpan(L"first")));
+    CHECK(daemon.Request(L"get", TEST_TARGET_NAME) == TEST_USERNAME L"&&&first");
+
+    CHECK(daemon.Request(L"set", TEST_TARGET_NAME, TEST_USERNAME, L"second") == L"Updated: " TEST_TARGET_NAME);
+    CHECK(daemon.Request(L"get", TEST_TARGET_NAME) == TEST_USERNAME L"&&&second");
+}
+
+TEST_CASE(DaemonCacheIsDroppedWhenBasisFileChanges) {
+    TestDaemon daemon(INFINITE);
+    CHECK(daemon.listening());
+    CHECK(WriteBasisFile(daemon.basis_file_name(), "basis\n\tfirst\n", 1));
+    CHECK(daemon.Request(L"list-basis", L"basis") == L"first");
+
+    // Only the write time is checked, so new content with the same time is still served from the cache ...
+    CHECK(WriteBasisFile(daemon.basis_file_name(), "basis\n\tsecond\n", 1));
+    CHECK(daemon.Request(L"list-basis", L"basis") == L"first");
+    // ... and the file is read again as soon as that changes.
+    CHECK(WriteBasisFile(daemon.basis_file_name(), "basis\n\tsecond\n", 2));
+    CHECK(daemon.Request(L"list-basis", L"basis") == L"second");
+}
+
+TEST_CASE(DaemonRefusesToReplaceARunningDaemon) {
+    TestDaemon daemon(INFINITE);
+    CHECK(daemon.listening());
+    MemoryCredentialBackend backend;
+    CredentialSession session(backend, INFINITE, daemon.basis_file_name());
+    SocketDaemon second(session);
+    CHECK(!second.Listen(GetTemporaryFileName(L"credential-store-tests.sock")));
+    CHECK(::WSAGetLastError() == WSAEADDRINUSE);
+    // The first daemon is still answering.
+    CHECK(daemon.Request(L"list-bases") == L"");
+}
+
+TEST_CASE(DaemonLeavesAFileWhichIsntASocket) {
+    const wstring path(GetTemporaryFileName(L"credential-store-tests-not-a-socket.sock"));
+    CHECK(WriteBasisFile(path, "not a socket\n", 1));
+    MemoryCredentialBackend backend;
+    CredentialSession session(backend, INFINITE, path);
+    SocketDaemon daemon(session);
+    CHECK(!daemon.Listen(path));
+    CHECK(::WSAGetLastError() == ERROR_ALREADY_EXISTS);
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    CHECK(::GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &attributes));
+    ::DeleteFileW(path.c_str());
+}
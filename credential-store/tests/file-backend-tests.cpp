@@ -0,0 +1,179 @@
+#include "stdafx.h"
+
+#include "test-harness.h"
+#include "credential-backend.h"
+#include "file-cipher.h"
+
+#include <windows.h>
+#include <memory>
+#include <string>
+#include <thread>
+
+#pragma hdrstop
+
+using namespace std;
+
+namespace {
+    /*
+        Stands in for DPAPI: it "encrypts" by prefixing a key, and will only open what was sealed with the same key,
+        as DPAPI will only open what the same user sealed.  It also keeps the last plain text it sealed, so a test
+        can check the file format itself.
+    */
+    class TestCipher : public FileCipher {
+    public:
+        TestCipher(const string& key, string* last_plain) : key_(key), last_plain_(last_plain) {}
+
+        virtual bool Seal(const string& plain, string& sealed) {
+            if (last_plain_ != NULL) {
+                *last_plain_ = plain;
+            }
+            sealed = key_ + plain;
+            return true;
+        }
+
+        virtual bool Open(const string& sealed, string& plain) {
+            if (sealed.compare(0, key_.size(), key_) != 0) {
+                ::SetLastError(ERROR_INVALID_DATA);
+                return false;
+            }
+            plain = sealed.substr(key_.size());
+            return true;
+        }
+
+    private:
+        string key_;
+        string* last_plain_;
+    };
+
+    unique_ptr<FileCipher> MakeCipher(const string& key, string* last_plain = NULL) {
+        return unique_ptr<FileCipher>(new TestCipher(key, last_plain));
+    }
+
+    // A credential file name in the temporary directory, deleted (with its lock file) when the test is done with it.
+    class TemporaryFile {
+    public:
+        explicit TemporaryFile(const wchar_t* name) {
+            wchar_t directory[MAX_PATH + 1];
+            const DWORD length = ::GetTempPathW(_countof(directory), directory);
+            name_ = wstring(directory, length) + name;
+            ::DeleteFileW(name_.c_str());
+        }
+
+        ~TemporaryFile() {
+            ::DeleteFileW(name_.c_str());
+            ::DeleteFileW((name_ + L".lock").c_str());
+        }
+
+        const wstring& name() const { return name_; }
+
+    private:
+        TemporaryFile(const TemporaryFile&);
+        TemporaryFile& operator=(const TemporaryFile&);
+
+        wstring name_;
+    };
+}
+
+TEST_CASE(FileBackendRoundTripsThroughAnyCipher) {
+    TemporaryFile file(L"credential-store-tests-round-trip.dat");
+    {
+        FileCredentialBackend backend(file.name(), MakeCipher("key"));
+        CHECK(backend.Open());
+        CHECK(WriteCredential(backend, L"git:https://example.com/r\u00E9po", L"someone", TextSpan(L"p\u00E4ss")));
+        CHECK(WriteCredential(backend, L"Intrepid - Domain Credentials", L"DOMAIN\\someone", TextSpan(L"")));
+    }
+
+    FileCredentialBackend reopened(file.name(), MakeCipher("key"));
+    CHECK(reopened.Open());
+    CredentialEnumeration enumeration;
+    CHECK(reopened.Enumerate(enumeration));
+    CHECK(enumeration.credentials.size() == 2);
+    CredentialPtr credential = reopened.Read(L"git:https://example.com/r\u00E9po");
+    CHECK(credential && CredentialHasValue(*credential, L"someone", TextSpan(L"p\u00E4ss")));
+    credential = reopened.Read(L"Intrepid - Domain Credentials");
+    CHECK(credential && CredentialHasValue(*credential, L"DOMAIN\\someone", TextSpan(L"")));
+}
+
+TEST_CASE(FileBackendRefusesAFileItCantOpen) {
+    TemporaryFile file(L"credential-store-tests-other-user.dat");
+    {
+        FileCredentialBackend backend(file.name(), MakeCipher("key"));
+        CHECK(backend.Open());
+        CHECK(WriteCredential(backend, L"holygradle:test", L"someone", TextSpan(L"secret")));
+    }
+
+    FileCredentialBackend other(file.name(), MakeCipher("other key"));
+    CHECK(!other.Open());
+    CredentialEnumeration enumeration;
+    CHECK(other.Enumerate(enumeration));
+    CHECK(enumeration.credentials.empty());
+}
+
+TEST_CASE(FileBackendWritesLittleEndianUtf16) {
+    TemporaryFile file(L"credential-store-tests-format.dat");
+    string plain;
+    FileCredentialBackend backend(file.name(), MakeCipher("key", &plain));
+    CHECK(WriteCredential(backend, L"\u00E9", L"", TextSpan(L"")));
+
+    // The magic number, version and count, then one credential's flags, type and persistence, all little-endian.
+    const char expected_head[] = "HGCS" "\x01\0\0\0" "\x01\0\0\0" "\0\0\0\0" "\x01\0\0\0" "\x03\0\0\0";
+    CHECK(plain.size() > sizeof(expected_head) - 1);
+    CHECK(plain.compare(0, sizeof(expected_head) - 1, string(expected_head, sizeof(expected_head) - 1)) == 0);
+    // After the time it was written, the target name: its size in bytes, then each UTF-16 code unit.
+    const size_t target_name_offset = sizeof(expected_head) - 1 + 8;
+    const char expected_target_name[] = "\x02\0\0\0" "\xE9\0";
+    CHECK(plain.compare(
+        target_name_offset,
+        sizeof(expected_target_name) - 1,
+        string(expected_target_name, sizeof(expected_target_name) - 1)
+    ) == 0);
+}
+
+TEST_CASE(FileBackendKeepsChangesFromAnotherInstance) {
+    TemporaryFile file(L"credential-store-tests-shared.dat");
+    FileCredentialBackend first(file.name(), MakeCipher("key"));
+    FileCredentialBackend second(file.name(), MakeCipher("key"));
+    CHECK(first.Open());
+    CHECK(second.Open());
+
+    // Each sees the file as the other left it, not as it was when it was opened.
+    CHECK(WriteCredential(first, L"holygradle:first", L"someone", TextSpan(L"one")));
+    CHECK(WriteCredential(second, L"holygradle:second", L"someone", TextSpan(L"two")));
+    CHECK(first.Delete(L"holygradle:second"));
+    CHECK(WriteCredential(second, L"holygradle:third", L"someone", TextSpan(L"three")));
+
+    FileCredentialBackend third(file.name(), MakeCipher("key"));
+    CHECK(third.Open());
+    CredentialEnumeration enumeration;
+    CHECK(third.Enumerate(enumeration));
+    CHECK(enumeration.credentials.size() == 2);
+    CredentialPtr credential = third.Read(L"holygradle:first");
+    CHECK(credential && CredentialHasValue(*credential, L"someone", TextSpan(L"one")));
+    CHECK(!third.Read(L"holygradle:second"));
+    credential = third.Read(L"holygradle:third");
+    CHECK(credential && CredentialHasValue(*credential, L"someone", TextSpan(L"three")));
+}
+
+TEST_CASE(FileBackendSerialisesConcurrentWriters) {
+    TemporaryFile file(L"credential-store-tests-concurrent.dat");
+    const int writes_each = 20;
+    bool ok[2] = { true, true };
+    auto write_some = [&](int writer) {
+        FileCredentialBackend backend(file.name(), MakeCipher("key"));
+        ok[writer] = backend.Open();
+        for (int index = 0; ok[writer] && index < writes_each; ++index) {
+            const wstring target_name = L"holygradle:" + to_wstring(writer) + L"-" + to_wstring(index);
+            ok[writer] = WriteCredential(backend, target_name, L"someone", TextSpan(L"secret"));
+        }
+    };
+    thread other(write_some, 1);
+    write_some(0);
+    other.join();
+    CHECK(ok[0] && ok[1]);
+
+    FileCredentialBackend reopened(file.name(), MakeCipher("key"));
+    CHECK(reopened.Open());
+    CredentialEnumeration enumeration;
+    CHECK(reopened.Enumerate(enumeration));
+    CHECK(enumeration.credentials.size() == 2 * writes_each);
+}
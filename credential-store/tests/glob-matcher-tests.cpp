@@ -0,0 +1,150 @@
+#include "stdafx.h"
+
+#include "test-harness.h"
+#include "glob-matcher.h"
+
+#include <string>
+#include <vector>
+
+#pragma hdrstop
+
+using namespace std;
+
+namespace {
+    // The obvious recursive matcher, slow but plainly right, to check the others against.
+    bool ReferenceMatch(const wchar_t* pattern, const wchar_t* text) {
+        if (*pattern == L'\0') {
+            return *text == L'\0';
+        }
+        if (*pattern == L'*') {
+            return ReferenceMatch(pattern + 1, text) || (*text != L'\0' && ReferenceMatch(pattern, text + 1));
+        }
+        return *text != L'\0' && (*pattern == L'?' || *pattern == *text) && ReferenceMatch(pattern + 1, text + 1);
+    }
+
+    // Every string of up to "max_length" characters from "alphabet", including the empty one.
+    vector<wstring> AllStrings(const wstring& alphabet, size_t max_length) {
+        vector<wstring> strings(1);
+        for (size_t begin = 0; begin < strings.size(); ++begin) {
+            if (strings[begin].size() == max_length) {
+                continue;
+            }
+            for (auto c = alphabet.begin(); c != alphabet.end(); ++c) {
+                strings.push_back(strings[begin] + *c);
+            }
+        }
+        return strings;
+    }
+}
+
+TEST_CASE(GlobMatchHandlesStarsAndQuestionMarks) {
+    CHECK(GlobMatch(L"a?c", L"abc"));
+    CHECK(!GlobMatch(L"a?c", L"ac"));
+    CHECK(!GlobMatch(L"a?c", L"abbc"));
+    CHECK(GlobMatch(L"a*c", L"ac"));
+    CHECK(GlobMatch(L"a*c", L"abbbc"));
+    CHECK(!GlobMatch(L"a*c", L"abcb"));
+    CHECK(GlobMatch(L"*", L""));
+    CHECK(!GlobMatch(L"?", L""));
+    CHECK(GlobMatch(L"", L""));
+    CHECK(!GlobMatch(L"", L"a"));
+    CHECK(GlobMatch(L"*a*b", L"xaxaxb"));
+    CHECK(!GlobMatch(L"*a*b", L"xbxa"));
+    CHECK(!GlobMatch(L"A*", L"abc"));
+    CHECK(GlobMatch(L"git:https://*/repo", L"git:https://host:8080/repo"));
+}
+
+TEST_CASE(GlobMatchAndGlobSetAgreeWithTheReference) {
+    const vector<wstring> patterns = AllStrings(L"ab*?", 4);
+    const vector<wstring> texts = AllStrings(L"ab", 5);
+    for (size_t p = 0; p < patterns.size(); ++p) {
+        GlobSet set;
+        set.Add(patterns[p], p);
+        for (auto text = texts.begin(); text != texts.end(); ++text) {
+            const bool expected = ReferenceMatch(patterns[p].c_str(), text->c_str());
+            CHECK_AT(GlobMatch(patterns[p], *text) == expected, p);
+            CHECK_AT(set.Match(*text) == (expected ? p : GLOB_NO_MATCH), p);
+        }
+    }
+}
+
+TEST_CASE(GlobSetReportsTheSmallestMatchingValue) {
+    GlobSet set;
+    CHECK(set.empty());
+    CHECK(set.Match(L"anything") == GLOB_NO_MATCH);
+
+    set.Add(L"git:https://host/*", 2);
+    set.Add(L"git:https://host/repo*", 1);
+    set.Add(L"*", 5);
+    set.Add(L"git:https://h?st/repo", 3);
+    CHECK(!set.empty());
+    CHECK(set.Match(L"git:https://host/repo/x") == 1);
+    CHECK(set.Match(L"git:https://host/other") == 2);
+    CHECK(set.Match(L"git:https://hast/repo") == 3);
+    CHECK(set.Match(L"hg:https://host/repo") == 5);
+    CHECK(set.Match(L"") == 5);
+
+    // The same pattern twice, and "**" for "*", keep the smaller value.
+    set.Add(L"git:https://h?st/repo", 0);
+    set.Add(L"hg:**", 4);
+    CHECK(set.Match(L"git:https://hast/repo") == 0);
+    CHECK(set.Match(L"hg:https://host/repo") == 4);
+    CHECK(set.Match(L"hg:") == 4);
+}
+
+TEST_CASE(GlobSetCachesStatesUntilAPatternIsAdded) {
+    GlobSet set;
+    set.Add(L"git:https://*/repo", 0);
+    CHECK(set.CachedStateCount() == 0);
+    CHECK(set.Match(L"git:https://host/repo") == 0);
+    const size_t states = set.CachedStateCount();
+    CHECK(states > 1);
+
+    // The same text again adds no states, and nor does another which passes through the same ones.
+    CHECK(set.Match(L"git:https://host/repo") == 0);
+    CHECK(set.Match(L"git:https://host/host/repo") == 0);
+    CHECK(set.CachedStateCount() == states);
+
+    // A mismatch stops at the first character no pattern can follow.
+    CHECK(set.Match(L"hg:https://host/repo") == GLOB_NO_MATCH);
+    CHECK(set.CachedStateCount() == states + 1);
+
+    // New patterns make a new DFA.
+    set.Add(L"hg:*", 1);
+    CHECK(set.CachedStateCount() == 0);
+    CHECK(set.Match(L"hg:https://host/repo") == 1);
+    CHECK(set.Match(L"git:https://host/repo") == 0);
+}
+
+TEST_CASE(GlobSetFallsBackToTheNfaWhenTheDfaIsFull) {
+    // "*a" then 13 "?"s needs a DFA state for every combination of where the last 14 "a"s were, far more than fit.
+    const wstring pattern = L"*a?????????????";
+    GlobSet set;
+    set.Add(pattern, 7);
+
+    unsigned int seed = 12345;
+    vector<wstring> texts;
+    for (size_t i = 0; i < 100; ++i) {
+        wstring text;
+        for (size_t length = 0; length < 200 + i; ++length) {
+            seed = seed * 1103515245 + 12345;
+            text += ((seed >> 16) & 1) ? L'a' : L'b';
+        }
+        texts.push_back(text);
+    }
+    for (size_t i = 0; i < texts.size(); ++i) {
+        CHECK_AT(set.Match(texts[i]) == (GlobMatch(pattern, texts[i]) ? 7 : GLOB_NO_MATCH), i);
+    }
+    CHECK(set.CachedStateCount() == MAX_DFA_STATES);
+
+    // Texts which the full DFA still covers, and texts which go beyond it, both match as before.
+    for (size_t i = 0; i < texts.size(); ++i) {
+        CHECK_AT(set.Match(texts[i]) == (GlobMatch(pattern, texts[i]) ? 7 : GLOB_NO_MATCH), i);
+        const wstring shorter = texts[i].substr(0, 20);
+        CHECK_AT(set.Match(shorter) == (GlobMatch(pattern, shorter) ? 7 : GLOB_NO_MATCH), i);
+    }
+    CHECK(set.Match(L"a") == GLOB_NO_MATCH);
+    CHECK(set.Match(L"bbba" + wstring(13, L'b')) == 7);
+    CHECK(set.Match(L"bbba" + wstring(14, L'b')) == GLOB_NO_MATCH);
+    CHECK(set.CachedStateCount() == MAX_DFA_STATES);
+}
@@ -0,0 +1,218 @@
+#include "stdafx.h"
+
+#include "test-harness.h"
+#include "ignore-case.h"
+
+#include <string>
+
+#pragma hdrstop
+
+/*
+    The comparisons work on blocks of sixteen and eight units where the processor allows, then finish unit by unit,
+    so each is checked at every length from empty to just past two blocks, with the difference (or the match) at
+    every position.
+*/
+
+#define MAX_TEST_LENGTH 33
+
+#define DOTLESS_I L'\x0131'  // Upper-cases to 'I'.
+#define LONG_S L'\x017F'     // Upper-cases to 'S'.
+
+using namespace std;
+
+namespace {
+    // Lower-case ASCII letters and digits, so that some units fold and some don't.
+    wstring LowerAscii(size_t length) {
+        static const wchar_t UNITS[] = L"abcdefghijklmnopqrstuvwxyz0123456789";
+        wstring text;
+        for (size_t i = 0; i < length; ++i) {
+            text += UNITS[i % (_countof(UNITS) - 1)];
+        }
+        return text;
+    }
+
+    wstring UpperAscii(size_t length) {
+        wstring text(LowerAscii(length));
+        for (auto it = text.begin(); it != text.end(); ++it) {
+            if (*it >= L'a' && *it <= L'z') {
+                *it = (wchar_t)(*it - 0x20);
+            }
+        }
+        return text;
+    }
+
+    // Each of the three UTF-8 forms takes its arguments as strings.
+    bool EqualsUtf8(const string& a, const string& b) {
+        return EqualsIgnoreCaseUtf8(a.data(), a.size(), b.data(), b.size());
+    }
+
+    bool StartsWithUtf8(const string& text, const string& prefix) {
+        return StartsWithIgnoreCaseUtf8(text.data(), text.size(), prefix.data(), prefix.size());
+    }
+
+    size_t FindUtf8(const string& text, const string& pattern) {
+        return FindIgnoreCaseUtf8(text.data(), text.size(), pattern.data(), pattern.size());
+    }
+}
+
+TEST_CASE(EqualsIgnoresAsciiCaseAtEveryLength) {
+    for (size_t length = 0; length <= MAX_TEST_LENGTH; ++length) {
+        CHECK_AT(EqualsIgnoreCase(LowerAscii(length), UpperAscii(length)), length);
+        CHECK_AT(!EqualsIgnoreCase(LowerAscii(length), LowerAscii(length + 1)), length);
+        CHECK_AT(!EqualsIgnoreCase(LowerAscii(length + 1), LowerAscii(length)), length);
+    }
+}
+
+TEST_CASE(EqualsFindsADifferenceAtEveryPosition) {
+    for (size_t length = 1; length <= MAX_TEST_LENGTH; ++length) {
+        for (size_t i = 0; i < length; ++i) {
+            wstring different(UpperAscii(length));
+            different[i] = L'_';
+            CHECK_AT(!EqualsIgnoreCase(LowerAscii(length), different), length * 100 + i);
+            // The letters either side of a letter's other case are still different letters.
+            different[i] = (wchar_t)(LowerAscii(length)[i] + 1);
+            CHECK_AT(!EqualsIgnoreCase(LowerAscii(length), different), length * 100 + i);
+        }
+    }
+}
+
+TEST_CASE(EqualsFoldsNonAsciiAmongAscii) {
+    for (size_t length = 1; length <= MAX_TEST_LENGTH; ++length) {
+        for (size_t i = 0; i < length; ++i) {
+            wstring lower(LowerAscii(length));
+            wstring upper(UpperAscii(length));
+            lower[i] = L'\x00E9';  // e acute
+            upper[i] = L'\x00C9';
+            CHECK_AT(EqualsIgnoreCase(lower, upper), length * 100 + i);
+            upper[i] = L'E';
+            CHECK_AT(!EqualsIgnoreCase(lower, upper), length * 100 + i);
+            lower[i] = L'\x0436';  // Cyrillic zhe
+            upper[i] = L'\x0416';
+            CHECK_AT(EqualsIgnoreCase(lower, upper), length * 100 + i);
+            upper[i] = L'\x0417';
+            CHECK_AT(!EqualsIgnoreCase(lower, upper), length * 100 + i);
+        }
+    }
+}
+
+TEST_CASE(EqualsMatchesNonAsciiUnitsWhichFoldToAscii) {
+    // A block of ASCII can differ from its match in the other string by a non-ASCII unit, not just in case.
+    for (size_t length = 1; length <= MAX_TEST_LENGTH; ++length) {
+        for (size_t i = 0; i < length; ++i) {
+            wstring ascii(LowerAscii(length));
+            wstring mixed(ascii);
+            ascii[i] = L'i';
+            mixed[i] = DOTLESS_I;
+            CHECK_AT(EqualsIgnoreCase(ascii, mixed), length * 100 + i);
+            CHECK_AT(EqualsIgnoreCase(mixed, ascii), length * 100 + i);
+            ascii[i] = L'S';
+            mixed[i] = LONG_S;
+            CHECK_AT(EqualsIgnoreCase(ascii, mixed), length * 100 + i);
+            ascii[i] = L'T';
+            CHECK_AT(!EqualsIgnoreCase(ascii, mixed), length * 100 + i);
+        }
+    }
+}
+
+TEST_CASE(StartsWithAtEveryLength) {
+    for (size_t length = 0; length <= MAX_TEST_LENGTH; ++length) {
+        const wstring text(LowerAscii(length));
+        for (size_t prefix_length = 0; prefix_length <= length; ++prefix_length) {
+            wstring prefix(UpperAscii(prefix_length));
+            CHECK_AT(StartsWithIgnoreCase(text, prefix), length * 100 + prefix_length);
+            if (prefix_length > 0) {
+                prefix[prefix_length - 1] = L'_';
+                CHECK_AT(!StartsWithIgnoreCase(text, prefix), length * 100 + prefix_length);
+                prefix[prefix_length - 1] = (text[prefix_length - 1] == L's') ? LONG_S : L'_';
+                CHECK_AT(
+                    StartsWithIgnoreCase(text, prefix) == (text[prefix_length - 1] == L's'),
+                    length * 100 + prefix_length
+                );
+            }
+        }
+        CHECK_AT(!StartsWithIgnoreCase(text, UpperAscii(length + 1)), length);
+    }
+}
+
+TEST_CASE(FindAtEveryPosition) {
+    const wstring pattern(L"xYz");
+    for (size_t length = 0; length <= MAX_TEST_LENGTH; ++length) {
+        const wstring filler(length, L'-');
+        CHECK_AT(FindIgnoreCase(filler, pattern) == IGNORE_CASE_NOT_FOUND, length);
+        CHECK_AT(FindIgnoreCase(filler, L"") == 0, length);
+        for (size_t i = 0; i + pattern.size() <= length; ++i) {
+            wstring text(filler);
+            text.replace(i, pattern.size(), L"XyZ");
+            CHECK_AT(FindIgnoreCase(text, pattern) == i, length * 100 + i);
+            // A non-ASCII unit just before the match must be passed over, not taken for the start of it.
+            if (i > 0) {
+                text[i - 1] = L'\x00E9';
+                CHECK_AT(FindIgnoreCase(text, pattern) == i, length * 100 + i);
+            }
+            // Only a partial match.
+            text[i + 2] = L'-';
+            CHECK_AT(FindIgnoreCase(text, pattern) == IGNORE_CASE_NOT_FOUND, length * 100 + i);
+        }
+    }
+}
+
+TEST_CASE(FindMatchesNonAsciiUnitsWhichFoldToAscii) {
+    for (size_t length = 2; length <= MAX_TEST_LENGTH; ++length) {
+        for (size_t i = 0; i + 2 <= length; ++i) {
+            // The first unit of the match is non-ASCII, but folds to the first unit of the pattern.
+            wstring text(length, L'-');
+            text[i] = LONG_S;
+            text[i + 1] = DOTLESS_I;
+            CHECK_AT(FindIgnoreCase(text, L"si") == i, length * 100 + i);
+            CHECK_AT(FindIgnoreCase(text, L"Si-") == ((i + 2 < length) ? i : IGNORE_CASE_NOT_FOUND), length * 100 + i);
+            // And the other way round.
+            CHECK_AT(FindIgnoreCase(L"-si-", text.substr(i, 2)) == 1, length * 100 + i);
+        }
+    }
+}
+
+TEST_CASE(FoldCaseAtEveryLength) {
+    for (size_t length = 0; length <= MAX_TEST_LENGTH; ++length) {
+        wstring text(LowerAscii(length));
+        FoldCase(&text[0], text.size());
+        CHECK_AT(text == UpperAscii(length), length);
+        for (size_t i = 0; i < length; ++i) {
+            wstring mixed(LowerAscii(length));
+            mixed[i] = L'\x00E9';
+            FoldCase(&mixed[0], mixed.size());
+            wstring expected(UpperAscii(length));
+            expected[i] = L'\x00C9';
+            CHECK_AT(mixed == expected, length * 100 + i);
+
+            mixed[i] = DOTLESS_I;
+            FoldCase(&mixed[0], mixed.size());
+            expected[i] = L'I';
+            CHECK_AT(mixed == expected, length * 100 + i);
+        }
+    }
+}
+
+TEST_CASE(Utf8ComparisonsAtEveryLength) {
+    for (size_t length = 0; length <= MAX_TEST_LENGTH; ++length) {
+        string lower;
+        string upper;
+        for (size_t i = 0; i < length; ++i) {
+            lower += (char)LowerAscii(length)[i];
+            upper += (char)UpperAscii(length)[i];
+        }
+        CHECK_AT(EqualsUtf8(lower, upper), length);
+        CHECK_AT(!EqualsUtf8(lower, upper + "a"), length);
+        CHECK_AT(StartsWithUtf8(lower + "tail", upper), length);
+        CHECK_AT(FindUtf8(lower + "X_Z", "x_z") == length, length);
+
+        // Non-ASCII after the ASCII: e acute, in two bytes, against its upper case, also in two.
+        CHECK_AT(EqualsUtf8(lower + "\xC3\xA9", upper + "\xC3\x89"), length);
+        CHECK_AT(!EqualsUtf8(lower + "\xC3\xA9", upper + "E"), length);
+        CHECK_AT(StartsWithUtf8(lower + "\xC3\xA9-", upper + "\xC3\x89"), length);
+        // The match is found after the non-ASCII, at a byte offset.
+        CHECK_AT(FindUtf8(lower + "\xC3\xA9x_z", "X_Z") == length + 2, length);
+        // Long s, in two bytes, matches "S" in one.
+        CHECK_AT(EqualsUtf8(lower + "\xC5\xBF", upper + "S"), length);
+        CHECK_AT(FindUtf8(lower + "\xC5\xBF" "i", "SI") == length, length);
+    }
+}
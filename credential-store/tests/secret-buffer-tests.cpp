@@ -0,0 +1,178 @@
+#include "stdafx.h"
+
+#include "test-harness.h"
+#include "credential-backend.h"
+#include "credential-output.h"
+#include "secret-buffer.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#pragma hdrstop
+
+#define TEST_PASSWORD L"correct horse battery staple"
+
+using namespace std;
+
+/*
+    The global allocator is replaced for the whole test program, so that a test can count the allocations made
+    between two points.  Nothing else is changed: blocks still come from malloc.
+*/
+namespace {
+    bool counting_allocations = false;
+    size_t allocation_count = 0;
+}
+
+void* operator new(size_t size) {
+    if (counting_allocations) {
+        ++allocation_count;
+    }
+    void* block = malloc((size == 0) ? 1 : size);
+    if (block == NULL) {
+        throw bad_alloc();
+    }
+    return block;
+}
+
+void operator delete(void* block) noexcept {
+    free(block);
+}
+
+namespace {
+    // Counts the allocations made during its lifetime.
+    class AllocationCounter {
+    public:
+        AllocationCounter() {
+            allocation_count = 0;
+            counting_allocations = true;
+        }
+
+        ~AllocationCounter() {
+            counting_allocations = false;
+        }
+
+        size_t count() const { return allocation_count; }
+
+    private:
+        AllocationCounter(const AllocationCounter&);
+        AllocationCounter& operator=(const AllocationCounter&);
+    };
+
+    /*
+        Holds one credential in fixed storage, standing in for the Windows Credential Manager, which copies the
+        password into its own memory on write and hands back its own buffer on read.  The credential it returns is
+        owned by the backend, so handing it out doesn't allocate a shared_ptr control block either.
+    */
+    class FixedCredentialBackend : public CredentialBackend {
+    public:
+        FixedCredentialBackend() {
+            memset(&credential_, 0, sizeof(credential_));
+        }
+
+        virtual CredentialPtr Read(const wstring& target_name) {
+            if (credential_.TargetName == NULL || target_name != credential_.TargetName) {
+                ::SetLastError(ERROR_NOT_FOUND);
+                return CredentialPtr();
+            }
+            return CredentialPtr(CredentialPtr(), &credential_);
+        }
+
+        virtual bool Write(const CREDENTIALW& credential) {
+            const size_t target_length = wcslen(credential.TargetName);
+            const size_t user_name_length = wcslen(credential.UserName);
+            if (target_length >= _countof(target_name_) || user_name_length >= _countof(user_name_) ||
+                !password_.Assign((const wchar_t*)credential.CredentialBlob, credential.CredentialBlobSize / 2)
+            ) {
+                return false;
+            }
+            wmemcpy(target_name_, credential.TargetName, target_length + 1);
+            wmemcpy(user_name_, credential.UserName, user_name_length + 1);
+            credential_ = credential;
+            credential_.TargetName = target_name_;
+            credential_.UserName = user_name_;
+            credential_.CredentialBlob = (LPBYTE)password_.data();
+            return true;
+        }
+
+        virtual bool Delete(const wstring&) {
+            return false;
+        }
+
+        virtual bool Enumerate(CredentialEnumeration&) {
+            return false;
+        }
+
+    private:
+        CREDENTIALW credential_;
+        wchar_t target_name_[256];
+        wchar_t user_name_[256];
+        SecretBuffer password_;
+    };
+}
+
+TEST_CASE(ReadSecretLineReadsLines) {
+    wistringstream in(L"first\r\n\nlast");
+    SecretBuffer secret;
+    CHECK(ReadSecretLine(in, secret) == SecretLine::Read);
+    CHECK(secret.span() == TextSpan(L"first"));
+    CHECK(ReadSecretLine(in, secret) == SecretLine::Read);
+    CHECK(secret.empty());
+    CHECK(ReadSecretLine(in, secret) == SecretLine::Read);
+    CHECK(secret.span() == TextSpan(L"last"));
+    CHECK(ReadSecretLine(in, secret) == SecretLine::End);
+    CHECK(secret.empty());
+}
+
+TEST_CASE(ReadSecretLineReportsOverflowApartFromEmpty) {
+    const wstring longest(SECRET_BUFFER_CAPACITY, L'x');
+    wistringstream in(longest + L"\n" + longest + L"y\nnext\n");
+    SecretBuffer secret;
+    CHECK(ReadSecretLine(in, secret) == SecretLine::Read);
+    CHECK(secret.size() == SECRET_BUFFER_CAPACITY);
+    CHECK(ReadSecretLine(in, secret) == SecretLine::TooLong);
+    CHECK(secret.empty());
+    // The rest of the long line was consumed, so the next read gets the next line.
+    CHECK(ReadSecretLine(in, secret) == SecretLine::Read);
+    CHECK(secret.span() == TextSpan(L"next"));
+}
+
+TEST_CASE(SecretPathDoesNotAllocate) {
+    // Everything which isn't the secret is set up first: the typed input, the names, the container which will hold
+    // the read credential, and the output buffer.
+    wistringstream typed(TEST_PASSWORD L"\r\n");
+    const wstring target_name(L"holygradle:test");
+    const wstring username(L"someone");
+    FixedCredentialBackend backend;
+    vector<CredentialPtr> credentials;
+    credentials.reserve(1);
+    OutputBuffer output;
+    output.Reserve(4096);
+
+    size_t allocations;
+    {
+        AllocationCounter counter;
+        // Prompt, write, read and output, as the for-basis command and the text "get" command (when its output
+        // isn't a console) do.
+        SecretBuffer password;
+        CHECK(ReadSecretLine(typed, password) == SecretLine::Read);
+        CHECK(WriteCredential(backend, target_name, username, password.span()));
+        password.Clear();
+        credentials.push_back(backend.Read(target_name));
+        if (credentials.back()) {
+            output.Reserve(MaxCredentialTextSize(*credentials.back()));
+            AppendCredentialText(*credentials.back(), CP_ACP, output);
+        }
+        allocations = counter.count();
+    }
+    CHECK(allocations == 0);
+
+    // Check that the path was really taken.
+    const char expected[] = "someone&&&correct horse battery staple";
+    CHECK(credentials.size() == 1 && credentials[0]);
+    CHECK(output.size() == sizeof(expected) - 1);
+    CHECK(memcmp(output.data(), expected, output.size()) == 0);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/*
+    A minimal unit-test harness.  Each TEST_CASE registers itself before main() runs, and CHECK records a failure
+    (with its file, line and expression) and carries on, so that one run reports every failing check.  The runner in
+    test-main.cpp runs every case, or only those whose names contain its argument, and exits with 1 if any failed.
+*/
+
+typedef void (*TestFunction)();
+
+struct TestCase {
+    const char* name;
+    TestFunction function;
+};
+
+std::vector<TestCase>& GetTestCases();
+
+class TestRegistration {
+public:
+    TestRegistration(const char* name, TestFunction function) {
+        TestCase test_case = { name, function };
+        GetTestCases().push_back(test_case);
+    }
+};
+
+// "index" is reported with the failure, for checks made in a loop; it is (size_t)-1 for a plain CHECK.
+void ReportCheckFailure(const char* file, int line, const char* expression, size_t index);
+
+#define TEST_CASE(name) \
+    static void name(); \
+    static TestRegistration name##_registration(#name, name); \
+    static void name()
+
+#define CHECK(expression) \
+    do { \
+        if (!(expression)) { \
+            ReportCheckFailure(__FILE__, __LINE__, #expression, (size_t)-1); \
+        } \
+    } while (0)
+
+#define CHECK_AT(expression, index) \
+    do { \
+        if (!(expression)) { \
+            ReportCheckFailure(__FILE__, __LINE__, #expression, (size_t)(index)); \
+        } \
+    } while (0)
@@ -0,0 +1,61 @@
+#include "stdafx.h"
+
+#include "test-harness.h"
+
+#include <tchar.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#pragma hdrstop
+
+using namespace std;
+
+namespace {
+    size_t failed_checks = 0;
+}
+
+vector<TestCase>& GetTestCases() {
+    static vector<TestCase> test_cases;
+    return test_cases;
+}
+
+void ReportCheckFailure(const char* file, int line, const char* expression, size_t index) {
+    ++failed_checks;
+    if (index == (size_t)-1) {
+        printf("  %s(%d): CHECK(%s) failed\n", file, line, expression);
+    } else {
+        printf("  %s(%d): CHECK(%s) failed at %lu\n", file, line, expression, (unsigned long)index);
+    }
+}
+
+int _tmain(int argc, wchar_t* argv[]) {
+    if (argc > 2) {
+        printf("Usage: credential-store-tests [<part of a test name>]\n");
+        return 1;
+    }
+    // Test names are ASCII, so the filter can be narrowed unit by unit.
+    string filter;
+    for (const wchar_t* c = (argc == 2) ? argv[1] : L""; *c != L'\0'; ++c) {
+        filter += (char)*c;
+    }
+
+    size_t run = 0;
+    size_t failed = 0;
+    vector<TestCase>& test_cases = GetTestCases();
+    for (auto it = test_cases.begin(); it != test_cases.end(); ++it) {
+        if (strstr(it->name, filter.c_str()) == NULL) {
+            continue;
+        }
+        printf("%s\n", it->name);
+        fflush(stdout);
+        const size_t failed_before = failed_checks;
+        it->function();
+        ++run;
+        if (failed_checks != failed_before) {
+            ++failed;
+        }
+    }
+    printf("%lu of %lu test(s) failed.\n", (unsigned long)failed, (unsigned long)run);
+    return (failed == 0 && run > 0) ? 0 : 1;
+}
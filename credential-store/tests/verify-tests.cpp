@@ -0,0 +1,110 @@
+#include "stdafx.h"
+
+#include "test-harness.h"
+#include "auth-stub-server.h"
+#include "credential-backend.h"
+#include "credential-snapshot.h"
+#include "credential-verify.h"
+
+#include <string>
+#include <vector>
+
+#pragma hdrstop
+
+#define STUB_USERNAME "alice"
+#define STUB_PASSWORD "correct horse battery staple"
+#define STUB_USERNAME_W L"alice"
+#define STUB_PASSWORD_W L"correct horse battery staple"
+
+using namespace std;
+
+namespace {
+    // The target name of a Git credential for "path" on the stub server.
+    wstring StubTargetName(const AuthStubServer& server, const wchar_t* path) {
+        return L"git:http://" STUB_USERNAME_W L"@127.0.0.1:" + to_wstring(server.port()) + path;
+    }
+
+    void WriteStubCredential(CredentialBackend& backend, const wstring& target_name, const wchar_t* password) {
+        CHECK(WriteCredential(backend, target_name, STUB_USERNAME_W, TextSpan(password)));
+    }
+}
+
+TEST_CASE(VerifyPassesRejectsAndTimesOut) {
+    AuthStubServer server(STUB_USERNAME, STUB_PASSWORD, 5000);
+    CHECK(server.Start());
+    MemoryCredentialBackend backend;
+    vector<wstring> target_names;
+    target_names.push_back(StubTargetName(server, L"/good"));
+    target_names.push_back(StubTargetName(server, L"/bad"));
+    target_names.push_back(StubTargetName(server, L"/slow/good"));
+    target_names.push_back(StubTargetName(server, L"/missing"));
+    WriteStubCredential(backend, target_names[0], STUB_PASSWORD_W);
+    WriteStubCredential(backend, target_names[1], L"wrong");
+    WriteStubCredential(backend, target_names[2], STUB_PASSWORD_W);
+    const CredentialSnapshot snapshot(backend);
+    VerifyOptions options = { 1, 1000 };
+
+    const vector<VerifyResult> results = VerifyCredentials(snapshot, target_names, options);
+    CHECK(results.size() == 4);
+    CHECK(results[0].status == VerifyStatus::Passed);
+    CHECK(results[0].http_status == 200);
+    CHECK(results[1].status == VerifyStatus::Rejected);
+    CHECK(results[1].http_status == 401);
+    // The slow request is given up on well before the server would answer it.
+    CHECK(results[2].status == VerifyStatus::Failed);
+    CHECK(results[2].http_status == 0);
+    CHECK(results[2].note == L"timed out");
+    CHECK(results[2].milliseconds < 5000);
+    CHECK(results[3].status == VerifyStatus::Skipped);
+    CHECK(results[3].note == L"not stored");
+    server.Stop();
+}
+
+TEST_CASE(VerifyCountsHostLevel404AsInconclusive) {
+    AuthStubServer server(STUB_USERNAME, STUB_PASSWORD, 0);
+    CHECK(server.Start());
+    MemoryCredentialBackend backend;
+    vector<wstring> target_names;
+    // Credentials for the whole host, right and wrong: the server says 404 to both, so neither is known to pass.
+    target_names.push_back(StubTargetName(server, L""));
+    target_names.push_back(L"git:http://127.0.0.1:" + to_wstring(server.port()));
+    WriteStubCredential(backend, target_names[0], STUB_PASSWORD_W);
+    WriteStubCredential(backend, target_names[1], L"wrong");
+    const CredentialSnapshot snapshot(backend);
+    VerifyOptions options = { 1, 5000 };
+
+    const vector<VerifyResult> results = VerifyCredentials(snapshot, target_names, options);
+    CHECK(results.size() == 2);
+    for (size_t i = 0; i < results.size(); ++i) {
+        CHECK_AT(results[i].status == VerifyStatus::Inconclusive, i);
+        CHECK_AT(results[i].http_status == 404, i);
+    }
+    server.Stop();
+}
+
+TEST_CASE(VerifyBoundsRequestsInFlightAndReusesConnections) {
+    // Each request takes long enough that the workers' requests overlap, whatever order they start in.
+    const size_t jobs = 3;
+    AuthStubServer server(STUB_USERNAME, STUB_PASSWORD, 300);
+    CHECK(server.Start());
+    MemoryCredentialBackend backend;
+    vector<wstring> target_names;
+    for (int i = 0; i < 9; ++i) {
+        target_names.push_back(StubTargetName(server, (L"/slow/repo" + to_wstring(i)).c_str()));
+        WriteStubCredential(backend, target_names.back(), STUB_PASSWORD_W);
+    }
+    const CredentialSnapshot snapshot(backend);
+    VerifyOptions options = { jobs, 5000 };
+
+    const vector<VerifyResult> results = VerifyCredentials(snapshot, target_names, options);
+    CHECK(results.size() == target_names.size());
+    for (size_t i = 0; i < results.size(); ++i) {
+        CHECK_AT(results[i].status == VerifyStatus::Passed, i);
+    }
+    server.Stop();
+    CHECK(server.request_count() == (long)target_names.size());
+    CHECK(server.max_active_requests() > 1);
+    CHECK(server.max_active_requests() <= (long)jobs);
+    // Each worker keeps its connection alive for its next request, so there are no more connections than workers.
+    CHECK(server.connection_count() <= (long)jobs);
+}
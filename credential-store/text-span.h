@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cwchar>
+#include <ostream>
+#include <string>
+
+// A view of a run of wide characters owned by something else, so that text can be scanned, compared and used as a
+// hash key without copying it.
+struct TextSpan {
+    const wchar_t* data;
+    size_t size;
+
+    TextSpan() : data(NULL), size(0) {}
+    TextSpan(const wchar_t* d, size_t s) : data(d), size(s) {}
+    TextSpan(const wchar_t* s) : data(s), size(s == NULL ? 0 : wcslen(s)) {}
+    TextSpan(const std::wstring& s) : data(s.data()), size(s.size()) {}
+
+    bool empty() const { return size == 0; }
+    const wchar_t* begin() const { return data; }
+    const wchar_t* end() const { return data + size; }
+    std::wstring str() const { return std::wstring(data, size); }
+
+    bool operator==(const TextSpan& other) const {
+        return size == other.size && (size == 0 || wmemcmp(data, other.data, size) == 0);
+    }
+    bool operator!=(const TextSpan& other) const { return !(*this == other); }
+    bool operator<(const TextSpan& other) const {
+        size_t common = (size < other.size) ? size : other.size;
+        int compared = (common == 0) ? 0 : wmemcmp(data, other.data, common);
+        return (compared != 0) ? (compared < 0) : (size < other.size);
+    }
+};
+
+// FNV-1a, over the characters of the span.
+struct TextSpanHash {
+    size_t operator()(const TextSpan& span) const {
+        size_t hash = (sizeof(size_t) == 8) ? (size_t)14695981039346656037ULL : (size_t)2166136261U;
+        const size_t prime = (sizeof(size_t) == 8) ? (size_t)1099511628211ULL : (size_t)16777619U;
+        for (const wchar_t* c = span.data; c != span.data + span.size; ++c) {
+            hash = (hash ^ (size_t)*c) * prime;
+        }
+        return hash;
+    }
+};
+
+inline std::wostream& operator<<(std::wostream& out, const TextSpan& span) {
+    return out.write(span.data, span.size);
+}
@@ -0,0 +1,138 @@
+#include "stdafx.h"
+
+#include "trace.h"
+#include "credential-output.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#pragma hdrstop
+
+// The FILETIME of 1970-01-01, in 100ns units.
+#define UNIX_EPOCH_FILETIME 116444736000000000ULL
+
+using namespace std;
+
+atomic<bool> tracing_enabled(false);
+
+namespace {
+    struct TraceEvent {
+        const char* name;
+        wstring detail;
+        LONGLONG start;
+        LONGLONG end;
+        DWORD thread_id;
+    };
+
+    struct TraceState {
+        mutex events_mutex;
+        vector<TraceEvent> events;
+        wstring file_name;
+        LONGLONG ticks_per_second;
+        // The clock reading when tracing started, and the wall-clock time then, in microseconds since 1970, so
+        // that the spans can be lined up with traces from other processes.
+        LONGLONG origin_ticks;
+        double origin_microseconds;
+    };
+
+    TraceState& GetTraceState() {
+        static TraceState state;
+        return state;
+    }
+
+    double ToMicroseconds(const TraceState& state, LONGLONG ticks) {
+        return state.origin_microseconds + (double)(ticks - state.origin_ticks) * 1000000.0 / state.ticks_per_second;
+    }
+
+    void WriteTrace() {
+        TraceState& state = GetTraceState();
+        lock_guard<mutex> lock(state.events_mutex);
+        tracing_enabled.store(false, memory_order_relaxed);
+
+        char number[64];
+        DWORD process_id = ::GetCurrentProcessId();
+        OutputBuffer output;
+        output.AppendAscii("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        sprintf_s(number, sizeof(number), "%lu", (unsigned long)process_id);
+        output.AppendAscii("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":");
+        output.AppendAscii(number);
+        output.AppendAscii(",\"args\":{\"name\":\"credential-store\"}}");
+        for (auto it = state.events.begin(); it != state.events.end(); ++it) {
+            // Span names are fixed identifiers, so they never need escaping.
+            output.AppendAscii(",\n{\"name\":\"");
+            output.AppendAscii(it->name);
+            output.AppendAscii("\"");
+            sprintf_s(
+                number, sizeof(number), ",\"cat\":\"credential-store\",\"ph\":\"X\",\"ts\":%.3f",
+                ToMicroseconds(state, it->start)
+            );
+            output.AppendAscii(number);
+            sprintf_s(
+                number, sizeof(number), ",\"dur\":%.3f",
+                (double)(it->end - it->start) * 1000000.0 / state.ticks_per_second
+            );
+            output.AppendAscii(number);
+            sprintf_s(
+                number, sizeof(number), ",\"pid\":%lu,\"tid\":%lu",
+                (unsigned long)process_id, (unsigned long)it->thread_id
+            );
+            output.AppendAscii(number);
+            if (!it->detail.empty()) {
+                output.AppendAscii(",\"args\":{\"detail\":");
+                output.AppendJsonString(it->detail.data(), it->detail.size());
+                output.AppendAscii("}");
+            }
+            output.AppendAscii("}");
+        }
+        output.AppendAscii("\n]}\n");
+
+        HANDLE file = ::CreateFileW(
+            state.file_name.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL
+        );
+        if (file == INVALID_HANDLE_VALUE || !output.WriteTo(file)) {
+            wcerr << L"ERROR: Failed to write trace file " << state.file_name << L" - errno " << ::GetLastError()
+                << endl;
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            ::CloseHandle(file);
+        }
+    }
+}
+
+void StartTracing(const wstring& file_name) {
+    TraceState& state = GetTraceState();
+    state.file_name = file_name;
+
+    LARGE_INTEGER value;
+    ::QueryPerformanceFrequency(&value);
+    state.ticks_per_second = value.QuadPart;
+    FILETIME now;
+    ::GetSystemTimeAsFileTime(&now);
+    state.origin_ticks = GetTraceClock();
+    ULONGLONG filetime = ((ULONGLONG)now.dwHighDateTime << 32) | now.dwLowDateTime;
+    state.origin_microseconds = (double)(filetime - UNIX_EPOCH_FILETIME) / 10.0;
+
+    // Most commands finish by calling exit(), so write the trace from an exit handler.  The state was constructed
+    // before this is registered, so it is still alive when the handler runs.
+    atexit(WriteTrace);
+    tracing_enabled.store(true, memory_order_relaxed);
+}
+
+LONGLONG GetTraceClock() {
+    LARGE_INTEGER value;
+    ::QueryPerformanceCounter(&value);
+    return value.QuadPart;
+}
+
+void RecordTraceSpan(const char* name, const wchar_t* detail, LONGLONG start, LONGLONG end) {
+    TraceState& state = GetTraceState();
+    TraceEvent event = { name, (detail == NULL) ? wstring() : wstring(detail), start, end, ::GetCurrentThreadId() };
+    lock_guard<mutex> lock(state.events_mutex);
+    // Read under the lock, so no span is added after the trace has been written.
+    if (tracing_enabled.load(memory_order_relaxed)) {
+        state.events.push_back(event);
+    }
+}
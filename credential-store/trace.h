@@ -0,0 +1,49 @@
+#pragma once
+
+#include <windows.h>
+#include <atomic>
+#include <string>
+
+#define TRACE_OPTION L"--trace="
+
+// Whether spans are being recorded.  Set at startup when --trace is given, and cleared when the trace is written at
+// exit, which can happen while worker threads are still finishing spans; they only need to see it eventually.
+extern std::atomic<bool> tracing_enabled;
+
+// Starts recording spans, to be written to the given file as Chrome trace-event JSON when the process exits.
+void StartTracing(const std::wstring& file_name);
+
+LONGLONG GetTraceClock();
+void RecordTraceSpan(const char* name, const wchar_t* detail, LONGLONG start, LONGLONG end);
+
+/*
+    Records the time from its construction to its destruction as a span named "name", if tracing is enabled;
+    otherwise it costs one test of a flag.  "detail" (for example, a target name) is optional, and must last as
+    long as the span.
+*/
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name, const wchar_t* detail = NULL)
+        : name_(name)
+        , detail_(detail)
+        , start_(tracing_enabled.load(std::memory_order_relaxed) ? GetTraceClock() : 0)
+    {
+    }
+
+    ~TraceSpan() {
+        if (start_ != 0) {
+            // Spans often end just before the caller checks GetLastError(), so don't disturb it.
+            DWORD error = ::GetLastError();
+            RecordTraceSpan(name_, detail_, start_, GetTraceClock());
+            ::SetLastError(error);
+        }
+    }
+
+private:
+    TraceSpan(const TraceSpan&);
+    TraceSpan& operator=(const TraceSpan&);
+
+    const char* name_;
+    const wchar_t* detail_;
+    LONGLONG start_;
+};
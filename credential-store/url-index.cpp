@@ -0,0 +1,133 @@
+#include "stdafx.h"
+
+#include "url-index.h"
+#include "ignore-case.h"
+
+#include <algorithm>
+
+#pragma hdrstop
+
+#define NO_NODE ((uint32_t)-1)
+
+using namespace std;
+
+UrlIndex::UrlIndex() {
+    // The root has an empty label; every other node hangs below it.
+    nodes_.push_back(Node());
+}
+
+uint32_t UrlIndex::ChildStartingWith(const Node& node, wchar_t c) const {
+    // Nodes rarely have more than a few dozen children, so a scan is quicker than a map.
+    for (auto it = node.children.begin(); it != node.children.end(); ++it) {
+        if (nodes_[*it].label[0] == c) {
+            return *it;
+        }
+    }
+    return NO_NODE;
+}
+
+void UrlIndex::Add(const wstring& url, size_t value) {
+    uint32_t node = 0;
+    size_t pos = 0;
+    while (pos < url.size()) {
+        uint32_t child = ChildStartingWith(nodes_[node], url[pos]);
+        if (child == NO_NODE) {
+            Node leaf;
+            leaf.label = url.substr(pos);
+            const uint32_t leaf_index = (uint32_t)nodes_.size();
+            nodes_.push_back(leaf);
+            nodes_[node].children.push_back(leaf_index);
+            node = leaf_index;
+            break;
+        }
+
+        const wstring& label = nodes_[child].label;
+        size_t common = 1;
+        while (common < label.size() && pos + common < url.size() && label[common] == url[pos + common]) {
+            ++common;
+        }
+        if (common < label.size()) {
+            // The URL leaves the edge part way along, so split it: a new node takes the shared part of the label
+            // and the old child keeps the rest.
+            Node middle;
+            middle.label = label.substr(0, common);
+            middle.children.push_back(child);
+            nodes_[child].label.erase(0, common);
+            const uint32_t middle_index = (uint32_t)nodes_.size();
+            nodes_.push_back(middle);
+            vector<uint32_t>& siblings = nodes_[node].children;
+            *find(siblings.begin(), siblings.end(), child) = middle_index;
+            child = middle_index;
+        }
+        node = child;
+        pos += common;
+    }
+    nodes_[node].values.push_back(value);
+}
+
+void UrlIndex::FindPrefixes(const wstring& url, vector<const vector<size_t>*>& matches) const {
+    uint32_t node = 0;
+    size_t pos = 0;
+    for (;;) {
+        const Node& current = nodes_[node];
+        if (!current.values.empty() && (pos == url.size() || url[pos] == L'/')) {
+            matches.push_back(&current.values);
+        }
+        if (pos == url.size()) {
+            return;
+        }
+        const uint32_t child = ChildStartingWith(current, url[pos]);
+        if (child == NO_NODE) {
+            return;
+        }
+        const wstring& label = nodes_[child].label;
+        if (url.compare(pos, label.size(), label) != 0) {
+            return;
+        }
+        pos += label.size();
+        node = child;
+    }
+}
+
+bool NormaliseUrl(const TextSpan& url, wstring& normalised, wstring& username) {
+    const wchar_t* const begin = url.begin();
+    const wchar_t* end = url.end();
+    for (const wchar_t* c = begin; c < end; ++c) {
+        if (*c == L'?' || *c == L'#') {
+            end = c;
+            break;
+        }
+    }
+
+    static const wchar_t SCHEME_SEPARATOR[] = L"://";
+    const wchar_t* scheme_end = search(begin, end, SCHEME_SEPARATOR, SCHEME_SEPARATOR + 3);
+    if (scheme_end == begin || scheme_end == end) {
+        return false;
+    }
+    const wchar_t* const authority = scheme_end + 3;
+    const wchar_t* const authority_end = find(authority, end, L'/');
+
+    // A password may contain '@', but a host can't, so the user info ends at the last one.
+    const wchar_t* host = authority;
+    for (const wchar_t* c = authority; c < authority_end; ++c) {
+        if (*c == L'@') {
+            host = c + 1;
+        }
+    }
+    username.clear();
+    if (host != authority) {
+        username.assign(authority, find(authority, host - 1, L':'));
+    }
+    if (host == authority_end) {
+        return false;
+    }
+
+    normalised.assign(begin, authority);
+    normalised.append(host, authority_end);
+    FoldCase(&normalised[0], normalised.size());
+    normalised.append(authority_end, end);
+    while (normalised.back() == L'/') {
+        normalised.pop_back();
+    }
+    return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "text-span.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+    A radix tree (a trie with runs of single-child nodes merged into one edge label) from normalised URLs to values,
+    for finding every stored URL which is a prefix of a given one, at a path boundary.  Looking up a URL walks it
+    once, so it costs the same however many URLs are stored.
+
+    URLs are normalised by NormaliseUrl before they're added or looked up.
+*/
+class UrlIndex {
+public:
+    UrlIndex();
+
+    // Adds a value under a normalised URL.  A URL may have any number of values.
+    void Add(const std::wstring& url, size_t value);
+
+    /*
+        Finds every stored URL which is the whole of "url" or a prefix of it ending just before a '/', and appends
+        the values of each to "matches", least specific (shortest) first.  "url" must be normalised.
+    */
+    void FindPrefixes(const std::wstring& url, std::vector<const std::vector<size_t>*>& matches) const;
+
+private:
+    struct Node {
+        std::wstring label;          // The characters on the edge into this node.
+        std::vector<uint32_t> children;
+        std::vector<size_t> values;  // Values of URLs which end at this node.
+    };
+
+    uint32_t ChildStartingWith(const Node& node, wchar_t c) const;
+
+    std::vector<Node> nodes_;
+};
+
+/*
+    Normalises a URL for the index: drops any user info (returning the part before any ':' in "username", as written),
+    any query or fragment, and any trailing '/', and upper-cases the scheme and host, which are case-insensitive.
+    Returns false if the text doesn't look like "<scheme>://<host>...".
+*/
+bool NormaliseUrl(const TextSpan& url, std::wstring& normalised, std::wstring& username);
@@ -2,19 +2,28 @@ package holygradle.scm
 
 import holygradle.custom_gradle.plugin_apis.CredentialSource
 import holygradle.custom_gradle.plugin_apis.Credentials
+import holygradle.custom_gradle.util.RetryHelper
 import holygradle.io.FileHelper
 import holygradle.util.addingDefault
 import org.gradle.api.Action
 import org.gradle.api.Project
 import org.gradle.process.ExecSpec
 import java.io.File
+import java.io.RandomAccessFile
 import java.net.URL
+import java.nio.channels.FileLock
+import java.nio.file.Files
+import java.nio.file.StandardCopyOption
 import java.util.function.Predicate
 
 // TODO 2017-03-28 HughG: Refactor credential methods out to a separate class.
 
 internal object ScmHelper {
     private const val CREDENTIAL_BASIS_FILE_PATH = "holygradle/credential-bases.txt"
+    // These match credential-store.exe's add-to-basis and remove-from-basis, which edit the same file.
+    private const val CREDENTIAL_BASIS_FILE_LOCK_TIMEOUT_MILLIS = 30000L
+    private const val CREDENTIAL_BASIS_FILE_RETRY_MILLIS = 50L
+    private const val CREDENTIAL_BASIS_FILE_REPLACE_ATTEMPTS = 40
     private val HTTP_URL_SCHEMES = listOf("http", "https")
 
     fun getGitConfigValue(gitCommand: Command, workingDir: File, configKey: String): String {
@@ -36,9 +45,11 @@ internal object ScmHelper {
 
         var lineIndex = 0
         var currentBasis: String? = null
-        basisFile.forEachLine { line ->
+        basisFile.forEachLine { fileLine ->
             val basis = currentBasis
             ++lineIndex
+            // credential-store.exe keeps a UTF-8 byte order mark if the file has one, and forEachLine doesn't skip it.
+            val line = if (lineIndex == 1) fileLine.removePrefix("\uFEFF") else fileLine
             val trimmedLine = line.trim()
             if (trimmedLine.isEmpty() || line[0] == '#') {
                 // Ignore blank and comment lines.
@@ -61,10 +72,12 @@ internal object ScmHelper {
         return bases
     }
 
+    // Writes via a temporary file and a rename, so that readers (which don't lock) see the whole old file or the whole
+    // new one.  The caller must hold the basis file lock, because credential-store.exe uses the same temporary file.
     private fun writeCredentialBasisFile(project: Project, credentialsByBasis: Map<String, Set<String>>) {
         val basisFile = File(project.gradle.gradleUserHomeDir, CREDENTIAL_BASIS_FILE_PATH)
-        FileHelper.ensureMkdirs(basisFile.parentFile, "create folder for ${basisFile.name}")
-        basisFile.printWriter().use { pw ->
+        val tempFile = File(basisFile.path + ".tmp")
+        tempFile.printWriter().use { pw ->
             pw.println("# This is a machine-generated Holy Gradle Credential Basis file.")
             pw.println("#")
             pw.println("# It contains a mapping from credential basis names to credential names.")
@@ -86,26 +99,77 @@ internal object ScmHelper {
                 }
             }
         }
+        // The rename fails while a reader has the file open without sharing delete access, so retry for a while.
+        RetryHelper.retry(
+                CREDENTIAL_BASIS_FILE_REPLACE_ATTEMPTS,
+                CREDENTIAL_BASIS_FILE_RETRY_MILLIS,
+                project.logger,
+                "replace ${basisFile.absolutePath}"
+        ) {
+            Files.move(
+                    tempFile.toPath(),
+                    basisFile.toPath(),
+                    StandardCopyOption.REPLACE_EXISTING,
+                    StandardCopyOption.ATOMIC_MOVE
+            )
+        }
+    }
+
+    /**
+     * Runs [action] holding an exclusive lock on "<basis file>.lock", the same lock credential-store.exe takes to
+     * edit the basis file, so that neither overwrites the other's changes.  The lock is on a separate file because
+     * each edit replaces the basis file itself.  Windows drops the lock if the process dies.
+     *
+     * File locks are held by the whole JVM, so threads in this one are kept apart by synchronizing as well.
+     */
+    @Synchronized
+    private fun <T> withCredentialBasisFileLock(project: Project, action: () -> T): T {
+        val basisFile = File(project.gradle.gradleUserHomeDir, CREDENTIAL_BASIS_FILE_PATH)
+        FileHelper.ensureMkdirs(basisFile.parentFile, "create folder for ${basisFile.name}")
+        RandomAccessFile(basisFile.path + ".lock", "rw").use { lockFile ->
+            val lock = lockCredentialBasisFile(lockFile, basisFile)
+            try {
+                return action()
+            } finally {
+                lock.release()
+            }
+        }
+    }
+
+    private fun lockCredentialBasisFile(lockFile: RandomAccessFile, basisFile: File): FileLock {
+        val deadline = System.currentTimeMillis() + CREDENTIAL_BASIS_FILE_LOCK_TIMEOUT_MILLIS
+        while (true) {
+            // Lock the same single byte as credential-store.exe does.
+            val lock = lockFile.channel.tryLock(0, 1, false)
+            if (lock != null) {
+                return lock
+            }
+            if (System.currentTimeMillis() >= deadline) {
+                throw RuntimeException("Timed out waiting to lock ${basisFile.absolutePath}")
+            }
+            Thread.sleep(CREDENTIAL_BASIS_FILE_RETRY_MILLIS)
+        }
     }
 
     // Update credential basis file if necessary.
     private fun updateCredentialBasisFile(project: Project, credentialName: String, credentialBasis: String) {
-        // Read contents of basis file.
-        val credentialsByBasis = readCredentialBasisFile(project)
+        withCredentialBasisFileLock(project) {
+            // Read contents of basis file.
+            val credentialsByBasis = readCredentialBasisFile(project)
 
-        // Ensure the credential name is associated with one and only one basis.
-        var changed = credentialsByBasis[credentialBasis]!!.add(credentialName)
-        credentialsByBasis.forEach { basis, credentials ->
-            if (basis != credentialName) {
-                changed = changed or credentials.remove(credentialName)
+            // Ensure the credential name is associated with one and only one basis.
+            var changed = credentialsByBasis[credentialBasis]!!.add(credentialName)
+            credentialsByBasis.forEach { basis, credentials ->
+                if (basis != credentialBasis) {
+                    changed = changed or credentials.remove(credentialName)
+                }
             }
-        }
 
-        // Write file, if the mapping is effectively changed.
-        if (changed) {
-            writeCredentialBasisFile(project, credentialsByBasis)
+            // Write file, if the mapping is effectively changed.
+            if (changed) {
+                writeCredentialBasisFile(project, credentialsByBasis)
+            }
         }
-
     }
 
     fun storeCredential(